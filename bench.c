@@ -0,0 +1,790 @@
+/*
+ * LICENSE available at the bottom
+ */
+
+// BENCHMARK EVERY KERNEL OVER DATASETS OF DIFFERENT SHAPES
+//
+// Usage: itj_csv_bench [--size MB] [--runs N] [--warmup N] [--format text|csv|json] [--dataset name] [--kernel name] [--perf] [--huge-pages]
+//
+// --perf reads the hardware counters around every parse with perf_event_open, on Linux only.
+// Without permission for it, see /proc/sys/kernel/perf_event_paranoid, the counters are left out.
+// --huge-pages parses from a buffer from itj_csv_buffer_alloc instead of calloc.
+//
+// The datasets are generated in memory, so the numbers are for the kernels alone and not the disk.
+// Every run parses a fresh copy, as contracting doubled quotes writes to the buffer.
+// count_records and count_records_parallel, one thread per cpu, only count the records.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <immintrin.h>
+
+#ifdef IS_WINDOWS
+#include <windows.h>
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#define ITJ_CSV_IMPLEMENTATION_AVX2
+#include "itj_csv.h"
+
+#define KB(x) (x * 1024)
+#define MB(x) (KB(x) * 1024)
+#define MAX_RUNS 100
+
+#ifdef IS_WINDOWS
+double g_freq;
+
+double get_time_ms() {
+    LARGE_INTEGER li;
+    QueryPerformanceCounter(&li);
+    return ((double)li.QuadPart)/g_freq;
+}
+#else
+double get_time_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0;
+}
+#endif
+
+enum format {
+    FORMAT_TEXT,
+    FORMAT_CSV,
+    FORMAT_JSON,
+};
+
+struct dataset {
+    const char *name;
+    itj_csv_bool is_crlf;
+    itj_csv_bool has_quotes;
+    char *data;
+    itj_csv_umax len;
+};
+
+struct kernel {
+    const char *name;
+    itj_csv_kernel_fn fn;
+    itj_csv_u32 flags; // What the kernel assumes about the data, see ITJ_CSV_KERNEL_*
+};
+
+struct kernel g_kernels[] = {
+    { "standard", itj_csv_get_next_value, ITJ_CSV_KERNEL_DEFAULT },
+    { "avx", itj_csv_get_next_value_avx, ITJ_CSV_KERNEL_DEFAULT },
+    { "avx2", itj_csv_get_next_value_avx2, ITJ_CSV_KERNEL_DEFAULT },
+    { "standard_comma", itj_csv_get_next_value_comma, ITJ_CSV_KERNEL_DEFAULT },
+    { "avx_comma", itj_csv_get_next_value_avx_comma, ITJ_CSV_KERNEL_DEFAULT },
+    { "avx2_comma", itj_csv_get_next_value_avx2_comma, ITJ_CSV_KERNEL_DEFAULT },
+    { "standard_comma_lf", itj_csv_get_next_value_comma_lf, ITJ_CSV_KERNEL_LF_ONLY },
+    { "avx_comma_lf", itj_csv_get_next_value_avx_comma_lf, ITJ_CSV_KERNEL_LF_ONLY },
+    { "avx2_comma_lf", itj_csv_get_next_value_avx2_comma_lf, ITJ_CSV_KERNEL_LF_ONLY },
+    { "standard_comma_lf_no_quotes", itj_csv_get_next_value_comma_lf_no_quotes, ITJ_CSV_KERNEL_LF_ONLY | ITJ_CSV_KERNEL_NO_QUOTES },
+    { "avx_comma_lf_no_quotes", itj_csv_get_next_value_avx_comma_lf_no_quotes, ITJ_CSV_KERNEL_LF_ONLY | ITJ_CSV_KERNEL_NO_QUOTES },
+    { "avx2_comma_lf_no_quotes", itj_csv_get_next_value_avx2_comma_lf_no_quotes, ITJ_CSV_KERNEL_LF_ONLY | ITJ_CSV_KERNEL_NO_QUOTES },
+    { "standard_comma_strict", itj_csv_get_next_value_comma_strict, ITJ_CSV_KERNEL_STRICT },
+    { "avx_comma_strict", itj_csv_get_next_value_avx_comma_strict, ITJ_CSV_KERNEL_STRICT },
+    { "avx2_comma_strict", itj_csv_get_next_value_avx2_comma_strict, ITJ_CSV_KERNEL_STRICT },
+};
+#define NUM_KERNELS (sizeof(g_kernels) / sizeof(g_kernels[0]))
+
+enum perf_counter {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    NUM_PERF_COUNTERS,
+};
+
+const char *g_perf_counter_names[NUM_PERF_COUNTERS] = { "cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses" };
+
+struct perf {
+    itj_csv_bool enabled;
+    int fds[NUM_PERF_COUNTERS];
+};
+
+struct perf g_perf;
+
+struct result {
+    itj_csv_umax num_values;
+    itj_csv_umax num_rows;
+    double seconds[MAX_RUNS];
+    double cycles[MAX_RUNS];
+    double counters[MAX_RUNS][NUM_PERF_COUNTERS]; // -1 when the counter is not available
+};
+
+#ifdef __linux__
+int perf_open(itj_csv_u32 type, itj_csv_u64 config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+void perf_init(struct perf *perf) {
+    perf->enabled = ITJ_CSV_FALSE;
+    for (itj_csv_u32 i = 0; i < NUM_PERF_COUNTERS; ++i) {
+        perf->fds[i] = -1;
+    }
+
+#ifdef __linux__
+    perf->fds[PERF_CYCLES] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    perf->fds[PERF_INSTRUCTIONS] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    perf->fds[PERF_BRANCH_MISSES] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    perf->fds[PERF_L1D_MISSES] = perf_open(PERF_TYPE_HW_CACHE,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    perf->fds[PERF_LLC_MISSES] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+
+    for (itj_csv_u32 i = 0; i < NUM_PERF_COUNTERS; ++i) {
+        if (perf->fds[i] >= 0) {
+            perf->enabled = ITJ_CSV_TRUE;
+        } else {
+            fprintf(stderr, "Unable to open the %s counter, it is left out\n", g_perf_counter_names[i]);
+        }
+    }
+#else
+    fprintf(stderr, "Hardware counters are only read on Linux\n");
+#endif
+}
+
+void perf_begin(struct perf *perf) {
+#ifdef __linux__
+    for (itj_csv_u32 i = 0; i < NUM_PERF_COUNTERS; ++i) {
+        if (perf->fds[i] >= 0) {
+            ioctl(perf->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(perf->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+void perf_end(struct perf *perf, double *counters_out) {
+    for (itj_csv_u32 i = 0; i < NUM_PERF_COUNTERS; ++i) {
+        counters_out[i] = -1.0;
+#ifdef __linux__
+        if (perf->fds[i] >= 0) {
+            ioctl(perf->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+            // value, time enabled, time running. Scaled up when the counter was multiplexed
+            itj_csv_u64 values[3];
+            if (read(perf->fds[i], values, sizeof(values)) == sizeof(values) && values[2] > 0) {
+                counters_out[i] = (double)values[0] * ((double)values[1] / (double)values[2]);
+            }
+        }
+#endif
+    }
+}
+
+itj_csv_u32 g_seed = 1;
+
+itj_csv_u32 our_rand() {
+    g_seed = (214013*g_seed+2531011);
+    return (g_seed>>16)&0x7FFF;
+}
+
+#define CHARACTERS "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789"
+
+void put_word(struct dataset *ds, itj_csv_umax max, itj_csv_umax len, itj_csv_bool quoted, itj_csv_bool escapes) {
+    if (quoted && ds->len < max) {
+        ds->data[ds->len++] = '"';
+    }
+
+    for (itj_csv_umax i = 0; i < len && ds->len + 2 < max; ++i) {
+        if (escapes && our_rand() % 16 == 0) {
+            ds->data[ds->len++] = '"';
+            ds->data[ds->len++] = '"';
+        } else {
+            ds->data[ds->len++] = CHARACTERS[our_rand() % (sizeof(CHARACTERS) - 1)];
+        }
+    }
+
+    if (quoted && ds->len < max) {
+        ds->data[ds->len++] = '"';
+    }
+}
+
+void put_number(struct dataset *ds) {
+    ds->len += snprintf(ds->data + ds->len, 32, "%u.%02u", our_rand() % 100000, our_rand() % 100);
+}
+
+/*
+ * narrow_numeric: 8 columns of decimals
+ * wide_quoted: 200 columns of quoted text with doubled quotes
+ * huge_fields: 4 columns of 4 KB to 64 KB text
+ * crlf: 20 mixed columns ending in \r\n
+ * empty_fields: 50 columns where most values are empty
+ */
+void make_dataset(struct dataset *ds, itj_csv_umax size) {
+    // Room for the row that crosses size, and for the kernels reading a block past the end
+    itj_csv_umax max = size + MB(1);
+    ds->data = (char *)calloc(1, max + ITJ_CSV_BLOCK_SIZE);
+    ds->len = 0;
+    g_seed = 1;
+
+    if (!ds->data) {
+        printf("Unable to allocate memory for the %s dataset\n", ds->name);
+        exit(EXIT_FAILURE);
+    }
+
+    const char *newline = ds->is_crlf ? "\r\n" : "\n";
+    itj_csv_umax num_columns = 0;
+    if (strcmp(ds->name, "narrow_numeric") == 0) {
+        num_columns = 8;
+    } else if (strcmp(ds->name, "wide_quoted") == 0) {
+        num_columns = 200;
+    } else if (strcmp(ds->name, "huge_fields") == 0) {
+        num_columns = 4;
+    } else if (strcmp(ds->name, "crlf") == 0) {
+        num_columns = 20;
+    } else {
+        num_columns = 50;
+    }
+
+    while (ds->len < size) {
+        for (itj_csv_umax column = 0; column < num_columns; ++column) {
+            if (strcmp(ds->name, "narrow_numeric") == 0) {
+                put_number(ds);
+            } else if (strcmp(ds->name, "wide_quoted") == 0) {
+                put_word(ds, max, 4 + our_rand() % 60, ITJ_CSV_TRUE, ITJ_CSV_TRUE);
+            } else if (strcmp(ds->name, "huge_fields") == 0) {
+                put_word(ds, max, KB(4) + (our_rand() * 2) % KB(60), column % 2, ITJ_CSV_FALSE);
+            } else if (strcmp(ds->name, "crlf") == 0) {
+                if (column % 2) {
+                    put_number(ds);
+                } else {
+                    put_word(ds, max, 2 + our_rand() % 30, column % 4 == 0, ITJ_CSV_FALSE);
+                }
+            } else if (our_rand() % 5 == 0) {
+                put_word(ds, max, 1 + our_rand() % 10, ITJ_CSV_FALSE, ITJ_CSV_FALSE);
+            }
+
+            if (column + 1 != num_columns) {
+                ds->data[ds->len++] = ',';
+            }
+        }
+
+        memcpy(ds->data + ds->len, newline, strlen(newline));
+        ds->len += strlen(newline);
+    }
+}
+
+void run_kernel(struct dataset *ds, struct kernel *kernel, char *copy, itj_csv_umax num_warmup, itj_csv_umax num_runs, struct result *result) {
+    for (itj_csv_umax run = 0; run < num_warmup + num_runs; ++run) {
+        memcpy(copy, ds->data, ds->len);
+
+        struct itj_csv csv;
+        itj_csv_open_memory(&csv, copy, ds->len, ITJ_CSV_DELIM_COMMA, NULL);
+
+        itj_csv_umax num_values = 0;
+        itj_csv_umax num_rows = 0;
+
+        if (g_perf.enabled) {
+            perf_begin(&g_perf);
+        }
+
+        double time_start = get_time_ms();
+        itj_csv_u64 cycles_start = __rdtsc();
+        for (;;) {
+            struct itj_csv_value value = kernel->fn(&csv);
+            if (value.need_data) {
+                break;
+            }
+
+            num_rows += value.is_end_of_line;
+            ++num_values;
+        }
+        itj_csv_u64 cycles_end = __rdtsc();
+        double time_end = get_time_ms();
+
+        double counters[NUM_PERF_COUNTERS];
+        if (g_perf.enabled) {
+            perf_end(&g_perf, counters);
+        }
+
+        if (run >= num_warmup) {
+            result->seconds[run - num_warmup] = (time_end - time_start) / 1000.0;
+            result->cycles[run - num_warmup] = (double)(cycles_end - cycles_start);
+            if (g_perf.enabled) {
+                memcpy(result->counters[run - num_warmup], counters, sizeof(counters));
+            }
+        }
+
+        result->num_values = num_values;
+        result->num_rows = num_rows;
+    }
+}
+
+// itj_csv_count_records only reads the data, so it runs on the original without a copy
+void run_count(struct dataset *ds, itj_csv_u32 num_threads, itj_csv_umax num_warmup, itj_csv_umax num_runs, struct result *result) {
+    for (itj_csv_umax run = 0; run < num_warmup + num_runs; ++run) {
+        double time_start = get_time_ms();
+        itj_csv_u64 cycles_start = __rdtsc();
+        itj_csv_umax num_rows = num_threads == 1 ? itj_csv_count_records(ds->data, ds->len) : itj_csv_count_records_parallel(ds->data, ds->len, num_threads);
+        itj_csv_u64 cycles_end = __rdtsc();
+        double time_end = get_time_ms();
+
+        if (run >= num_warmup) {
+            result->seconds[run - num_warmup] = (time_end - time_start) / 1000.0;
+            result->cycles[run - num_warmup] = (double)(cycles_end - cycles_start);
+            for (itj_csv_u32 i = 0; i < NUM_PERF_COUNTERS; ++i) {
+                result->counters[run - num_warmup][i] = -1.0;
+            }
+        }
+
+        result->num_values = 0;
+        result->num_rows = num_rows;
+    }
+}
+
+itj_csv_bool ingest_value(void *user, itj_csv_u32 worker, itj_csv_u32 file, struct itj_csv *csv, struct itj_csv_value *value) {
+    return ITJ_CSV_TRUE;
+}
+
+// Splits the dataset into num_files files on row boundaries, and parses them all with itj_csv_ingest_files
+itj_csv_bool run_ingest(struct dataset *ds, itj_csv_u32 num_files, itj_csv_umax num_warmup, itj_csv_umax num_runs, struct result *result) {
+    char (*names)[64] = (char (*)[64])calloc(num_files, sizeof(*names));
+    const char **paths = (const char **)calloc(num_files, sizeof(*paths));
+    struct itj_csv_ingest_stats *file_stats = (struct itj_csv_ingest_stats *)calloc(num_files, sizeof(*file_stats));
+    itj_csv_bool ok = names && paths && file_stats;
+
+    itj_csv_umax offset = 0;
+    for (itj_csv_u32 f = 0; ok && f < num_files; ++f) {
+        itj_csv_umax end = f + 1 == num_files ? ds->len : ds->len / num_files * (f + 1);
+        while (end < ds->len && ds->data[end - 1] != '\n') {
+            ++end;
+        }
+        if (end < offset) {
+            end = offset;
+        }
+
+        snprintf(names[f], sizeof(names[f]), "itj_csv_bench_%s_%u.csv", ds->name, f);
+        paths[f] = names[f];
+        FILE *fh = fopen(paths[f], "wb");
+        ok = fh && fwrite(ds->data + offset, 1, end - offset, fh) == end - offset;
+        if (fh) {
+            fclose(fh);
+        }
+        offset = end;
+    }
+
+    struct itj_csv_ingest ingest;
+    memset(&ingest, 0, sizeof(ingest));
+    ingest.paths = paths;
+    ingest.num_files = num_files;
+    ingest.delimiter = ITJ_CSV_DELIM_COMMA;
+    ingest.on_value = ingest_value;
+    ingest.file_stats = file_stats;
+
+    struct itj_csv_ingest_result ingest_result;
+    for (itj_csv_umax run = 0; ok && run < num_warmup + num_runs; ++run) {
+        itj_csv_u64 cycles_start = __rdtsc();
+        ok = itj_csv_ingest_files(&ingest, &ingest_result) && ingest_result.failed_files == 0;
+        itj_csv_u64 cycles_end = __rdtsc();
+
+        if (run >= num_warmup) {
+            result->seconds[run - num_warmup] = (double)ingest_result.total.nanoseconds / 1e9;
+            result->cycles[run - num_warmup] = (double)(cycles_end - cycles_start);
+            for (itj_csv_u32 i = 0; i < NUM_PERF_COUNTERS; ++i) {
+                result->counters[run - num_warmup][i] = -1.0;
+            }
+        }
+
+        result->num_values = ingest_result.total.values;
+        result->num_rows = ingest_result.total.rows;
+    }
+
+    if (ok) {
+        double slowest = 0.0, fastest = 0.0;
+        for (itj_csv_u32 f = 0; f < num_files; ++f) {
+            double mb_per_second = (double)file_stats[f].bytes / MB(1) / ((double)file_stats[f].nanoseconds / 1e9);
+            if (f == 0 || mb_per_second < slowest) {
+                slowest = mb_per_second;
+            }
+            if (f == 0 || mb_per_second > fastest) {
+                fastest = mb_per_second;
+            }
+        }
+        fprintf(stderr, "%s over %u files on %u workers with %llu KB buffers, per file from %.1f to %.1f MB/s\n", ds->name, num_files,
+                ingest_result.num_workers, (unsigned long long)(ingest_result.buffer_size / KB(1)), slowest, fastest);
+    }
+
+    for (itj_csv_u32 f = 0; paths && f < num_files; ++f) {
+        if (paths[f]) {
+            remove(paths[f]);
+        }
+    }
+    free(names);
+    free(paths);
+    free(file_stats);
+    return ok;
+}
+
+void mean_and_stddev(double *values, itj_csv_umax count, double *mean_out, double *stddev_out) {
+    double sum = 0.0;
+    for (itj_csv_umax i = 0; i < count; ++i) {
+        sum += values[i];
+    }
+    double mean = sum / count;
+
+    double variance = 0.0;
+    for (itj_csv_umax i = 0; i < count; ++i) {
+        variance += (values[i] - mean) * (values[i] - mean);
+    }
+
+    *mean_out = mean;
+    *stddev_out = count > 1 ? sqrt(variance / (count - 1)) : 0.0;
+}
+
+// Mean of a counter over the runs, or -1 when it was not read
+double counter_mean(struct result *result, itj_csv_u32 counter, itj_csv_umax num_runs) {
+    double sum = 0.0;
+    for (itj_csv_umax i = 0; i < num_runs; ++i) {
+        if (result->counters[i][counter] < 0.0) {
+            return -1.0;
+        }
+        sum += result->counters[i][counter];
+    }
+    return sum / num_runs;
+}
+
+void report_perf(enum format format, struct dataset *ds, struct result *result, itj_csv_umax num_runs) {
+    double means[NUM_PERF_COUNTERS];
+    for (itj_csv_u32 i = 0; i < NUM_PERF_COUNTERS; ++i) {
+        means[i] = counter_mean(result, i, num_runs);
+    }
+    double ipc = means[PERF_CYCLES] > 0.0 && means[PERF_INSTRUCTIONS] >= 0.0 ? means[PERF_INSTRUCTIONS] / means[PERF_CYCLES] : -1.0;
+
+    if (format == FORMAT_JSON) {
+        printf(", \"ipc\": ");
+        ipc < 0.0 ? printf("null") : printf("%.4f", ipc);
+        for (itj_csv_u32 i = 0; i < NUM_PERF_COUNTERS; ++i) {
+            printf(", \"%s_per_byte\": ", g_perf_counter_names[i]);
+            means[i] < 0.0 ? printf("null") : printf("%.6f", means[i] / ds->len);
+            printf(", \"%s_per_value\": ", g_perf_counter_names[i]);
+            means[i] < 0.0 || !result->num_values ? printf("null") : printf("%.6f", means[i] / result->num_values);
+        }
+    } else if (format == FORMAT_CSV) {
+        ipc < 0.0 ? printf(",") : printf(",%.4f", ipc);
+        for (itj_csv_u32 i = 0; i < NUM_PERF_COUNTERS; ++i) {
+            means[i] < 0.0 ? printf(",") : printf(",%.6f", means[i] / ds->len);
+            means[i] < 0.0 || !result->num_values ? printf(",") : printf(",%.6f", means[i] / result->num_values);
+        }
+    } else {
+        printf("%16s", "");
+        if (ipc >= 0.0) {
+            printf(" IPC %.2f", ipc);
+        }
+        for (itj_csv_u32 i = 0; i < NUM_PERF_COUNTERS; ++i) {
+            if (means[i] >= 0.0 && result->num_values) {
+                printf(", %s %.4f/byte %.3f/value", g_perf_counter_names[i], means[i] / ds->len, means[i] / result->num_values);
+            }
+        }
+    }
+}
+
+void report(enum format format, itj_csv_bool *is_first, struct dataset *ds, const char *kernel_name, struct result *result, itj_csv_umax num_runs) {
+    double gbps[MAX_RUNS], ns_per_row[MAX_RUNS], cycles_per_byte[MAX_RUNS];
+    for (itj_csv_umax i = 0; i < num_runs; ++i) {
+        gbps[i] = ((double)ds->len / 1e9) / result->seconds[i];
+        ns_per_row[i] = result->num_rows ? (result->seconds[i] * 1e9) / result->num_rows : 0.0;
+        cycles_per_byte[i] = result->cycles[i] / ds->len;
+    }
+
+    double gbps_mean, gbps_stddev, ns_mean, ns_stddev, cpb_mean, cpb_stddev;
+    mean_and_stddev(gbps, num_runs, &gbps_mean, &gbps_stddev);
+    mean_and_stddev(ns_per_row, num_runs, &ns_mean, &ns_stddev);
+    mean_and_stddev(cycles_per_byte, num_runs, &cpb_mean, &cpb_stddev);
+
+    if (format == FORMAT_JSON) {
+        printf("%s\n  {\"dataset\": \"%s\", \"kernel\": \"%s\", \"bytes\": %llu, \"rows\": %llu, \"values\": %llu, \"runs\": %llu, "
+               "\"gb_per_sec\": %.4f, \"gb_per_sec_stddev\": %.4f, \"ns_per_row\": %.2f, \"ns_per_row_stddev\": %.2f, "
+               "\"cycles_per_byte\": %.4f, \"cycles_per_byte_stddev\": %.4f",
+               *is_first ? "" : ",", ds->name, kernel_name, (unsigned long long)ds->len, (unsigned long long)result->num_rows,
+               (unsigned long long)result->num_values, (unsigned long long)num_runs,
+               gbps_mean, gbps_stddev, ns_mean, ns_stddev, cpb_mean, cpb_stddev);
+        if (g_perf.enabled) {
+            report_perf(format, ds, result, num_runs);
+        }
+        printf("}");
+    } else if (format == FORMAT_CSV) {
+        if (*is_first) {
+            printf("dataset,kernel,bytes,rows,values,runs,gb_per_sec,gb_per_sec_stddev,ns_per_row,ns_per_row_stddev,cycles_per_byte,cycles_per_byte_stddev");
+            if (g_perf.enabled) {
+                printf(",ipc");
+                for (itj_csv_u32 i = 0; i < NUM_PERF_COUNTERS; ++i) {
+                    printf(",%s_per_byte,%s_per_value", g_perf_counter_names[i], g_perf_counter_names[i]);
+                }
+            }
+            printf("\n");
+        }
+        printf("%s,%s,%llu,%llu,%llu,%llu,%.4f,%.4f,%.2f,%.2f,%.4f,%.4f",
+               ds->name, kernel_name, (unsigned long long)ds->len, (unsigned long long)result->num_rows,
+               (unsigned long long)result->num_values, (unsigned long long)num_runs,
+               gbps_mean, gbps_stddev, ns_mean, ns_stddev, cpb_mean, cpb_stddev);
+        if (g_perf.enabled) {
+            report_perf(format, ds, result, num_runs);
+        }
+        printf("\n");
+    } else {
+        if (*is_first) {
+            printf("%-16s %-28s %14s %14s %16s\n", "dataset", "kernel", "GB/s", "ns/row", "cycles/byte");
+        }
+        printf("%-16s %-28s %7.3f +-%5.3f %8.1f +-%4.1f %9.3f +-%5.3f\n",
+               ds->name, kernel_name, gbps_mean, gbps_stddev, ns_mean, ns_stddev, cpb_mean, cpb_stddev);
+        if (g_perf.enabled && result->num_values) {
+            report_perf(format, ds, result, num_runs);
+            printf("\n");
+        }
+    }
+
+    *is_first = ITJ_CSV_FALSE;
+}
+
+int main(int argc, char *argv[]) {
+#ifdef IS_WINDOWS
+    {
+        LARGE_INTEGER large_integer;
+        QueryPerformanceFrequency(&large_integer);
+        g_freq = ((double)large_integer.QuadPart) / 1000.0;
+    }
+#endif
+
+    itj_csv_umax size = MB(64);
+    itj_csv_umax num_runs = 5;
+    itj_csv_umax num_warmup = 1;
+    enum format format = FORMAT_TEXT;
+    const char *only_dataset = NULL;
+    const char *only_kernel = NULL;
+    itj_csv_bool huge_pages = ITJ_CSV_FALSE;
+    itj_csv_u32 num_files = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *next = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--size") == 0 && next) {
+            size = (itj_csv_umax)atoll(next) * MB(1);
+        } else if (strcmp(arg, "--runs") == 0 && next) {
+            num_runs = (itj_csv_umax)atoll(next);
+        } else if (strcmp(arg, "--warmup") == 0 && next) {
+            num_warmup = (itj_csv_umax)atoll(next);
+        } else if (strcmp(arg, "--format") == 0 && next) {
+            if (strcmp(next, "json") == 0) {
+                format = FORMAT_JSON;
+            } else if (strcmp(next, "csv") == 0) {
+                format = FORMAT_CSV;
+            } else {
+                format = FORMAT_TEXT;
+            }
+        } else if (strcmp(arg, "--dataset") == 0 && next) {
+            only_dataset = next;
+        } else if (strcmp(arg, "--kernel") == 0 && next) {
+            only_kernel = next;
+        } else if (strcmp(arg, "--files") == 0 && next) {
+            num_files = (itj_csv_u32)atoi(next);
+        } else if (strcmp(arg, "--huge-pages") == 0) {
+            huge_pages = ITJ_CSV_TRUE;
+            continue;
+        } else if (strcmp(arg, "--perf") == 0) {
+            perf_init(&g_perf);
+            continue;
+        } else {
+            printf("Usage: %s [--size MB] [--runs N] [--warmup N] [--format text|csv|json] [--dataset name] [--kernel name] [--perf] [--huge-pages] [--files N]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        ++i;
+    }
+
+    if (num_runs == 0 || num_runs > MAX_RUNS || size == 0) {
+        printf("--runs must be between 1 and %d, and --size above 0\n", MAX_RUNS);
+        return EXIT_FAILURE;
+    }
+
+    struct dataset datasets[] = {
+        { "narrow_numeric", ITJ_CSV_FALSE, ITJ_CSV_FALSE },
+        { "wide_quoted", ITJ_CSV_FALSE, ITJ_CSV_TRUE },
+        { "huge_fields", ITJ_CSV_FALSE, ITJ_CSV_TRUE },
+        { "crlf", ITJ_CSV_TRUE, ITJ_CSV_TRUE },
+        { "empty_fields", ITJ_CSV_FALSE, ITJ_CSV_FALSE },
+    };
+    itj_csv_umax num_datasets = sizeof(datasets) / sizeof(datasets[0]);
+
+    struct result *result = (struct result *)calloc(1, sizeof(*result));
+    if (!result) {
+        printf("Unable to allocate memory for the results\n");
+        return EXIT_FAILURE;
+    }
+
+    itj_csv_bool is_first = ITJ_CSV_TRUE;
+    if (format == FORMAT_JSON) {
+        printf("[");
+    }
+
+    for (itj_csv_umax d = 0; d < num_datasets; ++d) {
+        struct dataset *ds = &datasets[d];
+        if (only_dataset && strcmp(only_dataset, ds->name) != 0) {
+            continue;
+        }
+
+        make_dataset(ds, size);
+
+        struct itj_csv_buffer buffer = {0};
+        char *copy;
+        if (huge_pages) {
+            if (!itj_csv_buffer_alloc(&buffer, ds->len, NULL)) {
+                printf("Unable to allocate memory for a copy of the %s dataset\n", ds->name);
+                return EXIT_FAILURE;
+            }
+            if (d == 0 || only_dataset) {
+                const char *kinds[] = { "none", "explicit huge pages", "transparent huge pages", "pages", "heap" };
+                fprintf(stderr, "The parse buffer is on %s\n", kinds[buffer.kind]);
+            }
+            copy = (char *)buffer.data;
+        } else {
+            copy = (char *)calloc(1, ds->len + ITJ_CSV_BLOCK_SIZE);
+            if (!copy) {
+                printf("Unable to allocate memory for a copy of the %s dataset\n", ds->name);
+                return EXIT_FAILURE;
+            }
+        }
+
+        // Reference for how fast the memory is, as every run copies the dataset anyway
+        memcpy(copy, ds->data, ds->len);
+        double time_start = get_time_ms();
+        itj_csv_u64 cycles_start = __rdtsc();
+        for (itj_csv_umax run = 0; run < num_runs; ++run) {
+            memcpy(copy, ds->data, ds->len);
+            itj_csv_u64 cycles_end = __rdtsc();
+            double time_end = get_time_ms();
+            result->seconds[run] = (time_end - time_start) / 1000.0;
+            result->cycles[run] = (double)(cycles_end - cycles_start);
+            time_start = time_end;
+            cycles_start = cycles_end;
+        }
+        result->num_rows = 0;
+        result->num_values = 0;
+        for (itj_csv_umax run = 0; run < num_runs; ++run) {
+            for (itj_csv_u32 i = 0; i < NUM_PERF_COUNTERS; ++i) {
+                result->counters[run][i] = -1.0;
+            }
+        }
+        if (!only_kernel || strcmp(only_kernel, "memcpy") == 0) {
+            report(format, &is_first, ds, "memcpy", result, num_runs);
+        }
+
+        if (!only_kernel || strcmp(only_kernel, "count_records") == 0) {
+            run_count(ds, 1, num_warmup, num_runs, result);
+            report(format, &is_first, ds, "count_records", result, num_runs);
+        }
+        if (!only_kernel || strcmp(only_kernel, "count_records_parallel") == 0) {
+            run_count(ds, 0, num_warmup, num_runs, result);
+            report(format, &is_first, ds, "count_records_parallel", result, num_runs);
+        }
+
+        if (num_files > 0 && (!only_kernel || strcmp(only_kernel, "ingest_files") == 0)) {
+            if (run_ingest(ds, num_files, num_warmup, num_runs, result)) {
+                report(format, &is_first, ds, "ingest_files", result, num_runs);
+            } else {
+                fprintf(stderr, "Unable to write or ingest %u files of the %s dataset\n", num_files, ds->name);
+            }
+        }
+
+        itj_csv_umax expected_values = 0;
+        for (itj_csv_umax k = 0; k < NUM_KERNELS; ++k) {
+            struct kernel *kernel = &g_kernels[k];
+            if ((kernel->flags & ITJ_CSV_KERNEL_LF_ONLY) && ds->is_crlf) {
+                continue;
+            }
+            if ((kernel->flags & ITJ_CSV_KERNEL_NO_QUOTES) && ds->has_quotes) {
+                continue;
+            }
+            if (only_kernel && strcmp(only_kernel, kernel->name) != 0) {
+                continue;
+            }
+
+            run_kernel(ds, kernel, copy, num_warmup, num_runs, result);
+
+            if (expected_values == 0) {
+                expected_values = result->num_values;
+            } else if (expected_values != result->num_values) {
+                fprintf(stderr, "%s found %llu values in %s, where others found %llu\n", kernel->name,
+                        (unsigned long long)result->num_values, ds->name, (unsigned long long)expected_values);
+            }
+
+            report(format, &is_first, ds, kernel->name, result, num_runs);
+        }
+
+        if (huge_pages) {
+            itj_csv_buffer_free(&buffer, NULL);
+        } else {
+            free(copy);
+        }
+        free(ds->data);
+    }
+
+    if (format == FORMAT_JSON) {
+        printf("\n]\n");
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/*
+------------------------------------------------------------------------------
+This software is available under 2 licenses -- choose whichever you prefer.
+------------------------------------------------------------------------------
+ALTERNATIVE A - MIT License
+Copyright (c) 2017 Ian Thomassen Jacobsen
+Permission is hereby granted, free of charge, to any person obtaining a copy of 
+this software and associated documentation files (the "Software"), to deal in 
+the Software without restriction, including without limitation the rights to 
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+of the Software, and to permit persons to whom the Software is furnished to do 
+so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+SOFTWARE.
+------------------------------------------------------------------------------
+ALTERNATIVE B - Public Domain (www.unlicense.org)
+This is free and unencumbered software released into the public domain.
+Anyone is free to copy, modify, publish, use, compile, sell, or distribute this 
+software, either in source code form or as a compiled binary, for any purpose, 
+commercial or non-commercial, and by any means.
+In jurisdictions that recognize copyright laws, the author or authors of this 
+software dedicate any and all copyright interest in the software to the public 
+domain. We make this dedication for the benefit of the public at large and to 
+the detriment of our heirs and successors. We intend this dedication to be an 
+overt act of relinquishment in perpetuity of all present and future rights to 
+this software under copyright law.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN 
+ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION 
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+------------------------------------------------------------------------------
+*/
@@ -0,0 +1,448 @@
+/*
+ * LICENSE available at the bottom
+ */
+
+// BENCHMARK THE C++ WRAPPER AGAINST THE RAW C LOOP
+//
+// Usage: itj_csv_bench_cpp [--size MB] [--runs N]
+//
+// Both loops parse the same data with the same kernel, count the values and sum their lengths,
+// so the wrapper has to do the same work as the C loop. It fails when they disagree.
+// typed_load decodes narrow_numeric into a struct of doubles, with strtod and a branch per column
+// in the C loop, and with itj::schema in C++. f64_batch collects each row of narrow_numeric and converts
+// it with itj_csv_parse_f64 one value at a time in the first column, and with itj_csv_parse_f64_batch in
+// the second. timestamp_load decodes the timestamps dataset into a struct of time points, with sscanf
+// and timegm in the C loop, and with itj::schema and itj_csv_parse_timestamp in C++.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <chrono>
+#include <string_view>
+
+#define ITJ_CSV_IMPLEMENTATION_AVX2
+#include "itj_csv.hpp"
+
+#define KB(x) (x * 1024)
+#define MB(x) (KB(x) * 1024)
+
+struct dataset {
+    const char *name;
+    char *data;
+    itj_csv_umax len;
+};
+
+struct totals {
+    itj_csv_umax values;
+    itj_csv_umax bytes;
+};
+
+static unsigned int g_seed = 1;
+
+static unsigned int our_rand() {
+    g_seed = (214013 * g_seed + 2531011);
+    return (g_seed >> 16) & 0x7FFF;
+}
+
+// narrow_numeric: 8 columns of decimals. quoted: 20 columns of quoted text with doubled quotes
+static void make_dataset(struct dataset *ds, itj_csv_umax size, bool quoted) {
+    itj_csv_umax max = size + KB(64);
+    ds->data = (char *)calloc(1, max + ITJ_CSV_BLOCK_SIZE);
+    ds->len = 0;
+    if (!ds->data) {
+        printf("Unable to allocate memory for the %s dataset\n", ds->name);
+        exit(EXIT_FAILURE);
+    }
+
+    while (ds->len < size) {
+        itj_csv_umax num_columns = quoted ? 20 : 8;
+        for (itj_csv_umax column = 0; column < num_columns; ++column) {
+            if (quoted) {
+                ds->data[ds->len++] = '"';
+                itj_csv_umax len = 4 + our_rand() % 40;
+                for (itj_csv_umax i = 0; i < len; ++i) {
+                    if (our_rand() % 16 == 0) {
+                        ds->data[ds->len++] = '"';
+                        ds->data[ds->len++] = '"';
+                    } else {
+                        ds->data[ds->len++] = 'a' + our_rand() % 26;
+                    }
+                }
+                ds->data[ds->len++] = '"';
+            } else {
+                ds->len += snprintf(ds->data + ds->len, 32, "%u.%02u", our_rand() % 100000, our_rand() % 100);
+            }
+            ds->data[ds->len++] = column + 1 == num_columns ? '\n' : ',';
+        }
+    }
+}
+
+// timestamps: 4 columns of UTC timestamps with milliseconds
+static void make_timestamps(struct dataset *ds, itj_csv_umax size) {
+    ds->data = (char *)calloc(1, size + KB(64) + ITJ_CSV_BLOCK_SIZE);
+    ds->len = 0;
+    if (!ds->data) {
+        printf("Unable to allocate memory for the %s dataset\n", ds->name);
+        exit(EXIT_FAILURE);
+    }
+
+    while (ds->len < size) {
+        for (itj_csv_umax column = 0; column < 4; ++column) {
+            ds->len += snprintf(ds->data + ds->len, 32, "%04u-%02u-%02uT%02u:%02u:%02u.%03uZ", 1990 + our_rand() % 40, 1 + our_rand() % 12,
+                                1 + our_rand() % 28, our_rand() % 24, our_rand() % 60, our_rand() % 60, our_rand() % 1000);
+            ds->data[ds->len++] = column + 1 == 4 ? '\n' : ',';
+        }
+    }
+}
+
+template <itj_csv_kernel_fn Kernel>
+static struct totals run_c(char *copy, itj_csv_umax len) {
+    struct totals totals = {0, 0};
+    struct itj_csv csv;
+    itj_csv_open_memory(&csv, copy, len, ITJ_CSV_DELIM_COMMA, NULL);
+    for (;;) {
+        struct itj_csv_value value = Kernel(&csv);
+        if (value.need_data) {
+            break;
+        }
+        totals.values += 1;
+        totals.bytes += value.data.len;
+    }
+    return totals;
+}
+
+template <itj_csv_kernel_fn Kernel>
+static struct totals run_cpp(char *copy, itj_csv_umax len) {
+    struct totals totals = {0, 0};
+    struct itj_csv csv;
+    itj_csv_open_memory(&csv, copy, len, ITJ_CSV_DELIM_COMMA, NULL);
+    itj::csv_reader<Kernel> reader(csv);
+    for (auto row : reader) {
+        for (std::string_view field : row) {
+            totals.values += 1;
+            totals.bytes += field.size();
+        }
+    }
+    return totals;
+}
+
+// Best of the runs, in GB/s, as the wrapper should be no slower at its best
+template <struct totals (*Run)(char *, itj_csv_umax)>
+static double time_run(struct dataset *ds, char *copy, itj_csv_umax num_runs, struct totals *totals) {
+    double best = 0.0;
+    for (itj_csv_umax run = 0; run < num_runs + 1; ++run) {
+        memcpy(copy, ds->data, ds->len);
+        auto start = std::chrono::steady_clock::now();
+        *totals = Run(copy, ds->len);
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        if (run > 0 && (double)ds->len / seconds / 1e9 > best) {
+            best = (double)ds->len / seconds / 1e9;
+        }
+    }
+    return best;
+}
+
+template <itj_csv_kernel_fn Kernel>
+static bool compare(struct dataset *ds, char *copy, itj_csv_umax num_runs, const char *kernel_name) {
+    struct totals c_totals, cpp_totals;
+    double c_speed = time_run<run_c<Kernel>>(ds, copy, num_runs, &c_totals);
+    double cpp_speed = time_run<run_cpp<Kernel>>(ds, copy, num_runs, &cpp_totals);
+
+    printf("%-16s %-24s %8.3f %8.3f %7.1f%%\n", ds->name, kernel_name, c_speed, cpp_speed, 100.0 * cpp_speed / c_speed);
+    if (c_totals.values != cpp_totals.values || c_totals.bytes != cpp_totals.bytes) {
+        printf("The wrapper found %llu values of %llu bytes, where the C loop found %llu of %llu\n",
+               (unsigned long long)cpp_totals.values, (unsigned long long)cpp_totals.bytes,
+               (unsigned long long)c_totals.values, (unsigned long long)c_totals.bytes);
+        return false;
+    }
+    return true;
+}
+
+// narrow_numeric decoded into a struct, with strtod and a branch per column as in example_usage.c, or with itj::schema
+struct numeric_row {
+    double values[8];
+};
+
+static double load_c(char *copy, itj_csv_umax len) {
+    double sum = 0.0;
+    struct numeric_row row = {};
+    struct itj_csv csv;
+    itj_csv_open_memory(&csv, copy, len, ITJ_CSV_DELIM_COMMA, NULL);
+    for (;;) {
+        struct itj_csv_value value = itj_csv_get_next_value_avx2_comma(&csv);
+        if (value.need_data) {
+            break;
+        }
+        if (value.column < 8) {
+            row.values[value.column] = strtod((const char *)value.data.base, NULL);
+        }
+        if (value.is_end_of_line) {
+            for (itj_csv_u32 i = 0; i < 8; ++i) {
+                sum += row.values[i];
+            }
+        }
+    }
+    return sum;
+}
+
+static double load_cpp(char *copy, itj_csv_umax len) {
+    static itj::schema<numeric_row, &numeric_row::values> schema(itj::column<&numeric_row::values>(0));
+    static bool bound = schema.bind();
+    double sum = 0.0;
+    struct itj_csv csv;
+    itj_csv_open_memory(&csv, copy, len, ITJ_CSV_DELIM_COMMA, NULL);
+    itj::csv_reader<itj_csv_get_next_value_avx2_comma> reader(csv);
+    for (auto row : reader) {
+        struct numeric_row decoded;
+        schema.decode(row, decoded);
+        for (itj_csv_u32 i = 0; i < 8; ++i) {
+            sum += decoded.values[i];
+        }
+    }
+    return bound ? sum : 0.0;
+}
+
+// A row of spans, converted one at a time or as a batch. The spans stay valid since nothing is pumped
+template <bool Batch>
+static double load_row(char *copy, itj_csv_umax len) {
+    double sum = 0.0;
+    struct itj_csv_string spans[8];
+    double values[8];
+    struct itj_csv csv;
+    itj_csv_open_memory(&csv, copy, len, ITJ_CSV_DELIM_COMMA, NULL);
+    for (;;) {
+        struct itj_csv_value value = itj_csv_get_next_value_avx2_comma(&csv);
+        if (value.need_data) {
+            break;
+        }
+        if (value.column < 8) {
+            spans[value.column] = value.data;
+        }
+        if (value.is_end_of_line && value.column == 7) {
+            if (Batch) {
+                itj_csv_parse_f64_batch(spans, 8, values, NULL);
+            } else {
+                for (itj_csv_u32 i = 0; i < 8; ++i) {
+                    itj_csv_parse_f64(spans[i].base, spans[i].len, &values[i]);
+                }
+            }
+            for (itj_csv_u32 i = 0; i < 8; ++i) {
+                sum += values[i];
+            }
+        }
+    }
+    return sum;
+}
+
+template <double (*Load)(char *, itj_csv_umax)>
+static double time_load(struct dataset *ds, char *copy, itj_csv_umax num_runs, double *sum) {
+    double best = 0.0;
+    for (itj_csv_umax run = 0; run < num_runs + 1; ++run) {
+        memcpy(copy, ds->data, ds->len);
+        auto start = std::chrono::steady_clock::now();
+        *sum = Load(copy, ds->len);
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        if (run > 0 && (double)ds->len / seconds / 1e9 > best) {
+            best = (double)ds->len / seconds / 1e9;
+        }
+    }
+    return best;
+}
+
+static bool compare_load(struct dataset *ds, char *copy, itj_csv_umax num_runs) {
+    double c_sum, cpp_sum;
+    double c_speed = time_load<load_c>(ds, copy, num_runs, &c_sum);
+    double cpp_speed = time_load<load_cpp>(ds, copy, num_runs, &cpp_sum);
+
+    printf("%-16s %-24s %8.3f %8.3f %7.1f%%\n", ds->name, "typed_load", c_speed, cpp_speed, 100.0 * cpp_speed / c_speed);
+    if (c_sum != cpp_sum) {
+        printf("The schema summed to %f, where strtod summed to %f\n", cpp_sum, c_sum);
+        return false;
+    }
+    return true;
+}
+
+// timestamps decoded into a struct, with sscanf and timegm, or with itj::schema
+struct timestamp_row {
+    std::chrono::time_point<std::chrono::system_clock, std::chrono::nanoseconds> times[4];
+};
+
+static double load_timestamps_c(char *copy, itj_csv_umax len) {
+    double sum = 0.0;
+    itj_csv_s64 times[4] = {};
+    struct itj_csv csv;
+    itj_csv_open_memory(&csv, copy, len, ITJ_CSV_DELIM_COMMA, NULL);
+    for (;;) {
+        struct itj_csv_value value = itj_csv_get_next_value_avx2_comma(&csv);
+        if (value.need_data) {
+            break;
+        }
+        // sscanf takes the length of its input first, so it gets a copy of the value rather than the rest of the buffer
+        char text[32] = {};
+        memcpy(text, value.data.base, value.data.len < sizeof(text) - 1 ? value.data.len : sizeof(text) - 1);
+        struct tm tm = {};
+        int milliseconds = 0;
+        if (value.column < 4 && sscanf(text, "%4d-%2d-%2dT%2d:%2d:%2d.%3dZ", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+                                       &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &milliseconds) == 7) {
+            tm.tm_year -= 1900;
+            tm.tm_mon -= 1;
+#ifdef _WIN32
+            itj_csv_s64 seconds = _mkgmtime(&tm);
+#else
+            itj_csv_s64 seconds = timegm(&tm);
+#endif
+            times[value.column] = seconds * 1000000000ll + milliseconds * 1000000ll;
+        }
+        if (value.is_end_of_line) {
+            for (itj_csv_u32 i = 0; i < 4; ++i) {
+                sum += (double)(times[i] / 1000000);
+            }
+        }
+    }
+    return sum;
+}
+
+static double load_timestamps_cpp(char *copy, itj_csv_umax len) {
+    static itj::schema<timestamp_row, &timestamp_row::times> schema(itj::column<&timestamp_row::times>(0));
+    static bool bound = schema.bind();
+    double sum = 0.0;
+    struct itj_csv csv;
+    itj_csv_open_memory(&csv, copy, len, ITJ_CSV_DELIM_COMMA, NULL);
+    itj::csv_reader<itj_csv_get_next_value_avx2_comma> reader(csv);
+    for (auto row : reader) {
+        struct timestamp_row decoded;
+        schema.decode(row, decoded);
+        for (itj_csv_u32 i = 0; i < 4; ++i) {
+            sum += (double)(decoded.times[i].time_since_epoch().count() / 1000000);
+        }
+    }
+    return bound ? sum : 0.0;
+}
+
+static bool compare_timestamps(struct dataset *ds, char *copy, itj_csv_umax num_runs) {
+    double c_sum, cpp_sum;
+    double c_speed = time_load<load_timestamps_c>(ds, copy, num_runs, &c_sum);
+    double cpp_speed = time_load<load_timestamps_cpp>(ds, copy, num_runs, &cpp_sum);
+
+    printf("%-16s %-24s %8.3f %8.3f %7.1f%%\n", ds->name, "timestamp_load", c_speed, cpp_speed, 100.0 * cpp_speed / c_speed);
+    if (c_sum != cpp_sum) {
+        printf("The schema summed to %f, where timegm summed to %f\n", cpp_sum, c_sum);
+        return false;
+    }
+    return true;
+}
+
+static bool compare_batch(struct dataset *ds, char *copy, itj_csv_umax num_runs) {
+    double one_sum, batch_sum;
+    double one_speed = time_load<load_row<false>>(ds, copy, num_runs, &one_sum);
+    double batch_speed = time_load<load_row<true>>(ds, copy, num_runs, &batch_sum);
+
+    printf("%-16s %-24s %8.3f %8.3f %7.1f%%\n", ds->name, "f64_batch", one_speed, batch_speed, 100.0 * batch_speed / one_speed);
+    if (one_sum != batch_sum) {
+        printf("The batch summed to %f, where one at a time summed to %f\n", batch_sum, one_sum);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    itj_csv_umax size = MB(64);
+    itj_csv_umax num_runs = 5;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *next = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--size") == 0 && next) {
+            size = (itj_csv_umax)atoll(next) * MB(1);
+        } else if (strcmp(argv[i], "--runs") == 0 && next) {
+            num_runs = (itj_csv_umax)atoll(next);
+        } else {
+            printf("Usage: %s [--size MB] [--runs N]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        ++i;
+    }
+
+    struct dataset datasets[] = {
+        { "narrow_numeric", NULL, 0 },
+        { "quoted", NULL, 0 },
+        { "timestamps", NULL, 0 },
+    };
+
+    bool ok = true;
+    printf("%-16s %-24s %8s %8s %8s\n", "dataset", "kernel", "C GB/s", "C++ GB/s", "C++/C");
+    for (itj_csv_umax d = 0; d < sizeof(datasets) / sizeof(datasets[0]); ++d) {
+        struct dataset *ds = &datasets[d];
+        if (d == 2) {
+            make_timestamps(ds, size);
+        } else {
+            make_dataset(ds, size, d == 1);
+        }
+
+        char *copy = (char *)calloc(1, ds->len + ITJ_CSV_BLOCK_SIZE);
+        if (!copy) {
+            printf("Unable to allocate memory for a copy of the %s dataset\n", ds->name);
+            return EXIT_FAILURE;
+        }
+
+        ok = compare<itj_csv_get_next_value_comma>(ds, copy, num_runs, "comma") && ok;
+        ok = compare<itj_csv_get_next_value_avx_comma>(ds, copy, num_runs, "avx_comma") && ok;
+        ok = compare<itj_csv_get_next_value_avx2_comma>(ds, copy, num_runs, "avx2_comma") && ok;
+        if (d == 0) {
+            ok = compare<itj_csv_get_next_value_avx2_comma_lf_no_quotes>(ds, copy, num_runs, "avx2_comma_lf_no_quotes") && ok;
+            ok = compare_load(ds, copy, num_runs) && ok;
+            ok = compare_batch(ds, copy, num_runs) && ok;
+        } else if (d == 2) {
+            ok = compare_timestamps(ds, copy, num_runs) && ok;
+        }
+
+        free(copy);
+        free(ds->data);
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+------------------------------------------------------------------------------
+This software is available under 2 licenses -- choose whichever you prefer.
+------------------------------------------------------------------------------
+ALTERNATIVE A - MIT License
+Copyright (c) 2017 Ian Thomassen Jacobsen
+Permission is hereby granted, free of charge, to any person obtaining a copy of 
+this software and associated documentation files (the "Software"), to deal in 
+the Software without restriction, including without limitation the rights to 
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+of the Software, and to permit persons to whom the Software is furnished to do 
+so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+SOFTWARE.
+------------------------------------------------------------------------------
+ALTERNATIVE B - Public Domain (www.unlicense.org)
+This is free and unencumbered software released into the public domain.
+Anyone is free to copy, modify, publish, use, compile, sell, or distribute this 
+software, either in source code form or as a compiled binary, for any purpose, 
+commercial or non-commercial, and by any means.
+In jurisdictions that recognize copyright laws, the author or authors of this 
+software dedicate any and all copyright interest in the software to the public 
+domain. We make this dedication for the benefit of the public at large and to 
+the detriment of our heirs and successors. We intend this dedication to be an 
+overt act of relinquishment in perpetuity of all present and future rights to 
+this software under copyright law.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN 
+ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION 
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+------------------------------------------------------------------------------
+*/
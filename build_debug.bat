@@ -4,4 +4,6 @@ echo "This build script expects the 'cl' compiler to be available. It can be pre
 cl /Od /DIS_WINDOWS /Zi /FeOutput\\itj_csv_test.exe /FoOutput\\ /EHsc test.c
 cl /DIS_WINDOWS /Zi /FeOutput\\itj_csv_example_usage.exe /FoOutput\\ /EHsc example_usage.c
 cl /O2 /DIS_WINDOWS /Zi /FeOutput\\itj_csv_generate.exe /FoOutput\\ /EHsc generate.c
+cl /O2 /DIS_WINDOWS /Zi /FeOutput\\itj_csv_bench.exe /FoOutput\\ /EHsc bench.c
 
+cl /O2 /DIS_WINDOWS /Zi /std:c++17 /FeOutput\\itj_csv_bench_cpp.exe /FoOutput\\ /EHsc bench_cpp.cpp
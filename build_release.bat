@@ -4,3 +4,5 @@ echo "This build script expects the 'cl' compiler to be available. It can be pre
 cl /O2 /DIS_WINDOWS /Zi /FeOutput/itj_csv_test.exe /FoOutput\\ /EHsc test.c
 cl /DIS_WINDOWS /O2 /Zi /FeOutput/itj_csv_example_usage.exe /FoOutput\\ /EHsc example_usage.c
 cl /Ot /DIS_WINDOWS /Zi /FeOutput/itj_csv_generate.exe /FoOutput\\ /EHsc generate.c
+cl /O2 /DIS_WINDOWS /Zi /FeOutput/itj_csv_bench.exe /FoOutput\\ /EHsc bench.c
+cl /O2 /DIS_WINDOWS /Zi /std:c++17 /FeOutput/itj_csv_bench_cpp.exe /FoOutput\\ /EHsc bench_cpp.cpp
@@ -32,8 +32,10 @@ struct string {
 struct entry {
     struct string country_name;
     struct string country_code;
-    struct string indicator_name;
-    struct string indicator_code;
+    // Every row of the file has the same indicator, so these are codes into context.indicators
+    // rather than a copy per row
+    itj_csv_s32 indicator_name;
+    itj_csv_s32 indicator_code;
 
     float dates[DATE_END - DATE_START + 1];
 };
@@ -41,6 +43,7 @@ struct entry {
 struct context {
     itj_csv_umax entries_max, entries_used;
     struct entry *entries;
+    struct itj_csv_intern indicators;
 } *g_ctx = NULL;
 
 itj_csv_bool string_alloc(struct string *out, char *base, itj_csv_umax len) {
@@ -70,6 +73,7 @@ int main(int argc, char *argv[]) {
     g_ctx->entries_max = 1024;
     g_ctx->entries_used = 0;
     g_ctx->entries = (struct entry *)calloc(1, g_ctx->entries_max * sizeof(*g_ctx->entries));
+    itj_csv_intern_init(&g_ctx->indicators, NULL);
 
     const char *exe_path = argv[0];
     if (!exe_path) {
@@ -143,33 +147,34 @@ int main(int argc, char *argv[]) {
     }
 
 
-    // The CSV file, downloaded from the World Bank website, is non-standard, so we move around in the file first
+    struct itj_csv_dialect dialect;
+    if (!itj_csv_sniff(csv.read_base, csv.read_used, &dialect)) {
+        printf("Unable to work out the layout of '%s'\n", csv_path);
+        return EXIT_FAILURE;
+    }
+    csv.delimiter = dialect.delimiter;
+
+    // The CSV file, downloaded from the World Bank website, starts with a byte order mark and a few lines
+    // about the data source before the header, which the sniff counted
+    csv.read_iter = dialect.bom_len;
+    itj_csv_set_skip_lines(&csv, dialect.skip_lines, ITJ_CSV_TRUE, 0);
     struct itj_csv_value value;
-    value = itj_csv_get_next_value(&csv); // Skip Data Source
-    value = itj_csv_get_next_value(&csv); // Skip Data Source Value
-    itj_csv_ignore_newlines(&csv);
-    value = itj_csv_get_next_value(&csv); // Skip Last Updated Date
-    value = itj_csv_get_next_value(&csv); // Skip Last Updated Date Value
-    itj_csv_ignore_newlines(&csv);
-
-    itj_csv_u32 column_offset = 4;
-    itj_csv_s32 num_columns = -1;
-    for (;;) {
-        value = itj_csv_get_next_value(&csv);
-        if (value.need_data) {
-            pump_ret = itj_csv_pump_stdio(&csv);
-            if (pump_ret == 0) {
-                return EXIT_FAILURE;
-            } else {
-                continue;
-            }
-        }
 
-        if (value.is_end_of_line) {
-            num_columns = (value.idx + 1) - column_offset;
-            break;
-        }
+    if (!itj_csv_read_header(&csv)) {
+        printf("Unable to read the header of '%s'\n", csv_path);
+        return EXIT_FAILURE;
     }
+
+    itj_csv_smax country_name_column = itj_csv_column_index(&csv, "Country Name", 12);
+    itj_csv_smax country_code_column = itj_csv_column_index(&csv, "Country Code", 12);
+    itj_csv_smax indicator_name_column = itj_csv_column_index(&csv, "Indicator Name", 14);
+    itj_csv_smax indicator_code_column = itj_csv_column_index(&csv, "Indicator Code", 14);
+    itj_csv_smax first_date_column = itj_csv_column_index(&csv, "1960", 4);
+    if (country_name_column < 0 || country_code_column < 0 || first_date_column < 0) {
+        printf("'%s' is missing the columns this example reads\n", csv_path);
+        return EXIT_FAILURE;
+    }
+
     struct entry ent = {0};
     for (;;) {
         value = itj_csv_get_next_value_avx2(&csv);
@@ -182,30 +187,32 @@ int main(int argc, char *argv[]) {
             }
         }
 
-        itj_csv_umax column = (value.idx - column_offset) % num_columns;
+        itj_csv_smax column = value.column;
 
 
-        if (column == 0) {
+        if (column == country_name_column) {
             if (!string_alloc(&ent.country_name, value.data.base, value.data.len)) {
                 printf("Unable to allocate memory for string\n");
                 return EXIT_FAILURE;
             }
-        } else if (column == 1) {
+        } else if (column == country_code_column) {
             if (!string_alloc(&ent.country_code, value.data.base, value.data.len)) {
                 printf("Unable to allocate memory for string\n");
                 return EXIT_FAILURE;
             }
-        } else if (column == 2) {
-            if (!string_alloc(&ent.indicator_name, value.data.base, value.data.len)) {
+        } else if (column == indicator_name_column) {
+            ent.indicator_name = itj_csv_intern(&g_ctx->indicators, value.data.base, value.data.len);
+            if (ent.indicator_name < 0) {
                 printf("Unable to allocate memory for string\n");
                 return EXIT_FAILURE;
             }
-        } else if (column == 3) {
-            if (!string_alloc(&ent.indicator_code, value.data.base, value.data.len)) {
+        } else if (column == indicator_code_column) {
+            ent.indicator_code = itj_csv_intern(&g_ctx->indicators, value.data.base, value.data.len);
+            if (ent.indicator_code < 0) {
                 printf("Unable to allocate memory for string\n");
                 return EXIT_FAILURE;
             }
-        } else if (column > 3 && column <= 4 + (DATE_END - DATE_START)) {
+        } else if (column >= first_date_column && column <= first_date_column + (DATE_END - DATE_START)) {
             float val = NAN;
             if (value.data.len > 0) {
                 char *start = (char *)value.data.base;
@@ -215,7 +222,7 @@ int main(int argc, char *argv[]) {
                 val = strtof(start, &end);
             }
 
-            itj_csv_umax idx = (column - 4);
+            itj_csv_umax idx = (column - first_date_column);
             ent.dates[idx] = val;
         }
 
@@ -238,6 +245,7 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    itj_csv_free_header(&csv);
     itj_csv_close_fh(&csv);
 
     char buf[128];
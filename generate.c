@@ -3,72 +3,332 @@
  */
 
 // GENERATE A LARGE AND COMPLEX CSV FILE
+//
+// Usage: itj_csv_generate [options]
+//   -o PATH               File to write, generated.csv by default
+//   --size MB             Roughly how big the file gets, 1024 by default
+//   --columns N           Values per row, 500 by default
+//   --min-word N          Shortest text value, 4 by default
+//   --max-word N          Longest text value, 300 by default
+//   --quote-ratio F       Share of text values that are quoted, 0.5 by default
+//   --escape-ratio F      Share of quoted values holding doubled quotes, delimiters and newlines, 0 by default
+//   --numeric-ratio F     Share of values that are integers or decimals, 0 by default
+//   --empty-ratio F       Share of values that are empty, 0 by default
+//   --line-ending lf|crlf \n by default, or \r\n on Windows
+//   --header              Start with a row of column names
+//   --seed N              1 by default. The same seed and options always give the same file
+//   --threads N           How many chunks are generated at once, 4 by default
+//
+// The file is made of chunks of rows, each with a seed derived from --seed and its index,
+// so the thread count does not change the output
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
-#include <time.h>
+#include <string.h>
 
-#define NUM_COLUMNS 500
-#define NUM_ROWS (20 * 1000)
-#define MAX_WORD_SIZE 300
-#define MIN_WORD_SIZE 4 // If it becomes "quoted" then it erases two. So 2 is minimum
+#ifdef IS_WINDOWS
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#define MB(x) ((uint64_t)(x) * 1024 * 1024)
+#define CHUNK_SIZE MB(8)
+#define MAX_THREADS 256
+#define MAX_NUMBER_SIZE 32
 
 #define CHARACTERS "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789"
+#define ESCAPED_CHARACTERS "\",\n"
 
-uint32_t g_seed;
+struct options {
+    const char *path;
+    uint64_t size;
+    uint32_t num_columns;
+    uint32_t min_word;
+    uint32_t max_word;
+    double quote_ratio;
+    double escape_ratio;
+    double numeric_ratio;
+    double empty_ratio;
+    const char *newline;
+    int header;
+    uint64_t seed;
+    uint32_t num_threads;
+};
 
-uint32_t inline our_rand() {
-    g_seed = (214013*g_seed+2531011);
-    return (g_seed>>16)&0x7FFF;
+struct chunk {
+    const struct options *options;
+    uint64_t index;
+    uint64_t rng;
+    char *data;
+    uint64_t len;
+    uint64_t max;
+};
+
+static uint64_t next_rand(uint64_t *state) {
+    // xorshift64*
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
 }
 
-int main(int argc, char *argv[]) {
-    int newline_len;
-    char *newline;
+static double next_ratio(uint64_t *state) {
+    return (double)(next_rand(state) >> 11) / (double)(1ULL << 53);
+}
+
+static uint64_t chunk_seed(uint64_t seed, uint64_t index) {
+    // splitmix64, so neighbouring chunks do not start from related states
+    uint64_t z = seed + (index + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z = z ^ (z >> 31);
+    return z ? z : 1;
+}
+
+static void put_value(struct chunk *chunk) {
+    const struct options *options = chunk->options;
+    char *out = chunk->data + chunk->len;
+    uint64_t len = 0;
+    double kind = next_ratio(&chunk->rng);
+
+    if (kind < options->empty_ratio) {
+        return;
+    }
+
+    if (kind < options->empty_ratio + options->numeric_ratio) {
+        uint64_t r = next_rand(&chunk->rng);
+        if (r & 1) {
+            len = snprintf(out, MAX_NUMBER_SIZE, "%lld", (long long)(r >> 33) - (1LL << 29));
+        } else {
+            len = snprintf(out, MAX_NUMBER_SIZE, "%llu.%03llu", (unsigned long long)((r >> 8) % 1000000), (unsigned long long)((r >> 40) % 1000));
+        }
+        chunk->len += len;
+        return;
+    }
+
+    uint32_t word_len = options->min_word + (uint32_t)(next_rand(&chunk->rng) % (options->max_word - options->min_word + 1));
+    int quoted = next_ratio(&chunk->rng) < options->quote_ratio;
+    int escaped = quoted && next_ratio(&chunk->rng) < options->escape_ratio;
+
+    if (quoted) {
+        out[len++] = '"';
+    }
+
+    for (uint32_t i = 0; i < word_len; ++i) {
+        uint64_t r = next_rand(&chunk->rng);
+        if (escaped && (r & 0xF) == 0) {
+            char ch = ESCAPED_CHARACTERS[(r >> 4) % (sizeof(ESCAPED_CHARACTERS) - 1)];
+            out[len++] = ch;
+            if (ch == '"') {
+                out[len++] = '"';
+            }
+        } else {
+            out[len++] = CHARACTERS[(r >> 4) % (sizeof(CHARACTERS) - 1)];
+        }
+    }
+
+    if (quoted) {
+        out[len++] = '"';
+    }
+
+    chunk->len += len;
+}
+
+static uint64_t max_row_size(const struct options *options) {
+    uint64_t max_value = options->max_word * 2 + 2;
+    if (max_value < MAX_NUMBER_SIZE) {
+        max_value = MAX_NUMBER_SIZE;
+    }
+    return (max_value + 1) * options->num_columns + 2;
+}
+
+static void generate_chunk(struct chunk *chunk) {
+    const struct options *options = chunk->options;
+    uint64_t newline_len = strlen(options->newline);
+
+    chunk->rng = chunk_seed(options->seed, chunk->index);
+    chunk->len = 0;
+
+    // A row is always finished, so a chunk ends up a bit over CHUNK_SIZE
+    uint64_t target = options->size - chunk->index * CHUNK_SIZE;
+    if (target > CHUNK_SIZE) {
+        target = CHUNK_SIZE;
+    }
+
+    while (chunk->len < target) {
+        for (uint32_t column = 0; column < options->num_columns; ++column) {
+            put_value(chunk);
+            if (column + 1 != options->num_columns) {
+                chunk->data[chunk->len++] = ',';
+            }
+        }
+
+        memcpy(chunk->data + chunk->len, options->newline, newline_len);
+        chunk->len += newline_len;
+    }
+}
+
+#ifdef IS_WINDOWS
+static DWORD WINAPI generate_chunk_thread(LPVOID param) {
+    generate_chunk((struct chunk *)param);
+    return 0;
+}
+#else
+static void *generate_chunk_thread(void *param) {
+    generate_chunk((struct chunk *)param);
+    return NULL;
+}
+#endif
+
+static int parse_options(int argc, char *argv[], struct options *options) {
+    options->path = "generated.csv";
+    options->size = MB(1024);
+    options->num_columns = 500;
+    options->min_word = 4;
+    options->max_word = 300;
+    options->quote_ratio = 0.5;
+    options->escape_ratio = 0.0;
+    options->numeric_ratio = 0.0;
+    options->empty_ratio = 0.0;
 #if IS_WINDOWS
-    newline = "\r\n";
-    newline_len = 2;
+    options->newline = "\r\n";
 #else
-    newline = "\n";
-    newline_len = 1;
+    options->newline = "\n";
 #endif
-    char word[MAX_WORD_SIZE];
-    int word_len;
+    options->header = 0;
+    options->seed = 1;
+    options->num_threads = 4;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *next = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--header") == 0) {
+            options->header = 1;
+            continue;
+        }
+
+        if (!next) {
+            return 0;
+        }
+
+        if (strcmp(arg, "-o") == 0) {
+            options->path = next;
+        } else if (strcmp(arg, "--size") == 0) {
+            options->size = MB(strtoull(next, NULL, 10));
+        } else if (strcmp(arg, "--columns") == 0) {
+            options->num_columns = (uint32_t)strtoul(next, NULL, 10);
+        } else if (strcmp(arg, "--min-word") == 0) {
+            options->min_word = (uint32_t)strtoul(next, NULL, 10);
+        } else if (strcmp(arg, "--max-word") == 0) {
+            options->max_word = (uint32_t)strtoul(next, NULL, 10);
+        } else if (strcmp(arg, "--quote-ratio") == 0) {
+            options->quote_ratio = atof(next);
+        } else if (strcmp(arg, "--escape-ratio") == 0) {
+            options->escape_ratio = atof(next);
+        } else if (strcmp(arg, "--numeric-ratio") == 0) {
+            options->numeric_ratio = atof(next);
+        } else if (strcmp(arg, "--empty-ratio") == 0) {
+            options->empty_ratio = atof(next);
+        } else if (strcmp(arg, "--line-ending") == 0) {
+            if (strcmp(next, "crlf") == 0) {
+                options->newline = "\r\n";
+            } else if (strcmp(next, "lf") == 0) {
+                options->newline = "\n";
+            } else {
+                return 0;
+            }
+        } else if (strcmp(arg, "--seed") == 0) {
+            options->seed = strtoull(next, NULL, 10);
+        } else if (strcmp(arg, "--threads") == 0) {
+            options->num_threads = (uint32_t)strtoul(next, NULL, 10);
+        } else {
+            return 0;
+        }
+        ++i;
+    }
+
+    return options->num_columns > 0 && options->min_word <= options->max_word && options->size > 0 &&
+           options->num_threads > 0 && options->num_threads <= MAX_THREADS;
+}
+
+int main(int argc, char *argv[]) {
+    struct options options;
+    if (!parse_options(argc, argv, &options)) {
+        printf("Usage: %s [-o PATH] [--size MB] [--columns N] [--min-word N] [--max-word N] [--quote-ratio F] [--escape-ratio F]\n"
+               "       [--numeric-ratio F] [--empty-ratio F] [--line-ending lf|crlf] [--header] [--seed N] [--threads N]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
 
-    FILE *fh = fopen("generated.csv", "wb");
+    FILE *fh = fopen(options.path, "wb");
     if (!fh) {
-        printf("Unable to create or open generated.csv\n");
+        printf("Unable to create or open %s\n", options.path);
         return EXIT_FAILURE;
     }
 
-    setvbuf(fh, NULL, _IOFBF, 1024 * 1024 * 1024);
+    if (options.header) {
+        for (uint32_t column = 0; column < options.num_columns; ++column) {
+            fprintf(fh, column + 1 == options.num_columns ? "column%u" : "column%u,", column + 1);
+        }
+        fputs(options.newline, fh);
+    }
 
-    g_seed = time(NULL);
+    struct chunk *chunks = (struct chunk *)calloc(options.num_threads, sizeof(*chunks));
+    if (!chunks) {
+        printf("Unable to allocate memory for the chunks\n");
+        return EXIT_FAILURE;
+    }
 
-    for (unsigned long long row = 0; row < NUM_ROWS; ++row) {
-        for (unsigned long long column = 0; column < NUM_COLUMNS; ++column) {
-            int quoted = our_rand() % 2;
-            word_len = (our_rand() % (MAX_WORD_SIZE - MIN_WORD_SIZE)) + MIN_WORD_SIZE;
+    for (uint32_t t = 0; t < options.num_threads; ++t) {
+        chunks[t].options = &options;
+        chunks[t].max = CHUNK_SIZE + max_row_size(&options);
+        chunks[t].data = (char *)malloc(chunks[t].max);
+        if (!chunks[t].data) {
+            printf("Unable to allocate memory for a chunk of %llu bytes\n", (unsigned long long)chunks[t].max);
+            return EXIT_FAILURE;
+        }
+    }
 
-            for (int i = 0; i < word_len; ++i) {
-                word[i] = CHARACTERS[our_rand() % (sizeof(CHARACTERS) - 1)];
-            }
+    uint64_t num_chunks = (options.size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    uint64_t bytes_written = 0;
 
-            if (quoted) {
-                word[0] = '\"';
-                word[word_len - 1] = '\"';
-            }
+    // Generate a round of chunks in parallel, then write them in order
+    for (uint64_t first = 0; first < num_chunks; first += options.num_threads) {
+        uint32_t num_in_round = 0;
+#ifdef IS_WINDOWS
+        HANDLE threads[MAX_THREADS];
+#else
+        pthread_t threads[MAX_THREADS];
+#endif
 
-            fwrite(word, 1, word_len, fh);
-            if (column + 1 != NUM_COLUMNS) {
-                fwrite(",", 1, 1, fh);
-            }
+        for (uint32_t t = 0; t < options.num_threads && first + t < num_chunks; ++t) {
+            chunks[t].index = first + t;
+#ifdef IS_WINDOWS
+            threads[t] = CreateThread(NULL, 0, generate_chunk_thread, &chunks[t], 0, NULL);
+#else
+            pthread_create(&threads[t], NULL, generate_chunk_thread, &chunks[t]);
+#endif
+            ++num_in_round;
         }
-        fwrite(newline, 1, newline_len, fh);
 
-        if (row % 10000 == 0) {
-            printf("%llu rows written\n", row);
+        for (uint32_t t = 0; t < num_in_round; ++t) {
+#ifdef IS_WINDOWS
+            WaitForSingleObject(threads[t], INFINITE);
+            CloseHandle(threads[t]);
+#else
+            pthread_join(threads[t], NULL);
+#endif
+            if (fwrite(chunks[t].data, 1, chunks[t].len, fh) != chunks[t].len) {
+                printf("Unable to write to %s\n", options.path);
+                return EXIT_FAILURE;
+            }
+            bytes_written += chunks[t].len;
         }
+
+        printf("%llu MB written\n", (unsigned long long)(bytes_written / MB(1)));
     }
 
     fclose(fh);
@@ -17,6 +17,58 @@
  *    USE "value" here
  *   }
  *
+ *   Define ITJ_CSV_STATS to have the parser count bytes scanned and consumed, rescans, pump copies,
+ *   quoted values and value lengths, then read them with itj_csv_get_stats()
+ *
+ *   The _strict kernels, or itj_csv_select_kernel() with ITJ_CSV_KERNEL_STRICT, stop at malformed data
+ *   by returning need_data, after which the pump returns 0. itj_csv_get_error() has the kind of error,
+ *   its byte offset, row and column. The pump also records a value too big for the read buffer
+ *
+ *   itj_csv_set_skip_lines() makes the kernels skip a preamble of N lines, blank lines and comment lines
+ *
+ *   itj_csv_buffer_alloc() allocates a read buffer on huge pages when it can, aligned and with the slack
+ *   the SIMD kernels need. ITJ_CSV_PREFETCH_DISTANCE sets how far ahead the SIMD loops prefetch
+ *
+ *   itj_csv_read_header() reads the next row as the header, then itj_csv_column_index(csv, "name", len)
+ *   finds a column by name in constant time. itj_csv_free_header() frees it
+ *
+ *   itj_csv_count_records() counts records, newlines outside quotes, much faster than parsing.
+ *   itj_csv_count_records_parallel(), _fp() and _file() do the same over threads, a FILE or a mapped file
+ *
+ *   itj_csv_ingest_files() parses a list of files on a pool of workers within a read buffer memory budget,
+ *   handing values to a callback with the worker index, and reports bytes and time per file and overall
+ *
+ *   itj_csv_parse_s64() and itj_csv_parse_f64() convert a value to a number without copying it, and
+ *   their _batch() versions convert a whole numeric row or column, with SIMD for short values
+ *   itj_csv_parse_timestamp() converts an ISO 8601 date or timestamp to nanoseconds since the epoch
+ *
+ *   itj_csv_intern() gives each distinct string a small integer code, keeping one copy of it.
+ *   itj_csv_load_table() loads a whole file into columns laid out as Arrow arrays, strings, dictionary
+ *   encoded strings, integers, floats or timestamps, each with a validity bitmap
+ *   itj_csv_save_table_cache() writes a table to a binary file that itj_csv_open_table_cache() maps back
+ *   without parsing, as long as the CSV file it came from has not changed since
+ *   itj_csv_table_stamp_source() stamped it before loading
+ *   itj_csv_export_table() hands a table to Arrow through the C data interface, without copying it
+ *
+ *   itj_csv_group_by_run() counts rows and sums, min and max values per distinct key as it parses, in memory
+ *   that grows with the keys and not the rows. itj_csv_group_by_parallel() does it over threads and merges
+ *
+ *   itj_csv_sort_file() sorts a CSV file by a column, however big, within a memory budget
+ *
+ *   itj_csv_find_tail() and itj_csv_find_tail_file() find where the last n records start, scanning back from
+ *   the end, so showing the end of a big file costs what those records take to read
+ *
+ *   itj_csv_seek_bytes() and itj_csv_set_end_bytes() limit csv to the records that start in a byte range,
+ *   so readers given ranges that meet end to end read every record once
+ *
+ *   itj_csv_sniff() guesses the delimiter, quoting, line ending, header and column types
+ *   from a prefix of a file, usually whatever the first pump read
+ *
+ *   itj_csv_open_follow() and itj_csv_pump_follow() tail a file that is being appended to, waiting for more
+ *   at its end and holding back a last record that has no newline yet
+ *
+ *   itj_csv.hpp wraps all of this for C++, with range for loops over rows and fields
+ *
  *   KNOWN ISSUES: It expects an ending newline, and not just end of file
  */
 
@@ -79,8 +131,144 @@ typedef itj_csv_u32 itj_csv_umax;
 #define ITJ_CSV_MEMCPY(dst, src, size) memcpy(dst, src, size)
 #endif
 
+#ifndef ITJ_CSV_MEMSET
+#include <string.h>
+#define ITJ_CSV_MEMSET(dst, value, size) memset(dst, value, size)
+#endif
+
+#ifndef ITJ_CSV_MEMMOVE
+#include <string.h>
+#define ITJ_CSV_MEMMOVE(dst, src, size) memmove(dst, src, size)
+#endif
+
+#ifndef ITJ_CSV_MEMCMP
+#include <string.h>
+#define ITJ_CSV_MEMCMP(a, b, size) memcmp(a, b, size)
+#endif
+
 #define ITJ_CSV_DELIM_COMMA ','
 #define ITJ_CSV_DELIM_COLON ';'
+#define ITJ_CSV_DELIM_TAB '\t'
+#define ITJ_CSV_DELIM_PIPE '|'
+
+#ifdef _MSC_VER
+#define ITJ_CSV_INLINE static __forceinline
+#else
+#define ITJ_CSV_INLINE static inline __attribute__((always_inline))
+#endif
+
+// Define ITJ_CSV_STATS to count what the parser does, otherwise the counting compiles to nothing.
+// The SIMD kernels return what their parser returns when nothing is counted or checked after it. A value
+// kept in a local and copied out is built with narrow stores and read back with wide loads, which the
+// store buffer can not forward, and that stall on every value made the specialized kernels the slowest
+#ifdef ITJ_CSV_STATS
+#define ITJ_CSV_STAT(...) __VA_ARGS__
+#define ITJ_CSV_STATS_ENABLED 1
+#else
+#define ITJ_CSV_STAT(...)
+#define ITJ_CSV_STATS_ENABLED 0
+#endif
+
+// How many bytes the SIMD scanners look at in one go. Masks are one bit per byte
+#define ITJ_CSV_BLOCK_SIZE 32
+
+#ifndef ITJ_CSV_SNIFF_MAX_LINES
+#define ITJ_CSV_SNIFF_MAX_LINES 256
+#endif
+
+#ifndef ITJ_CSV_SNIFF_MAX_COLUMNS
+#define ITJ_CSV_SNIFF_MAX_COLUMNS 256
+#endif
+
+#ifndef ITJ_CSV_MAX_THREADS
+#define ITJ_CSV_MAX_THREADS 64
+#endif
+
+// Read buffer memory of itj_csv_ingest_files when the caller does not give a budget
+#ifndef ITJ_CSV_INGEST_BUDGET
+#define ITJ_CSV_INGEST_BUDGET (64 << 20)
+#endif
+
+// itj_csv_ingest_files runs fewer workers rather than give one a smaller buffer than this
+#ifndef ITJ_CSV_INGEST_MIN_BUFFER
+#define ITJ_CSV_INGEST_MIN_BUFFER (64 << 10)
+#endif
+
+// How often itj_csv_pump_follow looks for more data when it can not use inotify
+#ifndef ITJ_CSV_FOLLOW_POLL_MS
+#define ITJ_CSV_FOLLOW_POLL_MS 1
+#endif
+
+// Key and value columns one itj_csv_group_by can have, each
+#ifndef ITJ_CSV_GROUP_BY_MAX_COLUMNS
+#define ITJ_CSV_GROUP_BY_MAX_COLUMNS 16
+#endif
+
+// Memory itj_csv_sort_file sorts rows in at once when the caller does not give a budget
+#ifndef ITJ_CSV_SORT_BUDGET
+#define ITJ_CSV_SORT_BUDGET (256 << 20)
+#endif
+
+// itj_csv_sort_file goes over its memory budget rather than merge more sorted runs than this at once
+#ifndef ITJ_CSV_SORT_MAX_RUNS
+#define ITJ_CSV_SORT_MAX_RUNS 512
+#endif
+
+#define ITJ_CSV_NO_END ((itj_csv_umax)-1)
+
+// How far past an offset itj_csv_resync looks at quotes to tell if the offset is inside quotes
+#ifndef ITJ_CSV_RESYNC_WINDOW
+#define ITJ_CSV_RESYNC_WINDOW (64 << 10)
+#endif
+
+// How much itj_csv_find_tail_file reads at a time, going back from the end of the file
+#ifndef ITJ_CSV_TAIL_BLOCK
+#define ITJ_CSV_TAIL_BLOCK (64 << 10)
+#endif
+
+// Below this many bytes per thread the parallel functions use fewer threads
+#ifndef ITJ_CSV_MIN_THREAD_BYTES
+#define ITJ_CSV_MIN_THREAD_BYTES (1 << 20)
+#endif
+
+// How far ahead of the load the SIMD loops prefetch, in bytes. Off by default, as the hardware
+// prefetchers keep up with a straight scan on the machines measured so far. Try 256 to 1024
+#ifndef ITJ_CSV_PREFETCH_DISTANCE
+#define ITJ_CSV_PREFETCH_DISTANCE 0
+#endif
+
+#if ITJ_CSV_PREFETCH_DISTANCE > 0 && (defined(ITJ_CSV_IMPLEMENTATION_AVX) || defined(ITJ_CSV_IMPLEMENTATION_AVX2))
+#define ITJ_CSV_PREFETCH(p) _mm_prefetch((const char *)(p) + ITJ_CSV_PREFETCH_DISTANCE, _MM_HINT_T0)
+#else
+#define ITJ_CSV_PREFETCH(p)
+#endif
+
+#define ITJ_CSV_BUFFER_ALIGNMENT 64
+
+#define ITJ_CSV_KERNEL_DEFAULT 0x0
+#define ITJ_CSV_KERNEL_LF_ONLY 0x1 // Only \n ends a line, a \r is part of the value
+#define ITJ_CSV_KERNEL_NO_QUOTES 0x2 // A quote is part of the value, values are never quoted
+#define ITJ_CSV_KERNEL_STRICT 0x4 // Malformed data is an error, see itj_csv_get_error
+
+// The kernels specialized at compile time, for every implementation, as X(name, delimiter, flags).
+// Each becomes itj_csv_get_next_value_<name>, itj_csv_get_next_value_avx_<name> and itj_csv_get_next_value_avx2_<name>.
+// Others can be made with ITJ_CSV_DEFINE_KERNEL, ITJ_CSV_DEFINE_KERNEL_AVX and ITJ_CSV_DEFINE_KERNEL_AVX2
+#define ITJ_CSV_KERNELS(X) \
+    X(comma, ITJ_CSV_DELIM_COMMA, ITJ_CSV_KERNEL_DEFAULT) \
+    X(comma_lf, ITJ_CSV_DELIM_COMMA, ITJ_CSV_KERNEL_LF_ONLY) \
+    X(comma_no_quotes, ITJ_CSV_DELIM_COMMA, ITJ_CSV_KERNEL_NO_QUOTES) \
+    X(comma_lf_no_quotes, ITJ_CSV_DELIM_COMMA, ITJ_CSV_KERNEL_LF_ONLY | ITJ_CSV_KERNEL_NO_QUOTES) \
+    X(colon, ITJ_CSV_DELIM_COLON, ITJ_CSV_KERNEL_DEFAULT) \
+    X(colon_lf, ITJ_CSV_DELIM_COLON, ITJ_CSV_KERNEL_LF_ONLY) \
+    X(colon_no_quotes, ITJ_CSV_DELIM_COLON, ITJ_CSV_KERNEL_NO_QUOTES) \
+    X(colon_lf_no_quotes, ITJ_CSV_DELIM_COLON, ITJ_CSV_KERNEL_LF_ONLY | ITJ_CSV_KERNEL_NO_QUOTES) \
+    X(tab, ITJ_CSV_DELIM_TAB, ITJ_CSV_KERNEL_DEFAULT) \
+    X(tab_lf, ITJ_CSV_DELIM_TAB, ITJ_CSV_KERNEL_LF_ONLY) \
+    X(tab_no_quotes, ITJ_CSV_DELIM_TAB, ITJ_CSV_KERNEL_NO_QUOTES) \
+    X(tab_lf_no_quotes, ITJ_CSV_DELIM_TAB, ITJ_CSV_KERNEL_LF_ONLY | ITJ_CSV_KERNEL_NO_QUOTES) \
+    X(comma_strict, ITJ_CSV_DELIM_COMMA, ITJ_CSV_KERNEL_STRICT) \
+    X(colon_strict, ITJ_CSV_DELIM_COLON, ITJ_CSV_KERNEL_STRICT) \
+    X(tab_strict, ITJ_CSV_DELIM_TAB, ITJ_CSV_KERNEL_STRICT)
 
 typedef enum itj_csv_state_name {
     ITJ_CSV_STATE_NORMAL,
@@ -88,6 +276,26 @@ typedef enum itj_csv_state_name {
     ITJ_CSV_STATE_EOF,
 } itj_csv_state_name_t;
 
+// Ordered from least to most general, so merging two guesses is taking the max
+typedef enum itj_csv_type {
+    ITJ_CSV_TYPE_EMPTY,
+    ITJ_CSV_TYPE_INTEGER,
+    ITJ_CSV_TYPE_FLOAT,
+    ITJ_CSV_TYPE_STRING,
+} itj_csv_type_t;
+
+typedef struct itj_csv_dialect {
+    itj_csv_u8 delimiter;
+    itj_csv_bool has_quotes;
+    itj_csv_bool is_crlf;
+    itj_csv_bool has_header;
+    itj_csv_u32 bom_len; // A UTF-8 byte order mark is 3 bytes
+    itj_csv_u32 skip_lines; // Physical lines before the header, or first record if there is no header
+    itj_csv_u32 num_columns;
+    itj_csv_u32 num_sampled_lines;
+    itj_csv_u8 column_types[ITJ_CSV_SNIFF_MAX_COLUMNS]; // itj_csv_type_t, one per column
+} itj_csv_dialect_t;
+
 typedef struct itj_csv_string {
     itj_csv_u8 *base;
     itj_csv_u32 len;
@@ -97,9 +305,43 @@ typedef struct itj_csv_value {
     struct itj_csv_string data;
     itj_csv_bool is_end_of_line;
     itj_csv_bool need_data;
-    itj_csv_umax idx;
+    itj_csv_umax row; // Counting from 0, including any header
+    itj_csv_u32 column;
 } itj_csv_value_t;
 
+// Bucket 0 is empty values, bucket n holds lengths in [2^(n-1), 2^n)
+#define ITJ_CSV_STATS_LEN_BUCKETS 33
+
+struct itj_csv_header;
+
+typedef enum itj_csv_error_kind {
+    ITJ_CSV_ERROR_NONE,
+    ITJ_CSV_ERROR_QUOTE_IN_VALUE, // A quote inside a value that does not start with one
+    ITJ_CSV_ERROR_TEXT_AFTER_QUOTE, // Something other than a delimiter or a line ending after a closing quote
+    ITJ_CSV_ERROR_UNTERMINATED_QUOTE, // The data ends inside quotes
+    ITJ_CSV_ERROR_FIELD_COUNT, // A row with another number of values than the first row
+    ITJ_CSV_ERROR_VALUE_TOO_BIG, // A value does not fit in the read buffer
+} itj_csv_error_kind_t;
+
+typedef struct itj_csv_error {
+    itj_csv_error_kind_t kind;
+    itj_csv_umax offset; // From the start of the data, at the start of the bad value or at the bad byte
+    itj_csv_umax row;
+    itj_csv_u32 column;
+} itj_csv_error_t;
+
+typedef struct itj_csv_stats {
+    itj_csv_umax values;
+    itj_csv_umax bytes_scanned; // Includes scanning a value again after need_data
+    itj_csv_umax bytes_consumed;
+    itj_csv_umax rescans; // Values that ran out of data and are scanned again after a pump
+    itj_csv_umax pumps;
+    itj_csv_umax pump_bytes_moved; // A partial value copied to the start of the buffer
+    itj_csv_umax quoted_values;
+    itj_csv_umax contracted_quotes; // Doubled quotes turned into one
+    itj_csv_umax len_histogram[ITJ_CSV_STATS_LEN_BUCKETS];
+} itj_csv_stats_t;
+
 typedef struct itj_csv {
     itj_csv_u8 delimiter;
     itj_csv_umax read_iter;
@@ -107,13 +349,266 @@ typedef struct itj_csv {
     itj_csv_u8 *read_base;
     itj_csv_umax read_max;
     itj_csv_umax read_used;
-    itj_csv_umax idx;
+    itj_csv_umax row; // Of the next value
+    itj_csv_u32 column;
+    itj_csv_bool eof; // Nothing comes after read_used, so a value may end at the end of the data
+    itj_csv_umax base_offset; // Of read_base[0] from the start of the data
+    itj_csv_u32 num_columns; // Of the first row, once the strict kernels have seen it
+    struct itj_csv_error error;
+    itj_csv_u32 skip_lines; // Physical lines still to skip, see itj_csv_set_skip_lines
+    itj_csv_u8 comment; // Rows starting with it are skipped, 0 for none
+    itj_csv_bool skip_blank_lines;
+    itj_csv_bool skipping; // Any of the above are set, the kernels check it at the start of a row
+    itj_csv_bool in_skipped_line; // The line being skipped goes on in the next pump
     void *user_mem_ptr;
+    struct itj_csv_header *header; // From itj_csv_read_header
+    itj_csv_bool follow; // The file may grow, so its end is not the end of the data, see itj_csv_open_follow
+    itj_csv_bool follow_split; // itj_csv_pump_follow handed out a full buffer that ends inside a record
+    itj_csv_umax follow_scanned; // Bytes it gave back to the file, known to hold no newline outside quotes
+    itj_csv_u32 follow_quotes; // The quote state after those bytes
+    itj_csv_umax end_offset; // From the start of the data, where itj_csv_set_end_bytes ends it, or ITJ_CSV_NO_END
 #ifndef ITJ_CSV_NO_STD
     FILE *fh;
+    int follow_fd; // inotify, -1 when polling
+#endif
+#ifdef ITJ_CSV_STATS
+    struct itj_csv_stats stats;
 #endif
 } itj_csv_t;
 
+typedef struct itj_csv_value (*itj_csv_kernel_fn)(struct itj_csv *csv);
+
+typedef struct itj_csv_mapping {
+    itj_csv_u8 *data;
+    itj_csv_umax len;
+#ifdef _WIN32
+    void *file_handle;
+    void *mapping_handle;
+#endif
+} itj_csv_mapping_t;
+
+typedef void (*itj_csv_thread_fn)(void *arg);
+
+typedef enum itj_csv_buffer_kind {
+    ITJ_CSV_BUFFER_NONE,
+    ITJ_CSV_BUFFER_HUGETLB, // Explicit huge pages, MAP_HUGETLB or MEM_LARGE_PAGES
+    ITJ_CSV_BUFFER_TRANSPARENT, // Huge page aligned, with transparent huge pages asked for
+    ITJ_CSV_BUFFER_PAGES, // Plain pages from mmap or VirtualAlloc
+    ITJ_CSV_BUFFER_HEAP, // ITJ_CSV_ALLOC, aligned by hand
+} itj_csv_buffer_kind_t;
+
+typedef struct itj_csv_buffer {
+    itj_csv_u8 *data; // ITJ_CSV_BUFFER_ALIGNMENT aligned, zeroed, with ITJ_CSV_BLOCK_SIZE bytes of slack after size
+    itj_csv_umax size;
+    itj_csv_buffer_kind_t kind;
+    void *allocation;
+    itj_csv_umax allocation_size;
+} itj_csv_buffer_t;
+
+typedef struct itj_csv_ingest_stats {
+    itj_csv_umax bytes;
+    itj_csv_umax values;
+    itj_csv_umax rows; // Values that end a line
+    itj_csv_u64 nanoseconds;
+    itj_csv_u32 worker; // That read the file
+    itj_csv_bool opened;
+    itj_csv_bool stopped; // By the value callback returning false
+    struct itj_csv_error error;
+} itj_csv_ingest_stats_t;
+
+// Called on the worker thread, so the callbacks of different workers run at the same time
+typedef itj_csv_bool (*itj_csv_ingest_open_fn)(void *user, itj_csv_u32 worker, itj_csv_u32 file, struct itj_csv *csv);
+typedef itj_csv_bool (*itj_csv_ingest_value_fn)(void *user, itj_csv_u32 worker, itj_csv_u32 file, struct itj_csv *csv, struct itj_csv_value *value);
+typedef void (*itj_csv_ingest_done_fn)(void *user, itj_csv_u32 worker, itj_csv_u32 file, const struct itj_csv_ingest_stats *stats);
+
+typedef struct itj_csv_ingest {
+    const char *const *paths; // Null terminated
+    itj_csv_u32 num_files;
+    itj_csv_u32 num_workers; // 0 means one per cpu
+    itj_csv_umax memory_budget; // For the read buffers of all workers together, 0 means ITJ_CSV_INGEST_BUDGET
+    itj_csv_u8 delimiter;
+    itj_csv_kernel_fn kernel; // NULL means itj_csv_select_kernel(delimiter, ITJ_CSV_KERNEL_DEFAULT)
+    itj_csv_ingest_open_fn on_open; // Optional, after the first pump. Returning false skips the file
+    itj_csv_ingest_value_fn on_value; // Returning false stops the file
+    itj_csv_ingest_done_fn on_done; // Optional
+    void *user;
+    void *user_mem_ptr;
+    struct itj_csv_ingest_stats *file_stats; // Optional, num_files of them
+} itj_csv_ingest_t;
+
+typedef struct itj_csv_ingest_result {
+    struct itj_csv_ingest_stats total; // nanoseconds is the wall time of the whole run
+    itj_csv_u32 failed_files; // Not opened, or stopped at an error
+    itj_csv_u32 num_workers;
+    itj_csv_umax buffer_size; // Of each worker
+    itj_csv_umax memory_used; // By the read buffers of all workers, slack and alignment included
+} itj_csv_ingest_result_t;
+
+// Unique strings with a small code each, in the order they were first seen. The strings are laid out
+// as an Arrow string array, string i is from offsets[i] to offsets[i + 1] in the arena
+typedef struct itj_csv_intern {
+    itj_csv_s32 *offsets; // num_strings + 1 of them
+    itj_csv_u8 *arena;
+    itj_csv_u64 *hashes; // One per string, for growing the slots without hashing again
+    itj_csv_u32 *slots; // Code + 1, 0 for a free slot, probed linearly
+    itj_csv_u32 num_strings;
+    itj_csv_u32 strings_max;
+    itj_csv_u32 num_slots; // Powers of two, at most half full
+    itj_csv_umax arena_used;
+    itj_csv_umax arena_max;
+    void *user_mem_ptr;
+} itj_csv_intern_t;
+
+typedef enum itj_csv_column_type {
+    ITJ_CSV_COLUMN_STRING, // s32 offsets, one more than the rows, into data
+    ITJ_CSV_COLUMN_DICTIONARY, // s32 codes into dictionary
+    ITJ_CSV_COLUMN_S64,
+    ITJ_CSV_COLUMN_F64,
+    ITJ_CSV_COLUMN_TIMESTAMP, // s64 nanoseconds since the epoch, UTC
+} itj_csv_column_type_t;
+
+// A column in the Arrow layout. Bit i of validity, least significant bit first, is set when row i has
+// a value. An empty number or timestamp, or one that does not convert, is a 0 with its bit clear.
+// An empty string is an empty string
+typedef struct itj_csv_column {
+    itj_csv_column_type_t type;
+    struct itj_csv_string name; // A null terminated copy of the header name, or empty without a header
+    itj_csv_u8 *validity;
+    void *values;
+    itj_csv_u8 *data; // The bytes of a string column
+    itj_csv_umax data_used;
+    itj_csv_umax data_max;
+    itj_csv_umax null_count;
+    struct itj_csv_intern dictionary;
+} itj_csv_column_t;
+
+typedef union itj_csv_number {
+    itj_csv_s64 s64;
+    double f64;
+} itj_csv_number_t;
+
+// One value column within one group, in the type of the column. count is the values that converted
+typedef struct itj_csv_accumulator {
+    itj_csv_umax count;
+    itj_csv_number_t sum;
+    itj_csv_number_t min;
+    itj_csv_number_t max;
+} itj_csv_accumulator_t;
+
+/*
+ * Aggregates value columns per distinct key, without keeping the rows. The groups are the interned
+ * keys, so a group's index is its code, and its accumulators start at accumulators[group * num_values]
+ */
+typedef struct itj_csv_group_by {
+    itj_csv_u32 key_columns[ITJ_CSV_GROUP_BY_MAX_COLUMNS];
+    itj_csv_u32 num_keys;
+    itj_csv_u32 value_columns[ITJ_CSV_GROUP_BY_MAX_COLUMNS];
+    itj_csv_column_type_t value_types[ITJ_CSV_GROUP_BY_MAX_COLUMNS]; // ITJ_CSV_COLUMN_S64 or ITJ_CSV_COLUMN_F64
+    itj_csv_u32 num_values;
+
+    struct itj_csv_intern groups;
+    itj_csv_umax *group_rows;
+    struct itj_csv_accumulator *accumulators;
+    itj_csv_u32 groups_max;
+    itj_csv_umax num_rows;
+    itj_csv_u32 num_chunks; // Parts with rows that itj_csv_group_by_parallel split the data into, each on a thread
+
+    // The row being read: what each column is for, its key parts copied out, and its converted values
+    itj_csv_u8 *roles;
+    itj_csv_u32 num_roles;
+    itj_csv_umax key_offsets[ITJ_CSV_GROUP_BY_MAX_COLUMNS]; // Into row_keys
+    itj_csv_u32 key_lens[ITJ_CSV_GROUP_BY_MAX_COLUMNS];
+    itj_csv_u8 *row_keys;
+    itj_csv_umax row_keys_used;
+    itj_csv_umax row_keys_max;
+    itj_csv_u8 *key;
+    itj_csv_umax key_max;
+    itj_csv_number_t row_values[ITJ_CSV_GROUP_BY_MAX_COLUMNS];
+    itj_csv_u32 row_valid; // Bit per value column
+    itj_csv_bool in_row;
+    void *user_mem_ptr;
+} itj_csv_group_by_t;
+
+typedef struct itj_csv_sort {
+    const char *input_path;
+    itj_csv_u32 input_path_len;
+    const char *output_path; // Sorted runs are kept next to it until the merge is done
+    itj_csv_u32 output_path_len;
+    itj_csv_u32 key_column;
+    itj_csv_column_type_t key_type; // Strings and dictionaries compare as bytes, the rest as numbers
+    itj_csv_bool descending;
+    itj_csv_bool has_header; // The first record is written first and not sorted
+    itj_csv_u8 delimiter;
+    itj_csv_kernel_fn kernel; // NULL means itj_csv_select_kernel(delimiter, ITJ_CSV_KERNEL_DEFAULT)
+    itj_csv_u32 num_threads; // 0 means one per cpu
+    itj_csv_umax memory_budget; // For the rows sorted at once, 0 means ITJ_CSV_SORT_BUDGET
+    void *user_mem_ptr;
+} itj_csv_sort_t;
+
+typedef struct itj_csv_sort_result {
+    itj_csv_umax rows; // Without the header
+    itj_csv_umax runs;
+    itj_csv_u32 threads; // Most chunks sorted at once
+    itj_csv_u64 nanoseconds;
+} itj_csv_sort_result_t;
+
+// The Arrow C data interface, https://arrow.apache.org/docs/format/CDataInterface.html, as the
+// Arrow headers declare it, so a table can be handed to Arrow without linking to it
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#include <stdint.h>
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+    const char *format;
+    const char *name;
+    const char *metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema **children;
+    struct ArrowSchema *dictionary;
+    void (*release)(struct ArrowSchema *);
+    void *private_data;
+};
+
+struct ArrowArray {
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void **buffers;
+    struct ArrowArray **children;
+    struct ArrowArray *dictionary;
+    void (*release)(struct ArrowArray *);
+    void *private_data;
+};
+
+#endif // ARROW_C_DATA_INTERFACE
+
+// What a table was loaded from, so a cache of it can tell when the file changed
+typedef struct itj_csv_source_stamp {
+    itj_csv_u64 size;
+    itj_csv_s64 mtime_ns;
+    itj_csv_u64 hash;
+} itj_csv_source_stamp_t;
+
+// Parsed rows held as columns, from itj_csv_load_table or itj_csv_table_add_value
+typedef struct itj_csv_table {
+    struct itj_csv_column *columns;
+    itj_csv_u32 num_columns;
+    itj_csv_umax num_rows;
+    itj_csv_umax rows_max;
+    itj_csv_bool in_row; // Some values of the row after the last one are in
+    void *user_mem_ptr;
+    struct itj_csv_mapping mapping; // From itj_csv_open_table_cache, the columns then point into it and are read only
+    struct itj_csv_source_stamp source; // From itj_csv_table_stamp_source or itj_csv_open_table_cache
+} itj_csv_table_t;
+
 void itj_csv_ignore_newlines(struct itj_csv *csv) {
     itj_csv_umax i;
     itj_csv_umax max = csv->read_used;
@@ -134,6 +629,12 @@ void itj_csv_ignore_newlines(struct itj_csv *csv) {
         }
     }
 
+    // The newlines ended the record, if the last value did not
+    if (i != csv->read_iter && csv->column != 0) {
+        csv->row += 1;
+        csv->column = 0;
+    }
+
     csv->read_iter = i;
 }
 
@@ -153,20 +654,282 @@ itj_csv_umax itj_csv_contract_double_quotes(itj_csv_u8 *start, itj_csv_umax max)
     return new_len;
 }
 
-#if defined(ITJ_CSV_IMPLEMENTATION_AVX) || defined(ITJ_CSV_IMPLEMENTATION_AVX2)
+#ifdef ITJ_CSV_IMPLEMENTATION
 #ifdef _MSC_VER
+#include <intrin.h>
+
 inline itj_csv_u32 itj_csv_ffs(itj_csv_u32 value) {
     unsigned long pos;
     _BitScanForward(&pos, value);
     return pos + 1;
 }
+#define itj_csv_popcount(value) __popcnt(value)
+
+inline itj_csv_u32 itj_csv_bit_width(itj_csv_u32 value) {
+    unsigned long pos;
+    return _BitScanReverse(&pos, value) ? pos + 1 : 0;
+}
 #else
 #define itj_csv_ffs(value) __builtin_ffs(value)
+#define itj_csv_popcount(value) __builtin_popcount(value)
+#define itj_csv_bit_width(value) ((value) ? 32 - __builtin_clz(value) : 0)
+#endif
+
+// Moves on to the position of the next value, the first column of the next row after an end of line
+ITJ_CSV_INLINE void itj_csv_next_position(struct itj_csv *csv, itj_csv_bool is_end_of_line) {
+    csv->row += is_end_of_line;
+    csv->column = is_end_of_line ? 0 : csv->column + 1;
+}
+
+#ifdef ITJ_CSV_STATS
+// Called after every kernel call. A kernel sets prev_read_iter to where it started
+ITJ_CSV_INLINE void itj_csv_stat_value(struct itj_csv *csv, const struct itj_csv_value *value) {
+    if (value->need_data) {
+        // Running out of data at the end of the input is not followed by a rescan
+        csv->stats.rescans += !csv->eof;
+        csv->stats.bytes_scanned += csv->read_used - csv->read_iter;
+        return;
+    }
+
+    itj_csv_umax consumed = csv->read_iter - csv->prev_read_iter;
+    csv->stats.values += 1;
+    csv->stats.bytes_scanned += consumed;
+    csv->stats.bytes_consumed += consumed;
+    csv->stats.len_histogram[itj_csv_bit_width(value->data.len)] += 1;
+}
 #endif
+
+// Bit n is set when byte n of the ITJ_CSV_BLOCK_SIZE bytes at p equals ch.
+// All of the block must be readable, the scanners copy the tail of a buffer into a padded block
+ITJ_CSV_INLINE itj_csv_u32 itj_csv_byte_mask(const itj_csv_u8 *p, itj_csv_u8 ch) {
+#if defined(ITJ_CSV_IMPLEMENTATION_AVX2)
+    __m256i b = _mm256_loadu_si256((const __m256i *)p);
+    return (itj_csv_u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, _mm256_set1_epi8(ch)));
+#elif defined(ITJ_CSV_IMPLEMENTATION_AVX)
+    __m128i c = _mm_set1_epi8(ch);
+    itj_csv_u32 lo = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), c));
+    itj_csv_u32 hi = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 16)), c));
+    return lo | (hi << 16);
+#else
+    itj_csv_u32 mask = 0;
+    for (itj_csv_u32 i = 0; i < ITJ_CSV_BLOCK_SIZE; ++i) {
+        mask |= (itj_csv_u32)(p[i] == ch) << i;
+    }
+    return mask;
 #endif
+}
+
+// Bit n is set when there is an odd number of bits set at or below n
+ITJ_CSV_INLINE itj_csv_u32 itj_csv_prefix_xor(itj_csv_u32 mask) {
+    mask ^= mask << 1;
+    mask ^= mask << 2;
+    mask ^= mask << 4;
+    mask ^= mask << 8;
+    mask ^= mask << 16;
+    return mask;
+}
+
+// Turns a mask of quotation marks into a mask of the bytes between them. The opening quote is
+// part of the quoted bytes, the closing one is not. *inside_quotes carries the state between blocks
+ITJ_CSV_INLINE itj_csv_u32 itj_csv_quoted_mask(itj_csv_u32 quotes, itj_csv_u32 *inside_quotes) {
+    itj_csv_u32 quoted = itj_csv_prefix_xor(quotes) ^ (0u - *inside_quotes);
+    *inside_quotes = quoted >> 31;
+    return quoted;
+}
+
+// The index of the first '\n' in [i, max), or max. Whole blocks only, so it never reads past max
+ITJ_CSV_INLINE itj_csv_umax itj_csv_find_newline(const itj_csv_u8 *base, itj_csv_umax i, itj_csv_umax max) {
+    for (; i + ITJ_CSV_BLOCK_SIZE <= max; i += ITJ_CSV_BLOCK_SIZE) {
+        itj_csv_u32 mask = itj_csv_byte_mask(base + i, '\n');
+        if (mask) {
+            return i + itj_csv_ffs(mask) - 1;
+        }
+    }
+    for (; i < max && base[i] != '\n'; ++i) {
+    }
+    return i;
+}
+
+/*
+ * Called by the kernels at the start of a row when csv->skipping is set. Skips the physical lines
+ * left in csv->skip_lines, then blank lines and lines starting with csv->comment, moving read_iter
+ * past them. Returns where the row starts, or read_used when it needs more data
+ */
+static itj_csv_umax itj_csv_skip_lines_at_row_start(struct itj_csv *csv) {
+    itj_csv_u8 *base = csv->read_base;
+    itj_csv_umax max = csv->read_used;
+    itj_csv_umax i = csv->read_iter;
+
+    for (;;) {
+        if (csv->in_skipped_line) {
+            i = itj_csv_find_newline(base, i, max);
+            if (i == max) {
+                // The rest of the line is in the next pump, nothing here needs keeping
+                csv->read_iter = max;
+                return max;
+            }
+            i += 1;
+            csv->read_iter = i;
+            csv->in_skipped_line = ITJ_CSV_FALSE;
+            continue;
+        }
+
+        if (i >= max) {
+            return max;
+        }
+
+        itj_csv_u8 ch = base[i];
+        if (csv->skip_lines > 0) {
+            csv->skip_lines -= 1;
+            csv->in_skipped_line = ITJ_CSV_TRUE;
+        } else if (csv->comment && ch == csv->comment) {
+            csv->in_skipped_line = ITJ_CSV_TRUE;
+        } else if (csv->skip_blank_lines && ch == '\n') {
+            i += 1;
+            csv->read_iter = i;
+        } else if (csv->skip_blank_lines && ch == '\r') {
+            if (i + 1 == max) {
+                return max;
+            }
+            if (base[i + 1] != '\n') {
+                break;
+            }
+            i += 2;
+            csv->read_iter = i;
+        } else {
+            break;
+        }
+    }
+
+    if (csv->skip_lines == 0 && !csv->comment && !csv->skip_blank_lines) {
+        csv->skipping = ITJ_CSV_FALSE;
+    }
+    return i;
+}
+#endif // ITJ_CSV_IMPLEMENTATION
 
 #ifdef ITJ_CSV_IMPLEMENTATION
-struct itj_csv_value itj_csv_parse_quotes(struct itj_csv *csv, itj_csv_umax i) {
+
+// Records an error at byte i of the read buffer for the value at the current position. The value
+// comes back as need_data without consuming anything, and itj_csv_pump_stdio will not read on
+static struct itj_csv_value itj_csv_fail(struct itj_csv *csv, itj_csv_error_kind_t kind, itj_csv_umax i, struct itj_csv_value rv) {
+    csv->read_iter = csv->prev_read_iter;
+    csv->error.kind = kind;
+    csv->error.offset = csv->base_offset + i;
+    csv->error.row = csv->row;
+    csv->error.column = csv->column;
+    rv.need_data = ITJ_CSV_TRUE;
+    return rv;
+}
+
+// Every row must have as many values as the first. Called by the strict kernels once the position has moved past rv
+ITJ_CSV_INLINE struct itj_csv_value itj_csv_strict_check_row(struct itj_csv *csv, struct itj_csv_value rv) {
+    if (rv.need_data) {
+        return rv;
+    }
+
+    itj_csv_u32 num_values = rv.column + 1;
+    if (rv.is_end_of_line) {
+        if (csv->num_columns == 0) {
+            csv->num_columns = num_values;
+            return rv;
+        }
+        if (num_values == csv->num_columns) {
+            return rv;
+        }
+    } else if (csv->num_columns == 0 || num_values <= csv->num_columns) {
+        return rv;
+    }
+
+    csv->row = rv.row;
+    csv->column = rv.column;
+    return itj_csv_fail(csv, ITJ_CSV_ERROR_FIELD_COUNT, csv->prev_read_iter, rv);
+}
+
+// The end of a strict quoted value, from its closing quote at i, shared by the scalar and SIMD scans for it
+ITJ_CSV_INLINE struct itj_csv_value itj_csv_end_quotes_strict(struct itj_csv *csv, struct itj_csv_value rv, itj_csv_umax i, itj_csv_u8 delimiter, itj_csv_bool got_doubles) {
+    itj_csv_umax max = csv->read_used;
+    i += 1; // Past the closing quote
+    if (i < max) {
+        itj_csv_u8 ch = csv->read_base[i];
+        if (ch == delimiter) {
+            i += 1;
+        } else if (ch == '\n') {
+            rv.is_end_of_line = ITJ_CSV_TRUE;
+            i += 1;
+        } else if (ch == '\r' && i + 1 == max && !csv->eof) {
+            rv.need_data = ITJ_CSV_TRUE;
+            return rv;
+        } else if (ch == '\r' && i + 1 < max && csv->read_base[i + 1] == '\n') {
+            rv.is_end_of_line = ITJ_CSV_TRUE;
+            i += 2;
+        } else {
+            return itj_csv_fail(csv, ITJ_CSV_ERROR_TEXT_AFTER_QUOTE, i, rv);
+        }
+    } else if (!csv->eof) {
+        rv.need_data = ITJ_CSV_TRUE;
+        return rv;
+    }
+
+    if (got_doubles) {
+        itj_csv_umax new_len = itj_csv_contract_double_quotes(rv.data.base, rv.data.len);
+        ITJ_CSV_STAT(csv->stats.contracted_quotes += rv.data.len - new_len);
+        rv.data.len = new_len;
+    }
+    ITJ_CSV_STAT(csv->stats.quoted_values += 1);
+
+    csv->read_iter = i;
+    return rv;
+}
+
+/*
+ * The strict kernels parse quoted values here. Unlike itj_csv_parse_quotes, only a delimiter or a line
+ * ending may follow the closing quote, and running out of data inside quotes at the end of the file is an error
+ */
+struct itj_csv_value itj_csv_parse_quotes_strict(struct itj_csv *csv, itj_csv_umax i, itj_csv_u8 delimiter) {
+    csv->prev_read_iter = csv->read_iter;
+    struct itj_csv_value rv;
+    itj_csv_umax quote = i;
+    i += 1;
+    rv.data.base = &csv->read_base[i];
+    rv.data.len = 0;
+    rv.is_end_of_line = ITJ_CSV_FALSE;
+    rv.need_data = ITJ_CSV_FALSE;
+    rv.row = csv->row;
+    rv.column = csv->column;
+
+    itj_csv_bool got_doubles = ITJ_CSV_FALSE;
+    itj_csv_umax max = csv->read_used;
+    for (;; ++i) {
+        if (i >= max) {
+            if (csv->eof) {
+                return itj_csv_fail(csv, ITJ_CSV_ERROR_UNTERMINATED_QUOTE, quote, rv);
+            }
+            rv.need_data = ITJ_CSV_TRUE;
+            return rv;
+        }
+
+        if (csv->read_base[i] == '"') {
+            if (i + 1 == max && !csv->eof) {
+                rv.need_data = ITJ_CSV_TRUE;
+                return rv;
+            }
+            if (i + 1 < max && csv->read_base[i + 1] == '"') {
+                got_doubles = ITJ_CSV_TRUE;
+                rv.data.len += 2;
+                i += 1;
+                continue;
+            }
+            break;
+        }
+
+        rv.data.len += 1;
+    }
+
+    return itj_csv_end_quotes_strict(csv, rv, i, delimiter, got_doubles);
+}
+
+struct itj_csv_value itj_csv_parse_quotes(struct itj_csv *csv, itj_csv_umax i, itj_csv_u8 delimiter) {
     csv->prev_read_iter = csv->read_iter;
     struct itj_csv_value rv;
     i += 1; // Expecting " to be the first character
@@ -174,7 +937,8 @@ struct itj_csv_value itj_csv_parse_quotes(struct itj_csv *csv, itj_csv_umax i) {
     rv.data.len = 0;
     rv.is_end_of_line = ITJ_CSV_FALSE;
     rv.need_data = ITJ_CSV_FALSE;
-    rv.idx = csv->idx;
+    rv.row = csv->row;
+    rv.column = csv->column;
 
     itj_csv_bool got_doubles = ITJ_CSV_FALSE;
     itj_csv_umax max = csv->read_used;
@@ -182,6 +946,12 @@ struct itj_csv_value itj_csv_parse_quotes(struct itj_csv *csv, itj_csv_umax i) {
         itj_csv_u8 ch = csv->read_base[i];
         if (ch == '"') {
             if (i + 1 == max) {
+                if (!csv->eof) {
+                    // The quote might be the first half of a pair, the rest is in the next pump
+                    rv.need_data = ITJ_CSV_TRUE;
+                    return rv;
+                }
+                i += 1;
                 goto skip_max_test;
             } else {
                 itj_csv_u8 ch_next = csv->read_base[i + 1];
@@ -213,39 +983,58 @@ skip_max_test:
             i += 1;
             break;
         }
-        if (ch == csv->delimiter) {
+        if (ch == delimiter) {
             ++i;
             break;
         }
     }
 
+    if (i >= max && !rv.is_end_of_line && !csv->eof) {
+        rv.need_data = ITJ_CSV_TRUE;
+        return rv;
+    }
+
     if (got_doubles) {
-        rv.data.len = itj_csv_contract_double_quotes(rv.data.base, rv.data.len);
+        itj_csv_umax new_len = itj_csv_contract_double_quotes(rv.data.base, rv.data.len);
+        ITJ_CSV_STAT(csv->stats.contracted_quotes += rv.data.len - new_len);
+        rv.data.len = new_len;
     }
+    ITJ_CSV_STAT(csv->stats.quoted_values += 1);
 
     csv->read_iter = i;
     return rv;
 }
 
-struct itj_csv_value itj_csv_parse_value(struct itj_csv *csv, itj_csv_umax i) {
+ITJ_CSV_INLINE struct itj_csv_value itj_csv_parse_value_kernel(struct itj_csv *csv, itj_csv_umax i, itj_csv_u8 delimiter, itj_csv_u32 flags) {
+    if (csv->column == 0 && csv->skipping) {
+        i = itj_csv_skip_lines_at_row_start(csv);
+    }
+
     csv->prev_read_iter = csv->read_iter;
     struct itj_csv_value rv;
     rv.data.base = &csv->read_base[i];
     rv.data.len = 0;
     rv.is_end_of_line = ITJ_CSV_FALSE;
     rv.need_data = ITJ_CSV_FALSE;
-    rv.idx = csv->idx;
+    rv.row = csv->row;
+    rv.column = csv->column;
 
     itj_csv_umax max = csv->read_used;
     for (; i < max; ++i) {
         itj_csv_u8 ch = csv->read_base[i];
-        if (ch == '"') {
-            return itj_csv_parse_quotes(csv, i);
-        } else if (ch == csv->delimiter) {
+        if (!(flags & ITJ_CSV_KERNEL_NO_QUOTES) && ch == '"') {
+            if (flags & ITJ_CSV_KERNEL_STRICT) {
+                if (i != csv->read_iter) {
+                    return itj_csv_fail(csv, ITJ_CSV_ERROR_QUOTE_IN_VALUE, i, rv);
+                }
+                return itj_csv_parse_quotes_strict(csv, i, delimiter);
+            }
+            return itj_csv_parse_quotes(csv, i, delimiter);
+        } else if (ch == delimiter) {
             i += 1;
             csv->read_iter = i;
             return rv;
-        } else if (ch == '\r') {
+        } else if (!(flags & ITJ_CSV_KERNEL_LF_ONLY) && ch == '\r') {
             if (i + 1 == max) {
                 rv.need_data = ITJ_CSV_TRUE;
                 return rv;
@@ -273,28 +1062,63 @@ struct itj_csv_value itj_csv_parse_value(struct itj_csv *csv, itj_csv_umax i) {
     return rv;
 }
 
+struct itj_csv_value itj_csv_parse_value(struct itj_csv *csv, itj_csv_umax i) {
+    return itj_csv_parse_value_kernel(csv, i, csv->delimiter, ITJ_CSV_KERNEL_DEFAULT);
+}
+
 struct itj_csv_value itj_csv_get_next_value(struct itj_csv *csv) {
     struct itj_csv_value rv = itj_csv_parse_value(csv, csv->read_iter);
 
     if (!rv.need_data) {
-        csv->idx += 1;
+        itj_csv_next_position(csv, rv.is_end_of_line);
     }
 
+    ITJ_CSV_STAT(itj_csv_stat_value(csv, &rv));
     return rv;
 }
 
-#endif // ITJ_CSV_IMPLEMENTATION
+// The strict kernel for any delimiter, which select_kernel falls back to for ITJ_CSV_KERNEL_STRICT
+struct itj_csv_value itj_csv_get_next_value_strict(struct itj_csv *csv) {
+    struct itj_csv_value rv = itj_csv_parse_value_kernel(csv, csv->read_iter, csv->delimiter, ITJ_CSV_KERNEL_STRICT);
 
-#ifdef ITJ_CSV_IMPLEMENTATION_AVX
+    if (!rv.need_data) {
+        itj_csv_next_position(csv, rv.is_end_of_line);
+    }
 
-struct itj_csv_value itj_csv_parse_quotes_avx(struct itj_csv *csv, itj_csv_umax i) {
-    csv->prev_read_iter = csv->read_iter;
-    struct itj_csv_value rv;
-    rv.data.base = NULL;
+    rv = itj_csv_strict_check_row(csv, rv);
+    ITJ_CSV_STAT(itj_csv_stat_value(csv, &rv));
+    return rv;
+}
+
+// Defines itj_csv_get_next_value_<name>, with the delimiter and flags fixed at compile time
+#define ITJ_CSV_DEFINE_KERNEL(name, delimiter, flags) \
+    struct itj_csv_value itj_csv_get_next_value_##name(struct itj_csv *csv) { \
+        struct itj_csv_value rv = itj_csv_parse_value_kernel(csv, csv->read_iter, delimiter, flags); \
+        if (!rv.need_data) { \
+            itj_csv_next_position(csv, rv.is_end_of_line); \
+        } \
+        if ((flags) & ITJ_CSV_KERNEL_STRICT) { \
+            rv = itj_csv_strict_check_row(csv, rv); \
+        } \
+        ITJ_CSV_STAT(itj_csv_stat_value(csv, &rv)); \
+        return rv; \
+    }
+
+ITJ_CSV_KERNELS(ITJ_CSV_DEFINE_KERNEL)
+
+#endif // ITJ_CSV_IMPLEMENTATION
+
+#ifdef ITJ_CSV_IMPLEMENTATION_AVX
+
+struct itj_csv_value itj_csv_parse_quotes_avx(struct itj_csv *csv, itj_csv_umax i, itj_csv_u8 delimiter) {
+    csv->prev_read_iter = csv->read_iter;
+    struct itj_csv_value rv;
+    rv.data.base = NULL;
     rv.data.len = 0;
     rv.is_end_of_line = ITJ_CSV_FALSE;
     rv.need_data = ITJ_CSV_FALSE;
-    rv.idx = csv->idx;
+    rv.row = csv->row;
+    rv.column = csv->column;
 
     __m128i Q = _mm_set1_epi8('\"');
 
@@ -302,101 +1126,167 @@ struct itj_csv_value itj_csv_parse_quotes_avx(struct itj_csv *csv, itj_csv_umax
     i += 1;
     itj_csv_umax start = i;
     itj_csv_bool got_doubles = ITJ_CSV_FALSE;
-    itj_csv_bool quote_at_boundary = ITJ_CSV_FALSE;
 
     itj_csv_umax max = csv->read_used;
     while (i < max) {
+        ITJ_CSV_PREFETCH(csv->read_base + i);
         __m128i b = _mm_loadu_si128((__m128i *)(csv->read_base + i));
 
         __m128i q = _mm_cmpeq_epi8(b, Q);
         itj_csv_u32 quotes_mask = _mm_movemask_epi8(q);
 
-        if (quote_at_boundary) {
-            if ((quotes_mask >> 15) & 0x1 != 0x1) {
+        itj_csv_u32 step = 16;
+        while (quotes_mask) {
+            itj_csv_u32 j = itj_csv_ffs(quotes_mask) - 1;
+            if (i + j + 1 >= max) {
+                if (i + j >= max || !csv->eof) {
+                    // Either past the data, or a quote that might be half of a pair split across pumps
+                    rv.need_data = ITJ_CSV_TRUE;
+                    return rv;
+                }
+                i += j;
                 goto get_out;
             }
-            got_doubles = ITJ_CSV_TRUE;
-            quote_at_boundary = false;
-        }
 
+            if (j == 15) {
+                // The other half of a pair would be in the next block, so load again from the quote
+                step = 15;
+                break;
+            }
 
-        if (quotes_mask == 0) {
-            i += 16;
-        } else {
-            itj_csv_u32 acc = 0;
-            do {
-                itj_csv_u32 j = itj_csv_ffs(quotes_mask) - 1;
-                quotes_mask = quotes_mask >> j;
-                if (quotes_mask & 0x1) {
-                    if (acc == 15) {
-                        quote_at_boundary = true;
-                        i += j;
-                        quotes_mask = 0;
-                    } else {
-                        if ((quotes_mask & 0x3) == 3) {
-                            j += 2;
-                            quotes_mask = quotes_mask >> 2;
-                            i += j;
-                            got_doubles = ITJ_CSV_TRUE;
-                        } else {
-                            i += j;
-                            goto get_out;
-                        }
-                    }
-                }
-            } while (quotes_mask);
+            if ((quotes_mask >> (j + 1)) & 0x1) {
+                got_doubles = ITJ_CSV_TRUE;
+                quotes_mask &= ~(0x3u << j);
+            } else {
+                i += j;
+                goto get_out;
+            }
         }
+
+        i += step;
     }
-get_out:
-    if (i >= max) {
-        rv.need_data = ITJ_CSV_TRUE;
-        return rv;
-    }
 
+    rv.need_data = ITJ_CSV_TRUE;
+    return rv;
+
+get_out:
     rv.data.base = &csv->read_base[start];
     rv.data.len = i - start;
 
-
-    for (; i < max; ++i) {
+    for (i += 1; i < max; ++i) {
         itj_csv_u8 c = csv->read_base[i];
-        if (c == '\r' || c == '\n') {
-            if (i < max && c + csv->read_base[i] == '\r' + '\n') {
-                i += 2;
-                rv.is_end_of_line = ITJ_CSV_TRUE;
-                break;
-            } else if (c == '\n') {
-                i += 1;
-                rv.is_end_of_line = ITJ_CSV_TRUE;
-                break;
-            }
-        } else if (c == csv->delimiter) {
-            i++;
+        if (c == '\n') {
+            i += 1;
+            rv.is_end_of_line = ITJ_CSV_TRUE;
+            break;
+        } else if (c == delimiter) {
+            i += 1;
             break;
         }
+    }
 
+    if (i >= max && !rv.is_end_of_line && !csv->eof) {
+        rv.need_data = ITJ_CSV_TRUE;
+        return rv;
     }
 
     if (got_doubles) {
-        rv.data.len = itj_csv_contract_double_quotes(rv.data.base, rv.data.len);
+        itj_csv_umax new_len = itj_csv_contract_double_quotes(rv.data.base, rv.data.len);
+        ITJ_CSV_STAT(csv->stats.contracted_quotes += rv.data.len - new_len);
+        rv.data.len = new_len;
     }
+    ITJ_CSV_STAT(csv->stats.quoted_values += 1);
 
     csv->read_iter = i;
-    csv->idx += 1;
+    itj_csv_next_position(csv, rv.is_end_of_line);
 
     return rv;
 }
 
-struct itj_csv_value itj_csv_parse_value_avx(struct itj_csv *csv, itj_csv_umax i) {
+// itj_csv_parse_quotes_strict, finding the closing quote 16 bytes at a time
+struct itj_csv_value itj_csv_parse_quotes_strict_avx(struct itj_csv *csv, itj_csv_umax i, itj_csv_u8 delimiter) {
+    csv->prev_read_iter = csv->read_iter;
+    struct itj_csv_value rv;
+    itj_csv_umax quote = i;
+    i += 1;
+    itj_csv_umax start = i;
+    rv.data.base = &csv->read_base[start];
+    rv.data.len = 0;
+    rv.is_end_of_line = ITJ_CSV_FALSE;
+    rv.need_data = ITJ_CSV_FALSE;
+    rv.row = csv->row;
+    rv.column = csv->column;
+
+    __m128i Q = _mm_set1_epi8('\"');
+    itj_csv_bool got_doubles = ITJ_CSV_FALSE;
+
+    itj_csv_umax max = csv->read_used;
+    while (i < max) {
+        ITJ_CSV_PREFETCH(csv->read_base + i);
+        __m128i b = _mm_loadu_si128((__m128i *)(csv->read_base + i));
+        itj_csv_u32 quotes_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(b, Q));
+
+        itj_csv_u32 step = 16;
+        while (quotes_mask) {
+            itj_csv_u32 j = itj_csv_ffs(quotes_mask) - 1;
+            if (i + j >= max) {
+                break; // Past the data, where the block padding may hold anything
+            }
+            if (i + j + 1 == max) {
+                if (!csv->eof) {
+                    // The quote might be the first half of a pair, the rest is in the next pump
+                    rv.need_data = ITJ_CSV_TRUE;
+                    return rv;
+                }
+                i += j;
+                goto get_out;
+            }
+
+            if (j == 15) {
+                // The other half of a pair would be in the next block, so load again from the quote
+                step = 15;
+                break;
+            }
+
+            if ((quotes_mask >> (j + 1)) & 0x1) {
+                got_doubles = ITJ_CSV_TRUE;
+                quotes_mask &= ~(0x3u << j);
+            } else {
+                i += j;
+                goto get_out;
+            }
+        }
+
+        i += step;
+    }
+
+    if (csv->eof) {
+        return itj_csv_fail(csv, ITJ_CSV_ERROR_UNTERMINATED_QUOTE, quote, rv);
+    }
+    rv.need_data = ITJ_CSV_TRUE;
+    return rv;
+
+get_out:
+    rv.data.len = i - start;
+    return itj_csv_end_quotes_strict(csv, rv, i, delimiter, got_doubles);
+}
+
+ITJ_CSV_INLINE struct itj_csv_value itj_csv_parse_value_avx_kernel(struct itj_csv *csv, itj_csv_umax i, itj_csv_u8 delimiter, itj_csv_u32 flags) {
+    if (csv->column == 0 && csv->skipping) {
+        i = itj_csv_skip_lines_at_row_start(csv);
+    }
+
     csv->prev_read_iter = csv->read_iter;
     struct itj_csv_value rv;
     rv.data.base = NULL;
     rv.data.len = 0;
     rv.is_end_of_line = ITJ_CSV_FALSE;
     rv.need_data = ITJ_CSV_FALSE;
-    rv.idx = csv->idx;
+    rv.row = csv->row;
+    rv.column = csv->column;
 
     __m128i Q = _mm_set1_epi8('\"');
-    __m128i delim = _mm_set1_epi8(csv->delimiter);
+    __m128i delim = _mm_set1_epi8(delimiter);
     __m128i R = _mm_set1_epi8('\r');
     __m128i N = _mm_set1_epi8('\n');
 
@@ -404,38 +1294,49 @@ struct itj_csv_value itj_csv_parse_value_avx(struct itj_csv *csv, itj_csv_umax i
 
     itj_csv_umax max = csv->read_used;
     while (i < max) {
+        ITJ_CSV_PREFETCH(csv->read_base + i);
         __m128i b = _mm_loadu_si128((__m128i *)(csv->read_base + i));
 
-        __m128i q = _mm_cmpeq_epi8(b, Q);
-        itj_csv_u32 quote_mask = _mm_movemask_epi8(q);
-
-
         __m128i m = _mm_cmpeq_epi8(b, delim);
         __m128i n = _mm_cmpeq_epi8(b, N);
-        __m128i r = _mm_cmpeq_epi8(b, R);
-
-        m = _mm_or_si128(m, r);
         m = _mm_or_si128(m, n);
 
-        itj_csv_u32 mask = _mm_movemask_epi8(m);
+        if (!(flags & ITJ_CSV_KERNEL_LF_ONLY)) {
+            __m128i r = _mm_cmpeq_epi8(b, R);
+            m = _mm_or_si128(m, r);
+        }
+
+        // Bytes past the data are in the block padding, which may hold anything
+        itj_csv_u32 valid = max - i < 16 ? (1u << (max - i)) - 1 : 0xffff;
+        itj_csv_u32 mask = _mm_movemask_epi8(m) & valid;
+
+        if (!(flags & ITJ_CSV_KERNEL_NO_QUOTES)) {
+            __m128i q = _mm_cmpeq_epi8(b, Q);
+            itj_csv_u32 quote_mask = _mm_movemask_epi8(q) & valid;
 
-        if (mask == 0) {
-            if (quote_mask != 0) {
+            // A quote before the first delimiter, in a bit lower than any delimiter bit
+            if (quote_mask & ~mask & (mask - 1)) {
                 i += itj_csv_ffs(quote_mask) - 1;
-                return itj_csv_parse_quotes_avx(csv, i);
-            }
-            i += 16;
-        } else {
-            itj_csv_umax first_delim = itj_csv_ffs(mask) - 1;
-            if (quote_mask != 0) {
-                itj_csv_umax first_quote = itj_csv_ffs(quote_mask) - 1;
-                if (first_quote < first_delim) {
-                    return itj_csv_parse_quotes_avx(csv, i);
+                if (flags & ITJ_CSV_KERNEL_STRICT) {
+                    if (i != start) {
+                        return itj_csv_fail(csv, ITJ_CSV_ERROR_QUOTE_IN_VALUE, i, rv);
+                    }
+                    rv = itj_csv_parse_quotes_strict_avx(csv, i, delimiter);
+                    if (!rv.need_data) {
+                        itj_csv_next_position(csv, rv.is_end_of_line);
+                    }
+                    return rv;
                 }
+                return itj_csv_parse_quotes_avx(csv, i, delimiter);
             }
-            i += first_delim;
+        }
+
+        if (mask != 0) {
+            i += itj_csv_ffs(mask) - 1;
             break;
         }
+
+        i += 16;
     }
 
     if (i >= max) {
@@ -447,37 +1348,67 @@ struct itj_csv_value itj_csv_parse_value_avx(struct itj_csv *csv, itj_csv_umax i
     rv.data.len = i - start;
 
     itj_csv_u8 c = csv->read_base[i++];
-    if (c == '\r' || c == '\n') {
-        if (i < max && c + csv->read_base[i] == '\r' + '\n') {
+    if (c == '\n') {
+        rv.is_end_of_line = ITJ_CSV_TRUE;
+    } else if (!(flags & ITJ_CSV_KERNEL_LF_ONLY) && c == '\r') {
+        if (i == max) {
+            // Can not tell a lone \r from a \r\n split across pumps
+            rv.need_data = ITJ_CSV_TRUE;
+            return rv;
+        }
+        if (csv->read_base[i] == '\n') {
             i += 1;
             rv.is_end_of_line = ITJ_CSV_TRUE;
-        } else if (c == '\n') {
-            rv.is_end_of_line = ITJ_CSV_TRUE;
         }
     }
 
     csv->read_iter = i;
-    csv->idx += 1;
+    itj_csv_next_position(csv, rv.is_end_of_line);
 
     return rv;
 }
 
+struct itj_csv_value itj_csv_parse_value_avx(struct itj_csv *csv, itj_csv_umax i) {
+    return itj_csv_parse_value_avx_kernel(csv, i, csv->delimiter, ITJ_CSV_KERNEL_DEFAULT);
+}
+
 struct itj_csv_value itj_csv_get_next_value_avx(struct itj_csv *csv) {
-    return itj_csv_parse_value_avx(csv, csv->read_iter);
+    if (!ITJ_CSV_STATS_ENABLED) {
+        return itj_csv_parse_value_avx(csv, csv->read_iter);
+    }
+    struct itj_csv_value rv = itj_csv_parse_value_avx(csv, csv->read_iter);
+    ITJ_CSV_STAT(itj_csv_stat_value(csv, &rv));
+    return rv;
 }
 
+#define ITJ_CSV_DEFINE_KERNEL_AVX(name, delimiter, flags) \
+    struct itj_csv_value itj_csv_get_next_value_avx_##name(struct itj_csv *csv) { \
+        if (!ITJ_CSV_STATS_ENABLED && !((flags) & ITJ_CSV_KERNEL_STRICT)) { \
+            return itj_csv_parse_value_avx_kernel(csv, csv->read_iter, delimiter, flags); \
+        } \
+        struct itj_csv_value rv = itj_csv_parse_value_avx_kernel(csv, csv->read_iter, delimiter, flags); \
+        if ((flags) & ITJ_CSV_KERNEL_STRICT) { \
+            rv = itj_csv_strict_check_row(csv, rv); \
+        } \
+        ITJ_CSV_STAT(itj_csv_stat_value(csv, &rv)); \
+        return rv; \
+    }
+
+ITJ_CSV_KERNELS(ITJ_CSV_DEFINE_KERNEL_AVX)
+
 #endif // ITJ_CSV_IMPLEMENTATION_AVX
 
 #ifdef ITJ_CSV_IMPLEMENTATION_AVX2
 
-struct itj_csv_value itj_csv_parse_quotes_avx2(struct itj_csv *csv, itj_csv_umax i) {
+struct itj_csv_value itj_csv_parse_quotes_avx2(struct itj_csv *csv, itj_csv_umax i, itj_csv_u8 delimiter) {
     csv->prev_read_iter = csv->read_iter;
     struct itj_csv_value rv;
     rv.data.base = NULL;
     rv.data.len = 0;
     rv.is_end_of_line = ITJ_CSV_FALSE;
     rv.need_data = ITJ_CSV_FALSE;
-    rv.idx = csv->idx;
+    rv.row = csv->row;
+    rv.column = csv->column;
 
     __m256i Q = _mm256_set1_epi8('\"');
 
@@ -485,101 +1416,167 @@ struct itj_csv_value itj_csv_parse_quotes_avx2(struct itj_csv *csv, itj_csv_umax
     i += 1;
     itj_csv_umax start = i;
     itj_csv_bool got_doubles = ITJ_CSV_FALSE;
-    itj_csv_bool quote_at_boundary = ITJ_CSV_FALSE;
 
     itj_csv_umax max = csv->read_used;
     while (i < max) {
+        ITJ_CSV_PREFETCH(csv->read_base + i);
         __m256i b = _mm256_loadu_si256((__m256i *)(csv->read_base + i));
 
         __m256i q = _mm256_cmpeq_epi8(b, Q);
         itj_csv_u32 quotes_mask = _mm256_movemask_epi8(q);
 
-        if (quote_at_boundary) {
-            if ((quotes_mask >> 31) & 0x1 != 0x1) {
+        itj_csv_u32 step = 32;
+        while (quotes_mask) {
+            itj_csv_u32 j = itj_csv_ffs(quotes_mask) - 1;
+            if (i + j + 1 >= max) {
+                if (i + j >= max || !csv->eof) {
+                    // Either past the data, or a quote that might be half of a pair split across pumps
+                    rv.need_data = ITJ_CSV_TRUE;
+                    return rv;
+                }
+                i += j;
                 goto get_out;
             }
-            got_doubles = ITJ_CSV_TRUE;
-            quote_at_boundary = false;
-        }
 
-        if (quotes_mask == 0) {
-            i += 32;
-        } else {
-            itj_csv_u32 acc = 0;
-            do {
-                itj_csv_u32 j = itj_csv_ffs(quotes_mask) - 1;
-                quotes_mask = quotes_mask >> j;
-                acc += j;
-                if (quotes_mask & 0x1) {
-                    if (acc == 31) {
-                        quote_at_boundary = true;
-                        i += j;
-                        quotes_mask = 0;
-                    } else {
-                        if ((quotes_mask & 0x3) == 3) {
-                            j += 2;
-                            quotes_mask = quotes_mask >> 2;
-                            i += j;
-                            got_doubles = ITJ_CSV_TRUE;
-                        } else {
-                            i += j;
-                            goto get_out;
-                        }
-                    }
-                }
-            } while (quotes_mask);
+            if (j == 31) {
+                // The other half of a pair would be in the next block, so load again from the quote
+                step = 31;
+                break;
+            }
+
+            if ((quotes_mask >> (j + 1)) & 0x1) {
+                got_doubles = ITJ_CSV_TRUE;
+                quotes_mask &= ~(0x3u << j);
+            } else {
+                i += j;
+                goto get_out;
+            }
         }
+
+        i += step;
     }
-get_out:
-    if (i >= max) {
-        rv.need_data = ITJ_CSV_TRUE;
-        return rv;
-    }
 
+    rv.need_data = ITJ_CSV_TRUE;
+    return rv;
+
+get_out:
     rv.data.base = &csv->read_base[start];
     rv.data.len = i - start;
 
-
-    for (; i < max; ++i) {
+    for (i += 1; i < max; ++i) {
         itj_csv_u8 c = csv->read_base[i];
-        if (c == '\r' || c == '\n') {
-            if (i < max && c + csv->read_base[i] == '\r' + '\n') {
-                i += 2;
-                rv.is_end_of_line = ITJ_CSV_TRUE;
-                break;
-            } else if (c == '\n') {
-                i += 1;
-                rv.is_end_of_line = ITJ_CSV_TRUE;
-                break;
-            }
-        } else if (c == csv->delimiter) {
-            i++;
+        if (c == '\n') {
+            i += 1;
+            rv.is_end_of_line = ITJ_CSV_TRUE;
+            break;
+        } else if (c == delimiter) {
+            i += 1;
             break;
         }
+    }
 
+    if (i >= max && !rv.is_end_of_line && !csv->eof) {
+        rv.need_data = ITJ_CSV_TRUE;
+        return rv;
     }
 
     if (got_doubles) {
-        rv.data.len = itj_csv_contract_double_quotes(rv.data.base, rv.data.len);
+        itj_csv_umax new_len = itj_csv_contract_double_quotes(rv.data.base, rv.data.len);
+        ITJ_CSV_STAT(csv->stats.contracted_quotes += rv.data.len - new_len);
+        rv.data.len = new_len;
     }
+    ITJ_CSV_STAT(csv->stats.quoted_values += 1);
 
     csv->read_iter = i;
-    csv->idx += 1;
+    itj_csv_next_position(csv, rv.is_end_of_line);
 
     return rv;
 }
 
-struct itj_csv_value itj_csv_parse_value_avx2(struct itj_csv *csv, itj_csv_umax i) {
+// itj_csv_parse_quotes_strict, finding the closing quote 32 bytes at a time
+struct itj_csv_value itj_csv_parse_quotes_strict_avx2(struct itj_csv *csv, itj_csv_umax i, itj_csv_u8 delimiter) {
+    csv->prev_read_iter = csv->read_iter;
+    struct itj_csv_value rv;
+    itj_csv_umax quote = i;
+    i += 1;
+    itj_csv_umax start = i;
+    rv.data.base = &csv->read_base[start];
+    rv.data.len = 0;
+    rv.is_end_of_line = ITJ_CSV_FALSE;
+    rv.need_data = ITJ_CSV_FALSE;
+    rv.row = csv->row;
+    rv.column = csv->column;
+
+    __m256i Q = _mm256_set1_epi8('\"');
+    itj_csv_bool got_doubles = ITJ_CSV_FALSE;
+
+    itj_csv_umax max = csv->read_used;
+    while (i < max) {
+        ITJ_CSV_PREFETCH(csv->read_base + i);
+        __m256i b = _mm256_loadu_si256((__m256i *)(csv->read_base + i));
+        itj_csv_u32 quotes_mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(b, Q));
+
+        itj_csv_u32 step = 32;
+        while (quotes_mask) {
+            itj_csv_u32 j = itj_csv_ffs(quotes_mask) - 1;
+            if (i + j >= max) {
+                break; // Past the data, where the block padding may hold anything
+            }
+            if (i + j + 1 == max) {
+                if (!csv->eof) {
+                    // The quote might be the first half of a pair, the rest is in the next pump
+                    rv.need_data = ITJ_CSV_TRUE;
+                    return rv;
+                }
+                i += j;
+                goto get_out;
+            }
+
+            if (j == 31) {
+                // The other half of a pair would be in the next block, so load again from the quote
+                step = 31;
+                break;
+            }
+
+            if ((quotes_mask >> (j + 1)) & 0x1) {
+                got_doubles = ITJ_CSV_TRUE;
+                quotes_mask &= ~(0x3u << j);
+            } else {
+                i += j;
+                goto get_out;
+            }
+        }
+
+        i += step;
+    }
+
+    if (csv->eof) {
+        return itj_csv_fail(csv, ITJ_CSV_ERROR_UNTERMINATED_QUOTE, quote, rv);
+    }
+    rv.need_data = ITJ_CSV_TRUE;
+    return rv;
+
+get_out:
+    rv.data.len = i - start;
+    return itj_csv_end_quotes_strict(csv, rv, i, delimiter, got_doubles);
+}
+
+ITJ_CSV_INLINE struct itj_csv_value itj_csv_parse_value_avx2_kernel(struct itj_csv *csv, itj_csv_umax i, itj_csv_u8 delimiter, itj_csv_u32 flags) {
+    if (csv->column == 0 && csv->skipping) {
+        i = itj_csv_skip_lines_at_row_start(csv);
+    }
+
     csv->prev_read_iter = csv->read_iter;
     struct itj_csv_value rv;
     rv.data.base = NULL;
     rv.data.len = 0;
     rv.is_end_of_line = ITJ_CSV_FALSE;
     rv.need_data = ITJ_CSV_FALSE;
-    rv.idx = csv->idx;
+    rv.row = csv->row;
+    rv.column = csv->column;
 
     __m256i Q = _mm256_set1_epi8('\"');
-    __m256i delim = _mm256_set1_epi8(csv->delimiter);
+    __m256i delim = _mm256_set1_epi8(delimiter);
     __m256i R = _mm256_set1_epi8('\r');
     __m256i N = _mm256_set1_epi8('\n');
 
@@ -587,39 +1584,49 @@ struct itj_csv_value itj_csv_parse_value_avx2(struct itj_csv *csv, itj_csv_umax
 
     itj_csv_umax max = csv->read_used;
     while (i < max) {
+        ITJ_CSV_PREFETCH(csv->read_base + i);
         __m256i b = _mm256_loadu_si256((__m256i *)(csv->read_base + i));
 
-        __m256i q = _mm256_cmpeq_epi8(b, Q);
-        itj_csv_u32 quote_mask = _mm256_movemask_epi8(q);
-
-
         __m256i m = _mm256_cmpeq_epi8(b, delim);
         __m256i n = _mm256_cmpeq_epi8(b, N);
-        __m256i r = _mm256_cmpeq_epi8(b, R);
-
-        m = _mm256_or_si256(m, r);
         m = _mm256_or_si256(m, n);
 
-        itj_csv_u32 mask = _mm256_movemask_epi8(m);
+        if (!(flags & ITJ_CSV_KERNEL_LF_ONLY)) {
+            __m256i r = _mm256_cmpeq_epi8(b, R);
+            m = _mm256_or_si256(m, r);
+        }
+
+        // Bytes past the data are in the block padding, which may hold anything
+        itj_csv_u32 valid = max - i < 32 ? (1u << (max - i)) - 1 : 0xffffffff;
+        itj_csv_u32 mask = _mm256_movemask_epi8(m) & valid;
+
+        if (!(flags & ITJ_CSV_KERNEL_NO_QUOTES)) {
+            __m256i q = _mm256_cmpeq_epi8(b, Q);
+            itj_csv_u32 quote_mask = _mm256_movemask_epi8(q) & valid;
 
-        if (mask == 0) {
-            if (quote_mask != 0) {
+            // A quote before the first delimiter, in a bit lower than any delimiter bit
+            if (quote_mask & ~mask & (mask - 1)) {
                 i += itj_csv_ffs(quote_mask) - 1;
-                return itj_csv_parse_quotes_avx2(csv, i);
-            }
-            i += 32;
-        } else {
-            itj_csv_umax first_delim = itj_csv_ffs(mask) - 1;
-            if (quote_mask != 0) {
-                itj_csv_umax first_quote = itj_csv_ffs(quote_mask) - 1;
-                if (first_quote < first_delim) {
-                    i += first_quote;
-                    return itj_csv_parse_quotes_avx2(csv, i);
+                if (flags & ITJ_CSV_KERNEL_STRICT) {
+                    if (i != start) {
+                        return itj_csv_fail(csv, ITJ_CSV_ERROR_QUOTE_IN_VALUE, i, rv);
+                    }
+                    rv = itj_csv_parse_quotes_strict_avx2(csv, i, delimiter);
+                    if (!rv.need_data) {
+                        itj_csv_next_position(csv, rv.is_end_of_line);
+                    }
+                    return rv;
                 }
+                return itj_csv_parse_quotes_avx2(csv, i, delimiter);
             }
-            i += first_delim;
+        }
+
+        if (mask != 0) {
+            i += itj_csv_ffs(mask) - 1;
             break;
         }
+
+        i += 32;
     }
 
     if (i >= max) {
@@ -631,27 +1638,104 @@ struct itj_csv_value itj_csv_parse_value_avx2(struct itj_csv *csv, itj_csv_umax
     rv.data.len = i - start;
 
     itj_csv_u8 c = csv->read_base[i++];
-    if (c == '\r' || c == '\n') {
-        if (i < max && c + csv->read_base[i] == '\r' + '\n') {
+    if (c == '\n') {
+        rv.is_end_of_line = ITJ_CSV_TRUE;
+    } else if (!(flags & ITJ_CSV_KERNEL_LF_ONLY) && c == '\r') {
+        if (i == max) {
+            // Can not tell a lone \r from a \r\n split across pumps
+            rv.need_data = ITJ_CSV_TRUE;
+            return rv;
+        }
+        if (csv->read_base[i] == '\n') {
             i += 1;
             rv.is_end_of_line = ITJ_CSV_TRUE;
-        } else if (c == '\n') {
-            rv.is_end_of_line = ITJ_CSV_TRUE;
         }
     }
 
     csv->read_iter = i;
-    csv->idx += 1;
+    itj_csv_next_position(csv, rv.is_end_of_line);
 
     return rv;
 }
 
+struct itj_csv_value itj_csv_parse_value_avx2(struct itj_csv *csv, itj_csv_umax i) {
+    return itj_csv_parse_value_avx2_kernel(csv, i, csv->delimiter, ITJ_CSV_KERNEL_DEFAULT);
+}
+
 struct itj_csv_value itj_csv_get_next_value_avx2(struct itj_csv *csv) {
-    return itj_csv_parse_value_avx2(csv, csv->read_iter);
+    if (!ITJ_CSV_STATS_ENABLED) {
+        return itj_csv_parse_value_avx2(csv, csv->read_iter);
+    }
+    struct itj_csv_value rv = itj_csv_parse_value_avx2(csv, csv->read_iter);
+    ITJ_CSV_STAT(itj_csv_stat_value(csv, &rv));
+    return rv;
 }
 
+#define ITJ_CSV_DEFINE_KERNEL_AVX2(name, delimiter, flags) \
+    struct itj_csv_value itj_csv_get_next_value_avx2_##name(struct itj_csv *csv) { \
+        if (!ITJ_CSV_STATS_ENABLED && !((flags) & ITJ_CSV_KERNEL_STRICT)) { \
+            return itj_csv_parse_value_avx2_kernel(csv, csv->read_iter, delimiter, flags); \
+        } \
+        struct itj_csv_value rv = itj_csv_parse_value_avx2_kernel(csv, csv->read_iter, delimiter, flags); \
+        if ((flags) & ITJ_CSV_KERNEL_STRICT) { \
+            rv = itj_csv_strict_check_row(csv, rv); \
+        } \
+        ITJ_CSV_STAT(itj_csv_stat_value(csv, &rv)); \
+        return rv; \
+    }
+
+ITJ_CSV_KERNELS(ITJ_CSV_DEFINE_KERNEL_AVX2)
+
 #endif // ITJ_CSV_IMPLEMENTATION_AVX2
 
+#ifdef ITJ_CSV_IMPLEMENTATION
+
+/*
+ * Picks the kernel specialized for the delimiter and flags, from the widest implementation compiled in.
+ * The flags are only a promise about the data, so when there is no specialization the general kernel,
+ * which handles quotes and \r\n, is used instead. ITJ_CSV_KERNEL_STRICT always gets a strict kernel
+ */
+itj_csv_kernel_fn itj_csv_select_kernel(itj_csv_u8 delimiter, itj_csv_u32 flags) {
+#if defined(ITJ_CSV_IMPLEMENTATION_AVX2)
+#define ITJ_CSV_SELECT_KERNEL(name, kernel_delimiter, kernel_flags) \
+    if (delimiter == kernel_delimiter && flags == (kernel_flags)) return itj_csv_get_next_value_avx2_##name;
+    ITJ_CSV_KERNELS(ITJ_CSV_SELECT_KERNEL)
+    if (flags & ITJ_CSV_KERNEL_STRICT) return itj_csv_get_next_value_strict;
+    return itj_csv_get_next_value_avx2;
+#elif defined(ITJ_CSV_IMPLEMENTATION_AVX)
+#define ITJ_CSV_SELECT_KERNEL(name, kernel_delimiter, kernel_flags) \
+    if (delimiter == kernel_delimiter && flags == (kernel_flags)) return itj_csv_get_next_value_avx_##name;
+    ITJ_CSV_KERNELS(ITJ_CSV_SELECT_KERNEL)
+    if (flags & ITJ_CSV_KERNEL_STRICT) return itj_csv_get_next_value_strict;
+    return itj_csv_get_next_value_avx;
+#else
+#define ITJ_CSV_SELECT_KERNEL(name, kernel_delimiter, kernel_flags) \
+    if (delimiter == kernel_delimiter && flags == (kernel_flags)) return itj_csv_get_next_value_##name;
+    ITJ_CSV_KERNELS(ITJ_CSV_SELECT_KERNEL)
+    if (flags & ITJ_CSV_KERNEL_STRICT) return itj_csv_get_next_value_strict;
+    return itj_csv_get_next_value;
+#endif
+#undef ITJ_CSV_SELECT_KERNEL
+}
+
+// The flags a sniffed dialect allows. The sniff only saw a prefix, so this trusts the rest of the file to look the same
+itj_csv_u32 itj_csv_dialect_kernel_flags(const struct itj_csv_dialect *dialect) {
+    itj_csv_u32 flags = ITJ_CSV_KERNEL_DEFAULT;
+    if (!dialect->is_crlf) {
+        flags |= ITJ_CSV_KERNEL_LF_ONLY;
+    }
+    if (!dialect->has_quotes) {
+        flags |= ITJ_CSV_KERNEL_NO_QUOTES;
+    }
+    return flags;
+}
+
+itj_csv_kernel_fn itj_csv_select_dialect_kernel(const struct itj_csv_dialect *dialect) {
+    return itj_csv_select_kernel(dialect->delimiter, itj_csv_dialect_kernel_flags(dialect));
+}
+
+#endif // ITJ_CSV_IMPLEMENTATION
+
 #ifndef ITJ_CSV_NO_STD
 
 void itj_csv_close_fh(struct itj_csv *csv) {
@@ -665,33 +1749,61 @@ itj_csv_umax itj_csv_pump_stdio(struct itj_csv *csv) {
     itj_csv_umax diff = 0;
     itj_csv_smax ret;
 
-    if (csv->read_iter != 0) {
-        if (csv->read_iter == csv->prev_read_iter) {
-            if (csv->read_used > csv->read_iter) {
-                diff = csv->read_used - csv->read_iter;
-                if (diff <= csv->read_max) {
-                    ITJ_CSV_MEMCPY(csv->read_base, csv->read_base + csv->read_iter, diff);
-                } else {
-                    return 0;
-                }
-            }
+    // After an error, or at the end of the file, it returns 0. itj_csv_get_error tells them apart
+    if (csv->error.kind != ITJ_CSV_ERROR_NONE) {
+        return 0;
+    }
+
+    // Keep what has not been parsed, usually the start of a value that continues in the next read
+    if (csv->read_used > csv->read_iter) {
+        diff = csv->read_used - csv->read_iter;
+        if (diff == csv->read_max && !csv->eof) {
+            // One value fills the buffer, there is no room to read the rest of it
+            csv->error.kind = ITJ_CSV_ERROR_VALUE_TOO_BIG;
+            csv->error.offset = csv->base_offset + csv->read_iter;
+            csv->error.row = csv->row;
+            csv->error.column = csv->column;
+            return 0;
+        }
+        if (csv->read_iter != 0) {
+            ITJ_CSV_MEMMOVE(csv->read_base, csv->read_base + csv->read_iter, diff);
         }
     }
 
+    csv->base_offset += csv->read_iter;
     csv->read_iter = 0;
     csv->prev_read_iter = 0;
 
+    // A followed file may have grown since fread last saw its end
+    if (csv->follow) {
+        clearerr(csv->fh);
+    }
+
+    // Reading stops at the end set with itj_csv_set_end_bytes, which is the end of the data then
+    itj_csv_umax room = csv->read_max - diff;
+    itj_csv_bool at_end = ITJ_CSV_FALSE;
+    if (csv->end_offset != ITJ_CSV_NO_END) {
+        itj_csv_umax left = csv->end_offset > csv->base_offset + diff ? csv->end_offset - csv->base_offset - diff : 0;
+        at_end = left <= room;
+        room = at_end ? left : room;
+    }
+
     do {
-        ret = fread(csv->read_base + diff + total_read, 1, csv->read_max - diff - total_read, csv->fh);
+        ret = fread(csv->read_base + diff + total_read, 1, room - total_read, csv->fh);
         if (ret < 0) {
             return 0;
         }
 
         total_read += ret;
-    } while (ret != 0 && total_read < csv->read_max - diff);
+    } while (ret != 0 && total_read < room);
+
+    csv->eof = (ret == 0 && !csv->follow) || (at_end && total_read == room);
 
     csv->read_used = total_read + diff;
 
+    ITJ_CSV_STAT(csv->stats.pumps += 1);
+    ITJ_CSV_STAT(csv->stats.pump_bytes_moved += diff);
+
     return total_read;
 }
 
@@ -703,16 +1815,38 @@ void itj_csv_open_fp(struct itj_csv *csv_out, FILE *fh, void *mem_buf, itj_csv_u
     csv_out->delimiter = delimiter;
     csv_out->fh = fh;
     csv_out->user_mem_ptr = user_mem_ptr;
-    csv_out->idx = 0;
+    csv_out->row = 0;
+    csv_out->column = 0;
+    csv_out->header = NULL;
+    csv_out->base_offset = 0;
+    csv_out->num_columns = 0;
+    ITJ_CSV_MEMSET(&csv_out->error, 0, sizeof(csv_out->error));
+    csv_out->skip_lines = 0;
+    csv_out->comment = 0;
+    csv_out->skip_blank_lines = ITJ_CSV_FALSE;
+    csv_out->skipping = ITJ_CSV_FALSE;
+    csv_out->in_skipped_line = ITJ_CSV_FALSE;
+    csv_out->eof = ITJ_CSV_FALSE;
+    csv_out->follow = ITJ_CSV_FALSE;
+    csv_out->follow_split = ITJ_CSV_FALSE;
+    csv_out->follow_scanned = 0;
+    csv_out->follow_quotes = 0;
+    csv_out->end_offset = ITJ_CSV_NO_END;
+    csv_out->follow_fd = -1;
+    ITJ_CSV_STAT(ITJ_CSV_MEMSET(&csv_out->stats, 0, sizeof(csv_out->stats)));
 }
 
 itj_csv_bool itj_csv_open(struct itj_csv *csv_out, const char *filepath, itj_csv_u32 filepath_len, void *mem_buf, itj_csv_umax mem_buf_size, itj_csv_u8 delimiter, void *user_mem_ptr) {
-    char *null_terminated = ITJ_CSV_ALLOC(user_mem_ptr, filepath_len + 1);
+    char *null_terminated = (char *)ITJ_CSV_ALLOC(user_mem_ptr, filepath_len + 1);
+    if (!null_terminated) {
+        return ITJ_CSV_FALSE;
+    }
 
     ITJ_CSV_MEMCPY(null_terminated, filepath, filepath_len);
     null_terminated[filepath_len] = '\0';
 
     FILE *fh = fopen(null_terminated, "rb");
+    ITJ_CSV_FREE(user_mem_ptr, null_terminated);
     if (!fh) {
         return ITJ_CSV_FALSE;
     }
@@ -731,8 +1865,4418 @@ void itj_csv_open_memory(struct itj_csv *csv_out, void *mem_buf, itj_csv_umax me
     csv_out->read_max = mem_buf_size;
     csv_out->delimiter = delimiter;
     csv_out->user_mem_ptr = user_mem_ptr;
-    csv_out->idx = 0;
-}
+    csv_out->row = 0;
+    csv_out->column = 0;
+    csv_out->header = NULL;
+    csv_out->base_offset = 0;
+    csv_out->num_columns = 0;
+    ITJ_CSV_MEMSET(&csv_out->error, 0, sizeof(csv_out->error));
+    csv_out->skip_lines = 0;
+    csv_out->comment = 0;
+    csv_out->skip_blank_lines = ITJ_CSV_FALSE;
+    csv_out->skipping = ITJ_CSV_FALSE;
+    csv_out->in_skipped_line = ITJ_CSV_FALSE;
+    csv_out->eof = ITJ_CSV_TRUE;
+    csv_out->follow = ITJ_CSV_FALSE;
+    csv_out->follow_split = ITJ_CSV_FALSE;
+    csv_out->follow_scanned = 0;
+    csv_out->follow_quotes = 0;
+    csv_out->end_offset = ITJ_CSV_NO_END;
+    ITJ_CSV_STAT(ITJ_CSV_MEMSET(&csv_out->stats, 0, sizeof(csv_out->stats)));
+#ifndef ITJ_CSV_NO_STD
+    csv_out->fh = NULL;
+    csv_out->follow_fd = -1;
+#endif
+}
+
+// Copies the counters into *out. Returns false, with *out zeroed, when ITJ_CSV_STATS is not defined
+itj_csv_bool itj_csv_get_stats(const struct itj_csv *csv, struct itj_csv_stats *out) {
+#ifdef ITJ_CSV_STATS
+    *out = csv->stats;
+    return ITJ_CSV_TRUE;
+#else
+    ITJ_CSV_MEMSET(out, 0, sizeof(*out));
+    return ITJ_CSV_FALSE;
+#endif
+}
+
+/*
+ * Makes the kernels skip the first num_lines physical lines, quotes or not, and after that any blank
+ * line and any row starting with comment (0 for none). itj_csv_sniff finds the skip_lines for a preamble
+ */
+void itj_csv_set_skip_lines(struct itj_csv *csv, itj_csv_u32 num_lines, itj_csv_bool skip_blank_lines, itj_csv_u8 comment) {
+    csv->skip_lines = num_lines;
+    csv->skip_blank_lines = skip_blank_lines;
+    csv->comment = comment;
+    csv->skipping = num_lines > 0 || skip_blank_lines || comment;
+}
+
+struct itj_csv_error itj_csv_get_error(const struct itj_csv *csv) {
+    return csv->error;
+}
+
+const char *itj_csv_error_string(itj_csv_error_kind_t kind) {
+    switch (kind) {
+    case ITJ_CSV_ERROR_NONE: return "no error";
+    case ITJ_CSV_ERROR_QUOTE_IN_VALUE: return "quote inside an unquoted value";
+    case ITJ_CSV_ERROR_TEXT_AFTER_QUOTE: return "text after a closing quote";
+    case ITJ_CSV_ERROR_UNTERMINATED_QUOTE: return "unterminated quote";
+    case ITJ_CSV_ERROR_FIELD_COUNT: return "row has another number of values than the first row";
+    case ITJ_CSV_ERROR_VALUE_TOO_BIG: return "value does not fit in the read buffer";
+    }
+    return "unknown error";
+}
+
+void itj_csv_reset_stats(struct itj_csv *csv) {
+    ITJ_CSV_STAT(ITJ_CSV_MEMSET(&csv->stats, 0, sizeof(csv->stats)));
+}
+
+#ifdef ITJ_CSV_IMPLEMENTATION
+
+struct itj_csv_record_count {
+    itj_csv_umax unquoted_newlines;
+    itj_csv_umax newlines;
+    itj_csv_u32 inside_quotes;
+};
+
+ITJ_CSV_INLINE void itj_csv_count_block(const itj_csv_u8 *p, struct itj_csv_record_count *count) {
+    itj_csv_u32 newlines = itj_csv_byte_mask(p, '\n');
+    itj_csv_u32 quoted = itj_csv_quoted_mask(itj_csv_byte_mask(p, '"'), &count->inside_quotes);
+    count->unquoted_newlines += itj_csv_popcount(newlines & ~quoted);
+    count->newlines += itj_csv_popcount(newlines);
+}
+
+/*
+ * Counts the newlines in buf, and those of them that are not inside quotes, from the quote state in
+ * count->inside_quotes. A doubled quote flips the state twice, so it needs no special case.
+ * The buffer needs no padding, the tail is copied into a zeroed block
+ */
+void itj_csv_count_newlines(const itj_csv_u8 *buf, itj_csv_umax len, struct itj_csv_record_count *count) {
+    itj_csv_umax i = 0;
+    for (; i + ITJ_CSV_BLOCK_SIZE <= len; i += ITJ_CSV_BLOCK_SIZE) {
+        ITJ_CSV_PREFETCH(buf + i);
+        itj_csv_count_block(buf + i, count);
+    }
+
+    if (i < len) {
+        itj_csv_u8 tail[ITJ_CSV_BLOCK_SIZE];
+        ITJ_CSV_MEMSET(tail, 0, sizeof(tail));
+        ITJ_CSV_MEMCPY(tail, buf + i, len - i);
+        itj_csv_count_block(tail, count);
+    }
+}
+
+// Where the record after the one at i starts, past the first newline outside quotes from i, or len
+itj_csv_umax itj_csv_next_record(const void *buf, itj_csv_umax len, itj_csv_umax i, itj_csv_bool inside_quotes) {
+    const itj_csv_u8 *bytes = (const itj_csv_u8 *)buf;
+    for (; i < len; ++i) {
+        inside_quotes ^= bytes[i] == '"';
+        if (bytes[i] == '\n' && !inside_quotes) {
+            return i + 1;
+        }
+    }
+    return len;
+}
+
+// Counts records, the unquoted newlines plus a last record that has no ending newline
+itj_csv_umax itj_csv_count_records(const void *buf, itj_csv_umax len) {
+    struct itj_csv_record_count count = {0};
+    itj_csv_count_newlines((const itj_csv_u8 *)buf, len, &count);
+    return count.unquoted_newlines + (len > 0 && ((const itj_csv_u8 *)buf)[len - 1] != '\n');
+}
+
+#endif // ITJ_CSV_IMPLEMENTATION
+
+#if defined(ITJ_CSV_IMPLEMENTATION) && !defined(ITJ_CSV_NO_STD)
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+#ifndef ITJ_CSV_NO_THREADS
+#include <pthread.h>
+#endif
+#endif
+
+itj_csv_u32 itj_csv_num_cpus(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return num_cpus > 0 ? (itj_csv_u32)num_cpus : 1;
+#endif
+}
+
+struct itj_csv_thread_start {
+    itj_csv_thread_fn fn;
+    void *arg;
+};
+
+#ifndef ITJ_CSV_NO_THREADS
+#ifdef _WIN32
+static DWORD WINAPI itj_csv_thread_main(LPVOID arg) {
+    struct itj_csv_thread_start *start = (struct itj_csv_thread_start *)arg;
+    start->fn(start->arg);
+    return 0;
+}
+#else
+static void *itj_csv_thread_main(void *arg) {
+    struct itj_csv_thread_start *start = (struct itj_csv_thread_start *)arg;
+    start->fn(start->arg);
+    return NULL;
+}
+#endif
+#endif
+
+/*
+ * Calls fn once for each of the num_threads arguments in args, which are arg_size bytes apart, each on
+ * its own thread, and waits for all of them. The calling thread takes the first argument. With
+ * ITJ_CSV_NO_THREADS, or when a thread can not be started, the calls run on the calling thread
+ */
+void itj_csv_run_threads(itj_csv_thread_fn fn, void *args, itj_csv_umax arg_size, itj_csv_u32 num_threads) {
+    struct itj_csv_thread_start starts[ITJ_CSV_MAX_THREADS];
+    itj_csv_bool started[ITJ_CSV_MAX_THREADS];
+#ifdef _WIN32
+    HANDLE threads[ITJ_CSV_MAX_THREADS];
+#elif !defined(ITJ_CSV_NO_THREADS)
+    pthread_t threads[ITJ_CSV_MAX_THREADS];
+#endif
+
+    if (num_threads > ITJ_CSV_MAX_THREADS) {
+        num_threads = ITJ_CSV_MAX_THREADS;
+    }
+
+    for (itj_csv_u32 t = 1; t < num_threads; ++t) {
+        starts[t].fn = fn;
+        starts[t].arg = (itj_csv_u8 *)args + t * arg_size;
+        started[t] = ITJ_CSV_FALSE;
+#ifdef ITJ_CSV_NO_THREADS
+#elif defined(_WIN32)
+        threads[t] = CreateThread(NULL, 0, itj_csv_thread_main, &starts[t], 0, NULL);
+        started[t] = threads[t] != NULL;
+#else
+        started[t] = pthread_create(&threads[t], NULL, itj_csv_thread_main, &starts[t]) == 0;
+#endif
+    }
+
+    if (num_threads > 0) {
+        fn(args);
+    }
+
+    for (itj_csv_u32 t = 1; t < num_threads; ++t) {
+        if (!started[t]) {
+            fn(starts[t].arg);
+            continue;
+        }
+#ifdef ITJ_CSV_NO_THREADS
+#elif defined(_WIN32)
+        WaitForSingleObject(threads[t], INFINITE);
+        CloseHandle(threads[t]);
+#else
+        pthread_join(threads[t], NULL);
+#endif
+    }
+}
+
+// How many threads to split len bytes over, so each gets at least ITJ_CSV_MIN_THREAD_BYTES. 0 threads means one per cpu
+itj_csv_u32 itj_csv_thread_count(itj_csv_umax len, itj_csv_u32 num_threads) {
+    if (num_threads == 0) {
+        num_threads = itj_csv_num_cpus();
+    }
+    if (num_threads > ITJ_CSV_MAX_THREADS) {
+        num_threads = ITJ_CSV_MAX_THREADS;
+    }
+    if (len / ITJ_CSV_MIN_THREAD_BYTES < num_threads) {
+        num_threads = (itj_csv_u32)(len / ITJ_CSV_MIN_THREAD_BYTES);
+    }
+    return num_threads > 0 ? num_threads : 1;
+}
+
+struct itj_csv_count_chunk {
+    const itj_csv_u8 *base;
+    itj_csv_umax len;
+    struct itj_csv_record_count count;
+};
+
+static void itj_csv_count_chunk_thread(void *arg) {
+    struct itj_csv_count_chunk *chunk = (struct itj_csv_count_chunk *)arg;
+    itj_csv_count_newlines(chunk->base, chunk->len, &chunk->count);
+}
+
+/*
+ * itj_csv_count_records split over threads. A chunk does not know if it starts inside quotes, so it
+ * is counted as if it does not. If it turns out it did, every quoted byte was unquoted and the other
+ * way around, so its unquoted newlines are its newlines minus what it counted.
+ * The chunks are then walked in order, carrying the quote state over
+ */
+itj_csv_umax itj_csv_count_records_parallel(const void *buf, itj_csv_umax len, itj_csv_u32 num_threads) {
+    struct itj_csv_count_chunk chunks[ITJ_CSV_MAX_THREADS];
+    num_threads = itj_csv_thread_count(len, num_threads);
+
+    itj_csv_umax chunk_len = (len / num_threads + ITJ_CSV_BLOCK_SIZE - 1) & ~(itj_csv_umax)(ITJ_CSV_BLOCK_SIZE - 1);
+    itj_csv_umax offset = 0;
+    for (itj_csv_u32 t = 0; t < num_threads; ++t) {
+        chunks[t].base = (const itj_csv_u8 *)buf + offset;
+        chunks[t].len = t + 1 == num_threads || offset + chunk_len > len ? len - offset : chunk_len;
+        chunks[t].count.unquoted_newlines = 0;
+        chunks[t].count.newlines = 0;
+        chunks[t].count.inside_quotes = 0;
+        offset += chunks[t].len;
+    }
+
+    itj_csv_run_threads(itj_csv_count_chunk_thread, chunks, sizeof(chunks[0]), num_threads);
+
+    itj_csv_umax records = 0;
+    itj_csv_u32 inside_quotes = 0;
+    for (itj_csv_u32 t = 0; t < num_threads; ++t) {
+        struct itj_csv_record_count *count = &chunks[t].count;
+        records += inside_quotes ? count->newlines - count->unquoted_newlines : count->unquoted_newlines;
+        inside_quotes ^= count->inside_quotes;
+    }
+
+    return records + (len > 0 && ((const itj_csv_u8 *)buf)[len - 1] != '\n');
+}
+
+/*
+ * Splits buf into num_chunks pieces of about the same size that each start on a record, into starts,
+ * which has num_chunks + 1 entries and ends with len. The quotes are counted per piece over threads,
+ * num_threads pieces at a time, as itj_csv_count_records_parallel does, which gives the quote state at
+ * every piece, and a piece then starts after its first newline outside quotes. Pieces can be empty
+ */
+void itj_csv_split_records(const void *buf, itj_csv_umax len, itj_csv_umax *starts, itj_csv_umax num_chunks, itj_csv_u32 num_threads) {
+    struct itj_csv_count_chunk chunks[ITJ_CSV_MAX_THREADS];
+    const itj_csv_u8 *bytes = (const itj_csv_u8 *)buf;
+    num_threads = num_threads == 0 || num_threads > ITJ_CSV_MAX_THREADS ? ITJ_CSV_MAX_THREADS : num_threads;
+
+    itj_csv_umax chunk_len = (len / num_chunks + ITJ_CSV_BLOCK_SIZE - 1) & ~(itj_csv_umax)(ITJ_CSV_BLOCK_SIZE - 1);
+    itj_csv_u32 inside_quotes = 0;
+    for (itj_csv_umax first = 0; first < num_chunks; first += num_threads) {
+        itj_csv_u32 batch = num_chunks - first < num_threads ? (itj_csv_u32)(num_chunks - first) : num_threads;
+        for (itj_csv_u32 t = 0; t < batch; ++t) {
+            itj_csv_umax offset = (first + t) * chunk_len < len ? (first + t) * chunk_len : len;
+            chunks[t].base = bytes + offset;
+            chunks[t].len = first + t + 1 == num_chunks || offset + chunk_len > len ? len - offset : chunk_len;
+            chunks[t].count.unquoted_newlines = 0;
+            chunks[t].count.newlines = 0;
+            chunks[t].count.inside_quotes = 0;
+        }
+        itj_csv_run_threads(itj_csv_count_chunk_thread, chunks, sizeof(chunks[0]), batch);
+
+        // Move every piece start to the record after it, the end of the previous piece with it
+        for (itj_csv_u32 t = 0; t < batch; ++t) {
+            itj_csv_umax i = first + t;
+            itj_csv_umax start = (itj_csv_umax)(chunks[t].base - bytes);
+            if (i > 0) {
+                start = itj_csv_next_record(bytes, len, start, (itj_csv_bool)inside_quotes);
+                start = start > starts[i - 1] ? start : starts[i - 1];
+            }
+            starts[i] = start;
+            inside_quotes ^= chunks[t].count.inside_quotes;
+        }
+    }
+    starts[num_chunks] = len;
+}
+
+// Counts the records from where fh is to its end, reading through mem_buf
+itj_csv_bool itj_csv_count_records_fp(FILE *fh, void *mem_buf, itj_csv_umax mem_buf_size, itj_csv_umax *count_out) {
+    struct itj_csv_record_count count = {0};
+    itj_csv_u8 last = '\n';
+    for (;;) {
+        size_t ret = fread(mem_buf, 1, mem_buf_size, fh);
+        if (ret == 0) {
+            break;
+        }
+        itj_csv_count_newlines((const itj_csv_u8 *)mem_buf, ret, &count);
+        last = ((itj_csv_u8 *)mem_buf)[ret - 1];
+    }
+
+    if (ferror(fh)) {
+        return ITJ_CSV_FALSE;
+    }
+
+    *count_out = count.unquoted_newlines + (last != '\n');
+    return ITJ_CSV_TRUE;
+}
+
+// Maps a whole file read only. An empty file maps to data == NULL and len == 0
+itj_csv_bool itj_csv_map_file(struct itj_csv_mapping *out, const char *filepath, itj_csv_u32 filepath_len) {
+    char null_terminated[4096];
+    if (filepath_len >= sizeof(null_terminated)) {
+        return ITJ_CSV_FALSE;
+    }
+    ITJ_CSV_MEMCPY(null_terminated, filepath, filepath_len);
+    null_terminated[filepath_len] = '\0';
+
+    out->data = NULL;
+    out->len = 0;
+
+#ifdef _WIN32
+    out->file_handle = NULL;
+    out->mapping_handle = NULL;
+
+    HANDLE file = CreateFileA(null_terminated, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return ITJ_CSV_FALSE;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return ITJ_CSV_FALSE;
+    }
+
+    out->file_handle = file;
+    if (size.QuadPart == 0) {
+        return ITJ_CSV_TRUE;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) {
+        CloseHandle(file);
+        return ITJ_CSV_FALSE;
+    }
+
+    out->data = (itj_csv_u8 *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!out->data) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return ITJ_CSV_FALSE;
+    }
+
+    out->mapping_handle = mapping;
+    out->len = (itj_csv_umax)size.QuadPart;
+#else
+    int fd = open(null_terminated, O_RDONLY);
+    if (fd < 0) {
+        return ITJ_CSV_FALSE;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return ITJ_CSV_FALSE;
+    }
+
+    if (st.st_size > 0) {
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return ITJ_CSV_FALSE;
+        }
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+        out->data = (itj_csv_u8 *)data;
+        out->len = (itj_csv_umax)st.st_size;
+    }
+
+    close(fd);
+#endif
+
+    return ITJ_CSV_TRUE;
+}
+
+void itj_csv_unmap_file(struct itj_csv_mapping *mapping) {
+#ifdef _WIN32
+    if (mapping->data) {
+        UnmapViewOfFile(mapping->data);
+    }
+    if (mapping->mapping_handle) {
+        CloseHandle(mapping->mapping_handle);
+    }
+    if (mapping->file_handle) {
+        CloseHandle(mapping->file_handle);
+    }
+#else
+    if (mapping->data) {
+        munmap(mapping->data, mapping->len);
+    }
+#endif
+    mapping->data = NULL;
+    mapping->len = 0;
+}
+
+#define ITJ_CSV_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// The ITJ_CSV_BUFFER_HEAP kind of itj_csv_buffer_alloc, which takes size + ITJ_CSV_BLOCK_SIZE +
+// ITJ_CSV_BUFFER_ALIGNMENT bytes and no more
+static itj_csv_bool itj_csv_buffer_alloc_heap(struct itj_csv_buffer *out, itj_csv_umax size, void *user_mem_ptr) {
+    itj_csv_umax allocation_size = size + ITJ_CSV_BLOCK_SIZE + ITJ_CSV_BUFFER_ALIGNMENT;
+    void *heap = ITJ_CSV_ALLOC(user_mem_ptr, allocation_size);
+    if (!heap) {
+        return ITJ_CSV_FALSE;
+    }
+    ITJ_CSV_MEMSET(heap, 0, allocation_size);
+    out->size = size;
+    out->kind = ITJ_CSV_BUFFER_HEAP;
+    out->allocation = heap;
+    out->allocation_size = allocation_size;
+    out->data = (itj_csv_u8 *)(((itj_csv_umax)heap + ITJ_CSV_BUFFER_ALIGNMENT - 1) & ~(itj_csv_umax)(ITJ_CSV_BUFFER_ALIGNMENT - 1));
+    return ITJ_CSV_TRUE;
+}
+
+/*
+ * Allocates a read buffer of size bytes for itj_csv_open and friends, plus the ITJ_CSV_BLOCK_SIZE
+ * bytes of slack the SIMD kernels read past the data. It tries explicit huge pages first, then
+ * memory aligned to a huge page with transparent huge pages asked for, then ordinary pages, and
+ * last the heap. out->kind says which it got. Every kind is zeroed and ITJ_CSV_BUFFER_ALIGNMENT aligned
+ */
+itj_csv_bool itj_csv_buffer_alloc(struct itj_csv_buffer *out, itj_csv_umax size, void *user_mem_ptr) {
+    itj_csv_umax needed = size + ITJ_CSV_BLOCK_SIZE;
+
+    out->size = size;
+    out->kind = ITJ_CSV_BUFFER_NONE;
+    out->data = NULL;
+
+#ifdef _WIN32
+    void *large = NULL;
+    SIZE_T large_page = GetLargePageMinimum();
+    if (large_page > 0) {
+        itj_csv_umax large_size = (needed + large_page - 1) & ~(itj_csv_umax)(large_page - 1);
+        large = VirtualAlloc(NULL, large_size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (large) {
+            out->kind = ITJ_CSV_BUFFER_HUGETLB;
+            out->allocation_size = large_size;
+        }
+    }
+    if (!large) {
+        large = VirtualAlloc(NULL, needed, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if (large) {
+            out->kind = ITJ_CSV_BUFFER_PAGES;
+            out->allocation_size = needed;
+        }
+    }
+    if (large) {
+        out->allocation = large;
+        out->data = (itj_csv_u8 *)large;
+        return ITJ_CSV_TRUE;
+    }
+#else
+    itj_csv_umax huge_size = (needed + ITJ_CSV_HUGE_PAGE_SIZE - 1) & ~(itj_csv_umax)(ITJ_CSV_HUGE_PAGE_SIZE - 1);
+
+#ifdef MAP_HUGETLB
+    if (size >= ITJ_CSV_HUGE_PAGE_SIZE / 2) {
+        void *huge = mmap(NULL, huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (huge != MAP_FAILED) {
+            out->kind = ITJ_CSV_BUFFER_HUGETLB;
+            out->allocation = huge;
+            out->allocation_size = huge_size;
+            out->data = (itj_csv_u8 *)huge;
+            return ITJ_CSV_TRUE;
+        }
+    }
+#endif
+
+    // Over-allocate by a huge page, then give back what is before and after the aligned part
+    itj_csv_umax padded_size = huge_size + ITJ_CSV_HUGE_PAGE_SIZE;
+    void *pages = mmap(NULL, padded_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pages != MAP_FAILED) {
+        itj_csv_umax start = (itj_csv_umax)pages;
+        itj_csv_umax aligned = (start + ITJ_CSV_HUGE_PAGE_SIZE - 1) & ~(itj_csv_umax)(ITJ_CSV_HUGE_PAGE_SIZE - 1);
+        if (aligned > start) {
+            munmap(pages, aligned - start);
+        }
+        if (start + padded_size > aligned + huge_size) {
+            munmap((void *)(aligned + huge_size), start + padded_size - (aligned + huge_size));
+        }
+
+        out->kind = ITJ_CSV_BUFFER_PAGES;
+#ifdef MADV_HUGEPAGE
+        if (madvise((void *)aligned, huge_size, MADV_HUGEPAGE) == 0) {
+            out->kind = ITJ_CSV_BUFFER_TRANSPARENT;
+        }
+#endif
+        out->allocation = (void *)aligned;
+        out->allocation_size = huge_size;
+        out->data = (itj_csv_u8 *)aligned;
+        return ITJ_CSV_TRUE;
+    }
+#endif
+
+    return itj_csv_buffer_alloc_heap(out, size, user_mem_ptr);
+}
+
+void itj_csv_buffer_free(struct itj_csv_buffer *buffer, void *user_mem_ptr) {
+    switch (buffer->kind) {
+    case ITJ_CSV_BUFFER_HUGETLB:
+    case ITJ_CSV_BUFFER_TRANSPARENT:
+    case ITJ_CSV_BUFFER_PAGES:
+#ifdef _WIN32
+        VirtualFree(buffer->allocation, 0, MEM_RELEASE);
+#else
+        munmap(buffer->allocation, buffer->allocation_size);
+#endif
+        break;
+    case ITJ_CSV_BUFFER_HEAP:
+        ITJ_CSV_FREE(user_mem_ptr, buffer->allocation);
+        break;
+    case ITJ_CSV_BUFFER_NONE:
+        break;
+    }
+    buffer->kind = ITJ_CSV_BUFFER_NONE;
+    buffer->data = NULL;
+}
+
+// Maps the file and counts its records over num_threads threads, 0 meaning one per cpu
+itj_csv_bool itj_csv_count_records_file(const char *filepath, itj_csv_u32 filepath_len, itj_csv_u32 num_threads, itj_csv_umax *count_out) {
+    struct itj_csv_mapping mapping;
+    if (!itj_csv_map_file(&mapping, filepath, filepath_len)) {
+        return ITJ_CSV_FALSE;
+    }
+
+    *count_out = itj_csv_count_records_parallel(mapping.data, mapping.len, num_threads);
+    itj_csv_unmap_file(&mapping);
+    return ITJ_CSV_TRUE;
+}
+
+// Monotonic clock, for throughput
+itj_csv_u64 itj_csv_now_ns(void) {
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (itj_csv_u64)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (itj_csv_u64)ts.tv_sec * 1000000000ull + (itj_csv_u64)ts.tv_nsec;
+#endif
+}
+
+// Returns the value before adding one
+ITJ_CSV_INLINE itj_csv_u32 itj_csv_atomic_increment(volatile itj_csv_u32 *value) {
+#ifdef ITJ_CSV_NO_THREADS
+    return (*value)++;
+#elif defined(_MSC_VER)
+    return (itj_csv_u32)InterlockedIncrement((volatile LONG *)value) - 1;
+#else
+    return __atomic_fetch_add(value, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+// The value after taking one off
+ITJ_CSV_INLINE itj_csv_u32 itj_csv_atomic_decrement(volatile itj_csv_u32 *value) {
+#ifdef ITJ_CSV_NO_THREADS
+    return --(*value);
+#elif defined(_MSC_VER)
+    return (itj_csv_u32)InterlockedDecrement((volatile LONG *)value);
+#else
+    return __atomic_sub_fetch(value, 1, __ATOMIC_ACQ_REL);
+#endif
+}
+
+void itj_csv_free_header(struct itj_csv *csv);
+
+struct itj_csv_ingest_worker {
+    const struct itj_csv_ingest *ingest;
+    volatile itj_csv_u32 *next_file;
+    itj_csv_u32 index;
+    struct itj_csv_buffer buffer;
+    struct itj_csv_ingest_stats total;
+    itj_csv_u32 failed_files;
+};
+
+static void itj_csv_ingest_file(struct itj_csv_ingest_worker *worker, itj_csv_u32 file, struct itj_csv_ingest_stats *stats) {
+    const struct itj_csv_ingest *ingest = worker->ingest;
+    itj_csv_kernel_fn kernel = ingest->kernel ? ingest->kernel : itj_csv_select_kernel(ingest->delimiter, ITJ_CSV_KERNEL_DEFAULT);
+    itj_csv_u64 start = itj_csv_now_ns();
+
+    ITJ_CSV_MEMSET(stats, 0, sizeof(*stats));
+    stats->worker = worker->index;
+
+    FILE *fh = fopen(ingest->paths[file], "rb");
+    if (!fh) {
+        stats->nanoseconds = itj_csv_now_ns() - start;
+        return;
+    }
+    stats->opened = ITJ_CSV_TRUE;
+
+    struct itj_csv csv;
+    itj_csv_open_fp(&csv, fh, worker->buffer.data, worker->buffer.size, ingest->delimiter, ingest->user_mem_ptr);
+    itj_csv_pump_stdio(&csv);
+
+    if (!ingest->on_open || ingest->on_open(ingest->user, worker->index, file, &csv)) {
+        for (;;) {
+            struct itj_csv_value value = kernel(&csv);
+            if (value.need_data) {
+                if (itj_csv_pump_stdio(&csv) == 0) {
+                    break;
+                }
+                continue;
+            }
+
+            stats->values += 1;
+            stats->rows += value.is_end_of_line;
+            if (!ingest->on_value(ingest->user, worker->index, file, &csv, &value)) {
+                stats->stopped = ITJ_CSV_TRUE;
+                break;
+            }
+        }
+    }
+
+    stats->bytes = csv.base_offset + csv.read_used;
+    stats->error = csv.error;
+    itj_csv_free_header(&csv);
+    fclose(fh);
+    stats->nanoseconds = itj_csv_now_ns() - start;
+}
+
+static void itj_csv_ingest_thread(void *arg) {
+    struct itj_csv_ingest_worker *worker = (struct itj_csv_ingest_worker *)arg;
+    const struct itj_csv_ingest *ingest = worker->ingest;
+
+    for (;;) {
+        itj_csv_u32 file = itj_csv_atomic_increment(worker->next_file);
+        if (file >= ingest->num_files) {
+            break;
+        }
+
+        struct itj_csv_ingest_stats stats;
+        itj_csv_ingest_file(worker, file, &stats);
+
+        worker->total.bytes += stats.bytes;
+        worker->total.values += stats.values;
+        worker->total.rows += stats.rows;
+        worker->failed_files += !stats.opened || stats.error.kind != ITJ_CSV_ERROR_NONE;
+        if (ingest->file_stats) {
+            ingest->file_stats[file] = stats;
+        }
+        if (ingest->on_done) {
+            ingest->on_done(ingest->user, worker->index, file, &stats);
+        }
+    }
+}
+
+/*
+ * Parses many files with a fixed pool of workers, each with its own itj_csv and read buffer, taking
+ * the next file off a shared counter when done with one. The memory budget is split evenly between
+ * the read buffers, with fewer workers when a buffer would be under ITJ_CSV_INGEST_MIN_BUFFER. The
+ * buffers come from the heap, as itj_csv_buffer_alloc would round each up to a huge page and take
+ * more than the budget, and a value bigger than one ends its file with
+ * ITJ_CSV_ERROR_VALUE_TOO_BIG. Values go to on_value on the worker that read them, with the worker
+ * index, so callers keep per-worker state without locking. Returns false when nothing could run
+ */
+itj_csv_bool itj_csv_ingest_files(const struct itj_csv_ingest *ingest, struct itj_csv_ingest_result *out) {
+    struct itj_csv_ingest_worker workers[ITJ_CSV_MAX_THREADS];
+    itj_csv_umax budget = ingest->memory_budget ? ingest->memory_budget : ITJ_CSV_INGEST_BUDGET;
+    itj_csv_u32 num_workers = ingest->num_workers ? ingest->num_workers : itj_csv_num_cpus();
+
+    ITJ_CSV_MEMSET(out, 0, sizeof(*out));
+    if (!ingest->on_value || budget <= ITJ_CSV_BLOCK_SIZE) {
+        return ITJ_CSV_FALSE;
+    }
+
+    if (num_workers > ITJ_CSV_MAX_THREADS) {
+        num_workers = ITJ_CSV_MAX_THREADS;
+    }
+    if (num_workers > ingest->num_files) {
+        num_workers = ingest->num_files;
+    }
+    if (budget / ITJ_CSV_INGEST_MIN_BUFFER < num_workers) {
+        num_workers = (itj_csv_u32)(budget / ITJ_CSV_INGEST_MIN_BUFFER);
+    }
+    if (num_workers == 0) {
+        num_workers = 1;
+    }
+
+    // The SIMD slack and the alignment come out of the budget too
+    itj_csv_umax share = budget / num_workers;
+    if (share <= ITJ_CSV_BLOCK_SIZE + 2 * ITJ_CSV_BUFFER_ALIGNMENT) {
+        return ITJ_CSV_FALSE;
+    }
+    itj_csv_umax buffer_size = (share - ITJ_CSV_BLOCK_SIZE - ITJ_CSV_BUFFER_ALIGNMENT) & ~(itj_csv_umax)(ITJ_CSV_BUFFER_ALIGNMENT - 1);
+
+    volatile itj_csv_u32 next_file = 0;
+    for (itj_csv_u32 w = 0; w < num_workers; ++w) {
+        ITJ_CSV_MEMSET(&workers[w], 0, sizeof(workers[w]));
+        workers[w].ingest = ingest;
+        workers[w].next_file = &next_file;
+        workers[w].index = w;
+        if (!itj_csv_buffer_alloc_heap(&workers[w].buffer, buffer_size, ingest->user_mem_ptr)) {
+            for (itj_csv_u32 f = 0; f < w; ++f) {
+                itj_csv_buffer_free(&workers[f].buffer, ingest->user_mem_ptr);
+            }
+            return ITJ_CSV_FALSE;
+        }
+    }
+
+    itj_csv_u64 start = itj_csv_now_ns();
+    itj_csv_run_threads(itj_csv_ingest_thread, workers, sizeof(workers[0]), num_workers);
+    out->total.nanoseconds = itj_csv_now_ns() - start;
+
+    for (itj_csv_u32 w = 0; w < num_workers; ++w) {
+        out->total.bytes += workers[w].total.bytes;
+        out->total.values += workers[w].total.values;
+        out->total.rows += workers[w].total.rows;
+        out->failed_files += workers[w].failed_files;
+        out->memory_used += workers[w].buffer.allocation_size;
+        itj_csv_buffer_free(&workers[w].buffer, ingest->user_mem_ptr);
+    }
+    out->total.opened = ITJ_CSV_TRUE;
+    out->num_workers = num_workers;
+    out->buffer_size = buffer_size;
+    return ITJ_CSV_TRUE;
+}
+
+/*
+ * Opens a file to follow as it grows, from start_offset, which may be a saved
+ * itj_csv_follow_offset(). The end of the file is never taken as the end of the data, and
+ * itj_csv_pump_follow hands the kernels whole records only, so a last record without its newline
+ * waits for it. Watches the file with inotify on Linux, elsewhere it polls
+ */
+itj_csv_bool itj_csv_open_follow(struct itj_csv *csv_out, const char *filepath, itj_csv_u32 filepath_len, itj_csv_umax start_offset,
+                                 void *mem_buf, itj_csv_umax mem_buf_size, itj_csv_u8 delimiter, void *user_mem_ptr) {
+    char null_terminated[4096];
+    if (filepath_len >= sizeof(null_terminated)) {
+        return ITJ_CSV_FALSE;
+    }
+    ITJ_CSV_MEMCPY(null_terminated, filepath, filepath_len);
+    null_terminated[filepath_len] = '\0';
+
+    FILE *fh = fopen(null_terminated, "rb");
+    if (!fh) {
+        return ITJ_CSV_FALSE;
+    }
+
+#ifdef _WIN32
+    int seek_failed = _fseeki64(fh, (__int64)start_offset, SEEK_SET);
+#else
+    int seek_failed = fseeko(fh, (off_t)start_offset, SEEK_SET);
+#endif
+    if (seek_failed) {
+        fclose(fh);
+        return ITJ_CSV_FALSE;
+    }
+
+    itj_csv_open_fp(csv_out, fh, mem_buf, mem_buf_size, delimiter, user_mem_ptr);
+    csv_out->base_offset = start_offset;
+    csv_out->follow = ITJ_CSV_TRUE;
+
+#ifdef __linux__
+    // Set up before the first read, so nothing appended after it goes unnoticed
+    csv_out->follow_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (csv_out->follow_fd >= 0 && inotify_add_watch(csv_out->follow_fd, null_terminated, IN_MODIFY | IN_CLOSE_WRITE) < 0) {
+        close(csv_out->follow_fd);
+        csv_out->follow_fd = -1;
+    }
+#endif
+
+    return ITJ_CSV_TRUE;
+}
+
+// Where to start following again later, the offset of the first byte not parsed yet
+itj_csv_umax itj_csv_follow_offset(const struct itj_csv *csv) {
+    return csv->base_offset + csv->read_iter;
+}
+
+// Stops waiting for more, so the next itj_csv_pump_stdio takes the end of the file as the end of the data
+void itj_csv_stop_follow(struct itj_csv *csv) {
+#ifdef __linux__
+    if (csv->follow_fd >= 0) {
+        close(csv->follow_fd);
+    }
+#endif
+    csv->follow_fd = -1;
+    csv->follow = ITJ_CSV_FALSE;
+    if (csv->fh) {
+        clearerr(csv->fh);
+    }
+}
+
+static void itj_csv_follow_wait(struct itj_csv *csv, itj_csv_u32 timeout_ms) {
+#ifdef __linux__
+    if (csv->follow_fd >= 0) {
+        struct pollfd fd;
+        fd.fd = csv->follow_fd;
+        fd.events = POLLIN;
+        fd.revents = 0;
+        if (poll(&fd, 1, (int)timeout_ms) > 0) {
+            char events[4096];
+            while (read(csv->follow_fd, events, sizeof(events)) > 0) {
+            }
+        }
+        return;
+    }
+#endif
+
+    if (timeout_ms > ITJ_CSV_FOLLOW_POLL_MS) {
+        timeout_ms = ITJ_CSV_FOLLOW_POLL_MS;
+    }
+#ifdef _WIN32
+    Sleep(timeout_ms);
+#else
+    struct timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000;
+    nanosleep(&ts, NULL);
+#endif
+}
+
+ITJ_CSV_INLINE itj_csv_u32 itj_csv_unquoted_newlines(const itj_csv_u8 *p, itj_csv_u32 *inside_quotes) {
+    itj_csv_u32 quoted = itj_csv_quoted_mask(itj_csv_byte_mask(p, '"'), inside_quotes);
+    return itj_csv_byte_mask(p, '\n') & ~quoted;
+}
+
+// One past the last newline outside quotes in [i, len), or end when there is none. Starts from the
+// quote state in *inside_quotes and leaves the state at len there. The tail is copied into a zeroed block
+static itj_csv_umax itj_csv_last_record_end(const itj_csv_u8 *buf, itj_csv_umax i, itj_csv_umax len, itj_csv_umax end, itj_csv_u32 *inside_quotes) {
+    for (; i + ITJ_CSV_BLOCK_SIZE <= len; i += ITJ_CSV_BLOCK_SIZE) {
+        itj_csv_u32 newlines = itj_csv_unquoted_newlines(buf + i, inside_quotes);
+        if (newlines) {
+            end = i + itj_csv_bit_width(newlines);
+        }
+    }
+
+    if (i < len) {
+        itj_csv_u8 tail[ITJ_CSV_BLOCK_SIZE];
+        ITJ_CSV_MEMSET(tail, 0, sizeof(tail));
+        ITJ_CSV_MEMCPY(tail, buf + i, len - i);
+        itj_csv_u32 newlines = itj_csv_unquoted_newlines(tail, inside_quotes);
+        if (newlines) {
+            end = i + itj_csv_bit_width(newlines);
+        }
+    }
+    return end;
+}
+
+/*
+ * itj_csv_pump_stdio for a file opened with itj_csv_open_follow. When the file has no more whole
+ * records it waits up to timeout_ms for some to be appended, then returns 0 if none were.
+ * The bytes after the last newline are given back to the file, to be read again with the rest
+ * of their record, unless the buffer is full without a single newline, which the kernels report
+ * as ITJ_CSV_ERROR_VALUE_TOO_BIG. Bytes given back are remembered as scanned, so each pump
+ * scans only what was appended since. If seeking back fails it stops following, and the file is
+ * read to its end. Returns the bytes ready to parse
+ */
+itj_csv_umax itj_csv_pump_follow(struct itj_csv *csv, itj_csv_u32 timeout_ms) {
+    itj_csv_u64 start = itj_csv_now_ns();
+    for (;;) {
+        if (!csv->follow) {
+            return itj_csv_pump_stdio(csv);
+        }
+
+        // What is kept from the last pump is whole records, unless that filled the buffer
+        itj_csv_umax kept = csv->read_used > csv->read_iter ? csv->read_used - csv->read_iter : 0;
+        itj_csv_pump_stdio(csv);
+        if (csv->error.kind != ITJ_CSV_ERROR_NONE) {
+            return 0;
+        }
+
+        // The bytes given back last time are read again right after those kept
+        itj_csv_umax from = kept + csv->follow_scanned;
+        itj_csv_umax end = csv->follow_split ? 0 : kept;
+        itj_csv_u32 inside_quotes = csv->follow_quotes;
+        if (from > csv->read_used) {
+            // The file was cut short under us, scan all of it again
+            from = 0;
+            end = 0;
+            inside_quotes = 0;
+        }
+        end = itj_csv_last_record_end(csv->read_base, from, csv->read_used, end, &inside_quotes);
+        csv->follow_split = end == 0 && csv->read_used == csv->read_max;
+        if (csv->follow_split) {
+            end = csv->read_used;
+        }
+
+        csv->follow_scanned = csv->read_used - end;
+        csv->follow_quotes = inside_quotes;
+        if (end < csv->read_used) {
+            itj_csv_umax offset = csv->base_offset + end;
+#ifdef _WIN32
+            int seek_failed = _fseeki64(csv->fh, (__int64)offset, SEEK_SET);
+#else
+            int seek_failed = fseeko(csv->fh, (off_t)offset, SEEK_SET);
+#endif
+            if (seek_failed) {
+                itj_csv_stop_follow(csv);
+                return csv->read_used;
+            }
+            csv->read_used = end;
+        }
+        if (end > 0) {
+            return end;
+        }
+
+        itj_csv_u64 waited_ms = (itj_csv_now_ns() - start) / 1000000;
+        if (waited_ms >= timeout_ms) {
+            return 0;
+        }
+        itj_csv_follow_wait(csv, timeout_ms - (itj_csv_u32)waited_ms);
+    }
+}
+
+void itj_csv_close_follow(struct itj_csv *csv) {
+    itj_csv_stop_follow(csv);
+    itj_csv_close_fh(csv);
+}
+
+#endif // ITJ_CSV_IMPLEMENTATION && !ITJ_CSV_NO_STD
+
+#ifdef ITJ_CSV_IMPLEMENTATION
+
+/*
+ * The header row, copied out of the read buffer, with a perfect hash from column name to index.
+ * The names hash into buckets, and every bucket gets a displacement that moves all of its names
+ * to free slots, largest buckets first (hash and displace). A lookup is then one hash, one
+ * displacement and one string compare, whatever the number of columns
+ */
+typedef struct itj_csv_header {
+    struct itj_csv_string *names;
+    itj_csv_u32 num_columns;
+    itj_csv_u32 num_buckets; // Powers of two
+    itj_csv_u32 num_slots;
+    itj_csv_u32 *displacements; // One per bucket
+    itj_csv_u32 *slots; // Column index + 1, 0 for a free slot
+    itj_csv_u8 *arena;
+    itj_csv_umax arena_used;
+    itj_csv_umax arena_max;
+    itj_csv_u32 names_max;
+} itj_csv_header_t;
+
+// FNV-1a
+ITJ_CSV_INLINE itj_csv_u64 itj_csv_hash(const itj_csv_u8 *base, itj_csv_umax len) {
+    itj_csv_u64 hash = 0xcbf29ce484222325ull;
+    for (itj_csv_umax i = 0; i < len; ++i) {
+        hash = (hash ^ base[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+ITJ_CSV_INLINE itj_csv_u32 itj_csv_hash_slot(itj_csv_u64 hash, itj_csv_u32 displacement, itj_csv_u32 num_slots) {
+    hash += (itj_csv_u64)displacement * 0x9e3779b97f4a7c15ull;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return (itj_csv_u32)hash & (num_slots - 1);
+}
+
+static itj_csv_bool itj_csv_header_push(struct itj_csv *csv, struct itj_csv_header *header, const itj_csv_u8 *base, itj_csv_u32 len) {
+    if (header->num_columns == header->names_max) {
+        itj_csv_u32 names_max = header->names_max ? header->names_max * 2 : 64;
+        struct itj_csv_string *names = (struct itj_csv_string *)ITJ_CSV_ALLOC(csv->user_mem_ptr, names_max * sizeof(*names));
+        if (!names) {
+            return ITJ_CSV_FALSE;
+        }
+        if (header->names) {
+            ITJ_CSV_MEMCPY(names, header->names, header->num_columns * sizeof(*names));
+            ITJ_CSV_FREE(csv->user_mem_ptr, header->names);
+        }
+        header->names = names;
+        header->names_max = names_max;
+    }
+
+    if (header->arena_used + len > header->arena_max) {
+        itj_csv_umax arena_max = header->arena_max ? header->arena_max * 2 : 4096;
+        while (arena_max < header->arena_used + len) {
+            arena_max *= 2;
+        }
+        itj_csv_u8 *arena = (itj_csv_u8 *)ITJ_CSV_ALLOC(csv->user_mem_ptr, arena_max);
+        if (!arena) {
+            return ITJ_CSV_FALSE;
+        }
+        if (header->arena) {
+            ITJ_CSV_MEMCPY(arena, header->arena, header->arena_used);
+            ITJ_CSV_FREE(csv->user_mem_ptr, header->arena);
+        }
+        // Names point into the arena by offset until the arena stops moving
+        header->arena = arena;
+        header->arena_max = arena_max;
+    }
+
+    ITJ_CSV_MEMCPY(header->arena + header->arena_used, base, len);
+    header->names[header->num_columns].base = (itj_csv_u8 *)(itj_csv_umax)header->arena_used;
+    header->names[header->num_columns].len = len;
+    header->arena_used += len;
+    header->num_columns += 1;
+    return ITJ_CSV_TRUE;
+}
+
+ITJ_CSV_INLINE itj_csv_bool itj_csv_string_equal(const itj_csv_u8 *a, itj_csv_u32 a_len, const itj_csv_u8 *b, itj_csv_u32 b_len) {
+    if (a_len != b_len) {
+        return ITJ_CSV_FALSE;
+    }
+    for (itj_csv_u32 i = 0; i < a_len; ++i) {
+        if (a[i] != b[i]) {
+            return ITJ_CSV_FALSE;
+        }
+    }
+    return ITJ_CSV_TRUE;
+}
+
+// Finds a displacement for every bucket, or returns false if some bucket found none within the tries
+static itj_csv_bool itj_csv_header_place(struct itj_csv_header *header, const itj_csv_u64 *hashes, const itj_csv_u32 *bucket_starts, const itj_csv_u32 *bucket_sizes, const itj_csv_u32 *bucket_keys, const itj_csv_u32 *order) {
+    ITJ_CSV_MEMSET(header->slots, 0, header->num_slots * sizeof(*header->slots));
+
+    for (itj_csv_u32 o = 0; o < header->num_buckets; ++o) {
+        itj_csv_u32 b = order[o];
+        itj_csv_u32 start = bucket_starts[b];
+        itj_csv_u32 end = start + bucket_sizes[b];
+        header->displacements[b] = 0;
+        if (start == end) {
+            continue;
+        }
+
+        itj_csv_u32 displacement = 0;
+        for (; displacement < (1u << 16); ++displacement) {
+            itj_csv_u32 k = start;
+            for (; k < end; ++k) {
+                itj_csv_u32 slot = itj_csv_hash_slot(hashes[bucket_keys[k]], displacement, header->num_slots);
+                if (header->slots[slot]) {
+                    break;
+                }
+                header->slots[slot] = bucket_keys[k] + 1;
+            }
+
+            if (k == end) {
+                break;
+            }
+
+            // Undo the names placed with this displacement
+            while (k-- > start) {
+                header->slots[itj_csv_hash_slot(hashes[bucket_keys[k]], displacement, header->num_slots)] = 0;
+            }
+        }
+
+        if (displacement == (1u << 16)) {
+            return ITJ_CSV_FALSE;
+        }
+        header->displacements[b] = displacement;
+    }
+
+    return ITJ_CSV_TRUE;
+}
+
+static itj_csv_bool itj_csv_header_build(struct itj_csv *csv, struct itj_csv_header *header) {
+    itj_csv_u32 n = header->num_columns;
+    for (itj_csv_u32 i = 0; i < n; ++i) {
+        header->names[i].base = header->arena + (itj_csv_umax)header->names[i].base;
+    }
+
+    header->num_buckets = 1;
+    while (header->num_buckets * 2 < n) {
+        header->num_buckets *= 2;
+    }
+    header->num_slots = 2;
+    while (header->num_slots < n * 2) {
+        header->num_slots *= 2;
+    }
+
+    itj_csv_umax scratch_size = n * sizeof(itj_csv_u64) + (header->num_buckets * 3 + n) * sizeof(itj_csv_u32);
+    itj_csv_u8 *scratch = (itj_csv_u8 *)ITJ_CSV_ALLOC(csv->user_mem_ptr, scratch_size);
+    header->displacements = (itj_csv_u32 *)ITJ_CSV_ALLOC(csv->user_mem_ptr, header->num_buckets * sizeof(itj_csv_u32));
+    if (!scratch || !header->displacements) {
+        if (scratch) {
+            ITJ_CSV_FREE(csv->user_mem_ptr, scratch);
+        }
+        return ITJ_CSV_FALSE;
+    }
+    itj_csv_u64 *hashes = (itj_csv_u64 *)scratch;
+    itj_csv_u32 *bucket_starts = (itj_csv_u32 *)(hashes + n);
+    itj_csv_u32 *bucket_sizes = bucket_starts + header->num_buckets;
+    itj_csv_u32 *order = bucket_sizes + header->num_buckets;
+    itj_csv_u32 *bucket_keys = order + header->num_buckets;
+
+    // Counting sort of the names into buckets. A repeated name keeps its first column
+    ITJ_CSV_MEMSET(bucket_starts, 0, header->num_buckets * 2 * sizeof(itj_csv_u32));
+    for (itj_csv_u32 i = 0; i < n; ++i) {
+        hashes[i] = itj_csv_hash(header->names[i].base, header->names[i].len);
+        bucket_sizes[hashes[i] & (header->num_buckets - 1)] += 1;
+    }
+    itj_csv_u32 max_bucket_size = 0;
+    for (itj_csv_u32 b = 1; b < header->num_buckets; ++b) {
+        bucket_starts[b] = bucket_starts[b - 1] + bucket_sizes[b - 1];
+    }
+    ITJ_CSV_MEMSET(bucket_sizes, 0, header->num_buckets * sizeof(itj_csv_u32));
+    // Two names with the same hash go to the same slot whatever the displacement, and such names can be
+    // made on purpose, so the header is refused rather than grown without end
+    itj_csv_bool colliding = ITJ_CSV_FALSE;
+    for (itj_csv_u32 i = 0; i < n && !colliding; ++i) {
+        itj_csv_u32 b = hashes[i] & (header->num_buckets - 1);
+        itj_csv_bool repeated = ITJ_CSV_FALSE;
+        for (itj_csv_u32 k = bucket_starts[b]; k < bucket_starts[b] + bucket_sizes[b]; ++k) {
+            struct itj_csv_string *other = &header->names[bucket_keys[k]];
+            if (hashes[bucket_keys[k]] == hashes[i]) {
+                repeated = itj_csv_string_equal(other->base, other->len, header->names[i].base, header->names[i].len);
+                colliding = !repeated;
+                break;
+            }
+        }
+        if (!repeated) {
+            bucket_keys[bucket_starts[b] + bucket_sizes[b]++] = i;
+            if (bucket_sizes[b] > max_bucket_size) {
+                max_bucket_size = bucket_sizes[b];
+            }
+        }
+    }
+
+    // Largest buckets first, they are the hardest to place
+    itj_csv_u32 num_ordered = 0;
+    for (itj_csv_u32 size = max_bucket_size + 1; size-- > 0;) {
+        for (itj_csv_u32 b = 0; b < header->num_buckets; ++b) {
+            if (bucket_sizes[b] == size) {
+                order[num_ordered++] = b;
+            }
+        }
+    }
+
+    // Distinct hashes place in a table a few doublings bigger at most, the limit only bounds the memory
+    itj_csv_bool ok = ITJ_CSV_FALSE;
+    for (itj_csv_u32 attempt = 0; !colliding && attempt < 8; ++attempt) {
+        header->slots = (itj_csv_u32 *)ITJ_CSV_ALLOC(csv->user_mem_ptr, header->num_slots * sizeof(itj_csv_u32));
+        if (!header->slots) {
+            break;
+        }
+        if (itj_csv_header_place(header, hashes, bucket_starts, bucket_sizes, bucket_keys, order)) {
+            ok = ITJ_CSV_TRUE;
+            break;
+        }
+        ITJ_CSV_FREE(csv->user_mem_ptr, header->slots);
+        header->slots = NULL;
+        header->num_slots *= 2;
+    }
+
+    ITJ_CSV_FREE(csv->user_mem_ptr, scratch);
+    return ok;
+}
+
+void itj_csv_free_header(struct itj_csv *csv) {
+    struct itj_csv_header *header = csv->header;
+    if (!header) {
+        return;
+    }
+    if (header->names) {
+        ITJ_CSV_FREE(csv->user_mem_ptr, header->names);
+    }
+    if (header->arena) {
+        ITJ_CSV_FREE(csv->user_mem_ptr, header->arena);
+    }
+    if (header->displacements) {
+        ITJ_CSV_FREE(csv->user_mem_ptr, header->displacements);
+    }
+    if (header->slots) {
+        ITJ_CSV_FREE(csv->user_mem_ptr, header->slots);
+    }
+    ITJ_CSV_FREE(csv->user_mem_ptr, header);
+    csv->header = NULL;
+}
+
+/*
+ * Reads the next row as the header, copying the names out of the read buffer, and builds the
+ * lookup for itj_csv_column_index. Pumps when a file was opened, so call it after the first pump
+ * and after skipping any preamble. Returns false when out of memory, or for two names with the same
+ * hash, which the lookup can not tell apart
+ */
+itj_csv_bool itj_csv_read_header(struct itj_csv *csv) {
+    itj_csv_free_header(csv);
+
+    struct itj_csv_header *header = (struct itj_csv_header *)ITJ_CSV_ALLOC(csv->user_mem_ptr, sizeof(struct itj_csv_header));
+    if (!header) {
+        return ITJ_CSV_FALSE;
+    }
+    ITJ_CSV_MEMSET(header, 0, sizeof(*header));
+    csv->header = header;
+
+    for (;;) {
+        struct itj_csv_value value = itj_csv_get_next_value(csv);
+        if (value.need_data) {
+#ifndef ITJ_CSV_NO_STD
+            if (csv->fh && itj_csv_pump_stdio(csv) != 0) {
+                continue;
+            }
+#endif
+            break;
+        }
+
+        if (!itj_csv_header_push(csv, header, value.data.base, value.data.len)) {
+            itj_csv_free_header(csv);
+            return ITJ_CSV_FALSE;
+        }
+
+        if (value.is_end_of_line) {
+            if (!itj_csv_header_build(csv, header)) {
+                itj_csv_free_header(csv);
+                return ITJ_CSV_FALSE;
+            }
+            return ITJ_CSV_TRUE;
+        }
+    }
+
+    itj_csv_free_header(csv);
+    return ITJ_CSV_FALSE;
+}
+
+// The index of the column with this name in the header, or -1 if there is no such column or no header was read
+itj_csv_smax itj_csv_column_index(const struct itj_csv *csv, const char *name, itj_csv_u32 len) {
+    const struct itj_csv_header *header = csv->header;
+    if (!header || header->num_columns == 0) {
+        return -1;
+    }
+
+    itj_csv_u64 hash = itj_csv_hash((const itj_csv_u8 *)name, len);
+    itj_csv_u32 displacement = header->displacements[hash & (header->num_buckets - 1)];
+    itj_csv_u32 column = header->slots[itj_csv_hash_slot(hash, displacement, header->num_slots)];
+    if (column == 0) {
+        return -1;
+    }
+
+    const struct itj_csv_string *found = &header->names[column - 1];
+    if (!itj_csv_string_equal(found->base, found->len, (const itj_csv_u8 *)name, len)) {
+        return -1;
+    }
+    return column - 1;
+}
+
+// The name of a header column, or an empty string past the last column
+struct itj_csv_string itj_csv_column_name(const struct itj_csv *csv, itj_csv_u32 column) {
+    struct itj_csv_string rv = { NULL, 0 };
+    if (csv->header && column < csv->header->num_columns) {
+        rv = csv->header->names[column];
+    }
+    return rv;
+}
+
+#endif // ITJ_CSV_IMPLEMENTATION
+
+#ifdef ITJ_CSV_IMPLEMENTATION
+
+static const itj_csv_u8 itj_csv_sniff_candidates[] = { ITJ_CSV_DELIM_COMMA, ITJ_CSV_DELIM_COLON, ITJ_CSV_DELIM_TAB, ITJ_CSV_DELIM_PIPE };
+#define ITJ_CSV_NUM_SNIFF_CANDIDATES (sizeof(itj_csv_sniff_candidates) / sizeof(itj_csv_sniff_candidates[0]))
+
+itj_csv_type_t itj_csv_guess_type(const itj_csv_u8 *base, itj_csv_umax len) {
+    if (len == 0) {
+        return ITJ_CSV_TYPE_EMPTY;
+    }
+
+    itj_csv_umax i = 0;
+    if (base[i] == '-' || base[i] == '+') {
+        ++i;
+    }
+
+    itj_csv_umax num_digits = 0;
+    for (; i < len && base[i] >= '0' && base[i] <= '9'; ++i) {
+        ++num_digits;
+    }
+
+    if (i == len) {
+        return num_digits > 0 ? ITJ_CSV_TYPE_INTEGER : ITJ_CSV_TYPE_STRING;
+    }
+
+    if (base[i] == '.') {
+        for (++i; i < len && base[i] >= '0' && base[i] <= '9'; ++i) {
+            ++num_digits;
+        }
+    }
+
+    if (num_digits == 0) {
+        return ITJ_CSV_TYPE_STRING;
+    }
+
+    if (i < len && (base[i] == 'e' || base[i] == 'E')) {
+        ++i;
+        if (i < len && (base[i] == '-' || base[i] == '+')) {
+            ++i;
+        }
+
+        itj_csv_umax num_exponent_digits = 0;
+        for (; i < len && base[i] >= '0' && base[i] <= '9'; ++i) {
+            ++num_exponent_digits;
+        }
+
+        if (num_exponent_digits == 0) {
+            return ITJ_CSV_TYPE_STRING;
+        }
+    }
+
+    return i == len ? ITJ_CSV_TYPE_FLOAT : ITJ_CSV_TYPE_STRING;
+}
+
+// Exactly representable as doubles, so a mantissa under 2^53 times or divided by one rounds correctly
+static const double itj_csv_exact_powers_of_10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// A whole value as a decimal integer, with an optional sign. Fails on anything else, or on overflow
+itj_csv_bool itj_csv_parse_s64(const itj_csv_u8 *base, itj_csv_umax len, itj_csv_s64 *out) {
+    itj_csv_umax i = 0;
+    itj_csv_bool negative = ITJ_CSV_FALSE;
+    if (len > 0 && (base[0] == '-' || base[0] == '+')) {
+        negative = base[0] == '-';
+        i = 1;
+    }
+    if (i == len) {
+        return ITJ_CSV_FALSE;
+    }
+
+    itj_csv_u64 value = 0;
+    itj_csv_u64 limit = negative ? 9223372036854775808ull : 9223372036854775807ull;
+    for (; i < len; ++i) {
+        itj_csv_u32 digit = (itj_csv_u32)base[i] - '0';
+        if (digit > 9 || value > (limit - digit) / 10) {
+            return ITJ_CSV_FALSE;
+        }
+        value = value * 10 + digit;
+    }
+
+    *out = negative ? (itj_csv_s64)(0 - value) : (itj_csv_s64)value;
+    return ITJ_CSV_TRUE;
+}
+
+/*
+ * A whole value as a decimal floating point number. Up to 19 significant digits with a small
+ * exponent, nearly every number in a CSV file, is one multiply or divide by an exact power of 10
+ * (Clinger's fast path). Anything else, like long mantissas, big exponents, inf or nan, goes to strtod
+ */
+itj_csv_bool itj_csv_parse_f64(const itj_csv_u8 *base, itj_csv_umax len, double *out) {
+    itj_csv_umax i = 0;
+    itj_csv_bool negative = ITJ_CSV_FALSE;
+    if (len > 0 && (base[0] == '-' || base[0] == '+')) {
+        negative = base[0] == '-';
+        i = 1;
+    }
+
+    itj_csv_u64 mantissa = 0;
+    itj_csv_s32 exponent = 0;
+    itj_csv_u32 num_digits = 0;
+    itj_csv_u32 num_significant = 0;
+    itj_csv_bool truncated = ITJ_CSV_FALSE;
+    for (; i < len && (itj_csv_u32)base[i] - '0' <= 9; ++i, ++num_digits) {
+        if (num_significant < 19) {
+            mantissa = mantissa * 10 + (base[i] - '0');
+            num_significant += mantissa != 0;
+        } else {
+            truncated |= base[i] != '0';
+            exponent += 1;
+        }
+    }
+    if (i < len && base[i] == '.') {
+        for (++i; i < len && (itj_csv_u32)base[i] - '0' <= 9; ++i, ++num_digits) {
+            if (num_significant < 19) {
+                mantissa = mantissa * 10 + (base[i] - '0');
+                num_significant += mantissa != 0;
+                exponent -= 1;
+            } else {
+                truncated |= base[i] != '0';
+            }
+        }
+    }
+
+    if (num_digits > 0 && i < len && (base[i] == 'e' || base[i] == 'E')) {
+        itj_csv_umax j = i + 1;
+        itj_csv_bool negative_exponent = ITJ_CSV_FALSE;
+        if (j < len && (base[j] == '-' || base[j] == '+')) {
+            negative_exponent = base[j] == '-';
+            ++j;
+        }
+        itj_csv_s32 written = 0;
+        itj_csv_umax start = j;
+        for (; j < len && (itj_csv_u32)base[j] - '0' <= 9; ++j) {
+            if (written < 100000) {
+                written = written * 10 + (base[j] - '0');
+            }
+        }
+        if (j > start) {
+            exponent += negative_exponent ? -written : written;
+            i = j;
+        }
+    }
+
+    if (num_digits > 0 && i == len && !truncated && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+        double value = (double)mantissa;
+        value = exponent < 0 ? value / itj_csv_exact_powers_of_10[-exponent] : value * itj_csv_exact_powers_of_10[exponent];
+        *out = negative ? -value : value;
+        return ITJ_CSV_TRUE;
+    }
+
+#ifndef ITJ_CSV_NO_STD
+    char copy[128];
+    if (len == 0 || len >= sizeof(copy)) {
+        return ITJ_CSV_FALSE;
+    }
+    ITJ_CSV_MEMCPY(copy, base, len);
+    copy[len] = '\0';
+    char *end;
+    double value = strtod(copy, &end);
+    if (end != copy + len) {
+        return ITJ_CSV_FALSE;
+    }
+    *out = value;
+    return ITJ_CSV_TRUE;
+#else
+    return ITJ_CSV_FALSE;
+#endif
+}
+
+#ifdef ITJ_CSV_IMPLEMENTATION_AVX
+/*
+ * Up to 16 digits with at most one '.', and no sign, as a mantissa and a count of fraction digits.
+ * The digits are shuffled past the dot and right aligned in one register, then multiplied and added
+ * pairwise, into 2 digit, 4 digit and 8 digit numbers. Reads 16 bytes from base, so the value must be
+ * in a buffer with slack after it, like the ITJ_CSV_BLOCK_SIZE bytes a read buffer has
+ */
+ITJ_CSV_INLINE itj_csv_bool itj_csv_parse_decimal_sse(const itj_csv_u8 *base, itj_csv_u32 len, itj_csv_u64 *mantissa, itj_csv_u32 *num_fraction_digits) {
+    const __m128i iota = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m128i bytes = _mm_loadu_si128((const __m128i *)base);
+    __m128i digits = _mm_sub_epi8(bytes, _mm_set1_epi8('0'));
+    __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digits, _mm_set1_epi8(9)), digits);
+    __m128i is_dot = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('.'));
+
+    itj_csv_u32 value_mask = (1u << len) - 1;
+    itj_csv_u32 digit_mask = (itj_csv_u32)_mm_movemask_epi8(is_digit) & value_mask;
+    itj_csv_u32 dot_mask = (itj_csv_u32)_mm_movemask_epi8(is_dot) & value_mask;
+    if ((digit_mask | dot_mask) != value_mask || (dot_mask & (dot_mask - 1)) || digit_mask == 0) {
+        return ITJ_CSV_FALSE;
+    }
+
+    // Byte j of the result is digit k = j - (16 - num_digits), found at k, or at k + 1 from the dot on
+    itj_csv_u32 dot = dot_mask ? itj_csv_ffs(dot_mask) - 1 : len;
+    itj_csv_u32 num_digits = len - (dot_mask != 0);
+    __m128i k = _mm_sub_epi8(iota, _mm_set1_epi8((char)(16 - num_digits)));
+    __m128i from_dot = _mm_cmpgt_epi8(k, _mm_set1_epi8((char)dot - 1));
+    __m128i source = _mm_or_si128(_mm_sub_epi8(k, from_dot), _mm_cmpgt_epi8(_mm_setzero_si128(), k));
+    __m128i aligned = _mm_shuffle_epi8(digits, source);
+
+    __m128i pairs = _mm_maddubs_epi16(aligned, _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1));
+    __m128i quads = _mm_madd_epi16(pairs, _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1));
+    __m128i packed = _mm_packus_epi32(quads, quads);
+    __m128i eights = _mm_madd_epi16(packed, _mm_setr_epi16(10000, 1, 10000, 1, 10000, 1, 10000, 1));
+
+    itj_csv_u64 high = (itj_csv_u32)_mm_cvtsi128_si32(eights);
+    itj_csv_u64 low = (itj_csv_u32)_mm_cvtsi128_si32(_mm_srli_si128(eights, 4));
+    *mantissa = high * 100000000ull + low;
+    *num_fraction_digits = dot_mask ? len - dot - 1 : 0;
+    return ITJ_CSV_TRUE;
+}
+#endif
+
+/*
+ * Converts count values at a time into out, for numeric columns. Short integers and decimals, up to
+ * 16 digits, go through SIMD digit arithmetic with the AVX implementations; any other value in the
+ * batch falls back to itj_csv_parse_f64 on its own. Values the SIMD path reads must have 16 readable
+ * bytes from their start, which values still in a read buffer with its slack have. A value that does
+ * not convert, empty ones included, becomes NaN with a 0 in ok_out, if given.
+ * Returns how many did not convert
+ */
+itj_csv_umax itj_csv_parse_f64_batch(const struct itj_csv_string *values, itj_csv_umax count, double *out, itj_csv_u8 *ok_out) {
+    itj_csv_umax num_failed = 0;
+    for (itj_csv_umax v = 0; v < count; ++v) {
+        const itj_csv_u8 *base = values[v].base;
+        itj_csv_u32 len = values[v].len;
+        itj_csv_bool ok = ITJ_CSV_FALSE;
+#ifdef ITJ_CSV_IMPLEMENTATION_AVX
+        itj_csv_u32 sign = len > 0 && (base[0] == '-' || base[0] == '+');
+        itj_csv_u64 mantissa;
+        itj_csv_u32 num_fraction_digits;
+        if (len - sign - 1 < 16 && itj_csv_parse_decimal_sse(base + sign, len - sign, &mantissa, &num_fraction_digits) &&
+            mantissa <= (1ull << 53)) {
+            double value = (double)mantissa / itj_csv_exact_powers_of_10[num_fraction_digits];
+            out[v] = sign && base[0] == '-' ? -value : value;
+            ok = ITJ_CSV_TRUE;
+        } else
+#endif
+        {
+            ok = itj_csv_parse_f64(base, len, &out[v]);
+        }
+
+        if (!ok) {
+            itj_csv_u64 quiet_nan = 0x7ff8000000000000ull;
+            ITJ_CSV_MEMCPY(&out[v], &quiet_nan, sizeof(quiet_nan));
+            num_failed += 1;
+        }
+        if (ok_out) {
+            ok_out[v] = ok;
+        }
+    }
+    return num_failed;
+}
+
+// itj_csv_parse_f64_batch for integers. A value that does not convert becomes 0
+itj_csv_umax itj_csv_parse_s64_batch(const struct itj_csv_string *values, itj_csv_umax count, itj_csv_s64 *out, itj_csv_u8 *ok_out) {
+    itj_csv_umax num_failed = 0;
+    for (itj_csv_umax v = 0; v < count; ++v) {
+        const itj_csv_u8 *base = values[v].base;
+        itj_csv_u32 len = values[v].len;
+        itj_csv_bool ok = ITJ_CSV_FALSE;
+#ifdef ITJ_CSV_IMPLEMENTATION_AVX
+        itj_csv_u32 sign = len > 0 && (base[0] == '-' || base[0] == '+');
+        itj_csv_u64 mantissa;
+        itj_csv_u32 num_fraction_digits;
+        if (len - sign - 1 < 16 && itj_csv_parse_decimal_sse(base + sign, len - sign, &mantissa, &num_fraction_digits) &&
+            num_fraction_digits == 0 && base[len - 1] != '.') {
+            out[v] = sign && base[0] == '-' ? -(itj_csv_s64)mantissa : (itj_csv_s64)mantissa;
+            ok = ITJ_CSV_TRUE;
+        } else
+#endif
+        {
+            ok = itj_csv_parse_s64(base, len, &out[v]);
+        }
+
+        if (!ok) {
+            out[v] = 0;
+            num_failed += 1;
+        }
+        if (ok_out) {
+            ok_out[v] = ok;
+        }
+    }
+    return num_failed;
+}
+
+// Days since 1970-01-01 in the proleptic Gregorian calendar, month 1 to 12
+static itj_csv_s64 itj_csv_days_from_civil(itj_csv_s64 year, itj_csv_u32 month, itj_csv_u32 day) {
+    year -= month <= 2;
+    itj_csv_s64 era = (year >= 0 ? year : year - 399) / 400;
+    itj_csv_s64 year_of_era = year - era * 400;
+    itj_csv_s64 day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    itj_csv_s64 day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+/*
+ * Checks 8 bytes against a layout like "0000-00-" all at once, as one 64 bit word. A '0' in the
+ * layout takes any digit and anything else has to match exactly. XOR with the layout leaves 0 to 9
+ * in digit bytes and 0 in the others, and adding 0x76 sets the top bit of any byte above 9
+ */
+ITJ_CSV_INLINE itj_csv_bool itj_csv_match_layout8(const itj_csv_u8 *base, const char *layout) {
+    itj_csv_u64 chunk, pattern, digits = 0;
+    ITJ_CSV_MEMCPY(&chunk, base, 8);
+    ITJ_CSV_MEMCPY(&pattern, layout, 8);
+    for (itj_csv_u32 i = 0; i < 8; ++i) {
+        ((itj_csv_u8 *)&digits)[i] = layout[i] == '0' ? 0xFF : 0;
+    }
+    itj_csv_u64 x = chunk ^ pattern;
+    itj_csv_u64 high_bits = ((x & digits) + 0x7676767676767676ull) | x;
+    return (x & ~digits) == 0 && (high_bits & digits & 0x8080808080808080ull) == 0;
+}
+
+#define ITJ_CSV_TWO_DIGITS(p) ((itj_csv_u32)((p)[0] - '0') * 10 + ((p)[1] - '0'))
+
+// Seconds from the epoch to the start of a day, when the day is in its month
+static itj_csv_bool itj_csv_timestamp_date(itj_csv_u32 year, itj_csv_u32 month, itj_csv_u32 day, itj_csv_s64 *seconds_out) {
+    static const itj_csv_u8 days_in_month[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    itj_csv_bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    if (month - 1 > 11 || day == 0 || day > (itj_csv_u32)days_in_month[month - 1] + (month == 2 && leap)) {
+        return ITJ_CSV_FALSE;
+    }
+    *seconds_out = itj_csv_days_from_civil(year, month, day) * 86400;
+    return ITJ_CSV_TRUE;
+}
+
+// Within what an s64 of nanoseconds holds, whole seconds from 1677-09-21T00:12:44Z up to 2262-04-11T23:47:16.854775807Z
+static itj_csv_bool itj_csv_timestamp_end(itj_csv_s64 seconds, itj_csv_s64 nanoseconds, itj_csv_s64 *out) {
+    if (seconds < -9223372036ll || seconds > 9223372036ll || (seconds == 9223372036ll && nanoseconds > 854775807)) {
+        return ITJ_CSV_FALSE;
+    }
+    *out = seconds * 1000000000ll + nanoseconds;
+    return ITJ_CSV_TRUE;
+}
+
+// Reads count digits at base[*i], moving *i past them
+ITJ_CSV_INLINE itj_csv_bool itj_csv_timestamp_digits(const itj_csv_u8 *base, itj_csv_umax len, itj_csv_umax *i, itj_csv_u32 count, itj_csv_u32 *out) {
+    if (len - *i < count) {
+        return ITJ_CSV_FALSE;
+    }
+    itj_csv_u32 value = 0;
+    for (itj_csv_u32 j = 0; j < count; ++j, ++*i) {
+        if ((itj_csv_u32)base[*i] - '0' > 9) {
+            return ITJ_CSV_FALSE;
+        }
+        value = value * 10 + (base[*i] - '0');
+    }
+    *out = value;
+    return ITJ_CSV_TRUE;
+}
+
+/*
+ * itj_csv_parse_timestamp for the forms the fixed layout does not take, a byte at a time: a lower
+ * case t or z, more than 9 fraction digits, which are cut to nanoseconds, and zones written +hhmm or +hh
+ */
+static itj_csv_bool itj_csv_parse_timestamp_scalar(const itj_csv_u8 *base, itj_csv_umax len, itj_csv_s64 *out) {
+    itj_csv_umax i = 0;
+    itj_csv_u32 year, month, day;
+    itj_csv_s64 seconds;
+    if (!itj_csv_timestamp_digits(base, len, &i, 4, &year) || i == len || base[i++] != '-' ||
+        !itj_csv_timestamp_digits(base, len, &i, 2, &month) || i == len || base[i++] != '-' ||
+        !itj_csv_timestamp_digits(base, len, &i, 2, &day) || !itj_csv_timestamp_date(year, month, day, &seconds)) {
+        return ITJ_CSV_FALSE;
+    }
+    if (i == len) {
+        return itj_csv_timestamp_end(seconds, 0, out);
+    }
+
+    itj_csv_u32 hour, minute, second;
+    if (base[i] != 'T' && base[i] != 't' && base[i] != ' ') {
+        return ITJ_CSV_FALSE;
+    }
+    ++i;
+    if (!itj_csv_timestamp_digits(base, len, &i, 2, &hour) || i == len || base[i++] != ':' || !itj_csv_timestamp_digits(base, len, &i, 2, &minute) ||
+        i == len || base[i++] != ':' || !itj_csv_timestamp_digits(base, len, &i, 2, &second) ||
+        hour > 23 || minute > 59 || second > 59) {
+        return ITJ_CSV_FALSE;
+    }
+    seconds += hour * 3600 + minute * 60 + second;
+
+    itj_csv_s64 nanoseconds = 0;
+    if (i < len && base[i] == '.') {
+        itj_csv_umax start = ++i;
+        for (; i < len && (itj_csv_u32)base[i] - '0' <= 9; ++i) {
+            if (i - start < 9) {
+                nanoseconds = nanoseconds * 10 + (base[i] - '0');
+            }
+        }
+        if (i == start) {
+            return ITJ_CSV_FALSE;
+        }
+        for (itj_csv_umax j = i - start; j < 9; ++j) {
+            nanoseconds *= 10;
+        }
+    }
+
+    if (i < len && (base[i] == 'Z' || base[i] == 'z')) {
+        ++i;
+    } else if (i < len && (base[i] == '+' || base[i] == '-')) {
+        itj_csv_u8 sign = base[i++];
+        itj_csv_u32 zone_hours, zone_minutes = 0;
+        if (!itj_csv_timestamp_digits(base, len, &i, 2, &zone_hours)) {
+            return ITJ_CSV_FALSE;
+        }
+        itj_csv_bool colon = i < len && base[i] == ':';
+        i += colon;
+        if ((colon || i < len) && !itj_csv_timestamp_digits(base, len, &i, 2, &zone_minutes)) {
+            return ITJ_CSV_FALSE;
+        }
+        if (zone_hours > 23 || zone_minutes > 59) {
+            return ITJ_CSV_FALSE;
+        }
+        itj_csv_s64 offset = zone_hours * 3600 + zone_minutes * 60;
+        seconds -= sign == '+' ? offset : -offset;
+    }
+    if (i != len) {
+        return ITJ_CSV_FALSE;
+    }
+    return itj_csv_timestamp_end(seconds, nanoseconds, out);
+}
+
+/*
+ * An ISO 8601 timestamp as nanoseconds since 1970-01-01T00:00:00Z, in the layout
+ * YYYY-MM-DD[THH:MM:SS[.f][Z|+hh:mm|-hh:mm]], with a space allowed for the T and 1 to 9 fraction digits.
+ * A timestamp without a zone is taken as UTC. The fixed date and time parts are checked as 8 byte
+ * words, then every field is range checked, day of month included. What that layout does not take
+ * goes to itj_csv_parse_timestamp_scalar. Anything neither takes, or a time outside the 1677 to 2262
+ * range nanoseconds fit in, fails and leaves out alone
+ */
+itj_csv_bool itj_csv_parse_timestamp(const itj_csv_u8 *base, itj_csv_umax len, itj_csv_s64 *out) {
+    if (len < 10 || !itj_csv_match_layout8(base, "0000-00-") || (itj_csv_u32)base[8] - '0' > 9 || (itj_csv_u32)base[9] - '0' > 9) {
+        return itj_csv_parse_timestamp_scalar(base, len, out);
+    }
+
+    itj_csv_u32 year = ITJ_CSV_TWO_DIGITS(base) * 100 + ITJ_CSV_TWO_DIGITS(base + 2);
+    itj_csv_u32 month = ITJ_CSV_TWO_DIGITS(base + 5);
+    itj_csv_u32 day = ITJ_CSV_TWO_DIGITS(base + 8);
+    itj_csv_s64 seconds;
+    if (!itj_csv_timestamp_date(year, month, day, &seconds)) {
+        return ITJ_CSV_FALSE;
+    }
+    itj_csv_s64 nanoseconds = 0;
+
+    itj_csv_umax i = 10;
+    if (i < len) {
+        if (len < 19 || (base[10] != 'T' && base[10] != ' ') || !itj_csv_match_layout8(base + 11, "00:00:00")) {
+            return itj_csv_parse_timestamp_scalar(base, len, out);
+        }
+        itj_csv_u32 hour = ITJ_CSV_TWO_DIGITS(base + 11);
+        itj_csv_u32 minute = ITJ_CSV_TWO_DIGITS(base + 14);
+        itj_csv_u32 second = ITJ_CSV_TWO_DIGITS(base + 17);
+        if (hour > 23 || minute > 59 || second > 59) {
+            return ITJ_CSV_FALSE;
+        }
+        seconds += hour * 3600 + minute * 60 + second;
+        i = 19;
+
+        if (i < len && base[i] == '.') {
+            itj_csv_umax start = ++i;
+            for (; i < len && i - start < 10 && (itj_csv_u32)base[i] - '0' <= 9; ++i) {
+                nanoseconds = nanoseconds * 10 + (base[i] - '0');
+            }
+            if (i == start) {
+                return ITJ_CSV_FALSE;
+            }
+            if (i - start > 9) {
+                return itj_csv_parse_timestamp_scalar(base, len, out);
+            }
+            for (itj_csv_umax j = i - start; j < 9; ++j) {
+                nanoseconds *= 10;
+            }
+        }
+
+        if (i < len && base[i] == 'Z') {
+            ++i;
+        } else if (i < len && (base[i] == '+' || base[i] == '-')) {
+            const itj_csv_u8 *zone = base + i;
+            if (len - i != 6 || (itj_csv_u32)zone[1] - '0' > 9 || (itj_csv_u32)zone[2] - '0' > 9 || zone[3] != ':' ||
+                (itj_csv_u32)zone[4] - '0' > 9 || (itj_csv_u32)zone[5] - '0' > 9) {
+                return itj_csv_parse_timestamp_scalar(base, len, out);
+            }
+            itj_csv_u32 zone_hours = ITJ_CSV_TWO_DIGITS(zone + 1);
+            itj_csv_u32 zone_minutes = ITJ_CSV_TWO_DIGITS(zone + 4);
+            if (zone_hours > 23 || zone_minutes > 59) {
+                return ITJ_CSV_FALSE;
+            }
+            // The local time is ahead of UTC by a + offset
+            itj_csv_s64 offset = zone_hours * 3600 + zone_minutes * 60;
+            seconds -= zone[0] == '+' ? offset : -offset;
+            i += 6;
+        }
+        if (i != len) {
+            return itj_csv_parse_timestamp_scalar(base, len, out);
+        }
+    }
+    return itj_csv_timestamp_end(seconds, nanoseconds, out);
+}
+
+#undef ITJ_CSV_TWO_DIGITS
+
+/*
+ * Guesses the layout of a CSV file from a prefix of it, usually the first pump of the file.
+ * Counting runs a block at a time: quote, newline and delimiter candidate masks are built with SIMD,
+ * quoted bytes are masked out and the candidates are popcounted per line.
+ * The delimiter is the candidate with the most lines agreeing on a non-zero count. Lines before the
+ * first agreeing line, like the World Bank preamble, are reported in skip_lines.
+ * The trailing line of the prefix is ignored unless it is the only one, as it might be cut short.
+ * Returns ITJ_CSV_FALSE if there is nothing to look at
+ */
+itj_csv_bool itj_csv_sniff(const void *buf, itj_csv_umax len, struct itj_csv_dialect *out) {
+    const itj_csv_u8 *base = (const itj_csv_u8 *)buf;
+    itj_csv_u32 counts[ITJ_CSV_SNIFF_MAX_LINES][ITJ_CSV_NUM_SNIFF_CANDIDATES];
+    itj_csv_umax line_ends[ITJ_CSV_SNIFF_MAX_LINES];
+    itj_csv_u32 running[ITJ_CSV_NUM_SNIFF_CANDIDATES] = {0};
+    itj_csv_u32 num_lines = 0;
+    itj_csv_u32 num_crlf = 0;
+    itj_csv_u32 num_quotes = 0;
+    itj_csv_u32 inside_quotes = 0;
+    itj_csv_u8 tail[ITJ_CSV_BLOCK_SIZE];
+    itj_csv_u32 c;
+
+    ITJ_CSV_MEMSET(out, 0, sizeof(*out));
+    out->delimiter = ITJ_CSV_DELIM_COMMA;
+
+    if (len >= 3 && base[0] == 0xEF && base[1] == 0xBB && base[2] == 0xBF) {
+        out->bom_len = 3;
+    }
+
+    if (len <= out->bom_len) {
+        return ITJ_CSV_FALSE;
+    }
+
+    for (itj_csv_umax pos = out->bom_len; pos < len && num_lines < ITJ_CSV_SNIFF_MAX_LINES; pos += ITJ_CSV_BLOCK_SIZE) {
+        const itj_csv_u8 *p = base + pos;
+        if (len - pos < ITJ_CSV_BLOCK_SIZE) {
+            ITJ_CSV_MEMSET(tail, 0, ITJ_CSV_BLOCK_SIZE);
+            ITJ_CSV_MEMCPY(tail, p, len - pos);
+            p = tail;
+        }
+
+        itj_csv_u32 quotes = itj_csv_byte_mask(p, '"');
+        itj_csv_u32 outside = ~itj_csv_quoted_mask(quotes, &inside_quotes);
+        itj_csv_u32 newlines = itj_csv_byte_mask(p, '\n') & outside;
+        itj_csv_u32 candidates[ITJ_CSV_NUM_SNIFF_CANDIDATES];
+        for (c = 0; c < ITJ_CSV_NUM_SNIFF_CANDIDATES; ++c) {
+            candidates[c] = itj_csv_byte_mask(p, itj_csv_sniff_candidates[c]) & outside;
+        }
+        num_quotes += itj_csv_popcount(quotes);
+
+        itj_csv_u32 consumed = 0;
+        while (newlines && num_lines < ITJ_CSV_SNIFF_MAX_LINES) {
+            itj_csv_u32 bit = itj_csv_ffs(newlines) - 1;
+            itj_csv_u32 below = (1u << bit) - 1;
+            for (c = 0; c < ITJ_CSV_NUM_SNIFF_CANDIDATES; ++c) {
+                counts[num_lines][c] = running[c] + itj_csv_popcount(candidates[c] & below & ~consumed);
+                running[c] = 0;
+            }
+
+            line_ends[num_lines] = pos + bit;
+            if (pos + bit > out->bom_len && base[pos + bit - 1] == '\r') {
+                ++num_crlf;
+            }
+
+            ++num_lines;
+            consumed = below | (1u << bit);
+            newlines &= newlines - 1;
+        }
+
+        for (c = 0; c < ITJ_CSV_NUM_SNIFF_CANDIDATES; ++c) {
+            running[c] += itj_csv_popcount(candidates[c] & ~consumed);
+        }
+    }
+
+    if (num_lines == 0) {
+        for (c = 0; c < ITJ_CSV_NUM_SNIFF_CANDIDATES; ++c) {
+            counts[0][c] = running[c];
+        }
+        line_ends[0] = len;
+        num_lines = 1;
+    }
+
+    out->num_sampled_lines = num_lines;
+    out->has_quotes = num_quotes > 0;
+    out->is_crlf = num_crlf * 2 > num_lines;
+
+    itj_csv_bool is_blank[ITJ_CSV_SNIFF_MAX_LINES];
+    for (itj_csv_u32 l = 0; l < num_lines; ++l) {
+        itj_csv_umax start = l == 0 ? out->bom_len : line_ends[l - 1] + 1;
+        itj_csv_umax line_len = line_ends[l] - start;
+        is_blank[l] = line_len == 0 || (line_len == 1 && base[start] == '\r');
+    }
+
+    // The delimiter is the candidate where the most lines agree on how many there are
+    itj_csv_u32 best_candidate = 0;
+    itj_csv_u32 best_mode = 0;
+    itj_csv_u32 best_score = 0;
+    for (c = 0; c < ITJ_CSV_NUM_SNIFF_CANDIDATES; ++c) {
+        for (itj_csv_u32 l = 0; l < num_lines; ++l) {
+            if (is_blank[l] || counts[l][c] == 0) {
+                continue;
+            }
+
+            itj_csv_u32 score = 0;
+            for (itj_csv_u32 k = 0; k < num_lines; ++k) {
+                score += !is_blank[k] && counts[k][c] == counts[l][c];
+            }
+
+            if (score > best_score || (score == best_score && c == best_candidate && counts[l][c] > best_mode)) {
+                best_score = score;
+                best_mode = counts[l][c];
+                best_candidate = c;
+            }
+        }
+    }
+
+    out->delimiter = itj_csv_sniff_candidates[best_candidate];
+    out->num_columns = best_mode + 1;
+
+    itj_csv_u32 first_line = 0;
+    while (first_line < num_lines && (is_blank[first_line] || counts[first_line][best_candidate] != best_mode)) {
+        ++first_line;
+    }
+    if (first_line == num_lines) {
+        first_line = 0;
+    }
+    out->skip_lines = first_line;
+
+    // Types of the first agreeing line, and of every agreeing line after it
+    itj_csv_u8 first_types[ITJ_CSV_SNIFF_MAX_COLUMNS] = {0};
+    itj_csv_u32 first_lens[ITJ_CSV_SNIFF_MAX_COLUMNS] = {0};
+    itj_csv_u32 data_lens[ITJ_CSV_SNIFF_MAX_COLUMNS] = {0};
+    itj_csv_bool data_lens_agree[ITJ_CSV_SNIFF_MAX_COLUMNS];
+    itj_csv_u32 num_data_lines = 0;
+    itj_csv_u32 num_typed_columns = out->num_columns < ITJ_CSV_SNIFF_MAX_COLUMNS ? out->num_columns : ITJ_CSV_SNIFF_MAX_COLUMNS;
+
+    for (itj_csv_u32 l = first_line; l < num_lines; ++l) {
+        if (is_blank[l] || counts[l][best_candidate] != best_mode) {
+            continue;
+        }
+
+        itj_csv_umax i = l == 0 ? out->bom_len : line_ends[l - 1] + 1;
+        itj_csv_umax end = line_ends[l];
+        if (end > i && base[end - 1] == '\r') {
+            --end;
+        }
+
+        for (itj_csv_u32 column = 0; column < num_typed_columns; ++column) {
+            itj_csv_umax field_start = i;
+            itj_csv_umax field_end;
+            if (i < end && base[i] == '"') {
+                field_start = ++i;
+                for (; i < end; ++i) {
+                    if (base[i] == '"') {
+                        if (i + 1 < end && base[i + 1] == '"') {
+                            ++i;
+                        } else {
+                            break;
+                        }
+                    }
+                }
+                field_end = i;
+                while (i < end && base[i] != out->delimiter) {
+                    ++i;
+                }
+            } else {
+                while (i < end && base[i] != out->delimiter) {
+                    ++i;
+                }
+                field_end = i;
+            }
+            ++i;
+
+            itj_csv_type_t type = itj_csv_guess_type(base + field_start, field_end - field_start);
+            itj_csv_u32 field_len = (itj_csv_u32)(field_end - field_start);
+            if (l == first_line) {
+                first_types[column] = (itj_csv_u8)type;
+                first_lens[column] = field_len;
+                data_lens_agree[column] = ITJ_CSV_TRUE;
+            } else {
+                if (type > out->column_types[column]) {
+                    out->column_types[column] = (itj_csv_u8)type;
+                }
+                if (num_data_lines == 0) {
+                    data_lens[column] = field_len;
+                } else if (data_lens[column] != field_len) {
+                    data_lens_agree[column] = ITJ_CSV_FALSE;
+                }
+            }
+        }
+
+        if (l != first_line) {
+            ++num_data_lines;
+        }
+    }
+
+    // A column votes for a header when its first value has another type than the rest,
+    // or for text columns, when the rest agree on a length the first value does not have
+    itj_csv_smax votes = 0;
+    itj_csv_bool all_text = ITJ_CSV_TRUE;
+    for (itj_csv_u32 column = 0; column < num_typed_columns; ++column) {
+        itj_csv_u8 first_type = first_types[column];
+        itj_csv_u8 data_type = out->column_types[column];
+
+        if (first_type != ITJ_CSV_TYPE_STRING) {
+            all_text = ITJ_CSV_FALSE;
+        }
+
+        if (num_data_lines == 0 || data_type == ITJ_CSV_TYPE_EMPTY) {
+            continue;
+        }
+
+        if (data_type == ITJ_CSV_TYPE_STRING) {
+            if (data_lens_agree[column]) {
+                votes += first_lens[column] != data_lens[column] ? 1 : -1;
+            }
+        } else {
+            votes += first_type != data_type ? 1 : -1;
+        }
+    }
+
+    out->has_header = votes > 0 || (votes == 0 && all_text);
+
+    if (!out->has_header) {
+        for (itj_csv_u32 column = 0; column < num_typed_columns; ++column) {
+            if (first_types[column] > out->column_types[column]) {
+                out->column_types[column] = first_types[column];
+            }
+        }
+    }
+
+    return ITJ_CSV_TRUE;
+}
+
+#endif // ITJ_CSV_IMPLEMENTATION
+
+#ifdef ITJ_CSV_IMPLEMENTATION
+
+void itj_csv_intern_init(struct itj_csv_intern *intern, void *user_mem_ptr) {
+    ITJ_CSV_MEMSET(intern, 0, sizeof(*intern));
+    intern->user_mem_ptr = user_mem_ptr;
+}
+
+void itj_csv_free_intern(struct itj_csv_intern *intern) {
+    if (intern->offsets) {
+        ITJ_CSV_FREE(intern->user_mem_ptr, intern->offsets);
+    }
+    if (intern->arena) {
+        ITJ_CSV_FREE(intern->user_mem_ptr, intern->arena);
+    }
+    if (intern->hashes) {
+        ITJ_CSV_FREE(intern->user_mem_ptr, intern->hashes);
+    }
+    if (intern->slots) {
+        ITJ_CSV_FREE(intern->user_mem_ptr, intern->slots);
+    }
+    itj_csv_intern_init(intern, intern->user_mem_ptr);
+}
+
+// Doubles the slots and places every string again, from its kept hash
+static itj_csv_bool itj_csv_intern_grow_slots(struct itj_csv_intern *intern) {
+    itj_csv_u32 num_slots = intern->num_slots ? intern->num_slots * 2 : 64;
+    itj_csv_u32 *slots = (itj_csv_u32 *)ITJ_CSV_ALLOC(intern->user_mem_ptr, num_slots * sizeof(itj_csv_u32));
+    if (!slots) {
+        return ITJ_CSV_FALSE;
+    }
+    ITJ_CSV_MEMSET(slots, 0, num_slots * sizeof(itj_csv_u32));
+    for (itj_csv_u32 code = 0; code < intern->num_strings; ++code) {
+        itj_csv_u32 slot = itj_csv_hash_slot(intern->hashes[code], 0, num_slots);
+        while (slots[slot]) {
+            slot = (slot + 1) & (num_slots - 1);
+        }
+        slots[slot] = code + 1;
+    }
+
+    if (intern->slots) {
+        ITJ_CSV_FREE(intern->user_mem_ptr, intern->slots);
+    }
+    intern->slots = slots;
+    intern->num_slots = num_slots;
+    return ITJ_CSV_TRUE;
+}
+
+static itj_csv_bool itj_csv_intern_grow_strings(struct itj_csv_intern *intern) {
+    itj_csv_u32 strings_max = intern->strings_max ? intern->strings_max * 2 : 64;
+    itj_csv_s32 *offsets = (itj_csv_s32 *)ITJ_CSV_ALLOC(intern->user_mem_ptr, (strings_max + 1) * sizeof(itj_csv_s32));
+    itj_csv_u64 *hashes = (itj_csv_u64 *)ITJ_CSV_ALLOC(intern->user_mem_ptr, strings_max * sizeof(itj_csv_u64));
+    if (!offsets || !hashes) {
+        if (offsets) {
+            ITJ_CSV_FREE(intern->user_mem_ptr, offsets);
+        }
+        if (hashes) {
+            ITJ_CSV_FREE(intern->user_mem_ptr, hashes);
+        }
+        return ITJ_CSV_FALSE;
+    }
+
+    offsets[0] = 0;
+    if (intern->offsets) {
+        ITJ_CSV_MEMCPY(offsets, intern->offsets, (intern->num_strings + 1) * sizeof(itj_csv_s32));
+        ITJ_CSV_MEMCPY(hashes, intern->hashes, intern->num_strings * sizeof(itj_csv_u64));
+        ITJ_CSV_FREE(intern->user_mem_ptr, intern->offsets);
+        ITJ_CSV_FREE(intern->user_mem_ptr, intern->hashes);
+    }
+    intern->offsets = offsets;
+    intern->hashes = hashes;
+    intern->strings_max = strings_max;
+    return ITJ_CSV_TRUE;
+}
+
+/*
+ * The code of a string, adding a copy of it if it is new. Codes count up from 0 in the order strings
+ * are first seen, so they index a dictionary array directly. Returns -1 when out of memory, or when
+ * the arena would pass the 2GB that s32 offsets reach
+ */
+itj_csv_s32 itj_csv_intern(struct itj_csv_intern *intern, const itj_csv_u8 *base, itj_csv_u32 len) {
+    itj_csv_u64 hash = itj_csv_hash(base, len);
+    itj_csv_u32 slot = 0;
+    if (intern->num_slots) {
+        slot = itj_csv_hash_slot(hash, 0, intern->num_slots);
+        for (; intern->slots[slot]; slot = (slot + 1) & (intern->num_slots - 1)) {
+            itj_csv_u32 code = intern->slots[slot] - 1;
+            itj_csv_s32 start = intern->offsets[code];
+            if (intern->hashes[code] == hash &&
+                itj_csv_string_equal(intern->arena + start, (itj_csv_u32)(intern->offsets[code + 1] - start), base, len)) {
+                return (itj_csv_s32)code;
+            }
+        }
+    }
+
+    if (intern->arena_used + len > 0x7fffffff) {
+        return -1;
+    }
+    if ((intern->num_strings + 1) * 2 > intern->num_slots) {
+        if (!itj_csv_intern_grow_slots(intern)) {
+            return -1;
+        }
+        slot = itj_csv_hash_slot(hash, 0, intern->num_slots);
+        while (intern->slots[slot]) {
+            slot = (slot + 1) & (intern->num_slots - 1);
+        }
+    }
+    if (intern->num_strings == intern->strings_max && !itj_csv_intern_grow_strings(intern)) {
+        return -1;
+    }
+    if (intern->arena_used + len > intern->arena_max) {
+        itj_csv_umax arena_max = intern->arena_max ? intern->arena_max * 2 : 4096;
+        while (arena_max < intern->arena_used + len) {
+            arena_max *= 2;
+        }
+        itj_csv_u8 *arena = (itj_csv_u8 *)ITJ_CSV_ALLOC(intern->user_mem_ptr, arena_max);
+        if (!arena) {
+            return -1;
+        }
+        if (intern->arena) {
+            ITJ_CSV_MEMCPY(arena, intern->arena, intern->arena_used);
+            ITJ_CSV_FREE(intern->user_mem_ptr, intern->arena);
+        }
+        intern->arena = arena;
+        intern->arena_max = arena_max;
+    }
+
+    itj_csv_u32 code = intern->num_strings;
+    if (len > 0) {
+        ITJ_CSV_MEMCPY(intern->arena + intern->arena_used, base, len);
+    }
+    intern->arena_used += len;
+    intern->offsets[code + 1] = (itj_csv_s32)intern->arena_used;
+    intern->hashes[code] = hash;
+    intern->slots[slot] = code + 1;
+    intern->num_strings += 1;
+    return (itj_csv_s32)code;
+}
+
+// Only good until the next itj_csv_intern, which may move the arena
+struct itj_csv_string itj_csv_intern_string(const struct itj_csv_intern *intern, itj_csv_s32 code) {
+    struct itj_csv_string rv;
+    rv.base = intern->arena + intern->offsets[code];
+    rv.len = (itj_csv_u32)(intern->offsets[code + 1] - intern->offsets[code]);
+    return rv;
+}
+
+static itj_csv_umax itj_csv_column_value_size(itj_csv_column_type_t type) {
+    return type == ITJ_CSV_COLUMN_STRING || type == ITJ_CSV_COLUMN_DICTIONARY ? sizeof(itj_csv_s32) : sizeof(itj_csv_s64);
+}
+
+void itj_csv_free_table(struct itj_csv_table *table) {
+#ifndef ITJ_CSV_NO_STD
+    if (table->mapping.data) {
+        itj_csv_unmap_file(&table->mapping);
+        ITJ_CSV_FREE(table->user_mem_ptr, table->columns);
+        ITJ_CSV_MEMSET(table, 0, sizeof(*table));
+        return;
+    }
+#endif
+    for (itj_csv_u32 c = 0; table->columns && c < table->num_columns; ++c) {
+        struct itj_csv_column *column = &table->columns[c];
+        if (column->name.base) {
+            ITJ_CSV_FREE(table->user_mem_ptr, column->name.base);
+        }
+        if (column->validity) {
+            ITJ_CSV_FREE(table->user_mem_ptr, column->validity);
+        }
+        if (column->values) {
+            ITJ_CSV_FREE(table->user_mem_ptr, column->values);
+        }
+        if (column->data) {
+            ITJ_CSV_FREE(table->user_mem_ptr, column->data);
+        }
+        itj_csv_free_intern(&column->dictionary);
+    }
+    if (table->columns) {
+        ITJ_CSV_FREE(table->user_mem_ptr, table->columns);
+    }
+    ITJ_CSV_MEMSET(table, 0, sizeof(*table));
+}
+
+/*
+ * Sets up an empty table with a column of each type. The names come from the header of csv, if one
+ * was read, so read it first. Values of columns past num_columns are ignored
+ */
+itj_csv_bool itj_csv_table_init(struct itj_csv_table *table, const struct itj_csv *csv, const itj_csv_column_type_t *types, itj_csv_u32 num_columns) {
+    ITJ_CSV_MEMSET(table, 0, sizeof(*table));
+    table->user_mem_ptr = csv->user_mem_ptr;
+    table->columns = (struct itj_csv_column *)ITJ_CSV_ALLOC(table->user_mem_ptr, num_columns * sizeof(struct itj_csv_column));
+    if (!table->columns) {
+        return ITJ_CSV_FALSE;
+    }
+    ITJ_CSV_MEMSET(table->columns, 0, num_columns * sizeof(struct itj_csv_column));
+    table->num_columns = num_columns;
+
+    for (itj_csv_u32 c = 0; c < num_columns; ++c) {
+        struct itj_csv_column *column = &table->columns[c];
+        column->type = types[c];
+        itj_csv_intern_init(&column->dictionary, table->user_mem_ptr);
+
+        struct itj_csv_string name = itj_csv_column_name(csv, c);
+        if (name.base) {
+            column->name.base = (itj_csv_u8 *)ITJ_CSV_ALLOC(table->user_mem_ptr, name.len + 1);
+            if (!column->name.base) {
+                itj_csv_free_table(table);
+                return ITJ_CSV_FALSE;
+            }
+            ITJ_CSV_MEMCPY(column->name.base, name.base, name.len);
+            column->name.base[name.len] = '\0';
+            column->name.len = name.len;
+        }
+    }
+    return ITJ_CSV_TRUE;
+}
+
+// Doubles the rows every column has room for. A table mapped from a cache file cannot grow
+static itj_csv_bool itj_csv_table_grow(struct itj_csv_table *table) {
+    if (table->mapping.data) {
+        return ITJ_CSV_FALSE;
+    }
+    itj_csv_umax rows_max = table->rows_max ? table->rows_max * 2 : 1024;
+    for (itj_csv_u32 c = 0; c < table->num_columns; ++c) {
+        struct itj_csv_column *column = &table->columns[c];
+        itj_csv_umax value_size = itj_csv_column_value_size(column->type);
+        itj_csv_umax extra = column->type == ITJ_CSV_COLUMN_STRING;
+        void *values = ITJ_CSV_ALLOC(table->user_mem_ptr, (rows_max + extra) * value_size);
+        itj_csv_u8 *validity = (itj_csv_u8 *)ITJ_CSV_ALLOC(table->user_mem_ptr, (rows_max + 7) / 8);
+        if (!values || !validity) {
+            if (values) {
+                ITJ_CSV_FREE(table->user_mem_ptr, values);
+            }
+            if (validity) {
+                ITJ_CSV_FREE(table->user_mem_ptr, validity);
+            }
+            return ITJ_CSV_FALSE;
+        }
+        // Rows without a value stay 0 and invalid
+        ITJ_CSV_MEMSET(values, 0, (rows_max + extra) * value_size);
+        ITJ_CSV_MEMSET(validity, 0, (rows_max + 7) / 8);
+
+        if (column->values) {
+            ITJ_CSV_MEMCPY(values, column->values, (table->num_rows + extra) * value_size);
+            ITJ_CSV_MEMCPY(validity, column->validity, (table->num_rows + 7) / 8);
+            ITJ_CSV_FREE(table->user_mem_ptr, column->values);
+            ITJ_CSV_FREE(table->user_mem_ptr, column->validity);
+        }
+        column->values = values;
+        column->validity = validity;
+    }
+    table->rows_max = rows_max;
+    return ITJ_CSV_TRUE;
+}
+
+static itj_csv_bool itj_csv_column_push_bytes(struct itj_csv_table *table, struct itj_csv_column *column, const itj_csv_u8 *base, itj_csv_u32 len) {
+    if (column->data_used + len > 0x7fffffff) {
+        return ITJ_CSV_FALSE;
+    }
+    if (column->data_used + len > column->data_max) {
+        itj_csv_umax data_max = column->data_max ? column->data_max * 2 : 4096;
+        while (data_max < column->data_used + len) {
+            data_max *= 2;
+        }
+        itj_csv_u8 *data = (itj_csv_u8 *)ITJ_CSV_ALLOC(table->user_mem_ptr, data_max);
+        if (!data) {
+            return ITJ_CSV_FALSE;
+        }
+        if (column->data) {
+            ITJ_CSV_MEMCPY(data, column->data, column->data_used);
+            ITJ_CSV_FREE(table->user_mem_ptr, column->data);
+        }
+        column->data = data;
+        column->data_max = data_max;
+    }
+    if (len > 0) {
+        ITJ_CSV_MEMCPY(column->data + column->data_used, base, len);
+    }
+    column->data_used += len;
+    return ITJ_CSV_TRUE;
+}
+
+/*
+ * Adds a value from a kernel to the row being built, converting it for its column, and ends the row
+ * on the last value of a line. Empty values, "" included, values that do not convert and columns a
+ * short row does not reach are left without a value, strings as well as numbers.
+ * Returns false when out of memory, or when a string column would pass 2GB
+ */
+itj_csv_bool itj_csv_table_add_value(struct itj_csv_table *table, const struct itj_csv_value *value) {
+    if (value->need_data) {
+        return ITJ_CSV_TRUE;
+    }
+    if (!table->in_row) {
+        if (table->num_rows == table->rows_max && !itj_csv_table_grow(table)) {
+            return ITJ_CSV_FALSE;
+        }
+        table->in_row = ITJ_CSV_TRUE;
+    }
+
+    itj_csv_umax row = table->num_rows;
+    if (value->column < table->num_columns) {
+        struct itj_csv_column *column = &table->columns[value->column];
+        const itj_csv_u8 *base = value->data.base;
+        itj_csv_u32 len = value->data.len;
+        itj_csv_bool valid = ITJ_CSV_FALSE;
+        switch (column->type) {
+        case ITJ_CSV_COLUMN_STRING:
+            if (!itj_csv_column_push_bytes(table, column, base, len)) {
+                return ITJ_CSV_FALSE;
+            }
+            valid = len > 0;
+            break;
+        case ITJ_CSV_COLUMN_DICTIONARY: {
+            // A null keeps code 0, the empty string is not put in the dictionary
+            itj_csv_s32 code = len > 0 ? itj_csv_intern(&column->dictionary, base, len) : 0;
+            if (code < 0) {
+                return ITJ_CSV_FALSE;
+            }
+            ((itj_csv_s32 *)column->values)[row] = code;
+            valid = len > 0;
+        } break;
+        case ITJ_CSV_COLUMN_S64:
+            valid = itj_csv_parse_s64(base, len, &((itj_csv_s64 *)column->values)[row]);
+            break;
+        case ITJ_CSV_COLUMN_F64:
+            valid = itj_csv_parse_f64(base, len, &((double *)column->values)[row]);
+            break;
+        case ITJ_CSV_COLUMN_TIMESTAMP:
+            valid = itj_csv_parse_timestamp(base, len, &((itj_csv_s64 *)column->values)[row]);
+            break;
+        }
+        if (valid) {
+            column->validity[row >> 3] |= (itj_csv_u8)(1u << (row & 7));
+        }
+    }
+
+    if (value->is_end_of_line) {
+        for (itj_csv_u32 c = 0; c < table->num_columns; ++c) {
+            struct itj_csv_column *column = &table->columns[c];
+            if (column->type == ITJ_CSV_COLUMN_STRING) {
+                ((itj_csv_s32 *)column->values)[row + 1] = (itj_csv_s32)column->data_used;
+            }
+            column->null_count += !(column->validity[row >> 3] & (1u << (row & 7)));
+        }
+        table->num_rows += 1;
+        table->in_row = ITJ_CSV_FALSE;
+    }
+    return ITJ_CSV_TRUE;
+}
+
+/*
+ * Parses the rest of csv into table, pumping when it was opened on a file. kernel may be NULL for
+ * itj_csv_select_kernel(csv->delimiter, ITJ_CSV_KERNEL_DEFAULT). Returns false when out of memory,
+ * itj_csv_get_error() has any error in the data
+ */
+itj_csv_bool itj_csv_load_table(struct itj_csv *csv, itj_csv_kernel_fn kernel, struct itj_csv_table *table) {
+    if (!kernel) {
+        kernel = itj_csv_select_kernel(csv->delimiter, ITJ_CSV_KERNEL_DEFAULT);
+    }
+    for (;;) {
+        struct itj_csv_value value = kernel(csv);
+        if (value.need_data) {
+#ifndef ITJ_CSV_NO_STD
+            if (csv->fh && itj_csv_pump_stdio(csv) != 0) {
+                continue;
+            }
+#endif
+            break;
+        }
+        if (!itj_csv_table_add_value(table, &value)) {
+            return ITJ_CSV_FALSE;
+        }
+    }
+    return ITJ_CSV_TRUE;
+}
+
+ITJ_CSV_INLINE itj_csv_bool itj_csv_column_is_valid(const struct itj_csv_column *column, itj_csv_umax row) {
+    return (column->validity[row >> 3] >> (row & 7)) & 1;
+}
+
+// The string of a row of a string or dictionary column
+struct itj_csv_string itj_csv_column_string(const struct itj_csv_column *column, itj_csv_umax row) {
+    const itj_csv_s32 *values = (const itj_csv_s32 *)column->values;
+    if (column->type == ITJ_CSV_COLUMN_DICTIONARY) {
+        return itj_csv_intern_string(&column->dictionary, values[row]);
+    }
+    struct itj_csv_string rv;
+    rv.base = column->data + values[row];
+    rv.len = (itj_csv_u32)(values[row + 1] - values[row]);
+    return rv;
+}
+
+#endif // ITJ_CSV_IMPLEMENTATION
+
+#ifdef ITJ_CSV_IMPLEMENTATION
+
+#define ITJ_CSV_ROLE_NONE 0
+#define ITJ_CSV_ROLE_KEY 1 // + key index
+#define ITJ_CSV_ROLE_VALUE (1 + ITJ_CSV_GROUP_BY_MAX_COLUMNS) // + value index
+
+void itj_csv_free_group_by(struct itj_csv_group_by *group_by) {
+    void *user_mem_ptr = group_by->user_mem_ptr;
+    itj_csv_free_intern(&group_by->groups);
+    if (group_by->group_rows) {
+        ITJ_CSV_FREE(user_mem_ptr, group_by->group_rows);
+    }
+    if (group_by->accumulators) {
+        ITJ_CSV_FREE(user_mem_ptr, group_by->accumulators);
+    }
+    if (group_by->roles) {
+        ITJ_CSV_FREE(user_mem_ptr, group_by->roles);
+    }
+    if (group_by->row_keys) {
+        ITJ_CSV_FREE(user_mem_ptr, group_by->row_keys);
+    }
+    if (group_by->key) {
+        ITJ_CSV_FREE(user_mem_ptr, group_by->key);
+    }
+    group_by->group_rows = NULL;
+    group_by->accumulators = NULL;
+    group_by->roles = NULL;
+    group_by->row_keys = NULL;
+    group_by->key = NULL;
+    group_by->groups_max = 0;
+    group_by->num_rows = 0;
+}
+
+/*
+ * Sets up grouping by the key columns, in order, aggregating the value columns, each converted as
+ * ITJ_CSV_COLUMN_S64 or ITJ_CSV_COLUMN_F64. Up to ITJ_CSV_GROUP_BY_MAX_COLUMNS of each, and a column
+ * can be used once. Free it with itj_csv_free_group_by() even when this fails
+ */
+itj_csv_bool itj_csv_group_by_init(struct itj_csv_group_by *group_by, const itj_csv_u32 *key_columns, itj_csv_u32 num_keys, const itj_csv_u32 *value_columns,
+                                   const itj_csv_column_type_t *value_types, itj_csv_u32 num_values, void *user_mem_ptr) {
+    ITJ_CSV_MEMSET(group_by, 0, sizeof(*group_by));
+    group_by->user_mem_ptr = user_mem_ptr;
+    itj_csv_intern_init(&group_by->groups, user_mem_ptr);
+    if (num_keys == 0 || num_keys > ITJ_CSV_GROUP_BY_MAX_COLUMNS || num_values > ITJ_CSV_GROUP_BY_MAX_COLUMNS) {
+        return ITJ_CSV_FALSE;
+    }
+
+    itj_csv_u32 num_roles = 0;
+    for (itj_csv_u32 k = 0; k < num_keys; ++k) {
+        group_by->key_columns[k] = key_columns[k];
+        num_roles = key_columns[k] + 1 > num_roles ? key_columns[k] + 1 : num_roles;
+    }
+    for (itj_csv_u32 v = 0; v < num_values; ++v) {
+        group_by->value_columns[v] = value_columns[v];
+        group_by->value_types[v] = value_types[v];
+        num_roles = value_columns[v] + 1 > num_roles ? value_columns[v] + 1 : num_roles;
+    }
+    group_by->num_keys = num_keys;
+    group_by->num_values = num_values;
+
+    group_by->roles = (itj_csv_u8 *)ITJ_CSV_ALLOC(user_mem_ptr, num_roles);
+    if (!group_by->roles) {
+        return ITJ_CSV_FALSE;
+    }
+    ITJ_CSV_MEMSET(group_by->roles, ITJ_CSV_ROLE_NONE, num_roles);
+    group_by->num_roles = num_roles;
+    for (itj_csv_u32 k = 0; k < num_keys; ++k) {
+        if (group_by->roles[key_columns[k]] != ITJ_CSV_ROLE_NONE) {
+            return ITJ_CSV_FALSE;
+        }
+        group_by->roles[key_columns[k]] = (itj_csv_u8)(ITJ_CSV_ROLE_KEY + k);
+    }
+    for (itj_csv_u32 v = 0; v < num_values; ++v) {
+        if (group_by->roles[value_columns[v]] != ITJ_CSV_ROLE_NONE) {
+            return ITJ_CSV_FALSE;
+        }
+        group_by->roles[value_columns[v]] = (itj_csv_u8)(ITJ_CSV_ROLE_VALUE + v);
+    }
+    return ITJ_CSV_TRUE;
+}
+
+static itj_csv_bool itj_csv_grow_bytes(itj_csv_u8 **bytes, itj_csv_umax used, itj_csv_umax *max, itj_csv_umax needed, void *user_mem_ptr) {
+    if (needed <= *max) {
+        return ITJ_CSV_TRUE;
+    }
+    itj_csv_umax new_max = *max ? *max * 2 : 256;
+    while (new_max < needed) {
+        new_max *= 2;
+    }
+    itj_csv_u8 *new_bytes = (itj_csv_u8 *)ITJ_CSV_ALLOC(user_mem_ptr, new_max);
+    if (!new_bytes) {
+        return ITJ_CSV_FALSE;
+    }
+    if (*bytes) {
+        ITJ_CSV_MEMCPY(new_bytes, *bytes, used);
+        ITJ_CSV_FREE(user_mem_ptr, *bytes);
+    }
+    *bytes = new_bytes;
+    *max = new_max;
+    return ITJ_CSV_TRUE;
+}
+
+// The group of a key, with zeroed accumulators if it is new, or -1 when out of memory
+static itj_csv_s32 itj_csv_group_by_find(struct itj_csv_group_by *group_by, const itj_csv_u8 *key, itj_csv_u32 key_len) {
+    itj_csv_s32 group = itj_csv_intern(&group_by->groups, key, key_len);
+    if (group < 0 || (itj_csv_u32)group < group_by->groups_max) {
+        return group;
+    }
+
+    itj_csv_u32 groups_max = group_by->groups_max ? group_by->groups_max * 2 : 64;
+    itj_csv_umax num_values = group_by->num_values;
+    itj_csv_umax *group_rows = (itj_csv_umax *)ITJ_CSV_ALLOC(group_by->user_mem_ptr, groups_max * sizeof(itj_csv_umax));
+    struct itj_csv_accumulator *accumulators = (struct itj_csv_accumulator *)ITJ_CSV_ALLOC(group_by->user_mem_ptr, groups_max * num_values * sizeof(struct itj_csv_accumulator) + 1); // + 1 for no value columns
+    if (!group_rows || !accumulators) {
+        if (group_rows) {
+            ITJ_CSV_FREE(group_by->user_mem_ptr, group_rows);
+        }
+        if (accumulators) {
+            ITJ_CSV_FREE(group_by->user_mem_ptr, accumulators);
+        }
+        return -1;
+    }
+    ITJ_CSV_MEMSET(group_rows, 0, groups_max * sizeof(itj_csv_umax));
+    ITJ_CSV_MEMSET(accumulators, 0, groups_max * num_values * sizeof(struct itj_csv_accumulator));
+    if (group_by->group_rows) {
+        ITJ_CSV_MEMCPY(group_rows, group_by->group_rows, group_by->groups_max * sizeof(itj_csv_umax));
+        ITJ_CSV_MEMCPY(accumulators, group_by->accumulators, group_by->groups_max * num_values * sizeof(struct itj_csv_accumulator));
+        ITJ_CSV_FREE(group_by->user_mem_ptr, group_by->group_rows);
+        ITJ_CSV_FREE(group_by->user_mem_ptr, group_by->accumulators);
+    }
+    group_by->group_rows = group_rows;
+    group_by->accumulators = accumulators;
+    group_by->groups_max = groups_max;
+    return group;
+}
+
+ITJ_CSV_INLINE void itj_csv_accumulate(struct itj_csv_accumulator *accumulator, itj_csv_column_type_t type, itj_csv_number_t value) {
+    if (type == ITJ_CSV_COLUMN_S64) {
+        if (accumulator->count == 0 || value.s64 < accumulator->min.s64) {
+            accumulator->min.s64 = value.s64;
+        }
+        if (accumulator->count == 0 || value.s64 > accumulator->max.s64) {
+            accumulator->max.s64 = value.s64;
+        }
+        accumulator->sum.s64 += value.s64;
+    } else {
+        if (accumulator->count == 0 || value.f64 < accumulator->min.f64) {
+            accumulator->min.f64 = value.f64;
+        }
+        if (accumulator->count == 0 || value.f64 > accumulator->max.f64) {
+            accumulator->max.f64 = value.f64;
+        }
+        accumulator->sum.f64 += value.f64;
+    }
+    accumulator->count += 1;
+}
+
+/*
+ * Keys are interned as they are for a single key column, and as each part's length as 4 bytes then
+ * its bytes for more, so parts can not run into each other
+ */
+static itj_csv_bool itj_csv_group_by_end_row(struct itj_csv_group_by *group_by) {
+    const itj_csv_u8 *key = group_by->row_keys + group_by->key_offsets[0];
+    itj_csv_umax key_len = group_by->key_lens[0];
+    if (group_by->num_keys > 1) {
+        key_len = group_by->row_keys_used + group_by->num_keys * sizeof(itj_csv_u32);
+        if (!itj_csv_grow_bytes(&group_by->key, 0, &group_by->key_max, key_len, group_by->user_mem_ptr)) {
+            return ITJ_CSV_FALSE;
+        }
+        itj_csv_umax used = 0;
+        for (itj_csv_u32 k = 0; k < group_by->num_keys; ++k) {
+            itj_csv_u32 part_len = group_by->key_lens[k];
+            ITJ_CSV_MEMCPY(group_by->key + used, &part_len, sizeof(itj_csv_u32));
+            if (part_len > 0) {
+                ITJ_CSV_MEMCPY(group_by->key + used + sizeof(itj_csv_u32), group_by->row_keys + group_by->key_offsets[k], part_len);
+            }
+            used += sizeof(itj_csv_u32) + part_len;
+        }
+        key = group_by->key;
+        key_len = used;
+    }
+    if (key_len > 0x7fffffff) {
+        return ITJ_CSV_FALSE;
+    }
+
+    itj_csv_s32 group = itj_csv_group_by_find(group_by, key, (itj_csv_u32)key_len);
+    if (group < 0) {
+        return ITJ_CSV_FALSE;
+    }
+    group_by->group_rows[group] += 1;
+    struct itj_csv_accumulator *accumulators = group_by->accumulators + (itj_csv_umax)group * group_by->num_values;
+    for (itj_csv_u32 valid = group_by->row_valid; valid; valid &= valid - 1) {
+        itj_csv_u32 v = itj_csv_ffs(valid) - 1;
+        itj_csv_accumulate(&accumulators[v], group_by->value_types[v], group_by->row_values[v]);
+    }
+
+    group_by->num_rows += 1;
+    group_by->row_keys_used = 0;
+    group_by->row_valid = 0;
+    ITJ_CSV_MEMSET(group_by->key_offsets, 0, sizeof(group_by->key_offsets));
+    ITJ_CSV_MEMSET(group_by->key_lens, 0, sizeof(group_by->key_lens));
+    group_by->in_row = ITJ_CSV_FALSE;
+    return ITJ_CSV_TRUE;
+}
+
+/*
+ * Takes a value from a kernel. Key values are copied out, so pumping in the middle of a row is fine,
+ * value columns are converted, and the row is added to its group on its last value. A value that
+ * does not convert is left out of that column's count, sum, min and max.
+ * Returns false when out of memory
+ */
+itj_csv_bool itj_csv_group_by_add_value(struct itj_csv_group_by *group_by, const struct itj_csv_value *value) {
+    if (value->need_data) {
+        return ITJ_CSV_TRUE;
+    }
+    group_by->in_row = ITJ_CSV_TRUE;
+
+    itj_csv_u32 role = value->column < group_by->num_roles ? group_by->roles[value->column] : ITJ_CSV_ROLE_NONE;
+    if (role >= ITJ_CSV_ROLE_VALUE) {
+        itj_csv_u32 v = role - ITJ_CSV_ROLE_VALUE;
+        itj_csv_bool ok = group_by->value_types[v] == ITJ_CSV_COLUMN_S64 ? itj_csv_parse_s64(value->data.base, value->data.len, &group_by->row_values[v].s64)
+                                                                         : itj_csv_parse_f64(value->data.base, value->data.len, &group_by->row_values[v].f64);
+        group_by->row_valid |= (itj_csv_u32)ok << v;
+    } else if (role >= ITJ_CSV_ROLE_KEY) {
+        itj_csv_u32 k = role - ITJ_CSV_ROLE_KEY;
+        if (!itj_csv_grow_bytes(&group_by->row_keys, group_by->row_keys_used, &group_by->row_keys_max, group_by->row_keys_used + value->data.len, group_by->user_mem_ptr)) {
+            return ITJ_CSV_FALSE;
+        }
+        if (value->data.len > 0) {
+            ITJ_CSV_MEMCPY(group_by->row_keys + group_by->row_keys_used, value->data.base, value->data.len);
+        }
+        group_by->key_offsets[k] = group_by->row_keys_used;
+        group_by->key_lens[k] = (itj_csv_u32)value->data.len;
+        group_by->row_keys_used += value->data.len;
+    }
+
+    if (value->is_end_of_line) {
+        return itj_csv_group_by_end_row(group_by);
+    }
+    return ITJ_CSV_TRUE;
+}
+
+// Parses the rest of csv into group_by, the way itj_csv_load_table does
+itj_csv_bool itj_csv_group_by_run(struct itj_csv *csv, itj_csv_kernel_fn kernel, struct itj_csv_group_by *group_by) {
+    if (!kernel) {
+        kernel = itj_csv_select_kernel(csv->delimiter, ITJ_CSV_KERNEL_DEFAULT);
+    }
+    for (;;) {
+        struct itj_csv_value value = kernel(csv);
+        if (value.need_data) {
+#ifndef ITJ_CSV_NO_STD
+            if (csv->fh && itj_csv_pump_stdio(csv) != 0) {
+                continue;
+            }
+#endif
+            break;
+        }
+        if (!itj_csv_group_by_add_value(group_by, &value)) {
+            return ITJ_CSV_FALSE;
+        }
+    }
+    return ITJ_CSV_TRUE;
+}
+
+/*
+ * Adds the groups of from into into, which have to group by the same kinds of columns, like the
+ * tables of threads that each read a part of the data. Returns false when out of memory
+ */
+itj_csv_bool itj_csv_group_by_merge(struct itj_csv_group_by *into, const struct itj_csv_group_by *from) {
+    for (itj_csv_u32 g = 0; g < from->groups.num_strings; ++g) {
+        struct itj_csv_string key = itj_csv_intern_string(&from->groups, (itj_csv_s32)g);
+        itj_csv_s32 group = itj_csv_group_by_find(into, key.base, key.len);
+        if (group < 0) {
+            return ITJ_CSV_FALSE;
+        }
+        into->group_rows[group] += from->group_rows[g];
+        for (itj_csv_u32 v = 0; v < into->num_values; ++v) {
+            struct itj_csv_accumulator *a = &into->accumulators[(itj_csv_umax)group * into->num_values + v];
+            const struct itj_csv_accumulator *b = &from->accumulators[(itj_csv_umax)g * from->num_values + v];
+            if (b->count == 0) {
+                continue;
+            }
+            if (into->value_types[v] == ITJ_CSV_COLUMN_S64) {
+                a->min.s64 = a->count == 0 || b->min.s64 < a->min.s64 ? b->min.s64 : a->min.s64;
+                a->max.s64 = a->count == 0 || b->max.s64 > a->max.s64 ? b->max.s64 : a->max.s64;
+                a->sum.s64 += b->sum.s64;
+            } else {
+                a->min.f64 = a->count == 0 || b->min.f64 < a->min.f64 ? b->min.f64 : a->min.f64;
+                a->max.f64 = a->count == 0 || b->max.f64 > a->max.f64 ? b->max.f64 : a->max.f64;
+                a->sum.f64 += b->sum.f64;
+            }
+            a->count += b->count;
+        }
+    }
+    into->num_rows += from->num_rows;
+    return ITJ_CSV_TRUE;
+}
+
+// Part k of the key of a group. Only good until the next row or merge, which may move the keys
+struct itj_csv_string itj_csv_group_by_key(const struct itj_csv_group_by *group_by, itj_csv_u32 group, itj_csv_u32 k) {
+    struct itj_csv_string key = itj_csv_intern_string(&group_by->groups, (itj_csv_s32)group);
+    if (group_by->num_keys == 1) {
+        return key;
+    }
+    itj_csv_umax used = 0;
+    for (itj_csv_u32 i = 0;; ++i) {
+        itj_csv_u32 len;
+        ITJ_CSV_MEMCPY(&len, key.base + used, sizeof(itj_csv_u32));
+        if (i == k) {
+            key.base += used + sizeof(itj_csv_u32);
+            key.len = len;
+            return key;
+        }
+        used += sizeof(itj_csv_u32) + len;
+    }
+}
+
+// The accumulator of value column v in a group, and its mean, NaN for no values
+struct itj_csv_accumulator *itj_csv_group_by_accumulator(const struct itj_csv_group_by *group_by, itj_csv_u32 group, itj_csv_u32 v) {
+    return &group_by->accumulators[(itj_csv_umax)group * group_by->num_values + v];
+}
+
+double itj_csv_accumulator_mean(const struct itj_csv_accumulator *accumulator, itj_csv_column_type_t type) {
+    if (accumulator->count == 0) {
+        itj_csv_u64 quiet_nan = 0x7ff8000000000000ull;
+        double rv;
+        ITJ_CSV_MEMCPY(&rv, &quiet_nan, sizeof(rv));
+        return rv;
+    }
+    double sum = type == ITJ_CSV_COLUMN_S64 ? (double)accumulator->sum.s64 : accumulator->sum.f64;
+    return sum / (double)accumulator->count;
+}
+
+#endif // ITJ_CSV_IMPLEMENTATION
+
+#if defined(ITJ_CSV_IMPLEMENTATION) && !defined(ITJ_CSV_NO_STD)
+
+struct itj_csv_group_by_chunk {
+    struct itj_csv_group_by group_by;
+    const itj_csv_u8 *base; // In the caller's buffer, which is not written to
+    itj_csv_umax len;
+    itj_csv_u8 delimiter;
+    itj_csv_kernel_fn kernel;
+    itj_csv_bool ok;
+};
+
+/*
+ * Groups a copy of the chunk. The kernels load a block past the end of what they parse, which in the
+ * caller's buffer is the start of the next chunk, where another thread contracts doubled quotes in
+ * place. The copy has slack of its own, and the group keeps copies of its keys, so it can go after
+ */
+static void itj_csv_group_by_thread(void *arg) {
+    struct itj_csv_group_by_chunk *chunk = (struct itj_csv_group_by_chunk *)arg;
+    void *user_mem_ptr = chunk->group_by.user_mem_ptr;
+    itj_csv_u8 *copy = (itj_csv_u8 *)ITJ_CSV_ALLOC(user_mem_ptr, chunk->len + ITJ_CSV_BLOCK_SIZE);
+    if (!copy) {
+        chunk->ok = ITJ_CSV_FALSE;
+        return;
+    }
+    if (chunk->len > 0) {
+        ITJ_CSV_MEMCPY(copy, chunk->base, chunk->len);
+    }
+    ITJ_CSV_MEMSET(copy + chunk->len, 0, ITJ_CSV_BLOCK_SIZE);
+    struct itj_csv csv;
+    itj_csv_open_memory(&csv, copy, chunk->len, chunk->delimiter, user_mem_ptr);
+    chunk->ok = itj_csv_group_by_run(&csv, chunk->kernel, &chunk->group_by);
+    ITJ_CSV_FREE(user_mem_ptr, copy);
+}
+
+/*
+ * itj_csv_group_by_run over threads, for data in memory, like a file read into a buffer. Each thread
+ * groups a copy of a chunk into its own table, and the tables are merged into group_by at the end. The
+ * chunks start on records, see itj_csv_split_records. buf is not written to, but has to have
+ * ITJ_CSV_BLOCK_SIZE bytes of slack, like for itj_csv_open_memory, and start past any header.
+ * Returns false when out of memory
+ */
+itj_csv_bool itj_csv_group_by_parallel(struct itj_csv_group_by *group_by, void *buf, itj_csv_umax len, itj_csv_u8 delimiter, itj_csv_kernel_fn kernel, itj_csv_u32 num_threads) {
+    num_threads = itj_csv_thread_count(len, num_threads);
+    struct itj_csv_group_by_chunk *chunks = (struct itj_csv_group_by_chunk *)ITJ_CSV_ALLOC(group_by->user_mem_ptr, num_threads * sizeof(struct itj_csv_group_by_chunk));
+    if (!chunks) {
+        return ITJ_CSV_FALSE;
+    }
+    ITJ_CSV_MEMSET(chunks, 0, num_threads * sizeof(struct itj_csv_group_by_chunk));
+
+    itj_csv_umax starts[ITJ_CSV_MAX_THREADS + 1];
+    itj_csv_split_records(buf, len, starts, num_threads, num_threads);
+
+    itj_csv_bool ok = ITJ_CSV_TRUE;
+    for (itj_csv_u32 t = 0; t < num_threads; ++t) {
+        chunks[t].base = (const itj_csv_u8 *)buf + starts[t];
+        chunks[t].len = starts[t + 1] - starts[t];
+        chunks[t].delimiter = delimiter;
+        chunks[t].kernel = kernel;
+        ok = ok && itj_csv_group_by_init(&chunks[t].group_by, group_by->key_columns, group_by->num_keys, group_by->value_columns,
+                                         group_by->value_types, group_by->num_values, group_by->user_mem_ptr);
+    }
+    if (ok) {
+        itj_csv_run_threads(itj_csv_group_by_thread, chunks, sizeof(chunks[0]), num_threads);
+    }
+
+    for (itj_csv_u32 t = 0; t < num_threads; ++t) {
+        ok = ok && chunks[t].ok && itj_csv_group_by_merge(group_by, &chunks[t].group_by);
+        group_by->num_chunks += chunks[t].group_by.num_rows > 0;
+        itj_csv_free_group_by(&chunks[t].group_by);
+    }
+    ITJ_CSV_FREE(group_by->user_mem_ptr, chunks);
+    return ok;
+}
+
+#endif // ITJ_CSV_IMPLEMENTATION && !ITJ_CSV_NO_STD
+
+#if defined(ITJ_CSV_IMPLEMENTATION) && !defined(ITJ_CSV_NO_STD)
+
+/*
+ * A table cache file is a header, a descriptor per column, then every array of every column, each
+ * starting at a multiple of ITJ_CSV_CACHE_ALIGNMENT so they can be used in place once mapped.
+ * The header records the size, modification time and a hash of the CSV file it was loaded from,
+ * and the cache is only used while they all still match
+ */
+#define ITJ_CSV_CACHE_MAGIC "ITJCSVT1"
+#define ITJ_CSV_CACHE_VERSION 1
+#define ITJ_CSV_CACHE_ALIGNMENT 64
+#define ITJ_CSV_CACHE_SAMPLE_SIZE (64 * 1024)
+
+struct itj_csv_cache_header {
+    char magic[8];
+    itj_csv_u32 version;
+    itj_csv_u32 byte_order; // 0x01020304 as written, so a cache from another byte order is not used
+    itj_csv_u64 file_size;
+    itj_csv_u64 num_rows;
+    itj_csv_u32 num_columns;
+    itj_csv_u32 padding;
+    itj_csv_u64 source_size;
+    itj_csv_s64 source_mtime_ns;
+    itj_csv_u64 source_hash;
+};
+
+// Every offset is from the start of the file, and sizes are in bytes
+struct itj_csv_cache_column {
+    itj_csv_u32 type;
+    itj_csv_u32 name_len; // Without the null terminator, which is stored
+    itj_csv_u64 null_count;
+    itj_csv_u64 data_used;
+    itj_csv_u64 dictionary_num_strings;
+    itj_csv_u64 dictionary_arena_used;
+    itj_csv_u64 offsets[6]; // Of the name, validity, values, data, dictionary offsets and dictionary arena
+    itj_csv_u64 sizes[6];
+};
+
+/*
+ * The size and modification time of a file, and a hash of up to ITJ_CSV_CACHE_SAMPLE_SIZE bytes at
+ * its start, middle and end. Hashing samples keeps checking a big file to well under a millisecond,
+ * and with the size and time catches rewrites that keep both
+ */
+static itj_csv_bool itj_csv_stamp_source(const char *null_terminated, struct itj_csv_source_stamp *out, void *user_mem_ptr) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExA(null_terminated, GetFileExInfoStandard, &attributes)) {
+        return ITJ_CSV_FALSE;
+    }
+    out->size = ((itj_csv_u64)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+    out->mtime_ns = (itj_csv_s64)(((itj_csv_u64)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime) * 100;
+#else
+    struct stat st;
+    if (stat(null_terminated, &st) != 0) {
+        return ITJ_CSV_FALSE;
+    }
+    out->size = (itj_csv_u64)st.st_size;
+#ifdef __APPLE__
+    out->mtime_ns = (itj_csv_s64)st.st_mtimespec.tv_sec * 1000000000ll + st.st_mtimespec.tv_nsec;
+#else
+    out->mtime_ns = (itj_csv_s64)st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec;
+#endif
+#endif
+
+    FILE *fh = fopen(null_terminated, "rb");
+    itj_csv_u8 *sample = (itj_csv_u8 *)ITJ_CSV_ALLOC(user_mem_ptr, ITJ_CSV_CACHE_SAMPLE_SIZE);
+    itj_csv_bool ok = fh && sample;
+    itj_csv_u64 starts[3] = { 0, out->size / 2, out->size > ITJ_CSV_CACHE_SAMPLE_SIZE ? out->size - ITJ_CSV_CACHE_SAMPLE_SIZE : 0 };
+    out->hash = 0;
+    for (itj_csv_u32 i = 0; ok && i < 3; ++i) {
+#ifdef _WIN32
+        ok = _fseeki64(fh, (__int64)starts[i], SEEK_SET) == 0;
+#else
+        ok = fseeko(fh, (off_t)starts[i], SEEK_SET) == 0;
+#endif
+        itj_csv_umax len = ok ? fread(sample, 1, ITJ_CSV_CACHE_SAMPLE_SIZE, fh) : 0;
+        out->hash = (out->hash ^ itj_csv_hash(sample, len)) * 0x100000001b3ull;
+    }
+    if (fh) {
+        fclose(fh);
+    }
+    if (sample) {
+        ITJ_CSV_FREE(user_mem_ptr, sample);
+    }
+    return ok;
+}
+
+static itj_csv_bool itj_csv_cache_write(FILE *fh, const void *data, itj_csv_u64 size, itj_csv_u64 *written) {
+    static const itj_csv_u8 zeros[ITJ_CSV_CACHE_ALIGNMENT] = { 0 };
+    if (size > 0 && fwrite(data, 1, (size_t)size, fh) != size) {
+        return ITJ_CSV_FALSE;
+    }
+    *written += size;
+    itj_csv_u64 padding = (ITJ_CSV_CACHE_ALIGNMENT - *written % ITJ_CSV_CACHE_ALIGNMENT) % ITJ_CSV_CACHE_ALIGNMENT;
+    if (padding > 0 && fwrite(zeros, 1, (size_t)padding, fh) != padding) {
+        return ITJ_CSV_FALSE;
+    }
+    *written += padding;
+    return ITJ_CSV_TRUE;
+}
+
+/*
+ * Records the size, modification time and a sampled hash of the file a table is about to be loaded
+ * from, after itj_csv_table_init and before itj_csv_load_table. itj_csv_save_table_cache stores this
+ * stamp rather than one taken when saving, which would vouch for a file rewritten during the load
+ */
+itj_csv_bool itj_csv_table_stamp_source(struct itj_csv_table *table, const char *source_path, itj_csv_u32 source_path_len) {
+    char null_terminated[4096];
+    if (source_path_len >= sizeof(null_terminated)) {
+        return ITJ_CSV_FALSE;
+    }
+    ITJ_CSV_MEMCPY(null_terminated, source_path, source_path_len);
+    null_terminated[source_path_len] = '\0';
+    return itj_csv_stamp_source(null_terminated, &table->source, table->user_mem_ptr);
+}
+
+/*
+ * Writes a table loaded from source_path to a cache file. The file is written next to cache_path and
+ * renamed over it once complete, so a reader never maps half a cache. Returns false without writing
+ * when source_path no longer matches the stamp of itj_csv_table_stamp_source, or was never stamped
+ */
+itj_csv_bool itj_csv_save_table_cache(const struct itj_csv_table *table, const char *cache_path, itj_csv_u32 cache_path_len,
+                                      const char *source_path, itj_csv_u32 source_path_len) {
+    char null_terminated[4096];
+    char temporary[4096 + 4];
+    if (cache_path_len >= sizeof(null_terminated) || source_path_len >= sizeof(null_terminated)) {
+        return ITJ_CSV_FALSE;
+    }
+    ITJ_CSV_MEMCPY(null_terminated, source_path, source_path_len);
+    null_terminated[source_path_len] = '\0';
+
+    struct itj_csv_cache_header header;
+    ITJ_CSV_MEMSET(&header, 0, sizeof(header));
+    struct itj_csv_source_stamp stamp = table->source;
+    struct itj_csv_source_stamp now;
+    if (!itj_csv_stamp_source(null_terminated, &now, table->user_mem_ptr) || now.size != stamp.size || now.mtime_ns != stamp.mtime_ns ||
+        now.hash != stamp.hash) {
+        return ITJ_CSV_FALSE;
+    }
+    ITJ_CSV_MEMCPY(header.magic, ITJ_CSV_CACHE_MAGIC, 8);
+    header.version = ITJ_CSV_CACHE_VERSION;
+    header.byte_order = 0x01020304;
+    header.num_rows = table->num_rows;
+    header.num_columns = table->num_columns;
+    header.source_size = stamp.size;
+    header.source_mtime_ns = stamp.mtime_ns;
+    header.source_hash = stamp.hash;
+
+    itj_csv_umax descriptors_size = table->num_columns * sizeof(struct itj_csv_cache_column);
+    struct itj_csv_cache_column *descriptors = (struct itj_csv_cache_column *)ITJ_CSV_ALLOC(table->user_mem_ptr, descriptors_size + 1);
+    if (!descriptors) {
+        return ITJ_CSV_FALSE;
+    }
+    ITJ_CSV_MEMSET(descriptors, 0, descriptors_size);
+
+    // Lay out the arrays first, so the header and descriptors go out in one pass
+    const void *arrays[6];
+    itj_csv_u64 offset = sizeof(header);
+    offset += (ITJ_CSV_CACHE_ALIGNMENT - offset % ITJ_CSV_CACHE_ALIGNMENT) % ITJ_CSV_CACHE_ALIGNMENT;
+    offset += descriptors_size;
+    offset += (ITJ_CSV_CACHE_ALIGNMENT - offset % ITJ_CSV_CACHE_ALIGNMENT) % ITJ_CSV_CACHE_ALIGNMENT;
+    for (itj_csv_u32 c = 0; c < table->num_columns; ++c) {
+        const struct itj_csv_column *column = &table->columns[c];
+        struct itj_csv_cache_column *descriptor = &descriptors[c];
+        descriptor->type = column->type;
+        descriptor->name_len = column->name.len;
+        descriptor->null_count = column->null_count;
+        descriptor->data_used = column->data_used;
+        descriptor->dictionary_num_strings = column->dictionary.num_strings;
+        descriptor->dictionary_arena_used = column->dictionary.arena_used;
+        descriptor->sizes[0] = column->name.base ? column->name.len + 1 : 0;
+        descriptor->sizes[1] = (table->num_rows + 7) / 8;
+        descriptor->sizes[2] = (table->num_rows + (column->type == ITJ_CSV_COLUMN_STRING)) * itj_csv_column_value_size(column->type);
+        descriptor->sizes[3] = column->data_used;
+        descriptor->sizes[4] = column->dictionary.num_strings ? (column->dictionary.num_strings + 1) * sizeof(itj_csv_s32) : 0;
+        descriptor->sizes[5] = column->dictionary.arena_used;
+        for (itj_csv_u32 a = 0; a < 6; ++a) {
+            descriptor->offsets[a] = offset;
+            offset += descriptor->sizes[a];
+            offset += (ITJ_CSV_CACHE_ALIGNMENT - offset % ITJ_CSV_CACHE_ALIGNMENT) % ITJ_CSV_CACHE_ALIGNMENT;
+        }
+    }
+    header.file_size = offset;
+
+    ITJ_CSV_MEMCPY(temporary, cache_path, cache_path_len);
+    ITJ_CSV_MEMCPY(temporary + cache_path_len, ".tmp", 5);
+    FILE *fh = fopen(temporary, "wb");
+    itj_csv_u64 written = 0;
+    itj_csv_bool ok = fh && itj_csv_cache_write(fh, &header, sizeof(header), &written) &&
+                      itj_csv_cache_write(fh, descriptors, descriptors_size, &written);
+    for (itj_csv_u32 c = 0; ok && c < table->num_columns; ++c) {
+        const struct itj_csv_column *column = &table->columns[c];
+        arrays[0] = column->name.base;
+        arrays[1] = column->validity;
+        arrays[2] = column->values;
+        arrays[3] = column->data;
+        arrays[4] = column->dictionary.offsets;
+        arrays[5] = column->dictionary.arena;
+        for (itj_csv_u32 a = 0; ok && a < 6; ++a) {
+            // A string column with no rows still has its one offset, a 0
+            static const itj_csv_s32 no_rows = 0;
+            ok = itj_csv_cache_write(fh, arrays[a] ? arrays[a] : &no_rows, descriptors[c].sizes[a], &written);
+        }
+    }
+    ok = ok && written == header.file_size;
+    if (fh) {
+        ok = fclose(fh) == 0 && ok;
+    }
+    ITJ_CSV_FREE(table->user_mem_ptr, descriptors);
+
+    ITJ_CSV_MEMCPY(null_terminated, cache_path, cache_path_len);
+    null_terminated[cache_path_len] = '\0';
+#ifdef _WIN32
+    // rename does not replace an existing file on Windows
+    if (ok) {
+        remove(null_terminated);
+    }
+#endif
+    if (!ok || rename(temporary, null_terminated) != 0) {
+        remove(temporary);
+        return ITJ_CSV_FALSE;
+    }
+    return ITJ_CSV_TRUE;
+}
+
+// Offsets into a buffer of size bytes, starting at 0 and never going back
+static itj_csv_bool itj_csv_cache_offsets_are_sound(const itj_csv_s32 *offsets, itj_csv_u64 num_offsets, itj_csv_u64 size) {
+    if (num_offsets == 0) {
+        return ITJ_CSV_TRUE;
+    }
+    if (offsets[0] != 0 || (itj_csv_u64)offsets[num_offsets - 1] != size) {
+        return ITJ_CSV_FALSE;
+    }
+    for (itj_csv_u64 i = 1; i < num_offsets; ++i) {
+        if (offsets[i] < offsets[i - 1]) {
+            return ITJ_CSV_FALSE;
+        }
+    }
+    return ITJ_CSV_TRUE;
+}
+
+/*
+ * What the arrays of a column in the cache hold, once they are known to be inside it. The strings are
+ * read through the offsets and codes without bounds checks, so a damaged cache could otherwise read
+ * out of the mapping. This reads the offsets and codes, but not the strings or numbers
+ */
+static itj_csv_bool itj_csv_cache_column_is_sound(const itj_csv_u8 *data, itj_csv_u64 num_rows, const struct itj_csv_cache_column *descriptor) {
+    for (itj_csv_u32 a = 1; a < 6; ++a) {
+        if (descriptor->offsets[a] % ITJ_CSV_CACHE_ALIGNMENT != 0) {
+            return ITJ_CSV_FALSE;
+        }
+    }
+    if (descriptor->sizes[0] && data[descriptor->offsets[0] + descriptor->name_len] != '\0') {
+        return ITJ_CSV_FALSE;
+    }
+
+    // The offsets are s32, like Arrow's
+    itj_csv_u64 num_strings = descriptor->dictionary_num_strings;
+    if (num_strings >= 0x7FFFFFFF || descriptor->dictionary_arena_used > 0x7FFFFFFF || descriptor->data_used > 0x7FFFFFFF ||
+        descriptor->sizes[4] != (num_strings ? (num_strings + 1) * sizeof(itj_csv_s32) : 0) ||
+        !itj_csv_cache_offsets_are_sound((const itj_csv_s32 *)(data + descriptor->offsets[4]), num_strings ? num_strings + 1 : 0,
+                                         descriptor->dictionary_arena_used)) {
+        return ITJ_CSV_FALSE;
+    }
+
+    const itj_csv_u8 *validity = data + descriptor->offsets[1];
+    const itj_csv_s32 *values = (const itj_csv_s32 *)(data + descriptor->offsets[2]);
+    if (descriptor->type == ITJ_CSV_COLUMN_STRING) {
+        return itj_csv_cache_offsets_are_sound(values, num_rows + 1, descriptor->data_used);
+    }
+    if (descriptor->type == ITJ_CSV_COLUMN_DICTIONARY) {
+        // A null row's code is not used
+        for (itj_csv_u64 row = 0; row < num_rows; ++row) {
+            if ((validity[row >> 3] >> (row & 7)) & 1 && (values[row] < 0 || (itj_csv_u64)values[row] >= num_strings)) {
+                return ITJ_CSV_FALSE;
+            }
+        }
+    }
+    return ITJ_CSV_TRUE;
+}
+
+/*
+ * Maps a cache file written by itj_csv_save_table_cache into table, with every column pointing into
+ * the mapping. Nothing is copied, but the string offsets and dictionary codes are read once to check
+ * them, so opening costs a pass over those columns and little for the rest. Pass the CSV file the
+ * cache was saved from as source_path, and the cache is only used if that file has not changed since.
+ * Returns false for a missing, stale or damaged cache, after which loading the CSV file and saving it
+ * again is the way to go. The table is read only, and itj_csv_free_table unmaps it
+ */
+itj_csv_bool itj_csv_open_table_cache(struct itj_csv_table *table, const char *cache_path, itj_csv_u32 cache_path_len,
+                                      const char *source_path, itj_csv_u32 source_path_len, void *user_mem_ptr) {
+    ITJ_CSV_MEMSET(table, 0, sizeof(*table));
+    table->user_mem_ptr = user_mem_ptr;
+
+    char null_terminated[4096];
+    if (source_path_len >= sizeof(null_terminated)) {
+        return ITJ_CSV_FALSE;
+    }
+    ITJ_CSV_MEMCPY(null_terminated, source_path, source_path_len);
+    null_terminated[source_path_len] = '\0';
+
+    struct itj_csv_mapping mapping;
+    if (!itj_csv_map_file(&mapping, cache_path, cache_path_len)) {
+        return ITJ_CSV_FALSE;
+    }
+
+    struct itj_csv_cache_header header;
+    struct itj_csv_source_stamp stamp;
+    itj_csv_bool ok = mapping.len >= sizeof(header);
+    if (ok) {
+        ITJ_CSV_MEMCPY(&header, mapping.data, sizeof(header));
+        ok = itj_csv_string_equal((const itj_csv_u8 *)header.magic, 8, (const itj_csv_u8 *)ITJ_CSV_CACHE_MAGIC, 8) && header.version == ITJ_CSV_CACHE_VERSION &&
+             header.byte_order == 0x01020304 && header.file_size == mapping.len &&
+             header.num_columns < mapping.len / sizeof(struct itj_csv_cache_column) && header.num_rows / 8 < mapping.len;
+    }
+    ok = ok && itj_csv_stamp_source(null_terminated, &stamp, user_mem_ptr) && stamp.size == header.source_size &&
+         stamp.mtime_ns == header.source_mtime_ns && stamp.hash == header.source_hash;
+
+    if (ok) {
+        table->columns = (struct itj_csv_column *)ITJ_CSV_ALLOC(user_mem_ptr, header.num_columns * sizeof(struct itj_csv_column) + 1);
+        ok = table->columns != NULL;
+    }
+
+    itj_csv_u64 descriptors_offset = sizeof(header) + (ITJ_CSV_CACHE_ALIGNMENT - sizeof(header) % ITJ_CSV_CACHE_ALIGNMENT) % ITJ_CSV_CACHE_ALIGNMENT;
+    for (itj_csv_u32 c = 0; ok && c < header.num_columns; ++c) {
+        struct itj_csv_cache_column descriptor;
+        ok = descriptors_offset + (c + 1) * sizeof(descriptor) <= mapping.len;
+        if (!ok) {
+            break;
+        }
+        ITJ_CSV_MEMCPY(&descriptor, mapping.data + descriptors_offset + c * sizeof(descriptor), sizeof(descriptor));
+
+        // Every array has to be inside the file and the size the rows make it
+        ok = descriptor.type <= ITJ_CSV_COLUMN_TIMESTAMP && descriptor.sizes[1] == (header.num_rows + 7) / 8 &&
+             descriptor.sizes[2] == (header.num_rows + (descriptor.type == ITJ_CSV_COLUMN_STRING)) * itj_csv_column_value_size((itj_csv_column_type_t)descriptor.type) &&
+             descriptor.sizes[3] == descriptor.data_used && descriptor.sizes[5] == descriptor.dictionary_arena_used &&
+             (descriptor.sizes[0] == 0 || descriptor.sizes[0] == (itj_csv_u64)descriptor.name_len + 1);
+        for (itj_csv_u32 a = 0; ok && a < 6; ++a) {
+            ok = descriptor.offsets[a] <= mapping.len && descriptor.sizes[a] <= mapping.len - descriptor.offsets[a];
+        }
+        ok = ok && descriptor.null_count <= header.num_rows && itj_csv_cache_column_is_sound(mapping.data, header.num_rows, &descriptor);
+        if (!ok) {
+            break;
+        }
+
+        struct itj_csv_column *column = &table->columns[c];
+        ITJ_CSV_MEMSET(column, 0, sizeof(*column));
+        column->type = (itj_csv_column_type_t)descriptor.type;
+        column->name.base = descriptor.sizes[0] ? mapping.data + descriptor.offsets[0] : NULL;
+        column->name.len = descriptor.sizes[0] ? descriptor.name_len : 0;
+        column->validity = mapping.data + descriptor.offsets[1];
+        column->values = mapping.data + descriptor.offsets[2];
+        column->data = mapping.data + descriptor.offsets[3];
+        column->data_used = column->data_max = descriptor.data_used;
+        column->null_count = descriptor.null_count;
+        itj_csv_intern_init(&column->dictionary, user_mem_ptr);
+        column->dictionary.offsets = (itj_csv_s32 *)(mapping.data + descriptor.offsets[4]);
+        column->dictionary.arena = mapping.data + descriptor.offsets[5];
+        column->dictionary.num_strings = column->dictionary.strings_max = (itj_csv_u32)descriptor.dictionary_num_strings;
+        column->dictionary.arena_used = column->dictionary.arena_max = descriptor.dictionary_arena_used;
+    }
+
+    if (!ok) {
+        if (table->columns) {
+            ITJ_CSV_FREE(user_mem_ptr, table->columns);
+            table->columns = NULL;
+        }
+        itj_csv_unmap_file(&mapping);
+        return ITJ_CSV_FALSE;
+    }
+
+    table->num_columns = header.num_columns;
+    table->num_rows = table->rows_max = header.num_rows;
+    table->mapping = mapping;
+    table->source = stamp;
+    return ITJ_CSV_TRUE;
+}
+
+
+/*
+ * What the arrays of an exported table share: the table, taken over from the caller, and every child
+ * ArrowArray and buffer list, in one allocation. The root, each child and each dictionary hold a
+ * reference, so a consumer can move children out and release them in any order, and the last one
+ * released frees the table
+ */
+struct itj_csv_arrow_arrays {
+    struct itj_csv_table table;
+    volatile itj_csv_u32 references;
+};
+
+// The same for the schemas, which also keep a copy of the column names
+struct itj_csv_arrow_schemas {
+    void *user_mem_ptr;
+    volatile itj_csv_u32 references;
+};
+
+// Stands in for the buffers of empty columns, which are never read but should not be null
+static const itj_csv_s32 itj_csv_arrow_empty[2] = { 0, 0 };
+
+static void itj_csv_arrow_release_array(struct ArrowArray *array) {
+    // Children and dictionaries still in place go with their parent, moved ones are the consumer's
+    for (int64_t i = 0; i < array->n_children; ++i) {
+        if (array->children[i]->release) {
+            array->children[i]->release(array->children[i]);
+        }
+    }
+    if (array->dictionary && array->dictionary->release) {
+        array->dictionary->release(array->dictionary);
+    }
+
+    struct itj_csv_arrow_arrays *shared = (struct itj_csv_arrow_arrays *)array->private_data;
+    array->release = NULL;
+    if (itj_csv_atomic_decrement(&shared->references) == 0) {
+        void *user_mem_ptr = shared->table.user_mem_ptr;
+        itj_csv_free_table(&shared->table);
+        ITJ_CSV_FREE(user_mem_ptr, shared);
+    }
+}
+
+static void itj_csv_arrow_release_schema(struct ArrowSchema *schema) {
+    for (int64_t i = 0; i < schema->n_children; ++i) {
+        if (schema->children[i]->release) {
+            schema->children[i]->release(schema->children[i]);
+        }
+    }
+    if (schema->dictionary && schema->dictionary->release) {
+        schema->dictionary->release(schema->dictionary);
+    }
+
+    struct itj_csv_arrow_schemas *shared = (struct itj_csv_arrow_schemas *)schema->private_data;
+    schema->release = NULL;
+    if (itj_csv_atomic_decrement(&shared->references) == 0) {
+        ITJ_CSV_FREE(shared->user_mem_ptr, shared);
+    }
+}
+
+/*
+ * Exports a table as an Arrow struct array with a child per column: int64 "l", float64 "g", utf8 "u",
+ * timestamps as "tsn:UTC", and dictionary columns as int32 codes with a utf8 dictionary. The buffers
+ * are the table's own arrays, so nothing is copied; the export takes the table over, leaving it empty,
+ * and the release callbacks free it once the consumer is done. The schema holds its own copy of the
+ * names and lives on its own. Returns false when out of memory, leaving the table as it was
+ */
+itj_csv_bool itj_csv_export_table(struct itj_csv_table *table, struct ArrowArray *out_array, struct ArrowSchema *out_schema) {
+    itj_csv_u32 num_columns = table->num_columns;
+    itj_csv_u32 num_arrays = num_columns;
+    itj_csv_umax names_size = 1;
+    for (itj_csv_u32 c = 0; c < num_columns; ++c) {
+        num_arrays += table->columns[c].type == ITJ_CSV_COLUMN_DICTIONARY;
+        names_size += table->columns[c].name.len + 1;
+    }
+
+    // The shared part first, then the structs, then the pointer lists
+    itj_csv_umax arrays_size = sizeof(struct itj_csv_arrow_arrays) + num_arrays * sizeof(struct ArrowArray) +
+                               num_columns * sizeof(struct ArrowArray *) + (1 + num_arrays * 3) * sizeof(const void *);
+    itj_csv_umax schemas_size = sizeof(struct itj_csv_arrow_schemas) + num_arrays * sizeof(struct ArrowSchema) +
+                                num_columns * sizeof(struct ArrowSchema *) + names_size;
+    struct itj_csv_arrow_arrays *arrays = (struct itj_csv_arrow_arrays *)ITJ_CSV_ALLOC(table->user_mem_ptr, arrays_size);
+    struct itj_csv_arrow_schemas *schemas = (struct itj_csv_arrow_schemas *)ITJ_CSV_ALLOC(table->user_mem_ptr, schemas_size);
+    if (!arrays || !schemas) {
+        if (arrays) {
+            ITJ_CSV_FREE(table->user_mem_ptr, arrays);
+        }
+        if (schemas) {
+            ITJ_CSV_FREE(table->user_mem_ptr, schemas);
+        }
+        return ITJ_CSV_FALSE;
+    }
+    ITJ_CSV_MEMSET(arrays, 0, arrays_size);
+    ITJ_CSV_MEMSET(schemas, 0, schemas_size);
+
+    struct ArrowArray *child_arrays = (struct ArrowArray *)(arrays + 1);
+    struct ArrowArray **child_array_pointers = (struct ArrowArray **)(child_arrays + num_arrays);
+    const void **buffers = (const void **)(child_array_pointers + num_columns);
+    struct ArrowSchema *child_schemas = (struct ArrowSchema *)(schemas + 1);
+    struct ArrowSchema **child_schema_pointers = (struct ArrowSchema **)(child_schemas + num_arrays);
+    char *names = (char *)(child_schema_pointers + num_columns);
+
+    arrays->table = *table;
+    arrays->references = 1 + num_arrays;
+    schemas->user_mem_ptr = table->user_mem_ptr;
+    schemas->references = 1 + num_arrays;
+
+    ITJ_CSV_MEMSET(out_array, 0, sizeof(*out_array));
+    out_array->length = (int64_t)table->num_rows;
+    out_array->n_buffers = 1;
+    out_array->buffers = buffers;
+    buffers[0] = NULL;
+    out_array->n_children = num_columns;
+    out_array->children = child_array_pointers;
+    out_array->release = itj_csv_arrow_release_array;
+    out_array->private_data = arrays;
+
+    ITJ_CSV_MEMSET(out_schema, 0, sizeof(*out_schema));
+    out_schema->format = "+s";
+    out_schema->name = names;
+    names[0] = '\0';
+    out_schema->n_children = num_columns;
+    out_schema->children = child_schema_pointers;
+    out_schema->release = itj_csv_arrow_release_schema;
+    out_schema->private_data = schemas;
+
+    itj_csv_umax names_used = 1;
+    itj_csv_u32 num_dictionaries = 0;
+    const void **next_buffers = buffers + 1;
+    for (itj_csv_u32 c = 0; c < num_columns; ++c) {
+        const struct itj_csv_column *column = &table->columns[c];
+        struct ArrowArray *array = &child_arrays[c];
+        struct ArrowSchema *schema = &child_schemas[c];
+        child_array_pointers[c] = array;
+        child_schema_pointers[c] = schema;
+
+        array->length = (int64_t)table->num_rows;
+        array->null_count = (int64_t)column->null_count;
+        array->buffers = next_buffers;
+        array->release = itj_csv_arrow_release_array;
+        array->private_data = arrays;
+        next_buffers[0] = column->null_count ? column->validity : NULL;
+        next_buffers[1] = column->values ? column->values : itj_csv_arrow_empty;
+        next_buffers[2] = column->data ? column->data : (const void *)itj_csv_arrow_empty;
+        array->n_buffers = column->type == ITJ_CSV_COLUMN_STRING ? 3 : 2;
+        next_buffers += 3;
+
+        schema->name = names + names_used;
+        if (column->name.len) {
+            ITJ_CSV_MEMCPY(names + names_used, column->name.base, column->name.len);
+        }
+        names[names_used + column->name.len] = '\0';
+        names_used += column->name.len + 1;
+        schema->flags = ARROW_FLAG_NULLABLE;
+        schema->release = itj_csv_arrow_release_schema;
+        schema->private_data = schemas;
+
+        switch (column->type) {
+        case ITJ_CSV_COLUMN_STRING:
+            schema->format = "u";
+            break;
+        case ITJ_CSV_COLUMN_S64:
+            schema->format = "l";
+            break;
+        case ITJ_CSV_COLUMN_F64:
+            schema->format = "g";
+            break;
+        case ITJ_CSV_COLUMN_TIMESTAMP:
+            schema->format = "tsn:UTC";
+            break;
+        case ITJ_CSV_COLUMN_DICTIONARY: {
+            schema->format = "i";
+            struct ArrowArray *dictionary = &child_arrays[num_columns + num_dictionaries];
+            struct ArrowSchema *dictionary_schema = &child_schemas[num_columns + num_dictionaries];
+            num_dictionaries += 1;
+
+            dictionary->length = column->dictionary.num_strings;
+            dictionary->n_buffers = 3;
+            dictionary->buffers = next_buffers;
+            dictionary->release = itj_csv_arrow_release_array;
+            dictionary->private_data = arrays;
+            next_buffers[0] = NULL;
+            next_buffers[1] = column->dictionary.offsets ? (const void *)column->dictionary.offsets : itj_csv_arrow_empty;
+            next_buffers[2] = column->dictionary.arena ? (const void *)column->dictionary.arena : itj_csv_arrow_empty;
+            next_buffers += 3;
+            array->dictionary = dictionary;
+
+            dictionary_schema->format = "u";
+            dictionary_schema->name = names;
+            dictionary_schema->release = itj_csv_arrow_release_schema;
+            dictionary_schema->private_data = schemas;
+            schema->dictionary = dictionary_schema;
+        } break;
+        }
+    }
+
+    ITJ_CSV_MEMSET(table, 0, sizeof(*table));
+    return ITJ_CSV_TRUE;
+}
+
+#endif // ITJ_CSV_IMPLEMENTATION && !ITJ_CSV_NO_STD
+
+#if defined(ITJ_CSV_IMPLEMENTATION) && !defined(ITJ_CSV_NO_STD)
+
+// A row of a sorted run, in memory and in the run files, where string keys follow it
+struct itj_csv_sort_entry {
+    itj_csv_u64 key; // Numbers as bits that order as unsigned, strings as their first 8 bytes big endian
+    itj_csv_u64 key_next; // Of strings, the 8 bytes after those. Numbers 0
+    itj_csv_u64 key_offset; // Of a string in the keys of its chunk, not used in the run files
+    itj_csv_u64 offset; // Of the row in the input
+    itj_csv_u32 len; // Of the row, with its newline
+    itj_csv_u32 key_len; // Numbers 1, or 0 when the value does not convert
+};
+
+// Orders keys, giving a_bytes and b_bytes for strings and NULL for numbers. Strings that differ
+// in their first 16 bytes are ordered without looking at the bytes, which are often not in cache.
+// Keys such as names with a number after them often share their first 8 bytes
+ITJ_CSV_INLINE int itj_csv_sort_compare(const struct itj_csv_sort_entry *a, const itj_csv_u8 *a_bytes, const struct itj_csv_sort_entry *b, const itj_csv_u8 *b_bytes) {
+    if (!a_bytes) {
+        if (a->key_len != b->key_len) {
+            return a->key_len < b->key_len ? -1 : 1;
+        }
+        return a->key < b->key ? -1 : a->key > b->key;
+    }
+    if (a->key != b->key) {
+        return a->key < b->key ? -1 : 1;
+    }
+    if (a->key_next != b->key_next) {
+        return a->key_next < b->key_next ? -1 : 1;
+    }
+    // The prefixes are padded with zeros, so the bytes both keys have agree up to the 16th
+    itj_csv_u32 len = a->key_len < b->key_len ? a->key_len : b->key_len;
+    int rv = len > 16 ? ITJ_CSV_MEMCMP(a_bytes + 16, b_bytes + 16, len - 16) : 0;
+    if (rv != 0) {
+        return rv;
+    }
+    return a->key_len < b->key_len ? -1 : a->key_len > b->key_len;
+}
+
+ITJ_CSV_INLINE itj_csv_u64 itj_csv_sort_prefix(const itj_csv_u8 *bytes, itj_csv_u32 len) {
+    itj_csv_u64 prefix = 0;
+    for (itj_csv_u32 i = 0; i < 8; ++i) {
+        prefix = prefix << 8 | (i < len ? bytes[i] : 0);
+    }
+    return prefix;
+}
+
+ITJ_CSV_INLINE itj_csv_bool itj_csv_sort_is_string(const struct itj_csv_sort *sort) {
+    return sort->key_type == ITJ_CSV_COLUMN_STRING || sort->key_type == ITJ_CSV_COLUMN_DICTIONARY;
+}
+
+// A number as 64 bits that compare as unsigned in the same order as the numbers
+static itj_csv_bool itj_csv_sort_number_key(itj_csv_column_type_t type, const struct itj_csv_string *data, itj_csv_u64 *out) {
+    itj_csv_s64 s64;
+    double f64;
+    itj_csv_u64 bits;
+    if (type == ITJ_CSV_COLUMN_F64) {
+        if (!itj_csv_parse_f64(data->base, data->len, &f64)) {
+            return ITJ_CSV_FALSE;
+        }
+        ITJ_CSV_MEMCPY(&bits, &f64, sizeof(bits));
+        *out = bits >> 63 ? ~bits : bits | 0x8000000000000000ull;
+        return ITJ_CSV_TRUE;
+    }
+    itj_csv_bool ok = type == ITJ_CSV_COLUMN_TIMESTAMP ? itj_csv_parse_timestamp(data->base, data->len, &s64) : itj_csv_parse_s64(data->base, data->len, &s64);
+    *out = (itj_csv_u64)s64 ^ 0x8000000000000000ull;
+    return ok;
+}
+
+#define ITJ_CSV_SORT_INSERTION 16
+
+// Merge sorts entries, keeping rows with equal keys in the order they came in. Blocks of
+// ITJ_CSV_SORT_INSERTION are insertion sorted first, which saves the passes over the smallest widths
+static void itj_csv_sort_entries(const struct itj_csv_sort *sort, struct itj_csv_sort_entry *entries, struct itj_csv_sort_entry *scratch, itj_csv_umax count, const itj_csv_u8 *keys) {
+    itj_csv_bool strings = itj_csv_sort_is_string(sort);
+    int direction = sort->descending ? -1 : 1;
+    for (itj_csv_umax lo = 0; lo < count; lo += ITJ_CSV_SORT_INSERTION) {
+        itj_csv_umax hi = lo + ITJ_CSV_SORT_INSERTION < count ? lo + ITJ_CSV_SORT_INSERTION : count;
+        for (itj_csv_umax i = lo + 1; i < hi; ++i) {
+            struct itj_csv_sort_entry entry = entries[i];
+            itj_csv_umax j = i;
+            for (; j > lo; --j) {
+                const struct itj_csv_sort_entry *a = &entries[j - 1];
+                int order = itj_csv_sort_compare(a, strings ? keys + a->key_offset : NULL, &entry, strings ? keys + entry.key_offset : NULL);
+                if (order * direction <= 0) {
+                    break;
+                }
+                entries[j] = entries[j - 1];
+            }
+            entries[j] = entry;
+        }
+    }
+
+    struct itj_csv_sort_entry *from = entries;
+    struct itj_csv_sort_entry *to = scratch;
+    for (itj_csv_umax width = ITJ_CSV_SORT_INSERTION; width < count; width *= 2) {
+        for (itj_csv_umax lo = 0; lo < count; lo += 2 * width) {
+            itj_csv_umax mid = lo + width < count ? lo + width : count;
+            itj_csv_umax hi = mid + width < count ? mid + width : count;
+            itj_csv_umax i = lo, j = mid, k = lo;
+            while (i < mid && j < hi) {
+                const struct itj_csv_sort_entry *a = &from[i];
+                const struct itj_csv_sort_entry *b = &from[j];
+                int order = itj_csv_sort_compare(a, strings ? keys + a->key_offset : NULL, b, strings ? keys + b->key_offset : NULL);
+                to[k++] = order * direction > 0 ? from[j++] : from[i++];
+            }
+            while (i < mid) {
+                to[k++] = from[i++];
+            }
+            while (j < hi) {
+                to[k++] = from[j++];
+            }
+        }
+        struct itj_csv_sort_entry *swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != entries) {
+        ITJ_CSV_MEMCPY(entries, from, count * sizeof(struct itj_csv_sort_entry));
+    }
+}
+
+struct itj_csv_sort_chunk {
+    const struct itj_csv_sort *sort;
+    const itj_csv_u8 *base; // In the mapped input, which is not written to
+    itj_csv_umax offset; // Of base in the input
+    itj_csv_umax len;
+    itj_csv_umax run;
+    itj_csv_umax rows_max; // Sorted at once, a chunk with more rows spills them in more than one part
+    itj_csv_umax parts; // Run files written
+    itj_csv_umax rows;
+    itj_csv_bool ok;
+};
+
+// The file of a part of a sorted run, the output path with .run, the run number and the part after it
+static itj_csv_bool itj_csv_sort_run_path(const struct itj_csv_sort *sort, itj_csv_umax run, itj_csv_umax part, char *out, itj_csv_umax out_max) {
+    if (sort->output_path_len + 48 >= out_max) {
+        return ITJ_CSV_FALSE;
+    }
+    ITJ_CSV_MEMCPY(out, sort->output_path, sort->output_path_len);
+    snprintf(out + sort->output_path_len, 48, ".run%llu.%llu", (unsigned long long)run, (unsigned long long)part);
+    return ITJ_CSV_TRUE;
+}
+
+// Sorts the rows parsed so far and writes them as the next part of the run of the chunk
+static itj_csv_bool itj_csv_sort_spill(struct itj_csv_sort_chunk *chunk, struct itj_csv_sort_entry *entries, itj_csv_umax count, const itj_csv_u8 *keys) {
+    const struct itj_csv_sort *sort = chunk->sort;
+    itj_csv_bool strings = itj_csv_sort_is_string(sort);
+    struct itj_csv_sort_entry *scratch = (struct itj_csv_sort_entry *)ITJ_CSV_ALLOC(sort->user_mem_ptr, count * sizeof(struct itj_csv_sort_entry) + 1);
+    if (!scratch) {
+        return ITJ_CSV_FALSE;
+    }
+    itj_csv_sort_entries(sort, entries, scratch, count, keys);
+    ITJ_CSV_FREE(sort->user_mem_ptr, scratch);
+
+    char path[4096 + 48];
+    if (!itj_csv_sort_run_path(sort, chunk->run, chunk->parts, path, sizeof(path))) {
+        return ITJ_CSV_FALSE;
+    }
+    FILE *fh = fopen(path, "wb");
+    if (!fh) {
+        return ITJ_CSV_FALSE;
+    }
+    chunk->parts += 1;
+    itj_csv_bool ok = ITJ_CSV_TRUE;
+    for (itj_csv_umax i = 0; ok && i < count; ++i) {
+        struct itj_csv_sort_entry entry = entries[i];
+        const itj_csv_u8 *key = keys + entry.key_offset;
+        entry.key_offset = 0;
+        ok = fwrite(&entry, sizeof(entry), 1, fh) == 1 && (!strings || entry.key_len == 0 || fwrite(key, entry.key_len, 1, fh) == 1);
+    }
+    ok = fclose(fh) == 0 && ok;
+    return ok;
+}
+
+/*
+ * Parses a copy of a chunk, as the parser contracts doubled quotes in place, for the key and the byte
+ * span of every row. Where the kernel leaves read_iter after the end of a line is where the next row
+ * starts, so quoted newlines are handled by the parser. The spans are sorted and written as a run, in
+ * parts of rows_max rows when the chunk has more rows than that. entries holds rows_max of them and
+ * keys as many bytes as the chunk, which no string keys of its rows can be more than
+ */
+static itj_csv_bool itj_csv_sort_chunk_run(struct itj_csv_sort_chunk *chunk, itj_csv_u8 *copy, struct itj_csv_sort_entry *entries, itj_csv_umax entries_max, itj_csv_u8 *keys) {
+    const struct itj_csv_sort *sort = chunk->sort;
+    itj_csv_bool strings = itj_csv_sort_is_string(sort);
+    itj_csv_kernel_fn kernel = sort->kernel ? sort->kernel : itj_csv_select_kernel(sort->delimiter, ITJ_CSV_KERNEL_DEFAULT);
+    if (chunk->len > 0) {
+        ITJ_CSV_MEMCPY(copy, chunk->base, chunk->len);
+    }
+    // The kernels leave a last value without a line ending unread, so the last row of the input gets one
+    itj_csv_umax parse_len = chunk->len;
+    if (parse_len > 0 && copy[parse_len - 1] != '\n') {
+        copy[parse_len++] = '\n';
+    }
+    struct itj_csv csv;
+    itj_csv_open_memory(&csv, copy, parse_len, sort->delimiter, sort->user_mem_ptr);
+
+    struct itj_csv_sort_entry row;
+    ITJ_CSV_MEMSET(&row, 0, sizeof(row));
+    itj_csv_umax count = 0;
+    itj_csv_umax keys_used = 0;
+    itj_csv_umax row_start = 0;
+    for (;;) {
+        struct itj_csv_value value = kernel(&csv);
+        if (value.need_data) {
+            break;
+        }
+        if (value.column == sort->key_column) {
+            if (strings) {
+                if (value.data.len > 0) {
+                    ITJ_CSV_MEMCPY(keys + keys_used, value.data.base, value.data.len);
+                }
+                row.key = itj_csv_sort_prefix(value.data.base, value.data.len);
+                row.key_next = value.data.len > 8 ? itj_csv_sort_prefix(value.data.base + 8, value.data.len - 8) : 0;
+                row.key_offset = keys_used;
+                row.key_len = value.data.len;
+                keys_used += value.data.len;
+            } else {
+                row.key_len = itj_csv_sort_number_key(sort->key_type, &value.data, &row.key);
+            }
+        }
+        if (value.is_end_of_line) {
+            itj_csv_umax row_end = csv.read_iter < chunk->len ? csv.read_iter : chunk->len;
+            if (row_end - row_start > 0xffffffff) {
+                return ITJ_CSV_FALSE;
+            }
+            row.offset = chunk->offset + row_start;
+            row.len = (itj_csv_u32)(row_end - row_start);
+            entries[count++] = row;
+            chunk->rows += 1;
+            ITJ_CSV_MEMSET(&row, 0, sizeof(row));
+            row_start = csv.read_iter;
+            // The rows so far go in a part of their own, which frees their entries and keys
+            if (count == entries_max) {
+                if (!itj_csv_sort_spill(chunk, entries, count, keys)) {
+                    return ITJ_CSV_FALSE;
+                }
+                count = 0;
+                keys_used = 0;
+            }
+        }
+    }
+    return count == 0 || itj_csv_sort_spill(chunk, entries, count, keys);
+}
+
+static void itj_csv_sort_chunk_thread(void *arg) {
+    struct itj_csv_sort_chunk *chunk = (struct itj_csv_sort_chunk *)arg;
+    void *user_mem_ptr = chunk->sort->user_mem_ptr;
+    // A chunk has a row at most for every byte of it and the one without a newline at the end
+    itj_csv_umax entries_max = chunk->len + 1 < chunk->rows_max ? chunk->len + 1 : chunk->rows_max;
+    itj_csv_u8 *copy = (itj_csv_u8 *)ITJ_CSV_ALLOC(user_mem_ptr, chunk->len + 1 + ITJ_CSV_BLOCK_SIZE);
+    struct itj_csv_sort_entry *entries = (struct itj_csv_sort_entry *)ITJ_CSV_ALLOC(user_mem_ptr, entries_max * sizeof(struct itj_csv_sort_entry));
+    itj_csv_u8 *keys = itj_csv_sort_is_string(chunk->sort) ? (itj_csv_u8 *)ITJ_CSV_ALLOC(user_mem_ptr, chunk->len + 1) : NULL;
+    chunk->ok = copy && entries && (keys || !itj_csv_sort_is_string(chunk->sort)) && itj_csv_sort_chunk_run(chunk, copy, entries, entries_max, keys);
+    if (copy) {
+        ITJ_CSV_FREE(user_mem_ptr, copy);
+    }
+    if (entries) {
+        ITJ_CSV_FREE(user_mem_ptr, entries);
+    }
+    if (keys) {
+        ITJ_CSV_FREE(user_mem_ptr, keys);
+    }
+}
+
+// The next row of a sorted run being merged. Runs are read through a buffer of their own, as a
+// call into stdio for every row costs more than the comparisons
+struct itj_csv_sort_cursor {
+    FILE *fh;
+    itj_csv_u8 *buffer;
+    itj_csv_umax buffer_size;
+    itj_csv_umax buffer_used;
+    itj_csv_umax buffer_iter;
+    struct itj_csv_sort_entry entry;
+    itj_csv_u8 *key;
+    itj_csv_umax key_max;
+    itj_csv_bool done;
+};
+
+// Reads len bytes of a run, returning how many there were
+static itj_csv_umax itj_csv_sort_read(struct itj_csv_sort_cursor *cursor, void *out, itj_csv_umax len) {
+    itj_csv_umax done = 0;
+    while (done < len) {
+        if (cursor->buffer_iter == cursor->buffer_used) {
+            cursor->buffer_used = fread(cursor->buffer, 1, cursor->buffer_size, cursor->fh);
+            cursor->buffer_iter = 0;
+            if (cursor->buffer_used == 0) {
+                break;
+            }
+        }
+        itj_csv_umax available = cursor->buffer_used - cursor->buffer_iter;
+        itj_csv_umax n = len - done < available ? len - done : available;
+        ITJ_CSV_MEMCPY((itj_csv_u8 *)out + done, cursor->buffer + cursor->buffer_iter, n);
+        cursor->buffer_iter += n;
+        done += n;
+    }
+    return done;
+}
+
+static itj_csv_bool itj_csv_sort_advance(const struct itj_csv_sort *sort, struct itj_csv_sort_cursor *cursor) {
+    itj_csv_umax got = itj_csv_sort_read(cursor, &cursor->entry, sizeof(cursor->entry));
+    if (got != sizeof(cursor->entry)) {
+        cursor->done = ITJ_CSV_TRUE;
+        return got == 0 && !ferror(cursor->fh);
+    }
+    if (!itj_csv_sort_is_string(sort) || cursor->entry.key_len == 0) {
+        return ITJ_CSV_TRUE;
+    }
+    if (!itj_csv_grow_bytes(&cursor->key, 0, &cursor->key_max, cursor->entry.key_len, sort->user_mem_ptr)) {
+        return ITJ_CSV_FALSE;
+    }
+    return itj_csv_sort_read(cursor, cursor->key, cursor->entry.key_len) == cursor->entry.key_len;
+}
+
+// If the row of run a goes before the row of run b. Finished runs go last, and ties to the earlier run
+static itj_csv_bool itj_csv_sort_before(const struct itj_csv_sort *sort, const struct itj_csv_sort_cursor *cursors, itj_csv_u32 a, itj_csv_u32 b) {
+    if (cursors[a].done || cursors[b].done) {
+        return !cursors[a].done || (cursors[b].done && a < b);
+    }
+    itj_csv_bool strings = itj_csv_sort_is_string(sort);
+    const struct itj_csv_sort_entry *x = &cursors[a].entry;
+    const struct itj_csv_sort_entry *y = &cursors[b].entry;
+    int order = itj_csv_sort_compare(x, strings ? cursors[a].key : NULL, y, strings ? cursors[b].key : NULL);
+    order = sort->descending ? -order : order;
+    return order < 0 || (order == 0 && a < b);
+}
+
+// Fills the loser tree below node, the runs are the leaves from num_runs on, and returns the winner
+static itj_csv_u32 itj_csv_sort_build_tree(const struct itj_csv_sort *sort, const struct itj_csv_sort_cursor *cursors, itj_csv_u32 *tree, itj_csv_u32 num_runs, itj_csv_u32 node) {
+    if (node >= num_runs) {
+        return node - num_runs;
+    }
+    itj_csv_u32 a = itj_csv_sort_build_tree(sort, cursors, tree, num_runs, node * 2);
+    itj_csv_u32 b = itj_csv_sort_build_tree(sort, cursors, tree, num_runs, node * 2 + 1);
+    itj_csv_bool a_wins = itj_csv_sort_before(sort, cursors, a, b);
+    tree[node] = a_wins ? b : a;
+    return a_wins ? a : b;
+}
+
+/*
+ * Merges the sorted runs into out with a loser tree, copying each row from the mapped input. Every
+ * internal node keeps the run that lost there, so replacing the winner takes one comparison per level
+ * on the way up, against the losers only
+ */
+static itj_csv_bool itj_csv_sort_merge(const struct itj_csv_sort *sort, const struct itj_csv_mapping *input, struct itj_csv_sort_cursor *cursors, itj_csv_u32 num_runs,
+                                       FILE *out, itj_csv_umax *rows_out) {
+    const itj_csv_umax out_size = 1 << 20;
+    itj_csv_u32 *tree = (itj_csv_u32 *)ITJ_CSV_ALLOC(sort->user_mem_ptr, (num_runs + 1) * sizeof(itj_csv_u32));
+    itj_csv_u8 *out_buffer = (itj_csv_u8 *)ITJ_CSV_ALLOC(sort->user_mem_ptr, out_size);
+    if (!tree || !out_buffer) {
+        if (tree) {
+            ITJ_CSV_FREE(sort->user_mem_ptr, tree);
+        }
+        if (out_buffer) {
+            ITJ_CSV_FREE(sort->user_mem_ptr, out_buffer);
+        }
+        return ITJ_CSV_FALSE;
+    }
+    tree[0] = itj_csv_sort_build_tree(sort, cursors, tree, num_runs, 1);
+    itj_csv_bool ok = ITJ_CSV_TRUE;
+    itj_csv_umax rows = 0;
+    itj_csv_umax out_used = 0;
+    while (ok && !cursors[tree[0]].done) {
+        itj_csv_u32 winner = tree[0];
+        const struct itj_csv_sort_entry *entry = &cursors[winner].entry;
+        const itj_csv_u8 *row = input->data + entry->offset;
+        if (out_used + entry->len + 1 > out_size) {
+            ok = fwrite(out_buffer, 1, out_used, out) == out_used;
+            out_used = 0;
+        }
+        if (entry->len + 1 > out_size) {
+            ok = ok && fwrite(row, 1, entry->len, out) == entry->len;
+        } else {
+            ITJ_CSV_MEMCPY(out_buffer + out_used, row, entry->len);
+            out_used += entry->len;
+        }
+        if (entry->len > 0 && row[entry->len - 1] != '\n') {
+            out_buffer[out_used++] = '\n'; // The last row of the input
+        }
+        ok = ok && itj_csv_sort_advance(sort, &cursors[winner]);
+        rows += 1;
+
+        for (itj_csv_u32 node = (winner + num_runs) / 2; node > 0; node /= 2) {
+            if (itj_csv_sort_before(sort, cursors, tree[node], winner)) {
+                itj_csv_u32 loser = winner;
+                winner = tree[node];
+                tree[node] = loser;
+            }
+        }
+        tree[0] = winner;
+    }
+    ok = ok && fwrite(out_buffer, 1, out_used, out) == out_used;
+    ITJ_CSV_FREE(sort->user_mem_ptr, out_buffer);
+    ITJ_CSV_FREE(sort->user_mem_ptr, tree);
+    *rows_out = rows;
+    return ok;
+}
+
+/*
+ * Sorts a CSV file by one column into another file. The input is mapped and split on record boundaries
+ * into chunks that fit the memory budget between the threads, going by the rows of its first megabyte. Each thread parses a chunk, sorts the
+ * byte spans of its rows by key and spills them to a run file, with string keys but without the rows.
+ * The runs are then merged, the rows copied from the input in order. Rows with equal keys stay in the
+ * order they were in. The output is written next to output_path and renamed over it when done.
+ * Returns false when a file can not be read or written, or when out of memory
+ */
+itj_csv_bool itj_csv_sort_file(const struct itj_csv_sort *sort, struct itj_csv_sort_result *result) {
+    itj_csv_u64 start_ns = itj_csv_now_ns();
+    ITJ_CSV_MEMSET(result, 0, sizeof(*result));
+    char null_terminated[4096];
+    char temporary[4096 + 4];
+    if (sort->output_path_len >= sizeof(null_terminated)) {
+        return ITJ_CSV_FALSE;
+    }
+    ITJ_CSV_MEMCPY(null_terminated, sort->output_path, sort->output_path_len);
+    null_terminated[sort->output_path_len] = '\0';
+    ITJ_CSV_MEMCPY(temporary, null_terminated, sort->output_path_len);
+    ITJ_CSV_MEMCPY(temporary + sort->output_path_len, ".tmp", 5);
+
+    struct itj_csv_mapping input;
+    if (!itj_csv_map_file(&input, sort->input_path, sort->input_path_len)) {
+        return ITJ_CSV_FALSE;
+    }
+    itj_csv_umax header_len = sort->has_header ? itj_csv_next_record(input.data, input.len, 0, ITJ_CSV_FALSE) : 0;
+    const itj_csv_u8 *body = input.data + header_len;
+    itj_csv_umax body_len = input.len - header_len;
+
+    itj_csv_u32 num_threads = itj_csv_thread_count(body_len, sort->num_threads);
+    itj_csv_umax budget = sort->memory_budget ? sort->memory_budget : ITJ_CSV_SORT_BUDGET;
+    itj_csv_umax share = budget / num_threads;
+    /*
+     * A thread's share holds the copy of its chunk, string keys of up to as many bytes again, and for
+     * every row an entry and a slot of scratch to sort them. The rows in a chunk come from the average
+     * row of the first megabyte, and a chunk with more rows than fit spills them in more than one part
+     */
+    itj_csv_umax chunk_bytes = itj_csv_sort_is_string(sort) ? 2 : 1;
+    itj_csv_umax row_cost = 2 * sizeof(struct itj_csv_sort_entry);
+    itj_csv_umax sample_len = body_len < (1 << 20) ? body_len : (1 << 20);
+    itj_csv_umax sample_rows = itj_csv_count_records(body, sample_len);
+    itj_csv_umax row_len = sample_rows > 0 ? (sample_len + sample_rows - 1) / sample_rows : sample_len + 1;
+    itj_csv_umax chunk_len = share / (chunk_bytes * row_len + row_cost) * row_len;
+    chunk_len = chunk_len > ITJ_CSV_BLOCK_SIZE ? chunk_len : ITJ_CSV_BLOCK_SIZE;
+    itj_csv_umax rows_max = share > chunk_len * chunk_bytes ? (share - chunk_len * chunk_bytes) / row_cost : 0;
+    rows_max = rows_max > 64 ? rows_max : 64;
+    itj_csv_umax num_runs = (body_len + chunk_len - 1) / chunk_len;
+    if (num_runs > ITJ_CSV_SORT_MAX_RUNS) {
+        // Chunks that many times bigger than the budget has room for, with as many more rows
+        rows_max *= (num_runs + ITJ_CSV_SORT_MAX_RUNS - 1) / ITJ_CSV_SORT_MAX_RUNS;
+        num_runs = ITJ_CSV_SORT_MAX_RUNS;
+    }
+    num_runs = num_runs == 0 ? 1 : num_runs;
+
+    itj_csv_umax *starts = (itj_csv_umax *)ITJ_CSV_ALLOC(sort->user_mem_ptr, (num_runs + 1) * sizeof(itj_csv_umax));
+    itj_csv_umax *parts = (itj_csv_umax *)ITJ_CSV_ALLOC(sort->user_mem_ptr, num_runs * sizeof(itj_csv_umax));
+    struct itj_csv_sort_chunk *chunks = (struct itj_csv_sort_chunk *)ITJ_CSV_ALLOC(sort->user_mem_ptr, num_threads * sizeof(struct itj_csv_sort_chunk));
+    itj_csv_bool ok = starts && parts && chunks;
+    if (ok) {
+        ITJ_CSV_MEMSET(parts, 0, num_runs * sizeof(itj_csv_umax));
+        itj_csv_split_records(body, body_len, starts, num_runs, num_threads);
+    }
+
+    // Sort num_threads chunks at a time, each into its own run
+    for (itj_csv_umax first = 0; ok && first < num_runs; first += num_threads) {
+        itj_csv_u32 batch = num_runs - first < num_threads ? (itj_csv_u32)(num_runs - first) : num_threads;
+        for (itj_csv_u32 t = 0; t < batch; ++t) {
+            itj_csv_umax run = first + t;
+            chunks[t].sort = sort;
+            chunks[t].base = body + starts[run];
+            chunks[t].offset = header_len + starts[run];
+            chunks[t].len = starts[run + 1] - starts[run];
+            chunks[t].run = run;
+            chunks[t].rows_max = rows_max;
+            chunks[t].parts = 0;
+            chunks[t].rows = 0;
+            chunks[t].ok = ITJ_CSV_FALSE;
+        }
+        itj_csv_run_threads(itj_csv_sort_chunk_thread, chunks, sizeof(chunks[0]), batch);
+        result->threads = batch > result->threads ? batch : result->threads;
+        for (itj_csv_u32 t = 0; t < batch; ++t) {
+            parts[first + t] = chunks[t].parts;
+            ok = ok && chunks[t].ok;
+        }
+    }
+
+    // Every part of every run is merged as a run of its own
+    itj_csv_umax num_parts = 0;
+    for (itj_csv_umax run = 0; parts && run < num_runs; ++run) {
+        num_parts += parts[run];
+    }
+    struct itj_csv_sort_cursor *cursors = ok ? (struct itj_csv_sort_cursor *)ITJ_CSV_ALLOC(sort->user_mem_ptr, (num_parts + 1) * sizeof(struct itj_csv_sort_cursor)) : NULL;
+    ok = ok && cursors && num_parts <= 0xffffffff;
+    char path[4096 + 48];
+    FILE *out = NULL;
+    if (ok) {
+        ITJ_CSV_MEMSET(cursors, 0, (num_parts + 1) * sizeof(struct itj_csv_sort_cursor));
+        // The runs share the budget for their read buffers
+        itj_csv_umax buffer_size = budget / (num_parts ? num_parts : 1);
+        buffer_size = buffer_size > (64 << 10) ? buffer_size : (64 << 10);
+        buffer_size = buffer_size < (4 << 20) ? buffer_size : (4 << 20);
+        itj_csv_umax c = 0;
+        for (itj_csv_umax run = 0; ok && run < num_runs; ++run) {
+            for (itj_csv_umax part = 0; ok && part < parts[run]; ++part, ++c) {
+                cursors[c].buffer = (itj_csv_u8 *)ITJ_CSV_ALLOC(sort->user_mem_ptr, buffer_size);
+                cursors[c].buffer_size = buffer_size;
+                ok = cursors[c].buffer && itj_csv_sort_run_path(sort, run, part, path, sizeof(path)) && (cursors[c].fh = fopen(path, "rb")) != NULL;
+                ok = ok && setvbuf(cursors[c].fh, NULL, _IONBF, 0) == 0 && itj_csv_sort_advance(sort, &cursors[c]);
+            }
+        }
+        out = ok ? fopen(temporary, "wb") : NULL;
+        ok = out != NULL;
+    }
+    ok = ok && (header_len == 0 || fwrite(input.data, 1, header_len, out) == header_len);
+    ok = ok && (num_parts == 0 || itj_csv_sort_merge(sort, &input, cursors, (itj_csv_u32)num_parts, out, &result->rows));
+    if (out) {
+        ok = fclose(out) == 0 && ok;
+    }
+
+    for (itj_csv_umax c = 0; cursors && c < num_parts; ++c) {
+        if (cursors[c].fh) {
+            fclose(cursors[c].fh);
+        }
+        if (cursors[c].key) {
+            ITJ_CSV_FREE(sort->user_mem_ptr, cursors[c].key);
+        }
+        if (cursors[c].buffer) {
+            ITJ_CSV_FREE(sort->user_mem_ptr, cursors[c].buffer);
+        }
+    }
+    for (itj_csv_umax run = 0; parts && run < num_runs; ++run) {
+        for (itj_csv_umax part = 0; part < parts[run]; ++part) {
+            if (itj_csv_sort_run_path(sort, run, part, path, sizeof(path))) {
+                remove(path);
+            }
+        }
+    }
+    if (starts) {
+        ITJ_CSV_FREE(sort->user_mem_ptr, starts);
+    }
+    if (parts) {
+        ITJ_CSV_FREE(sort->user_mem_ptr, parts);
+    }
+    if (chunks) {
+        ITJ_CSV_FREE(sort->user_mem_ptr, chunks);
+    }
+    if (cursors) {
+        ITJ_CSV_FREE(sort->user_mem_ptr, cursors);
+    }
+    itj_csv_unmap_file(&input);
+
+    if (!ok || rename(temporary, null_terminated) != 0) {
+        remove(temporary);
+        return ITJ_CSV_FALSE;
+    }
+    result->runs = num_parts;
+    result->nanoseconds = itj_csv_now_ns() - start_ns;
+    return ITJ_CSV_TRUE;
+}
+
+#endif // ITJ_CSV_IMPLEMENTATION && !ITJ_CSV_NO_STD
+
+#ifdef ITJ_CSV_IMPLEMENTATION
+
+// Scanning data backwards from its end, for where its last records start
+struct itj_csv_tail_scan {
+    itj_csv_umax wanted;
+    itj_csv_umax found;
+    itj_csv_umax start; // Of the first of the wanted records, once they are all found
+    itj_csv_u32 inside_quotes; // An odd number of quotes after what is scanned so far
+};
+
+/*
+ * Scans the len bytes at bytes, which are at offset in the data and right before what is scanned
+ * already, a block at a time from the back. A newline starts a record when the quotes after it to the
+ * end of the data are even, as a whole record has an even number of them, and the parity of every newline
+ * in a block comes from the prefix xor of its quotes. Returns true once the wanted records are found
+ */
+static itj_csv_bool itj_csv_tail_scan_back(struct itj_csv_tail_scan *scan, const itj_csv_u8 *bytes, itj_csv_umax len, itj_csv_umax offset) {
+    itj_csv_umax i = len;
+    while (i > 0) {
+        itj_csv_u8 head[ITJ_CSV_BLOCK_SIZE];
+        const itj_csv_u8 *p = head;
+        itj_csv_umax block_start = 0;
+        if (i >= ITJ_CSV_BLOCK_SIZE) {
+            block_start = i - ITJ_CSV_BLOCK_SIZE;
+            p = bytes + block_start;
+        } else {
+            ITJ_CSV_MEMSET(head, 0, sizeof(head));
+            ITJ_CSV_MEMCPY(head, bytes, i);
+        }
+
+        itj_csv_u32 quotes = itj_csv_byte_mask(p, '"');
+        itj_csv_u32 newlines = itj_csv_byte_mask(p, '\n');
+        itj_csv_u32 block_parity = itj_csv_popcount(quotes) & 1;
+        // Bit n is set when the quotes after byte n to the end of the data are odd
+        itj_csv_u32 after = itj_csv_prefix_xor(quotes) ^ (0u - (scan->inside_quotes ^ block_parity));
+        itj_csv_u32 boundaries = newlines & ~after;
+        itj_csv_u32 count = itj_csv_popcount(boundaries);
+        if (scan->found + count >= scan->wanted) {
+            for (;;) {
+                itj_csv_u32 bit = itj_csv_bit_width(boundaries) - 1;
+                if (++scan->found == scan->wanted) {
+                    scan->start = offset + block_start + bit + 1;
+                    return ITJ_CSV_TRUE;
+                }
+                boundaries &= ~(1u << bit);
+            }
+        }
+        scan->found += count;
+        scan->inside_quotes ^= block_parity;
+        i = block_start;
+    }
+    return ITJ_CSV_FALSE;
+}
+
+// Where itj_csv_quotes_check_piece is in data it checks a piece at a time
+struct itj_csv_quote_state {
+    itj_csv_bool quoted;
+    itj_csv_bool value_start;
+    itj_csv_bool quote_at_end; // The last piece ended with a quote inside quotes, doubled or closing by the next byte
+};
+
+// The quotes in the next len bytes of the data, false as soon as one is out of place
+static itj_csv_bool itj_csv_quotes_check_piece(struct itj_csv_quote_state *state, const itj_csv_u8 *bytes, itj_csv_umax len, itj_csv_u8 delimiter) {
+    itj_csv_bool quoted = state->quoted;
+    itj_csv_bool value_start = state->value_start;
+    itj_csv_umax i = 0;
+    if (state->quote_at_end && len > 0) {
+        state->quote_at_end = ITJ_CSV_FALSE;
+        if (bytes[0] == '"') {
+            i = 1;
+        } else if (bytes[0] == delimiter || bytes[0] == '\r' || bytes[0] == '\n') {
+            quoted = ITJ_CSV_FALSE;
+        } else {
+            return ITJ_CSV_FALSE;
+        }
+    }
+    for (; i < len; ++i) {
+        itj_csv_u8 ch = bytes[i];
+        if (quoted) {
+            if (ch == '"') {
+                if (i + 1 == len) {
+                    state->quote_at_end = ITJ_CSV_TRUE;
+                    break;
+                }
+                itj_csv_u8 next = bytes[i + 1];
+                if (next == '"') {
+                    ++i;
+                } else if (next == delimiter || next == '\r' || next == '\n') {
+                    quoted = ITJ_CSV_FALSE;
+                } else {
+                    return ITJ_CSV_FALSE;
+                }
+            }
+        } else if (ch == '"') {
+            if (!value_start) {
+                return ITJ_CSV_FALSE;
+            }
+            quoted = ITJ_CSV_TRUE;
+            value_start = ITJ_CSV_FALSE;
+        } else {
+            value_start = ch == delimiter || ch == '\n';
+        }
+    }
+    state->quoted = quoted;
+    state->value_start = value_start;
+    return ITJ_CSV_TRUE;
+}
+
+// If the data checked ends outside quotes, where a quote at the very end closes them. open_end allows
+// it to end inside quotes, as a window of the data may
+ITJ_CSV_INLINE itj_csv_bool itj_csv_quotes_check_end(const struct itj_csv_quote_state *state, itj_csv_bool open_end) {
+    return !state->quoted || state->quote_at_end || open_end;
+}
+
+// itj_csv_quotes_are_clean from inside quotes or not and at the start of a value or not
+static itj_csv_bool itj_csv_quotes_check(const void *buf, itj_csv_umax len, itj_csv_u8 delimiter, itj_csv_bool quoted,
+                                         itj_csv_bool value_start, itj_csv_bool open_end) {
+    struct itj_csv_quote_state state;
+    state.quoted = quoted;
+    state.value_start = value_start;
+    state.quote_at_end = ITJ_CSV_FALSE;
+    return itj_csv_quotes_check_piece(&state, (const itj_csv_u8 *)buf, len, delimiter) && itj_csv_quotes_check_end(&state, open_end);
+}
+
+/*
+ * If every quote in the records in buf opens or closes a quoted value, or is doubled inside one. It is
+ * what tells a boundary found with the wrong quote parity, as the records after it then start inside
+ * quotes, and quotes end up in the middle of values
+ */
+itj_csv_bool itj_csv_quotes_are_clean(const void *buf, itj_csv_umax len, itj_csv_u8 delimiter) {
+    return itj_csv_quotes_check(buf, len, delimiter, ITJ_CSV_FALSE, ITJ_CSV_TRUE, ITJ_CSV_FALSE);
+}
+
+/*
+ * Where the last n records of buf start, or 0 when it has no more than n, reading about as much of it
+ * as those records take. The scan takes buf to end outside quotes. The records found are checked with
+ * itj_csv_quotes_are_clean, and if they fail, as when the last record is cut off inside quotes, the
+ * quote state at the end is counted from the start and the scan done again. A cut off record with no
+ * quotes after the newlines in it is not caught, its end is taken for records of its own
+ */
+itj_csv_umax itj_csv_find_tail(const void *buf, itj_csv_umax len, itj_csv_umax n, itj_csv_u8 delimiter) {
+    const itj_csv_u8 *bytes = (const itj_csv_u8 *)buf;
+    if (n == 0) {
+        return len;
+    }
+    // A newline at the very end ends the last record rather than starting one
+    itj_csv_umax scan_len = len > 0 && bytes[len - 1] == '\n' ? len - 1 : len;
+
+    struct itj_csv_tail_scan scan;
+    ITJ_CSV_MEMSET(&scan, 0, sizeof(scan));
+    scan.wanted = n;
+    itj_csv_tail_scan_back(&scan, bytes, scan_len, 0);
+    if (itj_csv_quotes_are_clean(bytes + scan.start, len - scan.start, delimiter)) {
+        return scan.start;
+    }
+
+    struct itj_csv_record_count count;
+    ITJ_CSV_MEMSET(&count, 0, sizeof(count));
+    itj_csv_count_newlines(bytes, len, &count);
+    ITJ_CSV_MEMSET(&scan, 0, sizeof(scan));
+    scan.wanted = n;
+    scan.inside_quotes = count.inside_quotes;
+    itj_csv_tail_scan_back(&scan, bytes, scan_len, 0);
+    return scan.start;
+}
+
+#endif // ITJ_CSV_IMPLEMENTATION
+
+#if defined(ITJ_CSV_IMPLEMENTATION) && !defined(ITJ_CSV_NO_STD)
+
+static itj_csv_bool itj_csv_read_at(FILE *fh, itj_csv_umax offset, void *out, itj_csv_umax len) {
+#ifdef _WIN32
+    int seek_failed = _fseeki64(fh, (__int64)offset, SEEK_SET);
+#else
+    int seek_failed = fseeko(fh, (off_t)offset, SEEK_SET);
+#endif
+    return !seek_failed && fread(out, 1, len, fh) == len;
+}
+
+/*
+ * itj_csv_find_tail for a file, read a block of ITJ_CSV_TAIL_BLOCK at a time from its end, into
+ * *offset_out. Open it there with itj_csv_open_follow to read the records, and keep following it
+ */
+itj_csv_bool itj_csv_find_tail_file(const char *filepath, itj_csv_u32 filepath_len, itj_csv_umax n, itj_csv_u8 delimiter, itj_csv_umax *offset_out,
+                                    void *user_mem_ptr) {
+    char null_terminated[4096];
+    if (filepath_len >= sizeof(null_terminated)) {
+        return ITJ_CSV_FALSE;
+    }
+    ITJ_CSV_MEMCPY(null_terminated, filepath, filepath_len);
+    null_terminated[filepath_len] = '\0';
+
+    FILE *fh = fopen(null_terminated, "rb");
+    if (!fh) {
+        return ITJ_CSV_FALSE;
+    }
+#ifdef _WIN32
+    itj_csv_bool ok = _fseeki64(fh, 0, SEEK_END) == 0;
+    itj_csv_umax len = ok ? (itj_csv_umax)_ftelli64(fh) : 0;
+#else
+    itj_csv_bool ok = fseeko(fh, 0, SEEK_END) == 0;
+    itj_csv_umax len = ok ? (itj_csv_umax)ftello(fh) : 0;
+#endif
+    itj_csv_u8 *block = (itj_csv_u8 *)ITJ_CSV_ALLOC(user_mem_ptr, ITJ_CSV_TAIL_BLOCK);
+    ok = ok && block;
+
+    itj_csv_u8 last = '\0';
+    ok = ok && (len == 0 || itj_csv_read_at(fh, len - 1, &last, 1));
+    itj_csv_umax scan_len = last == '\n' ? len - 1 : len;
+    struct itj_csv_tail_scan scan;
+    ITJ_CSV_MEMSET(&scan, 0, sizeof(scan));
+    for (itj_csv_u32 attempt = 0; ok && n > 0 && attempt < 2; ++attempt) {
+        itj_csv_u32 inside_quotes = 0;
+        if (attempt == 1) {
+            // The records found did not check out, so count the quotes from the start for the state at the end
+            struct itj_csv_record_count count;
+            ITJ_CSV_MEMSET(&count, 0, sizeof(count));
+            for (itj_csv_umax offset = 0; ok && offset < len; offset += ITJ_CSV_TAIL_BLOCK) {
+                itj_csv_umax size = len - offset < ITJ_CSV_TAIL_BLOCK ? len - offset : ITJ_CSV_TAIL_BLOCK;
+                ok = itj_csv_read_at(fh, offset, block, size);
+                itj_csv_count_newlines(block, size, &count);
+            }
+            inside_quotes = count.inside_quotes;
+        }
+
+        ITJ_CSV_MEMSET(&scan, 0, sizeof(scan));
+        scan.wanted = n;
+        scan.inside_quotes = inside_quotes;
+        for (itj_csv_umax end = scan_len; ok && end > 0;) {
+            itj_csv_umax size = end < ITJ_CSV_TAIL_BLOCK ? end : ITJ_CSV_TAIL_BLOCK;
+            ok = itj_csv_read_at(fh, end - size, block, size);
+            if (ok && itj_csv_tail_scan_back(&scan, block, size, end - size)) {
+                break;
+            }
+            end -= size;
+        }
+        if (!ok || attempt == 1) {
+            break;
+        }
+
+        // The records found are checked a block at a time, which is all of the file when it has fewer
+        struct itj_csv_quote_state state;
+        ITJ_CSV_MEMSET(&state, 0, sizeof(state));
+        state.value_start = ITJ_CSV_TRUE;
+        itj_csv_bool clean = ITJ_CSV_TRUE;
+        for (itj_csv_umax offset = scan.start; ok && clean && offset < len; offset += ITJ_CSV_TAIL_BLOCK) {
+            itj_csv_umax size = len - offset < ITJ_CSV_TAIL_BLOCK ? len - offset : ITJ_CSV_TAIL_BLOCK;
+            ok = itj_csv_read_at(fh, offset, block, size);
+            clean = ok && itj_csv_quotes_check_piece(&state, block, size, delimiter);
+        }
+        if (clean && itj_csv_quotes_check_end(&state, ITJ_CSV_FALSE)) {
+            break;
+        }
+    }
+
+    if (block) {
+        ITJ_CSV_FREE(user_mem_ptr, block);
+    }
+    fclose(fh);
+    *offset_out = n == 0 ? len : scan.start;
+    return ok;
+}
+
+#endif // ITJ_CSV_IMPLEMENTATION && !ITJ_CSV_NO_STD
+
+#ifdef ITJ_CSV_IMPLEMENTATION
+
+/*
+ * Guesses if the byte at window[0] is inside quotes, from the ITJ_CSV_RESYNC_WINDOW bytes from it at
+ * most and the byte before it, or '\n' at the start of the data. Read from the wrong side of a quote,
+ * data soon has a quote in the middle of a value, so it is taken to be outside if the window passes
+ * itj_csv_quotes_check from outside, and otherwise inside if it passes from inside. A window that
+ * passes neither is taken to be outside
+ */
+static itj_csv_bool itj_csv_resync_inside_quotes(itj_csv_u8 before, const itj_csv_u8 *window, itj_csv_umax window_len, itj_csv_u8 delimiter) {
+    window_len = window_len < ITJ_CSV_RESYNC_WINDOW ? window_len : ITJ_CSV_RESYNC_WINDOW;
+    itj_csv_bool value_start = before == delimiter || before == '\n';
+    if (itj_csv_quotes_check(window, window_len, delimiter, ITJ_CSV_FALSE, value_start, ITJ_CSV_TRUE)) {
+        return ITJ_CSV_FALSE;
+    }
+    return itj_csv_quotes_check(window, window_len, delimiter, ITJ_CSV_TRUE, ITJ_CSV_FALSE, ITJ_CSV_TRUE);
+}
+
+/*
+ * Where the first record that starts at or after offset in buf starts, or len. A record starts at 0
+ * and after every newline outside quotes. Whether the byte before offset is inside quotes is guessed
+ * from the bytes after it, see itj_csv_resync_inside_quotes. The guess only looks at the data, so
+ * ranges of one buffer or file cut at the same offsets meet at the same records, whoever reads them
+ */
+itj_csv_umax itj_csv_resync(const void *buf, itj_csv_umax len, itj_csv_umax offset, itj_csv_u8 delimiter) {
+    const itj_csv_u8 *bytes = (const itj_csv_u8 *)buf;
+    if (offset == 0 || offset >= len) {
+        return offset < len ? offset : len;
+    }
+    itj_csv_u8 before = offset >= 2 ? bytes[offset - 2] : '\n';
+    itj_csv_bool inside_quotes = itj_csv_resync_inside_quotes(before, bytes + offset - 1, len - offset + 1, delimiter);
+    return itj_csv_next_record(bytes, len, offset - 1, inside_quotes);
+}
+
+#endif // ITJ_CSV_IMPLEMENTATION
+
+#if defined(ITJ_CSV_IMPLEMENTATION) && !defined(ITJ_CSV_NO_STD)
+
+static itj_csv_bool itj_csv_file_size(FILE *fh, itj_csv_umax *size_out) {
+#ifdef _WIN32
+    if (_fseeki64(fh, 0, SEEK_END) != 0) {
+        return ITJ_CSV_FALSE;
+    }
+    *size_out = (itj_csv_umax)_ftelli64(fh);
+#else
+    if (fseeko(fh, 0, SEEK_END) != 0) {
+        return ITJ_CSV_FALSE;
+    }
+    *size_out = (itj_csv_umax)ftello(fh);
+#endif
+    return ITJ_CSV_TRUE;
+}
+
+// itj_csv_resync for the file of csv, read a window at a time. Leaves the file position anywhere
+static itj_csv_bool itj_csv_resync_fp(struct itj_csv *csv, itj_csv_umax offset, itj_csv_umax *out) {
+    itj_csv_umax len;
+    if (!itj_csv_file_size(csv->fh, &len)) {
+        return ITJ_CSV_FALSE;
+    }
+    if (offset == 0 || offset >= len) {
+        *out = offset < len ? offset : len;
+        return ITJ_CSV_TRUE;
+    }
+
+    itj_csv_u8 *window = (itj_csv_u8 *)ITJ_CSV_ALLOC(csv->user_mem_ptr, ITJ_CSV_RESYNC_WINDOW);
+    if (!window) {
+        return ITJ_CSV_FALSE;
+    }
+    itj_csv_umax position = offset - 1;
+    itj_csv_umax size = len - position < ITJ_CSV_RESYNC_WINDOW ? len - position : ITJ_CSV_RESYNC_WINDOW;
+    itj_csv_u8 before = '\n';
+    itj_csv_bool ok = (position == 0 || itj_csv_read_at(csv->fh, position - 1, &before, 1)) &&
+                      itj_csv_read_at(csv->fh, position, window, size);
+    itj_csv_bool inside_quotes = ok && itj_csv_resync_inside_quotes(before, window, size, csv->delimiter);
+
+    // The next record can be past the window, the quote state carries over from one to the next
+    *out = len;
+    while (ok && position < len) {
+        itj_csv_umax i = 0;
+        for (; i < size; ++i) {
+            inside_quotes ^= window[i] == '"';
+            if (window[i] == '\n' && !inside_quotes) {
+                break;
+            }
+        }
+        if (i < size) {
+            *out = position + i + 1;
+            break;
+        }
+        position += size;
+        size = len - position < ITJ_CSV_RESYNC_WINDOW ? len - position : ITJ_CSV_RESYNC_WINDOW;
+        ok = size == 0 || itj_csv_read_at(csv->fh, position, window, size);
+    }
+    ITJ_CSV_FREE(csv->user_mem_ptr, window);
+    return ok;
+}
+
+#endif // ITJ_CSV_IMPLEMENTATION && !ITJ_CSV_NO_STD
+
+#ifdef ITJ_CSV_IMPLEMENTATION
+
+/*
+ * Moves csv to the first record that starts at or after offset from the start of the data, see
+ * itj_csv_resync, to read a range of it. An offset before where csv is, like 0 after reading the header,
+ * leaves it where it is. Rows are counted on from where csv was. For a file, csv has to be open with
+ * itj_csv_open or itj_csv_open_fp on a file that can seek. Returns false when it can not read or seek
+ */
+itj_csv_bool itj_csv_seek_bytes(struct itj_csv *csv, itj_csv_umax offset) {
+    itj_csv_umax current = csv->base_offset + csv->read_iter;
+    itj_csv_umax start = current;
+#ifndef ITJ_CSV_NO_STD
+    if (csv->fh) {
+        if (offset > current && !itj_csv_resync_fp(csv, offset, &start)) {
+            return ITJ_CSV_FALSE;
+        }
+        start = start > current ? start : current;
+#ifdef _WIN32
+        int seek_failed = _fseeki64(csv->fh, (__int64)start, SEEK_SET);
+#else
+        int seek_failed = fseeko(csv->fh, (off_t)start, SEEK_SET);
+#endif
+        if (seek_failed) {
+            return ITJ_CSV_FALSE;
+        }
+        clearerr(csv->fh);
+        csv->base_offset = start;
+        csv->read_iter = 0;
+        csv->prev_read_iter = 0;
+        csv->read_used = 0;
+        csv->eof = ITJ_CSV_FALSE;
+        csv->column = 0;
+        csv->in_skipped_line = ITJ_CSV_FALSE;
+        csv->follow_split = ITJ_CSV_FALSE;
+        csv->follow_scanned = 0;
+        csv->follow_quotes = 0;
+        return ITJ_CSV_TRUE;
+    }
+#endif
+    // In memory read_max is the whole buffer, read_used may be cut by itj_csv_set_end_bytes
+    if (offset > current) {
+        start = itj_csv_resync(csv->read_base, csv->read_max, offset - csv->base_offset, csv->delimiter) + csv->base_offset;
+    }
+    csv->read_iter = start - csv->base_offset;
+    csv->read_iter = csv->read_iter < csv->read_used ? csv->read_iter : csv->read_used;
+    csv->prev_read_iter = csv->read_iter;
+    csv->column = 0;
+    csv->in_skipped_line = ITJ_CSV_FALSE;
+    return ITJ_CSV_TRUE;
+}
+
+/*
+ * Ends the data of csv before the first record that starts at or after offset, found the same way
+ * itj_csv_seek_bytes finds where to start. So N readers that each seek to one offset and end at the
+ * next one read every record once between them, with none left out and none read twice
+ */
+itj_csv_bool itj_csv_set_end_bytes(struct itj_csv *csv, itj_csv_umax offset) {
+    itj_csv_umax end;
+#ifndef ITJ_CSV_NO_STD
+    if (csv->fh) {
+        itj_csv_umax position = csv->base_offset + csv->read_used;
+        if (!itj_csv_resync_fp(csv, offset, &end)) {
+            return ITJ_CSV_FALSE;
+        }
+#ifdef _WIN32
+        int seek_failed = _fseeki64(csv->fh, (__int64)position, SEEK_SET);
+#else
+        int seek_failed = fseeko(csv->fh, (off_t)position, SEEK_SET);
+#endif
+        if (seek_failed) {
+            return ITJ_CSV_FALSE;
+        }
+        csv->end_offset = end;
+        if (position >= end) {
+            // The end is in what was read already
+            itj_csv_umax used = end > csv->base_offset ? end - csv->base_offset : 0;
+            csv->read_used = used > csv->read_iter ? used : csv->read_iter;
+            csv->eof = ITJ_CSV_TRUE;
+        }
+        return ITJ_CSV_TRUE;
+    }
+#endif
+    end = itj_csv_resync(csv->read_base, csv->read_max, offset > csv->base_offset ? offset - csv->base_offset : 0, csv->delimiter) + csv->base_offset;
+    csv->end_offset = end;
+    itj_csv_umax used = end - csv->base_offset;
+    used = used < csv->read_used ? used : csv->read_used;
+    csv->read_used = used > csv->read_iter ? used : csv->read_iter;
+    return ITJ_CSV_TRUE;
+}
+
+#endif // ITJ_CSV_IMPLEMENTATION
 
 /*
 ------------------------------------------------------------------------------
@@ -0,0 +1,444 @@
+/*
+ * C++ wrapper for itj_csv.h, iterating rows and fields as std::string_view. Needs C++17
+ *
+ * LICENSE available at the bottom
+ *
+ * USAGE: Define ITJ_CSV_IMPLEMENTATION, _AVX or _AVX2 in one file before including it, as with itj_csv.h
+ *
+ *   itj::csv_file_reader<itj_csv_get_next_value_avx2_comma> reader("data.csv", 2 * 1024 * 1024);
+ *   for (auto row : reader) {
+ *    for (std::string_view field : row) {
+ *      USE "field" here, it points into the read buffer and is valid until the next field
+ *    }
+ *   }
+ *   if (reader.get_error().kind != ITJ_CSV_ERROR_NONE) ...
+ *
+ *   itj::schema maps columns to the members of a struct, by index or by header name, and decodes a row
+ *   straight into it:
+ *
+ *   itj::schema schema(itj::column<&entry::code>("Country Code"), itj::column<&entry::dates>("1960"));
+ *   schema.bind(&reader.get_csv());
+ *   for (auto row : reader) {
+ *    entry ent = {};
+ *    schema.decode(row, ent);
+ *   }
+ *
+ *   The kernel is a template parameter, so the compiler sees which one it is and inlines it into the
+ *   loop. Pumping happens inside the iterators. itj::csv_reader wraps an itj_csv opened with the C API,
+ *   for memory, a FILE, a header or skipped lines, and itj::csv_file_reader opens and owns a file
+ */
+
+#ifndef ITJ_CSV_HPP
+#define ITJ_CSV_HPP
+
+#include "itj_csv.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace itj {
+
+template <itj_csv_kernel_fn Kernel = itj_csv_get_next_value>
+class csv_reader {
+public:
+    // The iterators keep the current value themselves rather than in the reader, so it can stay in
+    // registers. A value with need_data set is the end of the data
+    class field_iterator {
+    public:
+        field_iterator(csv_reader *owner, struct itj_csv_value value) : owner(owner), value(value), done(value.need_data) {}
+
+        std::string_view operator*() const {
+            return std::string_view((const char *)value.data.base, value.data.len);
+        }
+
+        // The last field of a row ends the row, without reading the first field of the next
+        field_iterator &operator++() {
+            if (value.is_end_of_line) {
+                done = true;
+            } else {
+                value = owner->next();
+                done = value.need_data;
+            }
+            return *this;
+        }
+
+        bool operator!=(const field_iterator &) const {
+            return !done;
+        }
+
+        // With its row, column and end of line flag
+        const struct itj_csv_value &get_value() const { return value; }
+
+    private:
+        csv_reader *owner;
+        struct itj_csv_value value;
+        bool done;
+    };
+
+    class row {
+    public:
+        row(csv_reader *owner, struct itj_csv_value first) : owner(owner), first(first) {}
+
+        field_iterator begin() const { return field_iterator(owner, first); }
+        field_iterator end() const { return field_iterator(owner, first); }
+
+        // Counting from 0, including any header, as itj_csv_value.row
+        itj_csv_umax index() const { return first.row; }
+
+    private:
+        csv_reader *owner;
+        struct itj_csv_value first;
+    };
+
+    class row_iterator {
+    public:
+        row_iterator(csv_reader *owner, struct itj_csv_value first) : owner(owner), first(first) {}
+
+        row operator*() const { return row(owner, first); }
+
+        // Skips whatever the loop body left of the row
+        row_iterator &operator++() {
+            if (!owner->at_row_end) {
+                struct itj_csv_value value;
+                do {
+                    value = owner->next();
+                } while (!value.need_data && !value.is_end_of_line);
+            }
+            first = owner->next();
+            return *this;
+        }
+
+        bool operator!=(const row_iterator &) const {
+            return !first.need_data;
+        }
+
+    private:
+        csv_reader *owner;
+        struct itj_csv_value first;
+    };
+
+    // csv is opened with itj_csv_open, itj_csv_open_fp or itj_csv_open_memory, and may be part way
+    explicit csv_reader(struct itj_csv &csv) : csv(&csv) {}
+
+    row_iterator begin() { return row_iterator(this, next()); }
+    row_iterator end() { return row_iterator(this, itj_csv_value()); }
+
+    // The next value, pumping when the kernel runs out, so the common path is the kernel call and one branch
+    struct itj_csv_value next() {
+        for (;;) {
+            struct itj_csv_value value = Kernel(csv);
+            if (!value.need_data) {
+                at_row_end = value.is_end_of_line;
+                return value;
+            }
+            if (!csv->fh || itj_csv_pump_stdio(csv) == 0) {
+                at_row_end = true;
+                return value;
+            }
+        }
+    }
+
+    struct itj_csv &get_csv() { return *csv; }
+    struct itj_csv_error get_error() const { return itj_csv_get_error(csv); }
+
+protected:
+    csv_reader() : csv(nullptr) {}
+
+    struct itj_csv *csv;
+
+private:
+    bool at_row_end = true; // The last value from next() ended a row
+};
+
+// Opens a file and owns it, and its read buffer from itj_csv_buffer_alloc
+template <itj_csv_kernel_fn Kernel = itj_csv_get_next_value>
+class csv_file_reader : public csv_reader<Kernel> {
+public:
+    csv_file_reader(const char *filepath, itj_csv_umax buffer_size, itj_csv_u8 delimiter = ITJ_CSV_DELIM_COMMA) {
+        this->csv = &file_csv;
+        if (!itj_csv_buffer_alloc(&buffer, buffer_size, nullptr)) {
+            itj_csv_open_memory(&file_csv, empty, 0, delimiter, nullptr);
+            return;
+        }
+        itj_csv_umax len = 0;
+        while (filepath[len]) {
+            ++len;
+        }
+        is_open = itj_csv_open(&file_csv, filepath, (itj_csv_u32)len, buffer.data, buffer.size, delimiter, nullptr);
+        if (!is_open) {
+            itj_csv_open_memory(&file_csv, empty, 0, delimiter, nullptr);
+        }
+    }
+
+    ~csv_file_reader() {
+        if (is_open) {
+            itj_csv_free_header(&file_csv);
+            itj_csv_close_fh(&file_csv);
+        }
+        itj_csv_buffer_free(&buffer, nullptr);
+    }
+
+    csv_file_reader(const csv_file_reader &) = delete;
+    csv_file_reader &operator=(const csv_file_reader &) = delete;
+
+    bool ok() const { return is_open; }
+
+private:
+    struct itj_csv file_csv;
+    struct itj_csv_buffer buffer = {};
+    itj_csv_u8 empty[ITJ_CSV_BLOCK_SIZE] = {}; // Read by the SIMD kernels when there is no file
+    bool is_open = false;
+};
+
+// How a member is read from a value. Specialize it for other types. An empty value is a missing one,
+// which leaves integers, strings and timestamps as they were, sets floats to NaN, and is not a failure
+template <typename T, typename Enable = void>
+struct value_decoder;
+
+template <typename T>
+struct value_decoder<T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>> {
+    static bool decode(std::string_view text, T &out) {
+        if (text.empty()) {
+            return true;
+        }
+        itj_csv_s64 value;
+        if (!itj_csv_parse_s64((const itj_csv_u8 *)text.data(), text.size(), &value)) {
+            return false;
+        }
+        if constexpr (std::is_unsigned_v<T>) {
+            if (value < 0 || (itj_csv_u64)value > (itj_csv_u64)std::numeric_limits<T>::max()) {
+                return false;
+            }
+        } else {
+            if (value < (itj_csv_s64)std::numeric_limits<T>::min() || value > (itj_csv_s64)std::numeric_limits<T>::max()) {
+                return false;
+            }
+        }
+        out = (T)value;
+        return true;
+    }
+};
+
+template <typename T>
+struct value_decoder<T, std::enable_if_t<std::is_floating_point_v<T>>> {
+    static bool decode(std::string_view text, T &out) {
+        double value = NAN;
+        if (!text.empty() && !itj_csv_parse_f64((const itj_csv_u8 *)text.data(), text.size(), &value)) {
+            return false;
+        }
+        out = (T)value;
+        return true;
+    }
+};
+
+template <>
+struct value_decoder<std::string> {
+    static bool decode(std::string_view text, std::string &out) {
+        out.assign(text.data(), text.size());
+        return true;
+    }
+};
+
+// An ISO 8601 date or timestamp through itj_csv_parse_timestamp, as a UTC time point
+template <>
+struct value_decoder<std::chrono::time_point<std::chrono::system_clock, std::chrono::nanoseconds>> {
+    static bool decode(std::string_view text, std::chrono::time_point<std::chrono::system_clock, std::chrono::nanoseconds> &out) {
+        itj_csv_s64 nanoseconds;
+        if (text.empty()) {
+            return true;
+        }
+        if (!itj_csv_parse_timestamp((const itj_csv_u8 *)text.data(), text.size(), &nanoseconds)) {
+            return false;
+        }
+        out = std::chrono::time_point<std::chrono::system_clock, std::chrono::nanoseconds>(std::chrono::nanoseconds(nanoseconds));
+        return true;
+    }
+};
+
+// Points into the read buffer, so it is only good until the next pump
+template <>
+struct value_decoder<std::string_view> {
+    static bool decode(std::string_view text, std::string_view &out) {
+        out = text;
+        return true;
+    }
+};
+
+template <typename T>
+struct member_traits;
+
+template <typename Class, typename Member>
+struct member_traits<Member Class::*> {
+    using class_type = Class;
+    using member_type = Member;
+};
+
+// A member of a struct and the column it comes from, by index or by header name.
+// An array member takes as many columns as it has elements, starting from that one
+template <auto Member>
+struct column {
+    template <typename Index, std::enable_if_t<std::is_integral_v<Index>, int> = 0>
+    constexpr column(Index index) : index((itj_csv_u32)index), name(nullptr) {}
+    constexpr column(const char *name) : index(0), name(name) {}
+
+    itj_csv_u32 index;
+    const char *name;
+};
+
+/*
+ * Decodes rows into a struct. The members and their types are template parameters, so each one gets
+ * its own decode function with the converter inlined. bind() resolves the columns once, into a
+ * table from column index to decode function, and a row is then one call through the table per
+ * value, with no per-field branching and no copies of the values
+ */
+template <typename Class, auto... Members>
+class schema {
+public:
+    constexpr explicit schema(column<Members>... columns) : columns{ { columns.index, columns.name }... } {}
+
+    // Looks up the columns given by name in the header from itj_csv_read_header. False if one is missing
+    bool bind(const struct itj_csv *csv = nullptr) {
+        itj_csv_u32 starts[sizeof...(Members)];
+        itj_csv_u32 num_values = 0;
+        itj_csv_u32 i = 0;
+        bool ok = true;
+        ((ok = ok && resolve<Members>(csv, columns[i], &starts[i], &num_values), ++i), ...);
+        if (!ok) {
+            return false;
+        }
+
+        slots.assign(num_values, slot{ skip, 0 });
+        i = 0;
+        (place<Members>(starts[i++]), ...);
+        return true;
+    }
+
+    // Decodes the values of a row from a csv_reader into out. Columns past the end of a short row leave
+    // their members as they were. Returns false if any value did not convert
+    template <typename Row>
+    bool decode(const Row &row, Class &out) const {
+        bool ok = true;
+        itj_csv_u32 num_slots = (itj_csv_u32)slots.size();
+        itj_csv_u32 column = 0;
+        for (std::string_view text : row) {
+            if (column == num_slots) {
+                break;
+            }
+            const slot &s = slots[column++];
+            ok &= s.decode(out, text, s.element);
+        }
+        return ok;
+    }
+
+private:
+    struct named_column {
+        itj_csv_u32 index;
+        const char *name;
+    };
+
+    struct slot {
+        bool (*decode)(Class &out, std::string_view text, itj_csv_u32 element);
+        itj_csv_u32 element;
+    };
+
+    template <auto Member>
+    static constexpr itj_csv_u32 extent() {
+        using member_type = typename member_traits<decltype(Member)>::member_type;
+        return std::is_array_v<member_type> ? (itj_csv_u32)std::extent_v<member_type> : 1;
+    }
+
+    template <auto Member>
+    static bool resolve(const struct itj_csv *csv, const named_column &column, itj_csv_u32 *start, itj_csv_u32 *num_values) {
+        *start = column.index;
+        if (column.name) {
+            itj_csv_smax index = csv ? itj_csv_column_index(csv, column.name, (itj_csv_u32)std::strlen(column.name)) : -1;
+            if (index < 0) {
+                return false;
+            }
+            *start = (itj_csv_u32)index;
+        }
+        if (*start + extent<Member>() > *num_values) {
+            *num_values = *start + extent<Member>();
+        }
+        return true;
+    }
+
+    template <auto Member>
+    void place(itj_csv_u32 start) {
+        for (itj_csv_u32 e = 0; e < extent<Member>(); ++e) {
+            slots[start + e] = slot{ decode_member<Member>, e };
+        }
+    }
+
+    template <auto Member>
+    static bool decode_member(Class &out, std::string_view text, itj_csv_u32 element) {
+        using member_type = typename member_traits<decltype(Member)>::member_type;
+        if constexpr (std::is_array_v<member_type>) {
+            return value_decoder<std::remove_extent_t<member_type>>::decode(text, (out.*Member)[element]);
+        } else {
+            return value_decoder<member_type>::decode(text, out.*Member);
+        }
+    }
+
+    static bool skip(Class &, std::string_view, itj_csv_u32) {
+        return true;
+    }
+
+    named_column columns[sizeof...(Members)];
+    std::vector<slot> slots;
+};
+
+template <auto First, auto... Rest>
+schema(column<First>, column<Rest>...) -> schema<typename member_traits<decltype(First)>::class_type, First, Rest...>;
+
+} // namespace itj
+
+#endif // ITJ_CSV_HPP
+
+/*
+------------------------------------------------------------------------------
+This software is available under 2 licenses -- choose whichever you prefer.
+------------------------------------------------------------------------------
+ALTERNATIVE A - MIT License
+Copyright (c) 2017 Ian Thomassen Jacobsen
+Permission is hereby granted, free of charge, to any person obtaining a copy of 
+this software and associated documentation files (the "Software"), to deal in 
+the Software without restriction, including without limitation the rights to 
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies 
+of the Software, and to permit persons to whom the Software is furnished to do 
+so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE 
+SOFTWARE.
+------------------------------------------------------------------------------
+ALTERNATIVE B - Public Domain (www.unlicense.org)
+This is free and unencumbered software released into the public domain.
+Anyone is free to copy, modify, publish, use, compile, sell, or distribute this 
+software, either in source code form or as a compiled binary, for any purpose, 
+commercial or non-commercial, and by any means.
+In jurisdictions that recognize copyright laws, the author or authors of this 
+software dedicate any and all copyright interest in the software to the public 
+domain. We make this dedication for the benefit of the public at large and to 
+the detriment of our heirs and successors. We intend this dedication to be an 
+overt act of relinquishment in perpetuity of all present and future rights to 
+this software under copyright law.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN 
+ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION 
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+------------------------------------------------------------------------------
+*/
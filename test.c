@@ -9,18 +9,15 @@
 
 #include <immintrin.h>
 
-#ifdef IS_WINDOWS
-#include <windows.h>
-#endif
-
 #define ITJ_CSV_IMPLEMENTATION_AVX2
+#define ITJ_CSV_STATS
+#define ITJ_CSV_MIN_THREAD_BYTES 64 // So the test document is split over threads
 #include "itj_csv.h"
 
 #define KB(x) (x * 1024)
 #define MB(x) (KB(x) * 1024)
 #define SIZE_OF_NULL_TERMINATOR 1
 #define SIZE_OF_DIR_SEPERATOR 1
-#define NUM_BUFFERED_CYCLES (10 * 1000 * 1000)
 
 #ifdef IS_WINDOWS
 #define DIR_SEPERATOR "\\"
@@ -28,166 +25,1765 @@
 #define DIR_SEPERATOR "/"
 #endif
 
-#ifdef IS_WINDOWS
-double g_freq;
+itj_csv_bool compare_strings(char *base1, itj_csv_umax len1, char *base2, itj_csv_umax len2) {
+    if (len1 == len2) {
+        if (memcmp(base1, base2, len1) == 0) {
+            return ITJ_CSV_TRUE;
+        }
+    }
 
-double get_time_ms() {
-    LARGE_INTEGER li;
-    QueryPerformanceCounter(&li);
-    return ((double)li.QuadPart)/g_freq;
+    return ITJ_CSV_FALSE;
 }
-#else
-double get_time_ms() {
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0;
+
+char *test_read_file(const char *path, itj_csv_umax *len_out) {
+    FILE *fh = fopen(path, "rb");
+    if (!fh) {
+        return NULL;
+    }
+    fseek(fh, 0, SEEK_END);
+    long len = ftell(fh);
+    fseek(fh, 0, SEEK_SET);
+    char *text = (char *)calloc(1, len + ITJ_CSV_BLOCK_SIZE);
+    *len_out = fread(text, 1, len, fh);
+    fclose(fh);
+    return text;
 }
-#endif
 
+itj_csv_bool g_did_a_test_fail = ITJ_CSV_FALSE;
+char *g_sitrep_filepath;
 
-itj_csv_bool compare_strings(char *base1, itj_csv_umax len1, char *base2, itj_csv_umax len2) {
-    if (len1 == len2) {
-        if (memcmp(base1, base2, len1) == 0) {
-            return ITJ_CSV_TRUE;
+void sitrep(char *fmt, ...) {
+    char *buf = (char *)calloc(1, KB(512));
+    if (!buf) {
+        printf("Unable to allocate memory for sitrep\n");
+        return;
+    }
+
+    va_list va;
+    va_start(va, fmt);
+    itj_csv_umax buf_len = vsnprintf(buf, KB(512), fmt, va);
+    va_end(va);
+
+    printf("%s", buf);
+
+    FILE *fh = fopen(g_sitrep_filepath, "ab");
+    if (fh) {
+        fwrite(buf, 1, buf_len, fh);
+        fclose(fh);
+    }
+
+    free(buf);
+}
+
+void test_print(char *str) {
+    sitrep("%s... ", str);
+}
+
+void test_print_result(itj_csv_bool result) {
+    if (result == ITJ_CSV_TRUE) {
+        sitrep("OK\n");
+    } else {
+        sitrep("FAIL\n");
+        g_did_a_test_fail = ITJ_CSV_TRUE;
+    }
+}
+
+void test_correctness(struct itj_csv_value value) {
+    itj_csv_umax column = value.column;
+    itj_csv_umax row = value.row;
+
+    if (column == 0) {
+        if (row == 0) {
+            test_print("Is header[0] == column1");
+            test_print_result(compare_strings(value.data.base, value.data.len, "column1", 7));
+        } else if (row == 1) {
+            test_print("Is the first column of the first row == row1_column1");
+            test_print_result(compare_strings(value.data.base, value.data.len, "row1_column1", 12));
+        } else if (row == 2) {
+            test_print("Is the first column of the second row == row2_column1");
+            test_print_result(compare_strings(value.data.base, value.data.len, "row2_column1", 12));
+        }
+    } else if (column == 1) {
+        if (row == 0) {
+            test_print("Is header[1] == column2");
+            test_print_result(compare_strings(value.data.base, value.data.len, "column2", 7));
+        } else if (row == 1) {
+            test_print("Is the second column of the first row == row1_column2");
+            test_print_result(compare_strings(value.data.base, value.data.len, "row1_column2", 12));
+        } else if (row == 2) {
+            test_print("Is the second column of the second row == row2_column2");
+            test_print_result(compare_strings(value.data.base, value.data.len, "row2_column2", 12));
+        }
+    } else if (column == 2) {
+        if (row == 0) {
+            test_print("Is header[2] == column\\r\\n3");
+            test_print_result(compare_strings(value.data.base, value.data.len, "column\r\n3", 9));
+        } else if (row == 1) {
+            test_print("Is the third column of the first row == row1_column\\r\\n3");
+            test_print_result(compare_strings(value.data.base, value.data.len, "row1_column\r\n3", 14));
+        } else if (row == 2) {
+            test_print("Is the third column of the second row == row2_column\\r\\n3");
+            test_print_result(compare_strings(value.data.base, value.data.len, "row2_column\r\n3", 14));
+        }
+    } else if (column == 3) {
+        if (row == 0) {
+            test_print("Is header[3] == column\"4");
+            test_print_result(compare_strings(value.data.base, value.data.len, "column\"4", 8));
+        } else if (row == 1) {
+            test_print("Is the fourth column of the first row == row1_column\"4");
+            test_print_result(compare_strings(value.data.base, value.data.len, "row1_column\"4", 13));
+        } else if (row == 2) {
+            test_print("Is the fourth column of the second row == row2_column\"4");
+            test_print_result(compare_strings(value.data.base, value.data.len, "row2_column\"4", 13));
+        }
+    } else if (column == 4) {
+        if (row == 0) {
+            test_print("Is header[4] == columnð");
+            test_print_result(compare_strings(value.data.base, value.data.len, "columnð", 8));
+        } else if (row == 1) {
+            test_print("Is the fifth column of the first row == row1_columnð");
+            test_print_result(compare_strings(value.data.base, value.data.len, "row1_columnð", 13));
+        } else if (row == 2) {
+            test_print("Is the fifth column of the second row == row2_columnð");
+            test_print_result(compare_strings(value.data.base, value.data.len, "row2_columnð", 13));
+        }
+    }
+}
+
+void test_sniff(void) {
+    struct itj_csv_dialect dialect;
+    const char *semicolons = "a;b;c\n1;2.5;x\n3;4;y\n";
+    itj_csv_sniff(semicolons, strlen(semicolons), &dialect);
+    test_print("Sniffing ; as the delimiter");
+    test_print_result(dialect.delimiter == ';' && dialect.num_columns == 3);
+    test_print("Sniffing a header over typed columns");
+    test_print_result(dialect.has_header && dialect.skip_lines == 0);
+    test_print("Sniffing integer, float and string columns");
+    test_print_result(dialect.column_types[0] == ITJ_CSV_TYPE_INTEGER && dialect.column_types[1] == ITJ_CSV_TYPE_FLOAT && dialect.column_types[2] == ITJ_CSV_TYPE_STRING);
+
+    const char *preamble =
+        "\xEF\xBB\xBF\"Data Source\",\"World Development Indicators\",\n\n"
+        "\"Last Updated Date\",\"2023-10-26\",\n\n"
+        "\"Country Name\",\"Country Code\",\"1960\",\"1961\",\n"
+        "\"Aruba\",\"ABW\",\"\",\"99.15\",\n"
+        "\"Africa Eastern and Southern\",\"AFE\",\"\",\"12.5\",\n";
+    itj_csv_sniff(preamble, strlen(preamble), &dialect);
+    test_print("Sniffing past a byte order mark and preamble");
+    test_print_result(dialect.bom_len == 3 && dialect.skip_lines == 4 && dialect.num_columns == 5);
+    test_print("Sniffing quotes and a header over a preamble");
+    test_print_result(dialect.has_quotes && dialect.has_header && !dialect.is_crlf);
+    test_print("Sniffing the year columns as numbers");
+    test_print_result(dialect.column_types[1] == ITJ_CSV_TYPE_STRING && dialect.column_types[2] == ITJ_CSV_TYPE_EMPTY && dialect.column_types[3] == ITJ_CSV_TYPE_FLOAT);
+
+    const char *tabs = "x\ty\r\n\"a\tb\"\t1\r\n\"c\"\t2\r\n";
+    itj_csv_sniff(tabs, strlen(tabs), &dialect);
+    test_print("Sniffing tabs and CRLF, ignoring quoted tabs");
+    test_print_result(dialect.delimiter == '\t' && dialect.is_crlf && dialect.num_columns == 2);
+
+    const char *numbers = "1,2\n3,4\n5,6\n";
+    itj_csv_sniff(numbers, strlen(numbers), &dialect);
+    test_print("Sniffing no header over numbers");
+    test_print_result(!dialect.has_header && dialect.column_types[0] == ITJ_CSV_TYPE_INTEGER);
+}
+
+#define TEST_DOCUMENT_VALUES 4000
+#define TEST_DOCUMENT_COLUMNS 7
+#define TEST_DOCUMENT_MAX_VALUE 70
+#define TEST_DOCUMENT_PUMP_SIZE 256
+
+struct test_document {
+    itj_csv_u8 delimiter;
+    char *data;
+    itj_csv_umax len;
+    char *values[TEST_DOCUMENT_VALUES];
+    itj_csv_umax value_lens[TEST_DOCUMENT_VALUES];
+};
+
+itj_csv_u32 g_test_seed;
+
+itj_csv_u32 test_rand(void) {
+    g_test_seed = (214013 * g_test_seed + 2531011);
+    return (g_test_seed >> 16) & 0x7FFF;
+}
+
+// Values of every length around the SIMD widths, quoted ones holding delimiters, newlines and doubled quotes
+void make_test_document_delimited(struct test_document *doc, const char *newline, itj_csv_bool with_quotes, itj_csv_u8 delimiter) {
+    const char *plain = "abcdefghijklmnopqrstuvwxyz0123456789";
+    char quoted[] = "abcdef,\n\"";
+    quoted[6] = (char)delimiter;
+    itj_csv_umax newline_len = strlen(newline);
+
+    g_test_seed = 1234;
+    doc->delimiter = delimiter;
+    doc->data = (char *)calloc(1, TEST_DOCUMENT_VALUES * (TEST_DOCUMENT_MAX_VALUE * 2 + 4) + ITJ_CSV_BLOCK_SIZE);
+    doc->len = 0;
+
+    for (itj_csv_umax i = 0; i < TEST_DOCUMENT_VALUES; ++i) {
+        itj_csv_umax len = test_rand() % TEST_DOCUMENT_MAX_VALUE;
+        itj_csv_bool is_quoted = with_quotes && (test_rand() % 2);
+        char *value = (char *)calloc(1, len + 1);
+
+        if (is_quoted) {
+            doc->data[doc->len++] = '"';
+        }
+
+        for (itj_csv_umax j = 0; j < len; ++j) {
+            if (is_quoted) {
+                value[j] = quoted[test_rand() % strlen(quoted)];
+                doc->data[doc->len++] = value[j];
+                if (value[j] == '"') {
+                    doc->data[doc->len++] = '"';
+                }
+            } else {
+                value[j] = plain[test_rand() % strlen(plain)];
+                doc->data[doc->len++] = value[j];
+            }
+        }
+
+        if (is_quoted) {
+            doc->data[doc->len++] = '"';
+        }
+
+        if ((i + 1) % TEST_DOCUMENT_COLUMNS == 0 || i + 1 == TEST_DOCUMENT_VALUES) {
+            memcpy(doc->data + doc->len, newline, newline_len);
+            doc->len += newline_len;
+        } else {
+            doc->data[doc->len++] = (char)delimiter;
+        }
+
+        doc->values[i] = value;
+        doc->value_lens[i] = len;
+    }
+}
+
+void make_test_document(struct test_document *doc, const char *newline, itj_csv_bool with_quotes) {
+    make_test_document_delimited(doc, newline, with_quotes, ITJ_CSV_DELIM_COMMA);
+}
+
+void free_test_document(struct test_document *doc) {
+    for (itj_csv_umax i = 0; i < TEST_DOCUMENT_VALUES; ++i) {
+        free(doc->values[i]);
+    }
+    free(doc->data);
+}
+
+itj_csv_bool check_test_value(struct test_document *doc, itj_csv_umax i, struct itj_csv_value value) {
+    if (i >= TEST_DOCUMENT_VALUES) {
+        return ITJ_CSV_FALSE;
+    }
+
+    itj_csv_bool expect_end_of_line = (i + 1) % TEST_DOCUMENT_COLUMNS == 0 || i + 1 == TEST_DOCUMENT_VALUES;
+    return value.is_end_of_line == expect_end_of_line && compare_strings((char *)value.data.base, value.data.len, doc->values[i], doc->value_lens[i]);
+}
+
+// Parses the document from memory, where the kernel sees all of it at once
+itj_csv_bool test_kernel_memory(struct test_document *doc, itj_csv_kernel_fn kernel) {
+    char *copy = (char *)calloc(1, doc->len + ITJ_CSV_BLOCK_SIZE);
+    memcpy(copy, doc->data, doc->len);
+
+    struct itj_csv csv;
+    itj_csv_open_memory(&csv, copy, doc->len, ITJ_CSV_DELIM_COMMA, NULL);
+
+    itj_csv_bool ok = ITJ_CSV_TRUE;
+    itj_csv_umax i = 0;
+    for (;;) {
+        struct itj_csv_value value = kernel(&csv);
+        if (value.need_data) {
+            break;
+        }
+
+        ok = ok && check_test_value(doc, i, value);
+        ++i;
+    }
+
+    free(copy);
+    return ok && i == TEST_DOCUMENT_VALUES;
+}
+
+// Parses the document through a small pump buffer, so values and line endings are split across pumps
+itj_csv_bool test_kernel_pumped(struct test_document *doc, itj_csv_kernel_fn kernel) {
+    FILE *fh = tmpfile();
+    if (!fh) {
+        return ITJ_CSV_FALSE;
+    }
+    fwrite(doc->data, 1, doc->len, fh);
+    rewind(fh);
+
+    char *buffer = (char *)calloc(1, TEST_DOCUMENT_PUMP_SIZE + ITJ_CSV_BLOCK_SIZE);
+    struct itj_csv csv;
+    itj_csv_open_fp(&csv, fh, buffer, TEST_DOCUMENT_PUMP_SIZE, ITJ_CSV_DELIM_COMMA, NULL);
+    itj_csv_pump_stdio(&csv);
+
+    itj_csv_bool ok = ITJ_CSV_TRUE;
+    itj_csv_umax i = 0;
+    for (;;) {
+        struct itj_csv_value value = kernel(&csv);
+        if (value.need_data) {
+            if (itj_csv_pump_stdio(&csv) == 0) {
+                break;
+            }
+            continue;
+        }
+
+        ok = ok && check_test_value(doc, i, value);
+        ++i;
+    }
+
+    itj_csv_close_fh(&csv);
+    free(buffer);
+    return ok && i == TEST_DOCUMENT_VALUES;
+}
+
+void test_kernel(struct test_document *doc, char *name, itj_csv_kernel_fn kernel) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "Parsing the test document from memory with %s", name);
+    test_print(buf);
+    test_print_result(test_kernel_memory(doc, kernel));
+
+    snprintf(buf, sizeof(buf), "Parsing the test document through small pumps with %s", name);
+    test_print(buf);
+    test_print_result(test_kernel_pumped(doc, kernel));
+}
+
+void test_kernels(void) {
+    struct test_document doc;
+
+    make_test_document(&doc, "\r\n", ITJ_CSV_TRUE);
+    test_kernel(&doc, "the standard kernel and CRLF", itj_csv_get_next_value);
+    test_kernel(&doc, "the AVX kernel and CRLF", itj_csv_get_next_value_avx);
+    test_kernel(&doc, "the AVX2 kernel and CRLF", itj_csv_get_next_value_avx2);
+    test_kernel(&doc, "the standard comma kernel and CRLF", itj_csv_get_next_value_comma);
+    test_kernel(&doc, "the AVX comma kernel and CRLF", itj_csv_get_next_value_avx_comma);
+    test_kernel(&doc, "the AVX2 comma kernel and CRLF", itj_csv_get_next_value_avx2_comma);
+    free_test_document(&doc);
+
+    make_test_document(&doc, "\n", ITJ_CSV_TRUE);
+    test_kernel(&doc, "the standard LF only kernel", itj_csv_get_next_value_comma_lf);
+    test_kernel(&doc, "the AVX LF only kernel", itj_csv_get_next_value_avx_comma_lf);
+    test_kernel(&doc, "the AVX2 LF only kernel", itj_csv_get_next_value_avx2_comma_lf);
+    free_test_document(&doc);
+
+    // The reader is opened for commas either way, so these only parse right by the kernel's own delimiter
+    make_test_document_delimited(&doc, "\r\n", ITJ_CSV_TRUE, ITJ_CSV_DELIM_TAB);
+    test_kernel(&doc, "the standard tab kernel and CRLF", itj_csv_get_next_value_tab);
+    test_kernel(&doc, "the AVX tab kernel and CRLF", itj_csv_get_next_value_avx_tab);
+    test_kernel(&doc, "the AVX2 tab kernel and CRLF", itj_csv_get_next_value_avx2_tab);
+    free_test_document(&doc);
+
+    make_test_document_delimited(&doc, "\n", ITJ_CSV_TRUE, ITJ_CSV_DELIM_COLON);
+    test_kernel(&doc, "the standard colon LF only kernel", itj_csv_get_next_value_colon_lf);
+    test_kernel(&doc, "the AVX colon LF only kernel", itj_csv_get_next_value_avx_colon_lf);
+    test_kernel(&doc, "the AVX2 colon LF only kernel", itj_csv_get_next_value_avx2_colon_lf);
+    free_test_document(&doc);
+
+    make_test_document(&doc, "\n", ITJ_CSV_FALSE);
+    test_kernel(&doc, "the standard LF only, no quotes kernel", itj_csv_get_next_value_comma_lf_no_quotes);
+    test_kernel(&doc, "the AVX LF only, no quotes kernel", itj_csv_get_next_value_avx_comma_lf_no_quotes);
+    test_kernel(&doc, "the AVX2 LF only, no quotes kernel", itj_csv_get_next_value_avx2_comma_lf_no_quotes);
+
+    struct itj_csv_dialect dialect;
+    itj_csv_sniff(doc.data, doc.len, &dialect);
+    test_print("Selecting the AVX2 LF only, no quotes kernel for the sniffed dialect");
+    test_print_result(itj_csv_select_dialect_kernel(&dialect) == itj_csv_get_next_value_avx2_comma_lf_no_quotes);
+    free_test_document(&doc);
+}
+
+// Rows of different lengths, where a flat value count can not be turned into columns
+itj_csv_bool test_positions_ragged(itj_csv_kernel_fn kernel) {
+    const char *text = "a,b,c\nd\n\"e\n\",f\n";
+    itj_csv_umax expected_rows[] = { 0, 0, 0, 1, 2, 2 };
+    itj_csv_u32 expected_columns[] = { 0, 1, 2, 0, 0, 1 };
+    itj_csv_umax len = strlen(text);
+    char *copy = (char *)calloc(1, len + ITJ_CSV_BLOCK_SIZE);
+    memcpy(copy, text, len);
+
+    struct itj_csv csv;
+    itj_csv_open_memory(&csv, copy, len, ITJ_CSV_DELIM_COMMA, NULL);
+
+    itj_csv_bool ok = ITJ_CSV_TRUE;
+    itj_csv_umax i = 0;
+    for (;;) {
+        struct itj_csv_value value = kernel(&csv);
+        if (value.need_data) {
+            break;
+        }
+        ok = ok && i < 6 && value.row == expected_rows[i] && value.column == expected_columns[i];
+        ++i;
+    }
+
+    free(copy);
+    return ok && i == 6;
+}
+
+void test_positions(void) {
+    test_print("Counting rows and columns of ragged rows with the standard kernel");
+    test_print_result(test_positions_ragged(itj_csv_get_next_value));
+    test_print("Counting rows and columns of ragged rows with the AVX kernel");
+    test_print_result(test_positions_ragged(itj_csv_get_next_value_avx));
+    test_print("Counting rows and columns of ragged rows with the AVX2 kernel");
+    test_print_result(test_positions_ragged(itj_csv_get_next_value_avx2));
+}
+
+// A preamble, blank lines in both line endings and comment lines longer than the pump buffer
+itj_csv_bool test_skip_lines_kernel(itj_csv_kernel_fn kernel, itj_csv_bool pumped) {
+    char *text = (char *)calloc(1, KB(4));
+    strcpy(text, "# comment\npreamble, with a \"stray quote\nsecond preamble\n\n# c2\r\na,b\r\n\r\n#");
+    for (itj_csv_u32 i = 0; i < 600; ++i) {
+        strcat(text, "x");
+    }
+    strcat(text, "\nc,\"#d\"\n\n#\n");
+    itj_csv_umax len = strlen(text);
+    const char *expected[] = { "a", "b", "c", "#d" };
+
+    struct itj_csv csv;
+    FILE *fh = NULL;
+    char *buffer;
+    if (pumped) {
+        fh = tmpfile();
+        fwrite(text, 1, len, fh);
+        rewind(fh);
+        buffer = (char *)calloc(1, TEST_DOCUMENT_PUMP_SIZE + ITJ_CSV_BLOCK_SIZE);
+        itj_csv_open_fp(&csv, fh, buffer, TEST_DOCUMENT_PUMP_SIZE, ITJ_CSV_DELIM_COMMA, NULL);
+        itj_csv_pump_stdio(&csv);
+    } else {
+        buffer = (char *)calloc(1, len + ITJ_CSV_BLOCK_SIZE);
+        memcpy(buffer, text, len);
+        itj_csv_open_memory(&csv, buffer, len, ITJ_CSV_DELIM_COMMA, NULL);
+    }
+    itj_csv_set_skip_lines(&csv, 3, ITJ_CSV_TRUE, '#');
+
+    itj_csv_bool ok = ITJ_CSV_TRUE;
+    itj_csv_umax i = 0;
+    for (;;) {
+        struct itj_csv_value value = kernel(&csv);
+        if (value.need_data) {
+            if (fh && itj_csv_pump_stdio(&csv) != 0) {
+                continue;
+            }
+            break;
+        }
+        ok = ok && i < 4 && compare_strings((char *)value.data.base, value.data.len, (char *)expected[i], strlen(expected[i])) &&
+             value.row == i / 2 && value.column == i % 2 && value.is_end_of_line == (i % 2 == 1);
+        ++i;
+    }
+
+    if (fh) {
+        itj_csv_close_fh(&csv);
+    }
+    free(buffer);
+    free(text);
+    return ok && i == 4;
+}
+
+void test_skip_lines(void) {
+    test_print("Skipping a preamble, blank and comment lines from memory with the standard kernel");
+    test_print_result(test_skip_lines_kernel(itj_csv_get_next_value, ITJ_CSV_FALSE));
+    test_print("Skipping a preamble, blank and comment lines from memory with the AVX kernel");
+    test_print_result(test_skip_lines_kernel(itj_csv_get_next_value_avx, ITJ_CSV_FALSE));
+    test_print("Skipping a preamble, blank and comment lines from memory with the AVX2 kernel");
+    test_print_result(test_skip_lines_kernel(itj_csv_get_next_value_avx2, ITJ_CSV_FALSE));
+    test_print("Skipping a preamble, blank and comment lines through small pumps with the standard kernel");
+    test_print_result(test_skip_lines_kernel(itj_csv_get_next_value, ITJ_CSV_TRUE));
+    test_print("Skipping a preamble, blank and comment lines through small pumps with the AVX2 kernel");
+    test_print_result(test_skip_lines_kernel(itj_csv_get_next_value_avx2, ITJ_CSV_TRUE));
+    test_print("Skipping a preamble, blank and comment lines through small pumps with the AVX2 strict kernel");
+    test_print_result(test_skip_lines_kernel(itj_csv_get_next_value_avx2_comma_strict, ITJ_CSV_TRUE));
+}
+
+itj_csv_bool test_stats_small(itj_csv_kernel_fn kernel) {
+    const char *text = "a,\"b\"\"c\",dd\n,eeee\n";
+    itj_csv_umax len = strlen(text);
+    char *copy = (char *)calloc(1, len + ITJ_CSV_BLOCK_SIZE);
+    memcpy(copy, text, len);
+
+    struct itj_csv csv;
+    itj_csv_open_memory(&csv, copy, len, ITJ_CSV_DELIM_COMMA, NULL);
+    while (!kernel(&csv).need_data) {
+    }
+
+    struct itj_csv_stats stats;
+    itj_csv_get_stats(&csv, &stats);
+    free(copy);
+
+    return stats.values == 5 && stats.quoted_values == 1 && stats.contracted_quotes == 1 &&
+           stats.bytes_consumed == len && stats.bytes_scanned == len && stats.rescans == 0 &&
+           stats.len_histogram[0] == 1 && stats.len_histogram[1] == 1 && stats.len_histogram[2] == 2 && stats.len_histogram[3] == 1;
+}
+
+void test_stats(void) {
+    struct itj_csv_stats stats;
+
+    test_print("Counting values, quotes and lengths with the standard kernel");
+    test_print_result(test_stats_small(itj_csv_get_next_value));
+    test_print("Counting values, quotes and lengths with the AVX2 kernel");
+    test_print_result(test_stats_small(itj_csv_get_next_value_avx2));
+
+    struct test_document doc;
+    make_test_document(&doc, "\r\n", ITJ_CSV_TRUE);
+    FILE *fh = tmpfile();
+    fwrite(doc.data, 1, doc.len, fh);
+    rewind(fh);
+
+    char *buffer = (char *)calloc(1, TEST_DOCUMENT_PUMP_SIZE + ITJ_CSV_BLOCK_SIZE);
+    struct itj_csv csv;
+    itj_csv_open_fp(&csv, fh, buffer, TEST_DOCUMENT_PUMP_SIZE, ITJ_CSV_DELIM_COMMA, NULL);
+    itj_csv_pump_stdio(&csv);
+    for (;;) {
+        struct itj_csv_value value = itj_csv_get_next_value_avx2(&csv);
+        if (value.need_data && itj_csv_pump_stdio(&csv) == 0) {
+            break;
+        }
+    }
+
+    itj_csv_get_stats(&csv, &stats);
+    test_print("Counting rescans and pump copies through small pumps");
+    test_print_result(stats.values == TEST_DOCUMENT_VALUES && stats.bytes_consumed == doc.len &&
+                      stats.bytes_scanned > stats.bytes_consumed && stats.rescans > 1 && stats.pump_bytes_moved > 0 &&
+                      stats.pumps > doc.len / TEST_DOCUMENT_PUMP_SIZE);
+
+    itj_csv_reset_stats(&csv);
+    itj_csv_get_stats(&csv, &stats);
+    test_print("Resetting the counters");
+    test_print_result(stats.values == 0 && stats.pumps == 0 && stats.len_histogram[0] == 0);
+
+    itj_csv_close_fh(&csv);
+    free(buffer);
+    free_test_document(&doc);
+}
+
+// Parses text with a strict kernel until it stops, and checks the error it stopped at
+itj_csv_bool test_strict_text(itj_csv_kernel_fn kernel, const char *text, itj_csv_error_kind_t kind, itj_csv_umax offset, itj_csv_umax row, itj_csv_u32 column) {
+    itj_csv_umax len = strlen(text);
+    char *copy = (char *)calloc(1, len + ITJ_CSV_BLOCK_SIZE);
+    memcpy(copy, text, len);
+
+    struct itj_csv csv;
+    itj_csv_open_memory(&csv, copy, len, ITJ_CSV_DELIM_COMMA, NULL);
+    while (!kernel(&csv).need_data) {
+    }
+
+    struct itj_csv_error error = itj_csv_get_error(&csv);
+    free(copy);
+    return error.kind == kind && (kind == ITJ_CSV_ERROR_NONE || (error.offset == offset && error.row == row && error.column == column));
+}
+
+itj_csv_bool test_strict_kernel(itj_csv_kernel_fn kernel) {
+    return test_strict_text(kernel, "a,\"b\"\"c\"\r\nd,\"e\"\n", ITJ_CSV_ERROR_NONE, 0, 0, 0) &&
+           test_strict_text(kernel, "a,b\nc,d\"e\n", ITJ_CSV_ERROR_QUOTE_IN_VALUE, 7, 1, 1) &&
+           test_strict_text(kernel, "a,b\n\"c\"x,d\n", ITJ_CSV_ERROR_TEXT_AFTER_QUOTE, 7, 1, 0) &&
+           test_strict_text(kernel, "a,b\nc,\"d\n", ITJ_CSV_ERROR_UNTERMINATED_QUOTE, 6, 1, 1) &&
+           test_strict_text(kernel, "a,b\nc\n", ITJ_CSV_ERROR_FIELD_COUNT, 4, 1, 0) &&
+           test_strict_text(kernel, "a,b\nc,d,e\n", ITJ_CSV_ERROR_FIELD_COUNT, 8, 1, 2) &&
+           // Quoted values longer than a SIMD block, with doubled quotes across block edges
+           test_strict_text(kernel, "a,\"0123456789abcde\"\"0123456789abcdefghijklmnopqrstu\"\"v\"\nb,c\n", ITJ_CSV_ERROR_NONE, 0, 0, 0) &&
+           test_strict_text(kernel, "a,b\n\"0123456789abcdefghijklmnopqrstuvwxyz0123\"x,d\n", ITJ_CSV_ERROR_TEXT_AFTER_QUOTE, 46, 1, 0) &&
+           test_strict_text(kernel, "a,b\nc,\"0123456789abcdefghijklmnopqrstuvwxyz0123\n", ITJ_CSV_ERROR_UNTERMINATED_QUOTE, 6, 1, 1);
+}
+
+// Reads text through a 64 byte buffer, or from memory, with quotes in the block padding after the data.
+// The kernels leave a last value without a newline unread
+itj_csv_bool test_strict_dirty_padding(itj_csv_kernel_fn kernel, const char *text, itj_csv_bool from_file, itj_csv_umax expected_values) {
+    itj_csv_umax len = strlen(text);
+    itj_csv_umax buffer_size = from_file ? 64 : len;
+    char *buffer = (char *)malloc(buffer_size + ITJ_CSV_BLOCK_SIZE);
+    memset(buffer, '"', buffer_size + ITJ_CSV_BLOCK_SIZE);
+    struct itj_csv csv;
+    FILE *fh = NULL;
+    if (from_file) {
+        fh = tmpfile();
+        fputs(text, fh);
+        rewind(fh);
+        itj_csv_open_fp(&csv, fh, buffer, buffer_size, ITJ_CSV_DELIM_COMMA, NULL);
+        itj_csv_pump_stdio(&csv);
+    } else {
+        memcpy(buffer, text, len);
+        itj_csv_open_memory(&csv, buffer, len, ITJ_CSV_DELIM_COMMA, NULL);
+    }
+    itj_csv_umax values = 0;
+    for (;;) {
+        struct itj_csv_value value = kernel(&csv);
+        if (value.need_data) {
+            if (fh && itj_csv_pump_stdio(&csv) != 0) {
+                continue;
+            }
+            break;
+        }
+        values += 1;
+    }
+    itj_csv_bool ok = itj_csv_get_error(&csv).kind == ITJ_CSV_ERROR_NONE && values == expected_values;
+    if (fh) {
+        itj_csv_close_fh(&csv);
+    }
+    free(buffer);
+    return ok;
+}
+
+itj_csv_bool test_strict_padding(itj_csv_kernel_fn kernel) {
+    const char *rows = "\"abcdefghijk\",\"l\"\n\"abcdefghijk\",\"l\"\n\"abcdefghijk\",\"l\"\n\"abcdefghijk\",\"l\"\nx,y";
+    return test_strict_dirty_padding(kernel, rows, ITJ_CSV_TRUE, 9) && test_strict_dirty_padding(kernel, "a,bcd", ITJ_CSV_FALSE, 1);
+}
+
+void test_strict(void) {
+    test_print("Stopping at malformed data with the standard strict kernel");
+    test_print_result(test_strict_kernel(itj_csv_get_next_value_comma_strict));
+    test_print("Stopping at malformed data with the AVX strict kernel");
+    test_print_result(test_strict_kernel(itj_csv_get_next_value_avx_comma_strict));
+    test_print("Stopping at malformed data with the AVX2 strict kernel");
+    test_print_result(test_strict_kernel(itj_csv_get_next_value_avx2_comma_strict));
+    test_print("Ignoring quotes in the block padding after a last line without a newline, with the strict kernels");
+    test_print_result(test_strict_padding(itj_csv_get_next_value_comma_strict) && test_strict_padding(itj_csv_get_next_value_avx_comma_strict) &&
+                      test_strict_padding(itj_csv_get_next_value_avx2_comma_strict));
+    test_print("Selecting a strict kernel for any delimiter");
+    test_print_result(itj_csv_select_kernel('|', ITJ_CSV_KERNEL_STRICT) == itj_csv_get_next_value_strict &&
+                      itj_csv_select_kernel(',', ITJ_CSV_KERNEL_STRICT) == itj_csv_get_next_value_avx2_comma_strict);
+
+    // The test document is well formed, but its last row is short
+    struct test_document doc;
+    make_test_document(&doc, "\r\n", ITJ_CSV_TRUE);
+    FILE *fh = tmpfile();
+    fwrite(doc.data, 1, doc.len, fh);
+    rewind(fh);
+
+    char *buffer = (char *)calloc(1, TEST_DOCUMENT_PUMP_SIZE + ITJ_CSV_BLOCK_SIZE);
+    struct itj_csv csv;
+    itj_csv_open_fp(&csv, fh, buffer, TEST_DOCUMENT_PUMP_SIZE, ITJ_CSV_DELIM_COMMA, NULL);
+    itj_csv_pump_stdio(&csv);
+
+    itj_csv_bool ok = ITJ_CSV_TRUE;
+    itj_csv_umax i = 0;
+    for (;;) {
+        struct itj_csv_value value = itj_csv_get_next_value_avx2_comma_strict(&csv);
+        if (value.need_data) {
+            if (itj_csv_pump_stdio(&csv) == 0) {
+                break;
+            }
+            continue;
+        }
+        ok = ok && check_test_value(&doc, i, value);
+        ++i;
+    }
+
+    struct itj_csv_error error = itj_csv_get_error(&csv);
+    itj_csv_umax last_row = TEST_DOCUMENT_VALUES / TEST_DOCUMENT_COLUMNS;
+    itj_csv_u32 last_column = TEST_DOCUMENT_VALUES % TEST_DOCUMENT_COLUMNS - 1;
+    test_print("Parsing the test document through small pumps with the AVX2 strict kernel, up to its short last row");
+    test_print_result(ok && i == TEST_DOCUMENT_VALUES - 1 && error.kind == ITJ_CSV_ERROR_FIELD_COUNT && error.row == last_row && error.column == last_column);
+    itj_csv_close_fh(&csv);
+    free_test_document(&doc);
+
+    // A value longer than the whole read buffer
+    fh = tmpfile();
+    fputs("a,b\n", fh);
+    for (itj_csv_u32 j = 0; j < TEST_DOCUMENT_PUMP_SIZE * 2; ++j) {
+        fputc('x', fh);
+    }
+    fputs(",c\n", fh);
+    rewind(fh);
+    itj_csv_open_fp(&csv, fh, buffer, TEST_DOCUMENT_PUMP_SIZE, ITJ_CSV_DELIM_COMMA, NULL);
+    itj_csv_pump_stdio(&csv);
+    for (;;) {
+        struct itj_csv_value value = itj_csv_get_next_value(&csv);
+        if (value.need_data && itj_csv_pump_stdio(&csv) == 0) {
+            break;
+        }
+    }
+    error = itj_csv_get_error(&csv);
+    test_print("Telling a value too big for the read buffer from the end of the file");
+    test_print_result(error.kind == ITJ_CSV_ERROR_VALUE_TOO_BIG && error.offset == 4 && error.row == 1 && error.column == 0);
+    itj_csv_close_fh(&csv);
+    free(buffer);
+}
+
+itj_csv_bool test_f64(const char *text, itj_csv_bool expected_ok) {
+    double value = 0.0;
+    itj_csv_bool ok = itj_csv_parse_f64((const itj_csv_u8 *)text, strlen(text), &value);
+    return ok == expected_ok && (!ok || value == strtod(text, NULL));
+}
+
+itj_csv_bool test_s64(const char *text, itj_csv_bool expected_ok, itj_csv_s64 expected) {
+    itj_csv_s64 value = 0;
+    itj_csv_bool ok = itj_csv_parse_s64((const itj_csv_u8 *)text, strlen(text), &value);
+    return ok == expected_ok && (!ok || value == expected);
+}
+
+void test_numbers(void) {
+    test_print("Parsing integers, with overflow and trailing text failing");
+    test_print_result(test_s64("0", ITJ_CSV_TRUE, 0) && test_s64("-42", ITJ_CSV_TRUE, -42) && test_s64("+7", ITJ_CSV_TRUE, 7) &&
+                      test_s64("9223372036854775807", ITJ_CSV_TRUE, 9223372036854775807ll) &&
+                      test_s64("-9223372036854775808", ITJ_CSV_TRUE, -9223372036854775807ll - 1) &&
+                      test_s64("9223372036854775808", ITJ_CSV_FALSE, 0) && test_s64("12a", ITJ_CSV_FALSE, 0) &&
+                      test_s64("", ITJ_CSV_FALSE, 0) && test_s64("-", ITJ_CSV_FALSE, 0));
+
+    test_print("Parsing floats the same as strtod, on the fast path and off it");
+    test_print_result(test_f64("1.5", ITJ_CSV_TRUE) && test_f64("-0.001", ITJ_CSV_TRUE) && test_f64("12345.678", ITJ_CSV_TRUE) &&
+                      test_f64("2e3", ITJ_CSV_TRUE) && test_f64(".5", ITJ_CSV_TRUE) && test_f64("5.", ITJ_CSV_TRUE) &&
+                      test_f64("0.1234567890123456789012", ITJ_CSV_TRUE) && test_f64("1e300", ITJ_CSV_TRUE) &&
+                      test_f64("123456789012345678901234567890", ITJ_CSV_TRUE) && test_f64("4.9e-324", ITJ_CSV_TRUE) &&
+                      test_f64("", ITJ_CSV_FALSE) && test_f64("1e", ITJ_CSV_FALSE) && test_f64("1,5", ITJ_CSV_FALSE) &&
+                      test_f64("abc", ITJ_CSV_FALSE));
+}
+
+void test_number_batch(void) {
+    const char *awkward[] = {"", "-", ".", "+.", "1.2.3", "12a", "5.", ".5", "-0", "+7", "1e5", "0.1234567890123456789012",
+                             "1234567890123456", "12345678901234567", "9007199254740993", "9223372036854775807", " 1", "1,5"};
+    itj_csv_u32 num_awkward = sizeof(awkward) / sizeof(awkward[0]);
+    itj_csv_u32 count = 10000;
+    char *text = (char *)calloc(1, count * 24 + ITJ_CSV_BLOCK_SIZE);
+    struct itj_csv_string *values = (struct itj_csv_string *)calloc(count, sizeof(*values));
+
+    // Random short integers and decimals with an awkward value every so often, packed like a row
+    srand(42);
+    itj_csv_umax len = 0;
+    for (itj_csv_u32 i = 0; i < count; ++i) {
+        values[i].base = (itj_csv_u8 *)text + len;
+        if (i % 7 == 0) {
+            len += sprintf(text + len, "%s", awkward[(i / 7) % num_awkward]);
+        } else {
+            itj_csv_u32 num_digits = 1 + rand() % 16;
+            itj_csv_u32 dot = rand() % (num_digits + 2);
+            if (rand() % 3 == 0) {
+                text[len++] = '-';
+            }
+            for (itj_csv_u32 d = 0; d < num_digits; ++d) {
+                if (d == dot) {
+                    text[len++] = '.';
+                }
+                text[len++] = (char)('0' + rand() % 10);
+            }
         }
+        values[i].len = (itj_csv_u32)(text + len - (char *)values[i].base);
+        text[len++] = ',';
     }
 
-    return ITJ_CSV_FALSE;
+    double *f64 = (double *)calloc(count, sizeof(double));
+    itj_csv_s64 *s64 = (itj_csv_s64 *)calloc(count, sizeof(itj_csv_s64));
+    itj_csv_u8 *ok = (itj_csv_u8 *)calloc(count, 1);
+
+    itj_csv_umax num_failed = itj_csv_parse_f64_batch(values, count, f64, ok);
+    itj_csv_bool same = ITJ_CSV_TRUE;
+    itj_csv_umax num_expected_failed = 0;
+    for (itj_csv_u32 i = 0; i < count; ++i) {
+        double expected = 0.0;
+        itj_csv_bool expected_ok = itj_csv_parse_f64(values[i].base, values[i].len, &expected);
+        num_expected_failed += !expected_ok;
+        same = same && ok[i] == expected_ok && (expected_ok ? memcmp(&f64[i], &expected, sizeof(double)) == 0 : f64[i] != f64[i]);
+    }
+    test_print("Converting a batch of decimals the same as one at a time");
+    test_print_result(same && num_failed == num_expected_failed);
+
+    num_failed = itj_csv_parse_s64_batch(values, count, s64, ok);
+    same = ITJ_CSV_TRUE;
+    num_expected_failed = 0;
+    for (itj_csv_u32 i = 0; i < count; ++i) {
+        itj_csv_s64 expected = 0;
+        itj_csv_bool expected_ok = itj_csv_parse_s64(values[i].base, values[i].len, &expected);
+        num_expected_failed += !expected_ok;
+        same = same && ok[i] == expected_ok && s64[i] == (expected_ok ? expected : 0);
+    }
+    test_print("Converting a batch of integers the same as one at a time");
+    test_print_result(same && num_failed == num_expected_failed);
+
+    free(ok);
+    free(s64);
+    free(f64);
+    free(values);
+    free(text);
+}
+
+itj_csv_bool test_timestamp(const char *text, itj_csv_bool expected_ok, itj_csv_s64 expected) {
+    itj_csv_s64 value = 0;
+    itj_csv_bool ok = itj_csv_parse_timestamp((const itj_csv_u8 *)text, strlen(text), &value);
+    return ok == expected_ok && (!ok || value == expected);
+}
+
+void test_timestamps(void) {
+    test_print("Parsing dates and timestamps, with fractions and zones");
+    test_print_result(test_timestamp("1970-01-01", ITJ_CSV_TRUE, 0) && test_timestamp("1969-12-31T23:59:59Z", ITJ_CSV_TRUE, -1000000000ll) &&
+                      test_timestamp("1900-01-01 00:00:00", ITJ_CSV_TRUE, -2208988800000000000ll) &&
+                      test_timestamp("2024-02-29T12:34:56.789+02:00", ITJ_CSV_TRUE, 1709202896789000000ll) &&
+                      test_timestamp("2024-02-29T10:34:56.789000000Z", ITJ_CSV_TRUE, 1709202896789000000ll) &&
+                      test_timestamp("2024-02-29T08:04:56.789-02:30", ITJ_CSV_TRUE, 1709202896789000000ll) &&
+                      test_timestamp("2262-04-11T23:47:16Z", ITJ_CSV_TRUE, 9223372036000000000ll));
+
+    test_print("Parsing timestamps the fixed layout does not take, a byte at a time");
+    test_print_result(test_timestamp("2024-02-29t12:34:56.789+0200", ITJ_CSV_TRUE, 1709202896789000000ll) &&
+                      test_timestamp("2024-02-29T12:34:56.789+02", ITJ_CSV_TRUE, 1709202896789000000ll) &&
+                      test_timestamp("2024-02-29T10:34:56.7890000009876z", ITJ_CSV_TRUE, 1709202896789000000ll) &&
+                      test_timestamp("2024-02-29 08:04:56.789-0230", ITJ_CSV_TRUE, 1709202896789000000ll) &&
+                      test_timestamp("1970-01-01t00:00:01Z", ITJ_CSV_TRUE, 1000000000ll));
+
+    test_print("Failing on bad fields, bad layouts and times out of range");
+    test_print_result(test_timestamp("2023-02-29", ITJ_CSV_FALSE, 0) && test_timestamp("2023-13-01", ITJ_CSV_FALSE, 0) &&
+                      test_timestamp("2023-04-31", ITJ_CSV_FALSE, 0) && test_timestamp("2023-01-01T24:00:00", ITJ_CSV_FALSE, 0) &&
+                      test_timestamp("2023-1-01", ITJ_CSV_FALSE, 0) && test_timestamp("2023/01/01", ITJ_CSV_FALSE, 0) &&
+                      test_timestamp("2023-01-01T", ITJ_CSV_FALSE, 0) && test_timestamp("2023-01-01T10:00", ITJ_CSV_FALSE, 0) &&
+                      test_timestamp("2023-01-01T10:00:00.", ITJ_CSV_FALSE, 0) && test_timestamp("2023-01-01T10:00:00.123x", ITJ_CSV_FALSE, 0) &&
+                      test_timestamp("2023-01-01T10:00:00+02:", ITJ_CSV_FALSE, 0) && test_timestamp("2023-01-01T10:00:00+020", ITJ_CSV_FALSE, 0) &&
+                      test_timestamp("2023-01-01T10:00:00+2", ITJ_CSV_FALSE, 0) && test_timestamp("2023-01-01t10:00:00+24", ITJ_CSV_FALSE, 0) &&
+                      test_timestamp("2023-02-29t10:00:00", ITJ_CSV_FALSE, 0) && test_timestamp("2023-01-01T10:00:00Zx", ITJ_CSV_FALSE, 0) &&
+                      test_timestamp("1600-01-01", ITJ_CSV_FALSE, 0) && test_timestamp("2262-04-12", ITJ_CSV_FALSE, 0) &&
+                      test_timestamp("", ITJ_CSV_FALSE, 0));
+
+    // Every day from 1678 to 2261 is a day after the one before it
+    itj_csv_bool ok = ITJ_CSV_TRUE;
+    itj_csv_s64 previous = 0;
+    itj_csv_u32 num_days = 0;
+    for (itj_csv_u32 year = 1678; year < 2262; ++year) {
+        for (itj_csv_u32 month = 1; month <= 12; ++month) {
+            for (itj_csv_u32 day = 1; day <= 31; ++day) {
+                char text[16];
+                itj_csv_s64 value;
+                sprintf(text, "%04u-%02u-%02u", year, month, day);
+                if (itj_csv_parse_timestamp((const itj_csv_u8 *)text, 10, &value)) {
+                    ok = ok && (num_days == 0 || value - previous == 86400000000000ll);
+                    previous = value;
+                    num_days += 1;
+                }
+            }
+        }
+    }
+    test_print("Counting every day from 1678 to 2261 once");
+    test_print_result(ok && num_days == 213301);
+}
+
+void test_header(void) {
+    const char *text = "id,\"first, name\",last_name,id,city\n1,a,b,2,c\n";
+    itj_csv_umax len = strlen(text);
+    char *copy = (char *)calloc(1, len + ITJ_CSV_BLOCK_SIZE);
+    memcpy(copy, text, len);
+
+    struct itj_csv csv;
+    itj_csv_open_memory(&csv, copy, len, ITJ_CSV_DELIM_COMMA, NULL);
+    test_print("Reading a header row");
+    test_print_result(itj_csv_read_header(&csv) && csv.row == 1);
+    test_print("Looking up columns by name, a repeated name keeping its first column");
+    test_print_result(itj_csv_column_index(&csv, "first, name", 11) == 1 && itj_csv_column_index(&csv, "city", 4) == 4 &&
+                      itj_csv_column_index(&csv, "id", 2) == 0 && itj_csv_column_index(&csv, "last_name", 9) == 2);
+    test_print("Looking up a column that is not there");
+    test_print_result(itj_csv_column_index(&csv, "town", 4) == -1 && itj_csv_column_index(&csv, "cit", 3) == -1);
+    itj_csv_free_header(&csv);
+    free(copy);
+
+    // A wide header read through pumps smaller than it
+    char *wide = (char *)calloc(1, KB(64));
+    itj_csv_umax wide_len = 0;
+    for (itj_csv_u32 i = 0; i < 2000; ++i) {
+        wide_len += sprintf(wide + wide_len, i + 1 < 2000 ? "column_%u," : "column_%u\n", i);
+    }
+
+    FILE *fh = tmpfile();
+    fwrite(wide, 1, wide_len, fh);
+    rewind(fh);
+    char *buffer = (char *)calloc(1, TEST_DOCUMENT_PUMP_SIZE + ITJ_CSV_BLOCK_SIZE);
+    itj_csv_open_fp(&csv, fh, buffer, TEST_DOCUMENT_PUMP_SIZE, ITJ_CSV_DELIM_COMMA, NULL);
+    itj_csv_pump_stdio(&csv);
+
+    itj_csv_bool ok = itj_csv_read_header(&csv);
+    for (itj_csv_u32 i = 0; ok && i < 2000; ++i) {
+        char name[32];
+        itj_csv_u32 name_len = sprintf(name, "column_%u", i);
+        ok = itj_csv_column_index(&csv, name, name_len) == i;
+    }
+    test_print("Looking up every column of a 2000 column header read through small pumps");
+    test_print_result(ok && itj_csv_column_index(&csv, "column_2000", 11) == -1);
+
+    itj_csv_free_header(&csv);
+    itj_csv_close_fh(&csv);
+    free(buffer);
+    free(wide);
+}
+
+itj_csv_bool test_buffer_size(itj_csv_umax size) {
+    struct itj_csv_buffer buffer;
+    if (!itj_csv_buffer_alloc(&buffer, size, NULL)) {
+        return ITJ_CSV_FALSE;
+    }
+
+    itj_csv_bool ok = ((itj_csv_umax)buffer.data % ITJ_CSV_BUFFER_ALIGNMENT) == 0 && buffer.kind != ITJ_CSV_BUFFER_NONE;
+    for (itj_csv_umax i = 0; i < size + ITJ_CSV_BLOCK_SIZE; i += 4096) {
+        ok = ok && buffer.data[i] == 0;
+    }
+    ok = ok && buffer.data[size + ITJ_CSV_BLOCK_SIZE - 1] == 0;
+    memset(buffer.data, 'x', size + ITJ_CSV_BLOCK_SIZE);
+
+    itj_csv_buffer_free(&buffer, NULL);
+    return ok && buffer.data == NULL;
+}
+
+void test_buffer(void) {
+    test_print("Allocating small and huge page sized read buffers, aligned and zeroed");
+    test_print_result(test_buffer_size(100) && test_buffer_size(MB(2)) && test_buffer_size(MB(5) + 3));
+}
+
+void test_count_records(void) {
+    struct test_document doc;
+    make_test_document(&doc, "\r\n", ITJ_CSV_TRUE);
+    itj_csv_umax expected = (TEST_DOCUMENT_VALUES + TEST_DOCUMENT_COLUMNS - 1) / TEST_DOCUMENT_COLUMNS;
+
+    test_print("Counting records, skipping newlines inside quotes");
+    test_print_result(itj_csv_count_records(doc.data, doc.len) == expected);
+
+    test_print("Counting records over threads");
+    itj_csv_bool ok = ITJ_CSV_TRUE;
+    for (itj_csv_u32 num_threads = 1; num_threads <= 7; ++num_threads) {
+        ok = ok && itj_csv_count_records_parallel(doc.data, doc.len, num_threads) == expected;
+    }
+    test_print_result(ok);
+
+    test_print("Counting a last record without an ending newline");
+    test_print_result(itj_csv_count_records(doc.data, doc.len - 2) == expected && itj_csv_count_records("a\n\"b\nc\"", 7) == 2);
+
+    const char *path = "itj_csv_test_count.csv";
+    FILE *fh = fopen(path, "wb");
+    fwrite(doc.data, 1, doc.len, fh);
+    fclose(fh);
+
+    char buffer[TEST_DOCUMENT_PUMP_SIZE];
+    itj_csv_umax count = 0;
+    fh = fopen(path, "rb");
+    test_print("Counting records from a FILE through a small buffer");
+    test_print_result(fh && itj_csv_count_records_fp(fh, buffer, sizeof(buffer), &count) && count == expected);
+    if (fh) {
+        fclose(fh);
+    }
+
+    count = 0;
+    test_print("Counting records in a mapped file");
+    test_print_result(itj_csv_count_records_file(path, (itj_csv_u32)strlen(path), 4, &count) && count == expected);
+
+    remove(path);
+    free_test_document(&doc);
+}
+
+// Appends the values up to need_data to out, | after a value and ; after a row
+void test_follow_values(struct itj_csv *csv, char *out, itj_csv_umax out_max) {
+    itj_csv_umax len = strlen(out);
+    for (;;) {
+        struct itj_csv_value value = itj_csv_get_next_value(csv);
+        if (value.need_data) {
+            break;
+        }
+        if (len + value.data.len + 2 < out_max) {
+            memcpy(out + len, value.data.base, value.data.len);
+            len += value.data.len;
+            out[len++] = value.is_end_of_line ? ';' : '|';
+            out[len] = '\0';
+        }
+    }
+}
+
+void test_follow_append(const char *path, const char *text) {
+    FILE *fh = fopen(path, "ab");
+    fwrite(text, 1, strlen(text), fh);
+    fclose(fh);
+}
+
+void test_follow(void) {
+    const char *path = "itj_csv_test_follow.csv";
+    char buffer[TEST_DOCUMENT_PUMP_SIZE + ITJ_CSV_BLOCK_SIZE];
+    char values[256] = {0};
+    remove(path);
+    test_follow_append(path, "a,b\nc,d");
+
+    struct itj_csv csv;
+    test_print("Following a file, holding back a last record without a newline");
+    itj_csv_bool ok = itj_csv_open_follow(&csv, path, (itj_csv_u32)strlen(path), 0, buffer, TEST_DOCUMENT_PUMP_SIZE, ITJ_CSV_DELIM_COMMA, NULL);
+    ok = ok && itj_csv_pump_follow(&csv, 0) == 4;
+    test_follow_values(&csv, values, sizeof(values));
+    ok = ok && itj_csv_pump_follow(&csv, 0) == 0 && strcmp(values, "a|b;") == 0;
+    test_print_result(ok);
+
+    test_print("Following a file as records and quoted newlines are appended");
+    test_follow_append(path, "\n\"p\nq\",r");
+    ok = ok && itj_csv_pump_follow(&csv, 100) == 4;
+    test_follow_values(&csv, values, sizeof(values));
+    ok = ok && itj_csv_pump_follow(&csv, 0) == 0;
+    test_follow_append(path, "\n");
+    ok = ok && itj_csv_pump_follow(&csv, 100) == 8;
+    test_follow_values(&csv, values, sizeof(values));
+    ok = ok && strcmp(values, "a|b;c|d;p\nq|r;") == 0 && itj_csv_follow_offset(&csv) == 16;
+    test_print_result(ok);
+
+    test_print("Waiting for data until the timeout when nothing is appended");
+    itj_csv_u64 start = itj_csv_now_ns();
+    ok = itj_csv_pump_follow(&csv, 20) == 0 && itj_csv_now_ns() - start >= 19000000;
+    test_print_result(ok);
+
+    test_print("Reading to the end of the file after no longer following");
+    test_follow_append(path, "s,t");
+    ok = itj_csv_pump_follow(&csv, 0) == 0;
+    test_follow_append(path, "\n");
+    itj_csv_stop_follow(&csv);
+    ok = ok && itj_csv_pump_follow(&csv, 0) == 4;
+    test_follow_values(&csv, values, sizeof(values));
+    ok = ok && strcmp(values, "a|b;c|d;p\nq|r;s|t;") == 0;
+    itj_csv_close_follow(&csv);
+
+    test_print_result(ok);
+
+    test_print("Following again from a saved offset");
+    values[0] = '\0';
+    ok = itj_csv_open_follow(&csv, path, (itj_csv_u32)strlen(path), 8, buffer, TEST_DOCUMENT_PUMP_SIZE, ITJ_CSV_DELIM_COMMA, NULL);
+    if (ok) {
+        ok = itj_csv_pump_follow(&csv, 0) == 12;
+        test_follow_values(&csv, values, sizeof(values));
+        ok = ok && strcmp(values, "p\nq|r;s|t;") == 0;
+        itj_csv_close_follow(&csv);
+    }
+    test_print_result(ok);
+
+    test_print("Following a quoted value with newlines that is appended over several blocks");
+    remove(path);
+    values[0] = '\0';
+    test_follow_append(path, "u,\"v\nv\nv\nv\nv\nv\nv\nv\nv\nv\nv\nv\nv\nv\nv\nv\nv\n");
+    ok = itj_csv_open_follow(&csv, path, (itj_csv_u32)strlen(path), 0, buffer, TEST_DOCUMENT_PUMP_SIZE, ITJ_CSV_DELIM_COMMA, NULL);
+    if (ok) {
+        ok = itj_csv_pump_follow(&csv, 0) == 0;
+        test_follow_append(path, "w\nw\nw\nw\nw\nw\nw\nw\nw\nw\nw\nw\nw\nw\nw\nw\nw\nw\n");
+        ok = ok && itj_csv_pump_follow(&csv, 0) == 0;
+        test_follow_append(path, "\"\n");
+        ok = ok && itj_csv_pump_follow(&csv, 0) == 75;
+        test_follow_values(&csv, values, sizeof(values));
+        ok = ok && strcmp(values, "u|v\nv\nv\nv\nv\nv\nv\nv\nv\nv\nv\nv\nv\nv\nv\nv\nv\nw\nw\nw\nw\nw\nw\nw\nw\nw\nw\nw\nw\nw\nw\nw\nw\nw\nw\n;") == 0;
+        ok = ok && itj_csv_follow_offset(&csv) == 75;
+        itj_csv_close_follow(&csv);
+    }
+    test_print_result(ok);
+
+    remove(path);
+}
+
+itj_csv_bool test_tail_text(const char *text, itj_csv_umax n, const char *expected) {
+    itj_csv_umax len = strlen(text);
+    itj_csv_umax start = itj_csv_find_tail(text, len, n, ITJ_CSV_DELIM_COMMA);
+    return compare_strings((char *)text + start, len - start, (char *)expected, strlen(expected));
+}
+
+void test_tail(void) {
+    const char *text = "id,text\n1,plain\n2,\"two\nlines\"\n3,\"with \"\"quotes\"\"\n\"\n";
+    test_print("Finding the last records from the end, past quoted newlines");
+    test_print_result(test_tail_text(text, 1, "3,\"with \"\"quotes\"\"\n\"\n") && test_tail_text(text, 2, "2,\"two\nlines\"\n3,\"with \"\"quotes\"\"\n\"\n") &&
+                      test_tail_text(text, 4, text) && test_tail_text(text, 10, text) && test_tail_text("a\nb", 1, "b") && test_tail_text("", 1, ""));
+
+    test_print("Finding the last records when the data ends inside quotes");
+    test_print_result(test_tail_text("1,a\n2,\"x\nsaid \"\"hi\"\" ok", 1, "2,\"x\nsaid \"\"hi\"\" ok"));
+
+    // Long enough to take many blocks, with a quoted newline on either side of each block boundary
+    const char *path = "itj_csv_test_tail.csv";
+    FILE *fh = fopen(path, "wb");
+    for (itj_csv_u32 i = 0; i < 20000; ++i) {
+        fprintf(fh, i % 3 ? "%u,\"a\nb\"\"%u\"\n" : "%u,plain %u\n", i, i);
+    }
+    fclose(fh);
+    itj_csv_umax len = 0;
+    char *file = test_read_file(path, &len);
+    itj_csv_bool ok = file != NULL;
+    itj_csv_umax n_values[] = { 1, 7, 5000, 19999, 20000, 30000 };
+    for (itj_csv_u32 i = 0; ok && i < sizeof(n_values) / sizeof(n_values[0]); ++i) {
+        itj_csv_umax offset = 0;
+        itj_csv_umax start = itj_csv_find_tail(file, len, n_values[i], ITJ_CSV_DELIM_COMMA);
+        ok = itj_csv_find_tail_file(path, (itj_csv_u32)strlen(path), n_values[i], ITJ_CSV_DELIM_COMMA, &offset, NULL) && offset == start &&
+             itj_csv_count_records(file + start, len - start) == (n_values[i] < 20000 ? n_values[i] : 20000);
+    }
+    test_print("Finding the last records of a file, reading it back from the end");
+    test_print_result(ok);
+    free(file);
+
+    // The quotes of the records found are checked a block at a time, so a doubled or closing quote can
+    // end one block and what it means start the next
+    const char *texts[] = { "1,\"a\"\"b\"\n2,\"\"\n", "1,\"a\"x\n", "1,a\"b\n", "1,\"a\"\"", "\"a\",\"b\"\r\n\"\"\"\"\n" };
+    ok = ITJ_CSV_TRUE;
+    for (itj_csv_u32 t = 0; t < sizeof(texts) / sizeof(texts[0]); ++t) {
+        itj_csv_umax text_len = strlen(texts[t]);
+        itj_csv_bool clean = itj_csv_quotes_are_clean(texts[t], text_len, ITJ_CSV_DELIM_COMMA);
+        for (itj_csv_umax split = 0; split <= text_len; ++split) {
+            struct itj_csv_quote_state state = { ITJ_CSV_FALSE, ITJ_CSV_TRUE, ITJ_CSV_FALSE };
+            itj_csv_bool pieces = itj_csv_quotes_check_piece(&state, (const itj_csv_u8 *)texts[t], split, ITJ_CSV_DELIM_COMMA) &&
+                                  itj_csv_quotes_check_piece(&state, (const itj_csv_u8 *)texts[t] + split, text_len - split, ITJ_CSV_DELIM_COMMA) &&
+                                  itj_csv_quotes_check_end(&state, ITJ_CSV_FALSE);
+            ok = ok && pieces == clean;
+        }
+    }
+    // A file cut off inside quotes with fewer records than asked for is checked from its start
+    fh = fopen(path, "wb");
+    for (itj_csv_u32 i = 0; i < 20000; ++i) {
+        fprintf(fh, i % 3 ? "%u,\"a\nb\"\"%u\"\n" : "%u,plain %u\n", i, i);
+    }
+    fputs("20000,\"x\nsaid \"\"hi\"\" ok", fh);
+    fclose(fh);
+    file = test_read_file(path, &len);
+    itj_csv_umax offset = 0;
+    ok = ok && file && itj_csv_find_tail_file(path, (itj_csv_u32)strlen(path), 30000, ITJ_CSV_DELIM_COMMA, &offset, NULL) && offset == 0 &&
+         itj_csv_find_tail_file(path, (itj_csv_u32)strlen(path), 1, ITJ_CSV_DELIM_COMMA, &offset, NULL) && offset == itj_csv_find_tail(file, len, 1, ITJ_CSV_DELIM_COMMA);
+    test_print("Checking the quotes of the records found a block at a time, across block boundaries");
+    test_print_result(ok);
+    free(file);
+    remove(path);
+}
+
+void test_range_values(struct itj_csv *csv, char *out, itj_csv_umax out_max) {
+    for (;;) {
+        struct itj_csv_value value = itj_csv_get_next_value(csv);
+        if (value.need_data) {
+            if (csv->fh && itj_csv_pump_stdio(csv) != 0) {
+                continue;
+            }
+            break;
+        }
+        itj_csv_umax len = strlen(out);
+        if (len + value.data.len + 2 < out_max) {
+            memcpy(out + len, value.data.base, value.data.len);
+            len += value.data.len;
+            out[len++] = value.is_end_of_line ? ';' : '|';
+            out[len] = '\0';
+        }
+    }
+}
+
+// Reads the records of text that start in [begin, end) into out, after the header
+void test_range_memory(const char *text, itj_csv_umax begin, itj_csv_umax end, char *out, itj_csv_umax out_max) {
+    itj_csv_umax len = strlen(text);
+    char *copy = (char *)calloc(1, len + ITJ_CSV_BLOCK_SIZE);
+    memcpy(copy, text, len);
+    struct itj_csv csv;
+    itj_csv_open_memory(&csv, copy, len, ITJ_CSV_DELIM_COMMA, NULL);
+    itj_csv_read_header(&csv);
+    itj_csv_seek_bytes(&csv, begin);
+    itj_csv_set_end_bytes(&csv, end);
+    test_range_values(&csv, out, out_max);
+    itj_csv_free_header(&csv);
+    free(copy);
+}
+
+void test_seek(void) {
+    const char *text = "id,text\n1,plain\n2,\"two\nlines, \"\"quoted\"\"\"\n3,\"x\n\ny\"\n4,last\n";
+    itj_csv_umax len = strlen(text);
+    char whole[256] = "";
+    char split[256];
+    test_range_memory(text, 0, len, whole, sizeof(whole));
+    itj_csv_bool ok = strcmp(whole, "1|plain;2|two\nlines, \"quoted\";3|x\n\ny;4|last;") == 0;
+    for (itj_csv_umax k = 0; ok && k <= len; ++k) {
+        split[0] = '\0';
+        test_range_memory(text, 0, k, split, sizeof(split));
+        test_range_memory(text, k, len, split, sizeof(split));
+        ok = strcmp(split, whole) == 0;
+    }
+    test_print("Splitting data at every byte into two ranges that read every record once");
+    test_print_result(ok && itj_csv_resync(text, len, 17, ITJ_CSV_DELIM_COMMA) == 42 && itj_csv_resync(text, len, 44, ITJ_CSV_DELIM_COMMA) == 51);
+
+    // Ranges of a file read through a buffer smaller than some of its records
+    const char *path = "itj_csv_test_seek.csv";
+    FILE *fh = fopen(path, "wb");
+    fputs("id,text\n", fh);
+    for (itj_csv_u32 i = 0; i < 2000; ++i) {
+        fprintf(fh, i % 3 ? "%u,\"a \"\"%u\"\"\nb\"\n" : "%u,plain %u\n", i, i);
+    }
+    fclose(fh);
+    itj_csv_umax file_len = 0;
+    free(test_read_file(path, &file_len));
+    itj_csv_umax ranges[] = { 0, 1, 5000, 5001, 17000, 17003, 30000, file_len };
+    itj_csv_umax id_sum = 0, rows = 0;
+    ok = ITJ_CSV_TRUE;
+    for (itj_csv_u32 r = 0; ok && r + 1 < sizeof(ranges) / sizeof(ranges[0]); ++r) {
+        char buf[256 + ITJ_CSV_BLOCK_SIZE];
+        struct itj_csv csv;
+        ok = itj_csv_open(&csv, path, (itj_csv_u32)strlen(path), buf, 256, ITJ_CSV_DELIM_COMMA, NULL);
+        ok = ok && itj_csv_read_header(&csv) && itj_csv_seek_bytes(&csv, ranges[r]) && itj_csv_set_end_bytes(&csv, ranges[r + 1]);
+        for (struct itj_csv_value value;;) {
+            value = itj_csv_get_next_value(&csv);
+            if (value.need_data) {
+                if (itj_csv_pump_stdio(&csv) != 0) {
+                    continue;
+                }
+                break;
+            }
+            itj_csv_s64 id;
+            if (value.column == 0) {
+                ok = ok && itj_csv_parse_s64(value.data.base, value.data.len, &id);
+                id_sum += (itj_csv_umax)id;
+                rows += 1;
+            }
+        }
+        ok = ok && itj_csv_get_error(&csv).kind == ITJ_CSV_ERROR_NONE;
+        itj_csv_free_header(&csv);
+        itj_csv_close_fh(&csv);
+    }
+    test_print("Splitting a file into ranges that read every record once");
+    test_print_result(ok && rows == 2000 && id_sum == 2000 * 1999 / 2);
+    remove(path);
+}
+
+#define TEST_INGEST_FILES 6
+
+struct test_ingest {
+    itj_csv_umax values[ITJ_CSV_MAX_THREADS];
+    itj_csv_umax done[ITJ_CSV_MAX_THREADS];
+};
+
+itj_csv_bool test_ingest_value(void *user, itj_csv_u32 worker, itj_csv_u32 file, struct itj_csv *csv, struct itj_csv_value *value) {
+    struct test_ingest *ingest = (struct test_ingest *)user;
+    ingest->values[worker] += 1;
+    return ITJ_CSV_TRUE;
+}
+
+void test_ingest_done(void *user, itj_csv_u32 worker, itj_csv_u32 file, const struct itj_csv_ingest_stats *stats) {
+    struct test_ingest *ingest = (struct test_ingest *)user;
+    ingest->done[worker] += 1;
+}
+
+void test_ingest(void) {
+    struct test_document doc;
+    make_test_document(&doc, "\n", ITJ_CSV_TRUE);
+
+    char names[TEST_INGEST_FILES + 1][64];
+    const char *paths[TEST_INGEST_FILES + 1];
+    for (itj_csv_u32 f = 0; f < TEST_INGEST_FILES; ++f) {
+        snprintf(names[f], sizeof(names[f]), "itj_csv_test_ingest_%u.csv", f);
+        paths[f] = names[f];
+        FILE *fh = fopen(paths[f], "wb");
+        fwrite(doc.data, 1, doc.len, fh);
+        fclose(fh);
+    }
+    snprintf(names[TEST_INGEST_FILES], sizeof(names[0]), "itj_csv_test_ingest_missing.csv");
+    paths[TEST_INGEST_FILES] = names[TEST_INGEST_FILES];
+
+    struct test_ingest counts;
+    struct itj_csv_ingest_stats file_stats[TEST_INGEST_FILES + 1];
+    struct itj_csv_ingest ingest;
+    struct itj_csv_ingest_result result;
+    memset(&counts, 0, sizeof(counts));
+    memset(&ingest, 0, sizeof(ingest));
+    ingest.paths = paths;
+    ingest.num_files = TEST_INGEST_FILES;
+    ingest.num_workers = 4;
+    ingest.memory_budget = 4 * ITJ_CSV_INGEST_MIN_BUFFER;
+    ingest.delimiter = ITJ_CSV_DELIM_COMMA;
+    ingest.on_value = test_ingest_value;
+    ingest.on_done = test_ingest_done;
+    ingest.user = &counts;
+    ingest.file_stats = file_stats;
+
+    test_print("Ingesting files on a pool of workers, values counted per worker");
+    itj_csv_bool ok = itj_csv_ingest_files(&ingest, &result) && result.num_workers == 4 && result.failed_files == 0;
+    ok = ok && result.memory_used <= ingest.memory_budget;
+    itj_csv_umax values = 0, done = 0;
+    for (itj_csv_u32 w = 0; w < ITJ_CSV_MAX_THREADS; ++w) {
+        values += counts.values[w];
+        done += counts.done[w];
+    }
+    ok = ok && values == TEST_DOCUMENT_VALUES * TEST_INGEST_FILES && done == TEST_INGEST_FILES;
+    ok = ok && result.total.values == values && result.total.bytes == doc.len * TEST_INGEST_FILES;
+    for (itj_csv_u32 f = 0; f < TEST_INGEST_FILES; ++f) {
+        ok = ok && file_stats[f].opened && file_stats[f].values == TEST_DOCUMENT_VALUES && file_stats[f].bytes == doc.len;
+    }
+    test_print_result(ok);
+
+    test_print("Ingesting with fewer workers to keep within the memory budget, and a missing file");
+    ingest.num_files = TEST_INGEST_FILES + 1;
+    ingest.memory_budget = 2 * ITJ_CSV_INGEST_MIN_BUFFER;
+    ok = itj_csv_ingest_files(&ingest, &result) && result.num_workers == 2 && result.failed_files == 1;
+    ok = ok && result.memory_used <= ingest.memory_budget && result.memory_used > result.buffer_size * result.num_workers;
+    ok = ok && !file_stats[TEST_INGEST_FILES].opened;
+    ok = ok && result.total.values == TEST_DOCUMENT_VALUES * TEST_INGEST_FILES;
+    test_print_result(ok);
+
+    for (itj_csv_u32 f = 0; f < TEST_INGEST_FILES; ++f) {
+        remove(paths[f]);
+    }
+    free_test_document(&doc);
+}
+
+void test_intern(void) {
+    struct itj_csv_intern intern;
+    itj_csv_intern_init(&intern, NULL);
+
+    // 300 distinct codes over 100000 values, the way a country code column repeats
+    itj_csv_bool ok = ITJ_CSV_TRUE;
+    for (itj_csv_u32 i = 0; i < 100000; ++i) {
+        char text[16];
+        itj_csv_u32 len = sprintf(text, "C%03u", (i * 7919) % 300);
+        itj_csv_s32 code = itj_csv_intern(&intern, (const itj_csv_u8 *)text, len);
+        struct itj_csv_string back = itj_csv_intern_string(&intern, code);
+        ok = ok && code >= 0 && back.len == len && memcmp(back.base, text, len) == 0;
+        ok = ok && (i >= 300 || code == (itj_csv_s32)i);
+    }
+    test_print("Interning repeated strings into one code each, in first seen order");
+    test_print_result(ok && intern.num_strings == 300 && intern.arena_used == 300 * 4);
+
+    itj_csv_s32 empty = itj_csv_intern(&intern, (const itj_csv_u8 *)"", 0);
+    test_print("Interning the empty string");
+    test_print_result(empty == 300 && itj_csv_intern(&intern, (const itj_csv_u8 *)"x", 0) == empty && itj_csv_intern_string(&intern, empty).len == 0);
+    itj_csv_free_intern(&intern);
+}
+
+void test_table(void) {
+    const char *text = "code,name,count,ratio,when\n"
+                       "DNK,Denmark,1,0.5,2020-01-01\n"
+                       "SWE,\"Sweden, Kingdom of\",,x,2020-01-02T10:00:00Z\n"
+                       "DNK,,-3,1e3,bad\n"
+                       "NOR,Norway\n"
+                       ",\"\"\n";
+    itj_csv_umax len = strlen(text);
+    char *copy = (char *)calloc(1, len + ITJ_CSV_BLOCK_SIZE);
+    memcpy(copy, text, len);
+
+    struct itj_csv csv;
+    itj_csv_open_memory(&csv, copy, len, ITJ_CSV_DELIM_COMMA, NULL);
+    itj_csv_read_header(&csv);
+    itj_csv_column_type_t types[] = { ITJ_CSV_COLUMN_DICTIONARY, ITJ_CSV_COLUMN_STRING, ITJ_CSV_COLUMN_S64, ITJ_CSV_COLUMN_F64, ITJ_CSV_COLUMN_TIMESTAMP };
+    struct itj_csv_table table;
+    itj_csv_bool ok = itj_csv_table_init(&table, &csv, types, 5) && itj_csv_load_table(&csv, NULL, &table);
+    test_print("Loading a file into columns, with names from the header");
+    test_print_result(ok && table.num_rows == 5 && strcmp((const char *)table.columns[0].name.base, "code") == 0 &&
+                      strcmp((const char *)table.columns[4].name.base, "when") == 0);
+
+    struct itj_csv_column *codes = &table.columns[0];
+    itj_csv_s32 *code_values = (itj_csv_s32 *)codes->values;
+    test_print("Dictionary encoding a column, with an empty value as a null");
+    test_print_result(codes->dictionary.num_strings == 3 && code_values[0] == 0 && code_values[1] == 1 && code_values[2] == 0 && code_values[3] == 2 &&
+                      memcmp(itj_csv_column_string(codes, 3).base, "NOR", 3) == 0 && code_values[4] == 0 && codes->null_count == 1 &&
+                      !itj_csv_column_is_valid(codes, 4));
+
+    struct itj_csv_column *names = &table.columns[1];
+    itj_csv_s32 *offsets = (itj_csv_s32 *)names->values;
+    struct itj_csv_string sweden = itj_csv_column_string(names, 1);
+    test_print("Laying out strings as offsets into one buffer, empty ones as nulls");
+    test_print_result(offsets[0] == 0 && offsets[1] == 7 && sweden.len == 18 && memcmp(sweden.base, "Sweden, Kingdom of", 18) == 0 &&
+                      offsets[3] == offsets[2] && offsets[4] == offsets[3] + 6 && offsets[5] == offsets[4] && names->null_count == 2 &&
+                      !itj_csv_column_is_valid(names, 2) && itj_csv_column_is_valid(names, 3) && !itj_csv_column_is_valid(names, 4));
+
+    struct itj_csv_column *counts = &table.columns[2];
+    struct itj_csv_column *ratios = &table.columns[3];
+    struct itj_csv_column *whens = &table.columns[4];
+    test_print("Converting numbers and timestamps, with empty, bad and missing values as nulls");
+    test_print_result(((itj_csv_s64 *)counts->values)[0] == 1 && ((itj_csv_s64 *)counts->values)[2] == -3 && counts->null_count == 3 &&
+                      !itj_csv_column_is_valid(counts, 1) && itj_csv_column_is_valid(counts, 2) && !itj_csv_column_is_valid(counts, 3) &&
+                      ((double *)ratios->values)[2] == 1000.0 && ratios->null_count == 3 && ((double *)ratios->values)[1] == 0.0 &&
+                      ((itj_csv_s64 *)whens->values)[1] == 1577959200000000000ll && whens->null_count == 3 && whens->validity[0] == 0x3);
+
+    itj_csv_free_table(&table);
+    itj_csv_free_header(&csv);
+
+    // Enough rows to grow the columns a few times
+    itj_csv_umax num_rows = 5000;
+    char *many = (char *)calloc(1, num_rows * 16 + ITJ_CSV_BLOCK_SIZE);
+    itj_csv_umax many_len = 0;
+    for (itj_csv_umax i = 0; i < num_rows; ++i) {
+        many_len += sprintf(many + many_len, "%llu,k%llu\n", (unsigned long long)i, (unsigned long long)(i % 10));
+    }
+    itj_csv_open_memory(&csv, many, many_len, ITJ_CSV_DELIM_COMMA, NULL);
+    itj_csv_column_type_t many_types[] = { ITJ_CSV_COLUMN_S64, ITJ_CSV_COLUMN_DICTIONARY };
+    ok = itj_csv_table_init(&table, &csv, many_types, 2) && itj_csv_load_table(&csv, itj_csv_get_next_value_avx2, &table);
+    for (itj_csv_umax i = 0; ok && i < num_rows; ++i) {
+        ok = ((itj_csv_s64 *)table.columns[0].values)[i] == (itj_csv_s64)i && ((itj_csv_s32 *)table.columns[1].values)[i] == (itj_csv_s32)(i % 10);
+    }
+    test_print("Loading rows past the first few growths of the columns");
+    test_print_result(ok && table.num_rows == num_rows && table.columns[0].null_count == 0 && table.columns[0].name.base == NULL);
+    itj_csv_free_table(&table);
+    free(many);
+    free(copy);
+}
+
+itj_csv_bool test_tables_equal(const struct itj_csv_table *a, const struct itj_csv_table *b) {
+    if (a->num_columns != b->num_columns || a->num_rows != b->num_rows) {
+        return ITJ_CSV_FALSE;
+    }
+    for (itj_csv_u32 c = 0; c < a->num_columns; ++c) {
+        const struct itj_csv_column *x = &a->columns[c];
+        const struct itj_csv_column *y = &b->columns[c];
+        itj_csv_umax value_size = x->type == ITJ_CSV_COLUMN_STRING || x->type == ITJ_CSV_COLUMN_DICTIONARY ? 4 : 8;
+        itj_csv_umax num_values = a->num_rows + (x->type == ITJ_CSV_COLUMN_STRING);
+        if (x->type != y->type || x->null_count != y->null_count || x->name.len != y->name.len || x->data_used != y->data_used ||
+            x->dictionary.num_strings != y->dictionary.num_strings || x->dictionary.arena_used != y->dictionary.arena_used ||
+            (x->name.len && memcmp(x->name.base, y->name.base, x->name.len) != 0) ||
+            memcmp(x->validity, y->validity, (a->num_rows + 7) / 8) != 0 || memcmp(x->values, y->values, num_values * value_size) != 0 ||
+            (x->data_used && memcmp(x->data, y->data, x->data_used) != 0) ||
+            (x->dictionary.num_strings && memcmp(x->dictionary.offsets, y->dictionary.offsets, (x->dictionary.num_strings + 1) * 4) != 0) ||
+            (x->dictionary.arena_used && memcmp(x->dictionary.arena, y->dictionary.arena, x->dictionary.arena_used) != 0)) {
+            return ITJ_CSV_FALSE;
+        }
+    }
+    return ITJ_CSV_TRUE;
+}
+
+itj_csv_bool test_load_table_file(const char *path, struct itj_csv_table *table) {
+    static const itj_csv_column_type_t types[] = { ITJ_CSV_COLUMN_DICTIONARY, ITJ_CSV_COLUMN_STRING, ITJ_CSV_COLUMN_S64, ITJ_CSV_COLUMN_F64, ITJ_CSV_COLUMN_TIMESTAMP };
+    char buffer[TEST_DOCUMENT_PUMP_SIZE + ITJ_CSV_BLOCK_SIZE];
+    struct itj_csv csv;
+    if (!itj_csv_open(&csv, path, (itj_csv_u32)strlen(path), buffer, TEST_DOCUMENT_PUMP_SIZE, ITJ_CSV_DELIM_COMMA, NULL)) {
+        return ITJ_CSV_FALSE;
+    }
+    itj_csv_pump_stdio(&csv);
+    itj_csv_bool ok = itj_csv_read_header(&csv) && itj_csv_table_init(table, &csv, types, 5) &&
+                      itj_csv_table_stamp_source(table, path, (itj_csv_u32)strlen(path)) && itj_csv_load_table(&csv, NULL, table);
+    itj_csv_free_header(&csv);
+    itj_csv_close_fh(&csv);
+    return ok;
+}
+
+// Saves table as a cache, then writes bytes over it at the start of an array of a column plus at,
+// or over the descriptor of the column when array is 6, and tells if the cache is still opened
+itj_csv_bool test_damaged_cache_opens(struct itj_csv_table *table, const char *path, const char *cache_path, itj_csv_u32 column,
+                                      itj_csv_u32 array, itj_csv_umax at, const void *bytes, itj_csv_umax len) {
+    if (!itj_csv_save_table_cache(table, cache_path, (itj_csv_u32)strlen(cache_path), path, (itj_csv_u32)strlen(path))) {
+        return ITJ_CSV_TRUE;
+    }
+    struct itj_csv_cache_column descriptor;
+    itj_csv_umax descriptor_offset = (sizeof(struct itj_csv_cache_header) + 63) / 64 * 64 + column * sizeof(descriptor);
+    FILE *fh = fopen(cache_path, "r+b");
+    fseek(fh, (long)descriptor_offset, SEEK_SET);
+    fread(&descriptor, sizeof(descriptor), 1, fh);
+    fseek(fh, (long)(array == 6 ? descriptor_offset : descriptor.offsets[array]) + (long)at, SEEK_SET);
+    fwrite(bytes, 1, len, fh);
+    fclose(fh);
+
+    struct itj_csv_table cached;
+    if (!itj_csv_open_table_cache(&cached, cache_path, (itj_csv_u32)strlen(cache_path), path, (itj_csv_u32)strlen(path), NULL)) {
+        return ITJ_CSV_FALSE;
+    }
+    itj_csv_free_table(&cached);
+    return ITJ_CSV_TRUE;
 }
 
-itj_csv_bool g_did_a_test_fail = ITJ_CSV_FALSE;
-char *g_sitrep_filepath;
+void test_table_cache(void) {
+    const char *path = "itj_csv_test_cache.csv";
+    const char *cache_path = "itj_csv_test_cache.bin";
+    FILE *fh = fopen(path, "wb");
+    fputs("code,name,count,ratio,when\n", fh);
+    for (itj_csv_u32 i = 0; i < 3000; ++i) {
+        fprintf(fh, "C%02u,name %u,%s,%u.25,2021-03-%02uT12:00:00Z\n", i % 40, i, i % 5 ? "7" : "", i, 1 + i % 28);
+    }
+    fclose(fh);
 
-void sitrep(char *fmt, ...) {
-    char *buf = (char *)calloc(1, KB(512));
-    if (!buf) {
-        printf("Unable to allocate memory for sitrep\n");
-        return;
+    struct itj_csv_table loaded, cached;
+    itj_csv_bool ok = test_load_table_file(path, &loaded) && itj_csv_save_table_cache(&loaded, cache_path, (itj_csv_u32)strlen(cache_path), path, (itj_csv_u32)strlen(path));
+    ok = ok && itj_csv_open_table_cache(&cached, cache_path, (itj_csv_u32)strlen(cache_path), path, (itj_csv_u32)strlen(path), NULL);
+    test_print("Mapping a saved table back the same as it was loaded");
+    test_print_result(ok && test_tables_equal(&loaded, &cached) && strcmp((const char *)cached.columns[4].name.base, "when") == 0 &&
+                      memcmp(itj_csv_column_string(&cached.columns[0], 41).base, "C01", 3) == 0);
+
+    struct itj_csv_value value = { 0 };
+    value.is_end_of_line = ITJ_CSV_TRUE;
+    test_print("Refusing to add rows to a mapped table");
+    test_print_result(ok && !itj_csv_table_add_value(&cached, &value) && cached.num_rows == 3000);
+    test_print("Saving a mapped table again, under the stamp it was opened with");
+    test_print_result(ok && itj_csv_save_table_cache(&cached, "itj_csv_test_cache2.bin", 23, path, (itj_csv_u32)strlen(path)));
+    remove("itj_csv_test_cache2.bin");
+    if (ok) {
+        itj_csv_free_table(&cached);
     }
 
-    va_list va;
-    va_start(va, fmt);
-    itj_csv_umax buf_len = vsnprintf(buf, KB(512), fmt, va);
-    va_end(va);
+    // Rewritten after it was loaded, the same size, and a table that was never stamped
+    itj_csv_source_stamp_t stamp = loaded.source;
+    fh = fopen(path, "r+b");
+    fseek(fh, 31, SEEK_SET);
+    fputc('Z', fh);
+    fclose(fh);
+    ok = !itj_csv_save_table_cache(&loaded, cache_path, (itj_csv_u32)strlen(cache_path), path, (itj_csv_u32)strlen(path)) &&
+         itj_csv_open_table_cache(&cached, cache_path, (itj_csv_u32)strlen(cache_path), path, (itj_csv_u32)strlen(path), NULL) == ITJ_CSV_FALSE;
+    memset(&loaded.source, 0, sizeof(loaded.source));
+    ok = ok && itj_csv_table_stamp_source(&loaded, path, (itj_csv_u32)strlen(path)) && loaded.source.hash != stamp.hash;
+    memset(&loaded.source, 0, sizeof(loaded.source));
+    ok = ok && !itj_csv_save_table_cache(&loaded, cache_path, (itj_csv_u32)strlen(cache_path), path, (itj_csv_u32)strlen(path));
+    test_print("Refusing to save a cache when the CSV file changed since it was loaded, or was never stamped");
+    test_print_result(ok);
+    itj_csv_free_table(&loaded);
+
+    // The same size with other content
+    fh = fopen(path, "r+b");
+    fseek(fh, 30, SEEK_SET);
+    fputc('X', fh);
+    fclose(fh);
+    test_print("Not using a cache once its CSV file changed");
+    test_print_result(!itj_csv_open_table_cache(&cached, cache_path, (itj_csv_u32)strlen(cache_path), path, (itj_csv_u32)strlen(path), NULL));
+
+    // Arrays that are inside the file, but would have the strings read out of it
+    itj_csv_s32 big = 1 << 30, zero = 0;
+    itj_csv_u64 dictionary_offsets_size = 4; // One offset, where the codes need one more than there are strings
+    ok = test_load_table_file(path, &loaded);
+    test_print("Not using a cache with a dictionary code, dictionary offset or string offset out of range");
+    test_print_result(ok && !test_damaged_cache_opens(&loaded, path, cache_path, 0, 2, 4, &big, 4) &&
+                      !test_damaged_cache_opens(&loaded, path, cache_path, 0, 4, 8, &big, 4) &&
+                      !test_damaged_cache_opens(&loaded, path, cache_path, 1, 2, 20, &zero, 4) &&
+                      !test_damaged_cache_opens(&loaded, path, cache_path, 1, 2, 4 * 3000, &big, 4) &&
+                      !test_damaged_cache_opens(&loaded, path, cache_path, 0, 6, offsetof(struct itj_csv_cache_column, sizes) + 4 * 8,
+                                                &dictionary_offsets_size, 8) &&
+                      test_damaged_cache_opens(&loaded, path, cache_path, 0, 2, 4, &zero, 4));
+
+    ok = ok && itj_csv_save_table_cache(&loaded, cache_path, (itj_csv_u32)strlen(cache_path), path, (itj_csv_u32)strlen(path));
+    itj_csv_free_table(&loaded);
+    fh = fopen(cache_path, "r+b");
+    fseek(fh, 0, SEEK_END);
+    long cache_size = ftell(fh);
+    fseek(fh, 0, SEEK_SET);
+    fputc('Y', fh);
+    fclose(fh);
+    test_print("Not using a cache file that was damaged");
+    test_print_result(ok && cache_size > 0 && !itj_csv_open_table_cache(&cached, cache_path, (itj_csv_u32)strlen(cache_path), path, (itj_csv_u32)strlen(path), NULL));
 
-    printf("%s", buf);
+    remove(path);
+    remove(cache_path);
+}
 
-    FILE *fh = fopen(g_sitrep_filepath, "ab");
-    if (fh) {
-        fwrite(buf, 1, buf_len, fh);
-        fclose(fh);
-    }
+void test_arrow_export(void) {
+    const char *text = "code,name,count\nDNK,Denmark,1\nSWE,Sweden,\nDNK,,3\n";
+    itj_csv_umax len = strlen(text);
+    char *copy = (char *)calloc(1, len + ITJ_CSV_BLOCK_SIZE);
+    memcpy(copy, text, len);
 
-    free(buf);
-}
+    struct itj_csv csv;
+    itj_csv_open_memory(&csv, copy, len, ITJ_CSV_DELIM_COMMA, NULL);
+    itj_csv_read_header(&csv);
+    itj_csv_column_type_t types[] = { ITJ_CSV_COLUMN_DICTIONARY, ITJ_CSV_COLUMN_STRING, ITJ_CSV_COLUMN_S64 };
+    struct itj_csv_table table;
+    itj_csv_bool ok = itj_csv_table_init(&table, &csv, types, 3) && itj_csv_load_table(&csv, NULL, &table);
+    itj_csv_free_header(&csv);
+    const void *names_data = table.columns[1].data;
+    const void *names_validity = table.columns[1].validity;
+    const void *counts = table.columns[2].values;
+    const void *counts_validity = table.columns[2].validity;
+
+    struct ArrowArray array;
+    struct ArrowSchema schema;
+    ok = ok && itj_csv_export_table(&table, &array, &schema);
+    test_print("Exporting a table through the Arrow C data interface, taking it over");
+    test_print_result(ok && table.columns == NULL && array.length == 3 && array.n_children == 3 && strcmp(schema.format, "+s") == 0 &&
+                      strcmp(schema.children[0]->format, "i") == 0 && strcmp(schema.children[0]->dictionary->format, "u") == 0 &&
+                      strcmp(schema.children[1]->name, "name") == 0 && strcmp(schema.children[2]->format, "l") == 0);
+    if (!ok) {
+        free(copy);
+        return;
+    }
 
-void test_print(char *str) {
-    sitrep("%s... ", str);
+    struct ArrowArray *codes = array.children[0];
+    struct ArrowArray *count_array = array.children[2];
+    test_print("Pointing the Arrow buffers at the table's own arrays");
+    test_print_result(array.children[1]->buffers[2] == names_data && array.children[1]->buffers[0] == names_validity &&
+                      array.children[1]->null_count == 1 && array.children[0]->buffers[0] == NULL && count_array->buffers[1] == counts &&
+                      count_array->buffers[0] == counts_validity && count_array->null_count == 1 && codes->dictionary->length == 2 &&
+                      ((const itj_csv_s32 *)codes->buffers[1])[2] == 0);
+
+    // A consumer may move a child out and keep it after releasing the rest
+    struct ArrowArray moved = *count_array;
+    count_array->release = NULL;
+    struct ArrowSchema moved_schema = *schema.children[2];
+    schema.children[2]->release = NULL;
+    array.release(&array);
+    schema.release(&schema);
+    test_print("Keeping a moved child alive after releasing its parent");
+    test_print_result(array.release == NULL && schema.release == NULL && ((const itj_csv_s64 *)moved.buffers[1])[2] == 3 &&
+                      strcmp(moved_schema.name, "count") == 0);
+    moved.release(&moved);
+    moved_schema.release(&moved_schema);
+    free(copy);
 }
 
-void test_print_result(itj_csv_bool result) {
-    if (result == ITJ_CSV_TRUE) {
-        sitrep("OK\n");
-    } else {
-        sitrep("FAIL\n");
-        g_did_a_test_fail = ITJ_CSV_TRUE;
+itj_csv_bool test_group_by_equal(struct itj_csv_group_by *a, struct itj_csv_group_by *b) {
+    itj_csv_bool ok = a->num_rows == b->num_rows && a->groups.num_strings == b->groups.num_strings;
+    for (itj_csv_u32 g = 0; ok && g < a->groups.num_strings; ++g) {
+        struct itj_csv_string key = itj_csv_intern_string(&a->groups, (itj_csv_s32)g);
+        itj_csv_s32 other = itj_csv_intern(&b->groups, key.base, key.len);
+        ok = other >= 0 && (itj_csv_u32)other < a->groups.num_strings && a->group_rows[g] == b->group_rows[other];
+        for (itj_csv_u32 v = 0; ok && v < a->num_values; ++v) {
+            struct itj_csv_accumulator *x = itj_csv_group_by_accumulator(a, g, v);
+            struct itj_csv_accumulator *y = itj_csv_group_by_accumulator(b, (itj_csv_u32)other, v);
+            ok = x->count == y->count && memcmp(&x->sum, &y->sum, sizeof(x->sum)) == 0 && memcmp(&x->min, &y->min, sizeof(x->min)) == 0 &&
+                 memcmp(&x->max, &y->max, sizeof(x->max)) == 0;
+        }
     }
+    return ok;
 }
 
-void print_total(itj_csv_umax bytes_read, double time_start, double time_end) {
-    double time_diff_ms = time_end - time_start;
-    double time_diff_sec = time_diff_ms / 1000.0;
+void test_group_by(void) {
+    const char *text = "code,year,count,ratio\n"
+                       "DNK,2020,1,0.5\n"
+                       "\"S\nWE\",2020,,x\n"
+                       "DNK,2021,-3,1.5\n"
+                       "DNK,2020,4\n";
+    itj_csv_umax len = strlen(text);
+    char *copy = (char *)calloc(1, len + ITJ_CSV_BLOCK_SIZE);
+    memcpy(copy, text, len);
 
-    sitrep("Read %llu total bytes. %.3f MB per second\n", bytes_read, ((double)bytes_read / (1024.0 * 1024.0)) / time_diff_sec);
+    struct itj_csv csv;
+    itj_csv_open_memory(&csv, copy, len, ITJ_CSV_DELIM_COMMA, NULL);
+    itj_csv_read_header(&csv);
+    itj_csv_u32 keys[] = { 0 };
+    itj_csv_u32 values[] = { 2, 3 };
+    itj_csv_column_type_t types[] = { ITJ_CSV_COLUMN_S64, ITJ_CSV_COLUMN_F64 };
+    struct itj_csv_group_by group_by;
+    itj_csv_bool ok = itj_csv_group_by_init(&group_by, keys, 1, values, types, 2, NULL) && itj_csv_group_by_run(&csv, NULL, &group_by);
+    itj_csv_free_header(&csv);
+
+    struct itj_csv_accumulator *dnk_count = itj_csv_group_by_accumulator(&group_by, 0, 0);
+    struct itj_csv_accumulator *dnk_ratio = itj_csv_group_by_accumulator(&group_by, 0, 1);
+    struct itj_csv_string swe = itj_csv_group_by_key(&group_by, 1, 0);
+    test_print("Grouping by one column, leaving out values that do not convert");
+    test_print_result(ok && group_by.num_rows == 4 && group_by.groups.num_strings == 2 && group_by.group_rows[0] == 3 && group_by.group_rows[1] == 1 &&
+                      dnk_count->count == 3 && dnk_count->sum.s64 == 2 && dnk_count->min.s64 == -3 && dnk_count->max.s64 == 4 && dnk_ratio->count == 2 &&
+                      itj_csv_accumulator_mean(dnk_ratio, ITJ_CSV_COLUMN_F64) == 1.0 && compare_strings((char *)swe.base, swe.len, "S\nWE", 4) &&
+                      itj_csv_group_by_accumulator(&group_by, 1, 0)->count == 0);
+    itj_csv_free_group_by(&group_by);
+
+    memcpy(copy, text, len);
+    itj_csv_open_memory(&csv, copy, len, ITJ_CSV_DELIM_COMMA, NULL);
+    itj_csv_read_header(&csv);
+    itj_csv_u32 two_keys[] = { 0, 1 };
+    ok = itj_csv_group_by_init(&group_by, two_keys, 2, values, types, 1, NULL) && itj_csv_group_by_run(&csv, NULL, &group_by);
+    itj_csv_free_header(&csv);
+    struct itj_csv_string year = itj_csv_group_by_key(&group_by, 2, 1);
+    test_print("Grouping by two columns");
+    test_print_result(ok && group_by.groups.num_strings == 3 && group_by.group_rows[0] == 2 && itj_csv_group_by_accumulator(&group_by, 0, 0)->sum.s64 == 5 &&
+                      compare_strings((char *)year.base, year.len, "2021", 4));
+    itj_csv_free_group_by(&group_by);
+    free(copy);
+
+    // Quoted keys with newlines and quotes in them, so chunk starts can fall inside quotes. With the
+    // ITJ_CSV_MIN_THREAD_BYTES of this file every one of the 8 threads gets rows
+    itj_csv_umax big_max = MB(1);
+    char *big = (char *)calloc(1, big_max + ITJ_CSV_BLOCK_SIZE);
+    itj_csv_umax big_len = 0;
+    g_test_seed = 47;
+    while (big_len + 64 < big_max) {
+        itj_csv_u32 key = test_rand() % 97;
+        big_len += sprintf(big + big_len, key % 3 ? "K%u,%d,%u.25\n" : "\"K\n\"\"%u\",%d,%u.25\n", key, (int)(test_rand() % 2001) - 1000, test_rand() % 64);
+    }
+    char *big_copy = (char *)calloc(1, big_len + ITJ_CSV_BLOCK_SIZE);
+    memcpy(big_copy, big, big_len);
+
+    itj_csv_u32 big_values[] = { 1, 2 };
+    struct itj_csv_group_by serial;
+    ok = itj_csv_group_by_init(&group_by, keys, 1, big_values, types, 2, NULL) &&
+         itj_csv_group_by_parallel(&group_by, big_copy, big_len, ITJ_CSV_DELIM_COMMA, NULL, 8);
+    // The threads parse copies of their chunks, as the kernels read into the next chunk
+    ok = ok && memcmp(big_copy, big, big_len) == 0;
+    itj_csv_open_memory(&csv, big, big_len, ITJ_CSV_DELIM_COMMA, NULL);
+    ok = ok && itj_csv_group_by_init(&serial, keys, 1, big_values, types, 2, NULL) && itj_csv_group_by_run(&csv, NULL, &serial);
+    test_print("Grouping over threads matches grouping on one thread, leaving the buffer as it was");
+    test_print_result(ok && serial.groups.num_strings == 97 && test_group_by_equal(&serial, &group_by) && group_by.num_chunks == 8);
+    itj_csv_free_group_by(&serial);
+    itj_csv_free_group_by(&group_by);
+    free(big_copy);
+    free(big);
+}
 
+itj_csv_bool test_sort_text(const char *text, struct itj_csv_sort *sort, const char *expected) {
+    FILE *fh = fopen(sort->input_path, "wb");
+    fputs(text, fh);
+    fclose(fh);
+    struct itj_csv_sort_result result;
+    itj_csv_umax len = 0;
+    char *sorted = itj_csv_sort_file(sort, &result) ? test_read_file(sort->output_path, &len) : NULL;
+    itj_csv_bool ok = sorted && compare_strings(sorted, len, (char *)expected, strlen(expected));
+    free(sorted);
+    return ok;
 }
 
-void test_correctness(struct itj_csv_value value, itj_csv_smax num_columns, itj_csv_smax *num_columns_out, itj_csv_u32 num_lines, itj_csv_u32 *num_lines_out) {
-    itj_csv_umax column; 
-    if (num_columns == -1) {
-        column = value.idx;
-    } else {
-        column = value.idx % num_columns;
+void test_sort(void) {
+    const char *path = "itj_csv_test_sort.csv";
+    const char *sorted_path = "itj_csv_test_sorted.csv";
+    struct itj_csv_sort sort;
+    memset(&sort, 0, sizeof(sort));
+    sort.input_path = path;
+    sort.input_path_len = (itj_csv_u32)strlen(path);
+    sort.output_path = sorted_path;
+    sort.output_path_len = (itj_csv_u32)strlen(sorted_path);
+    sort.key_type = ITJ_CSV_COLUMN_STRING;
+    sort.has_header = ITJ_CSV_TRUE;
+    sort.delimiter = ITJ_CSV_DELIM_COMMA;
+
+    test_print("Sorting by a string column, quoted keys and rows with newlines in them");
+    test_print_result(test_sort_text("key,n\n\"b\"\"\",1\nb,\"x\ny\"\n\"a\nz\",3\n\"a\",4", &sort, "key,n\n\"a\",4\n\"a\nz\",3\nb,\"x\ny\"\n\"b\"\"\",1\n"));
+
+    // Keys are told apart by their first 16 bytes before their bytes are compared
+    test_print("Sorting by string keys that share their first 8 or 16 bytes");
+    test_print_result(test_sort_text("key,n\nprefix__b_long_tail_2,1\nprefix__a,2\nprefix__b_long_tail_1,3\nprefix__b_long_tail_,4\nprefix__b,5\nprefix__a,6\nprefix__b_long_t,7\n", &sort,
+                                     "key,n\nprefix__a,2\nprefix__a,6\nprefix__b,5\nprefix__b_long_t,7\nprefix__b_long_tail_,4\nprefix__b_long_tail_1,3\nprefix__b_long_tail_2,1\n"));
+
+    sort.key_column = 1;
+    sort.key_type = ITJ_CSV_COLUMN_S64;
+    sort.descending = ITJ_CSV_TRUE;
+    test_print("Sorting by a number column descending, ties in input order");
+    test_print_result(test_sort_text("k,n\na,2\nb,x\nc,10\nd,2\ne\n", &sort, "k,n\nc,10\na,2\nd,2\nb,x\ne\n"));
+
+    // Many runs from a small budget, with quotes across the chunk starts, against one run
+    FILE *fh = fopen(path, "wb");
+    fputs("id,name,value\n", fh);
+    g_test_seed = 48;
+    for (itj_csv_u32 i = 0; i < 40000; ++i) {
+        itj_csv_u32 r = test_rand();
+        fprintf(fh, r % 4 ? "%u,n%u,%d.5\n" : "%u,\"n\n\"\"%u\"\"\",%d.5\n", i, r % 1000, (int)(test_rand() % 20001) - 10000);
     }
-
-    if (column == 0) {
-        if (num_lines == 0) {
-            test_print("Is header[0] == column1");
-            test_print_result(compare_strings(value.data.base, value.data.len, "column1", 7));
-        } else if (num_lines == 1) {
-            test_print("Is the first column of the first row == row1_column1");
-            test_print_result(compare_strings(value.data.base, value.data.len, "row1_column1", 12));
-        } else if (num_lines == 2) {
-            test_print("Is the first column of the second row == row2_column1");
-            test_print_result(compare_strings(value.data.base, value.data.len, "row2_column1", 12));
-        }
-    } else if (column == 1) {
-        if (num_lines == 0) {
-            test_print("Is header[1] == column2");
-            test_print_result(compare_strings(value.data.base, value.data.len, "column2", 7));
-        } else if (num_lines == 1) {
-            test_print("Is the second column of the first row == row1_column2");
-            test_print_result(compare_strings(value.data.base, value.data.len, "row1_column2", 12));
-        } else if (num_lines == 2) {
-            test_print("Is the second column of the second row == row2_column2");
-            test_print_result(compare_strings(value.data.base, value.data.len, "row2_column2", 12));
-        }
-    } else if (column == 2) {
-        if (num_lines == 0) {
-            test_print("Is header[2] == column\\r\\n3");
-            test_print_result(compare_strings(value.data.base, value.data.len, "column\r\n3", 9));
-        } else if (num_lines == 1) {
-            test_print("Is the third column of the first row == row1_column\\r\\n3");
-            test_print_result(compare_strings(value.data.base, value.data.len, "row1_column\r\n3", 14));
-        } else if (num_lines == 2) {
-            test_print("Is the third column of the second row == row2_column\\r\\n3");
-            test_print_result(compare_strings(value.data.base, value.data.len, "row2_column\r\n3", 14));
-        }
-    } else if (column == 3) {
-        if (num_lines == 0) {
-            test_print("Is header[3] == column\"4");
-            test_print_result(compare_strings(value.data.base, value.data.len, "column\"4", 8));
-        } else if (num_lines == 1) {
-            test_print("Is the fourth column of the first row == row1_column\"4");
-            test_print_result(compare_strings(value.data.base, value.data.len, "row1_column\"4", 13));
-        } else if (num_lines == 2) {
-            test_print("Is the fourth column of the second row == row2_column\"4");
-            test_print_result(compare_strings(value.data.base, value.data.len, "row2_column\"4", 13));
-        }
-    } else if (column == 4) {
-        if (num_lines == 0) {
-            test_print("Is header[4] == columnð");
-            test_print_result(compare_strings(value.data.base, value.data.len, "columnð", 8));
-        } else if (num_lines == 1) {
-            test_print("Is the fifth column of the first row == row1_columnð");
-            test_print_result(compare_strings(value.data.base, value.data.len, "row1_columnð", 13));
-        } else if (num_lines == 2) {
-            test_print("Is the fifth column of the second row == row2_columnð");
-            test_print_result(compare_strings(value.data.base, value.data.len, "row2_columnð", 13));
+    fclose(fh);
+    sort.key_column = 2;
+    sort.key_type = ITJ_CSV_COLUMN_F64;
+    sort.descending = ITJ_CSV_FALSE;
+    sort.num_threads = 4;
+    sort.memory_budget = KB(64);
+    struct itj_csv_sort_result result;
+    itj_csv_umax small_len = 0, big_len = 0, input_len = 0;
+    itj_csv_bool ok = itj_csv_sort_file(&sort, &result);
+    char *small = test_read_file(sorted_path, &small_len);
+    itj_csv_umax runs = result.runs;
+    itj_csv_u32 threads = result.threads;
+    sort.memory_budget = MB(64);
+    ok = ok && itj_csv_sort_file(&sort, &result);
+    char *big = test_read_file(sorted_path, &big_len);
+    char *input = test_read_file(path, &input_len);
+
+    ok = ok && small && big && compare_strings(small, small_len, big, big_len);
+
+    // Sorted by value, and every row once, as the ids add up. Parsing contracts the quotes in small
+    struct itj_csv csv;
+    itj_csv_open_memory(&csv, small, small_len, ITJ_CSV_DELIM_COMMA, NULL);
+    itj_csv_kernel_fn kernel = itj_csv_select_kernel(ITJ_CSV_DELIM_COMMA, ITJ_CSV_KERNEL_DEFAULT);
+    double last = -1e9;
+    itj_csv_umax id_sum = 0, rows = 0;
+    for (struct itj_csv_value value = kernel(&csv); !value.need_data; value = kernel(&csv)) {
+        itj_csv_s64 id;
+        double number;
+        if (value.row > 0 && value.column == 0 && itj_csv_parse_s64(value.data.base, value.data.len, &id)) {
+            id_sum += (itj_csv_umax)id;
+            rows += 1;
+        } else if (value.row > 0 && value.column == 2 && itj_csv_parse_f64(value.data.base, value.data.len, &number)) {
+            ok = ok && number >= last;
+            last = number;
         }
     }
-
-    if (value.is_end_of_line) {
-        if (num_columns == -1) {
-            *num_columns_out = value.idx + 1;
+    test_print("Sorting a file in many runs over threads matches sorting it in one");
+    test_print_result(ok && threads == 4 && runs > 20 && result.runs == 1 && result.rows == 40000 && small_len == input_len && rows == 40000 && id_sum == 40000ull * 39999 / 2);
+    free(small);
+    free(big);
+    free(input);
+
+    // Long rows in the first megabyte and short ones after, so the chunks of short rows have more than
+    // the rows estimated for them and spill them in parts, many more runs than the dozen chunks
+    fh = fopen(path, "wb");
+    fputs("id,name,value\n", fh);
+    for (itj_csv_u32 i = 0; i < 100000; ++i) {
+        itj_csv_u32 r = test_rand();
+        if (i < 5000) {
+            fprintf(fh, "%u,%0200u,%d.5\n", i, r % 1000, (int)(test_rand() % 20001) - 10000);
+        } else {
+            fprintf(fh, "%u,,%d\n", i, (int)(test_rand() % 20001) - 10000);
         }
-
-        *num_lines_out = num_lines + 1;
     }
+    fclose(fh);
+    sort.memory_budget = MB(1);
+    ok = itj_csv_sort_file(&sort, &result);
+    small = test_read_file(sorted_path, &small_len);
+    runs = result.runs;
+    sort.memory_budget = MB(64);
+    ok = ok && itj_csv_sort_file(&sort, &result);
+    big = test_read_file(sorted_path, &big_len);
+    test_print("Sorting rows shorter than the estimate for their chunk spills them in more runs");
+    test_print_result(ok && small && big && compare_strings(small, small_len, big, big_len) && runs > 40 && result.rows == 100000);
+    free(small);
+    free(big);
+    remove(path);
+    remove(sorted_path);
 }
 
 int main(int argc, char *argv[]) {
-    printf("Press any key to start\n");
-    getc(stdin);
-
-#ifdef IS_WINDOWS
-    {
-        LARGE_INTEGER large_integer;
-        QueryPerformanceFrequency(&large_integer);
-        g_freq = ((double)large_integer.QuadPart) / 1000.0;
-    }
-#endif
-
     g_sitrep_filepath = (char *)calloc(1, KB(10));
     if (!g_sitrep_filepath) {
         printf("Unable to allocate memory for sitrep filepath\n");
@@ -195,12 +1791,6 @@ int main(int argc, char *argv[]) {
     }
     snprintf(g_sitrep_filepath, KB(10), "itj_csv_test_%lld.log", time(NULL));
 
-    itj_csv_smax *buffered_cycles = (itj_csv_smax *)calloc(1, NUM_BUFFERED_CYCLES * sizeof(*buffered_cycles));
-    if (!buffered_cycles) {
-        printf("Unable to allocate memory for buffered cycles. It might work to lower NUM_BUFFERED_CYCLES\n");
-        return EXIT_FAILURE;
-    }
-
     const char *exe_path = argv[0];
     if (!exe_path) {
         printf("Unable to run because argv[0] does not point to the path to the executable\n");
@@ -253,19 +1843,6 @@ int main(int argc, char *argv[]) {
         correctness_with_header_csv_path = path;
     }
 
-    const char *generated_csv_path = "generated.csv";
-    itj_csv_umax generated_csv_path_len = strlen(generated_csv_path);
-    if (exe_dir_len > 0) {
-        char *path = (char *)calloc(1, exe_dir_len + generated_csv_path_len + SIZE_OF_NULL_TERMINATOR);
-        if (!path) {
-            printf("Unable to allocate memory for the generated csv path, '%s'\n", generated_csv_path);
-            return EXIT_FAILURE;
-        }
-
-        generated_csv_path_len = snprintf(path, exe_dir_len + SIZE_OF_DIR_SEPERATOR + generated_csv_path_len + SIZE_OF_NULL_TERMINATOR, "%s" DIR_SEPERATOR "%s", exe_dir, generated_csv_path);
-        generated_csv_path = path;
-    }
-
     printf("Running itj_csv correctness tests\n");
 
     printf("Running standard correctness tests\n");
@@ -291,8 +1868,6 @@ int main(int argc, char *argv[]) {
     }
 
     itj_csv_bool end = ITJ_CSV_FALSE;
-    itj_csv_u32 num_lines = 0;
-    itj_csv_smax num_columns = -1;
     itj_csv_bool first = ITJ_CSV_TRUE;
     for (;;) {
         struct itj_csv_value value = itj_csv_get_next_value(&csv);
@@ -305,11 +1880,11 @@ int main(int argc, char *argv[]) {
             }
         }
 
-        test_correctness(value, num_columns, &num_columns, num_lines, &num_lines);
+        test_correctness(value);
 
         if (value.is_end_of_line && first) {
             test_print("Expecting 5 columns in header");
-            test_print_result(value.idx == 4);
+            test_print_result(value.column == 4);
             first = ITJ_CSV_FALSE;
         }
 
@@ -337,8 +1912,6 @@ int main(int argc, char *argv[]) {
         return EXIT_FAILURE;
     }
 
-    num_lines = 0;
-    num_columns = -1;
     first = ITJ_CSV_TRUE;
     for (;;) {
         struct itj_csv_value value = itj_csv_get_next_value_avx2(&csv);
@@ -351,11 +1924,11 @@ int main(int argc, char *argv[]) {
             }
         }
 
-        test_correctness(value, num_columns, &num_columns, num_lines, &num_lines);
+        test_correctness(value);
 
         if (value.is_end_of_line && first) {
             test_print("Expecting 5 columns in header");
-            test_print_result(value.idx == 4);
+            test_print_result(value.column == 4);
             first = ITJ_CSV_FALSE;
         }
 
@@ -369,251 +1942,78 @@ int main(int argc, char *argv[]) {
         sitrep("ALL CORRECTNESS TESTS COMPLETED SUCCESSFULL\n");
     }
 
-    sitrep("\nRunning itj_csv speed tests\n");
-
-    sitrep("Reading generated csv file without any work as reference\n");
-
-    FILE *fh = fopen(generated_csv_path, "rb");
-    if (!fh) {
-        printf("Unable to open %s for reference reading\n", generated_csv_path);
-        return EXIT_FAILURE;
-    }
-
-    double time_start_of_reference = get_time_ms();
-
-    itj_csv_umax bytes_read = 0;
-    for (;;) {
-        itj_csv_smax bytes = fread(buffer, 1, buffer_max, fh);
-        if (bytes < 0) {
-            printf("Unable to read all of %s\n", generated_csv_path);
-            return EXIT_FAILURE;
-        }
-
-        if (bytes == 0) {
-            break;
-        }
-
-        bytes_read += bytes;
-    }
-
-    double time_end_of_reference = get_time_ms();
-
-    fclose(fh);
-
-    print_total(bytes_read, time_start_of_reference, time_end_of_reference);
-
-    if (!itj_csv_open(&csv, generated_csv_path, generated_csv_path_len, buffer, buffer_max, ITJ_CSV_DELIM_COMMA, NULL)) {
-        printf("Failed to initalize itj_csv struct to file, '%s'\n", correctness_with_header_csv_path);
-        printf("Remember to generate a file for profiling first!\n");
-        return EXIT_FAILURE;
-    }
-
-    bytes_read = 0;
-    pump_ret = itj_csv_pump_stdio(&csv);
-    if (pump_ret == 0) {
-        printf("Unable to read from '%s'\n", generated_csv_path);
-        return EXIT_FAILURE;
-    }
-    bytes_read += pump_ret;
-
-    num_columns = -1;
-    num_lines = 0;
-    itj_csv_smax num_values = 0;
-    double time_start_of_standard = get_time_ms();
-    for (;;) {
-        struct itj_csv_value value = itj_csv_get_next_value_avx2(&csv);
-
-#if 0
-        itj_csv_umax column;
-        if (num_columns == -1) {
-            column = value.idx;
-        } else {
-            column = value.idx % num_columns;
-        }
-#endif
-
-        if (value.need_data) {
-            pump_ret = itj_csv_pump_stdio(&csv);
-            if (pump_ret == 0) {
-                break;
-            } else {
-                bytes_read += pump_ret;
-                continue;
-            }
-        }
-
-        if (value.is_end_of_line) {
-            ++num_lines;
-            if (num_columns == -1) {
-                num_columns = value.idx + 1;
-            }
-        }
-
-        ++num_values;
-
-    }
-    double time_end_of_standard = get_time_ms();
-
-
-    sitrep("The following numbers are for the non-SIMD version\n");
-
-    print_total(bytes_read, time_start_of_standard, time_end_of_standard);
-    itj_csv_close_fh(&csv);
-
-
-    sitrep("The number of iterations %llu\n", num_values);
-    sitrep("The number of lines %llu\n", num_lines);
-    sitrep("The number of columns %llu\n", num_columns);
-
-    if (!itj_csv_open(&csv, generated_csv_path, generated_csv_path_len, buffer, buffer_max, ITJ_CSV_DELIM_COMMA, NULL)) {
-        printf("Failed to initalize itj_csv struct to file, '%s'\n", correctness_with_header_csv_path);
-        printf("Remember to generate a file for profiling first!\n");
-        return EXIT_FAILURE;
-    }
-
-    bytes_read = 0;
-    pump_ret = itj_csv_pump_stdio(&csv);
-    if (pump_ret == 0) {
-        printf("Unable to read from '%s'\n", generated_csv_path);
-        return EXIT_FAILURE;
-    }
-    bytes_read += pump_ret;
-
-    num_columns = -1;
-    num_lines = 0;
-    num_values = 0;
-    double time_start_of_avx = get_time_ms();
-    for (;;) {
-        struct itj_csv_value value = itj_csv_get_next_value_avx(&csv);
-
-#if 0
-        itj_csv_umax column;
-        if (num_columns == -1) {
-            column = value.idx;
-        } else {
-            column = value.idx % num_columns;
-        }
-#endif
-
-        if (value.need_data) {
-            pump_ret = itj_csv_pump_stdio(&csv);
-            if (pump_ret == 0) {
-                break;
-            } else {
-                bytes_read += pump_ret;
-                continue;
-            }
-        }
-
-        if (value.is_end_of_line) {
-            ++num_lines;
-            if (num_columns == -1) {
-                num_columns = value.idx + 1;
-            }
-        }
+    printf("Running kernel correctness tests\n");
+    g_did_a_test_fail = ITJ_CSV_FALSE;
 
-        ++num_values;
+    test_kernels();
+    test_positions();
+    test_strict();
+    test_skip_lines();
 
+    if (g_did_a_test_fail) {
+        sitrep("NOT ALL CORRECTNESS TESTS COMPLETED SUCCESSFULLY!\n");
+    } else {
+        sitrep("ALL CORRECTNESS TESTS COMPLETED SUCCESSFULL\n");
     }
-    double time_end_of_avx = get_time_ms();
-
-
-    sitrep("The following numbers are for the AVX version\n");
 
-    print_total(bytes_read, time_start_of_avx, time_end_of_avx);
-    itj_csv_close_fh(&csv);
+    printf("Running sniffing correctness tests\n");
+    g_did_a_test_fail = ITJ_CSV_FALSE;
 
-    if (!itj_csv_open(&csv, generated_csv_path, generated_csv_path_len, buffer, buffer_max, ITJ_CSV_DELIM_COMMA, NULL)) {
-        printf("Failed to initalize itj_csv struct to file, '%s'\n", correctness_with_header_csv_path);
-        printf("Remember to generate a file for profiling first!\n");
-        return EXIT_FAILURE;
-    }
+    test_sniff();
+    test_header();
+    test_numbers();
+    test_number_batch();
+    test_timestamps();
 
-    bytes_read = 0;
-    pump_ret = itj_csv_pump_stdio(&csv);
-    if (pump_ret == 0) {
-        printf("Unable to read from '%s'\n", generated_csv_path);
-        return EXIT_FAILURE;
+    if (g_did_a_test_fail) {
+        sitrep("NOT ALL CORRECTNESS TESTS COMPLETED SUCCESSFULLY!\n");
+    } else {
+        sitrep("ALL CORRECTNESS TESTS COMPLETED SUCCESSFULL\n");
     }
-    bytes_read += pump_ret;
-
-    num_columns = -1;
-    num_lines = 0;
-    num_values = 0;
-    double time_start_of_avx2 = get_time_ms();
-    for (;;) {
-        struct itj_csv_value value = itj_csv_get_next_value_avx2(&csv);
-
-#if 0
-        itj_csv_umax column;
-        if (num_columns == -1) {
-            column = value.idx;
-        } else {
-            column = value.idx % num_columns;
-        }
-#endif
-
-        if (value.need_data) {
-            pump_ret = itj_csv_pump_stdio(&csv);
-            if (pump_ret == 0) {
-                break;
-            } else {
-                bytes_read += pump_ret;
-                continue;
-            }
-        }
 
-        if (value.is_end_of_line) {
-            ++num_lines;
-            if (num_columns == -1) {
-                num_columns = value.idx + 1;
-            }
-        }
+    printf("Running statistics correctness tests\n");
+    g_did_a_test_fail = ITJ_CSV_FALSE;
 
-        ++num_values;
+    test_stats();
 
+    if (g_did_a_test_fail) {
+        sitrep("NOT ALL CORRECTNESS TESTS COMPLETED SUCCESSFULLY!\n");
+    } else {
+        sitrep("ALL CORRECTNESS TESTS COMPLETED SUCCESSFULL\n");
     }
-    double time_end_of_avx2 = get_time_ms();
-
 
-    sitrep("The following numbers are for the AVX2 version\n");
+    printf("Running record counting correctness tests\n");
+    g_did_a_test_fail = ITJ_CSV_FALSE;
 
-    print_total(bytes_read, time_start_of_avx2, time_end_of_avx2);
-    itj_csv_close_fh(&csv);
+    test_count_records();
+    test_buffer();
+    test_ingest();
+    test_follow();
+    test_tail();
+    test_seek();
 
-    fh = fopen(generated_csv_path, "rb");
-    if (!fh) {
-        printf("Unable to open %s for the second reference reading\n", generated_csv_path);
-        return EXIT_FAILURE;
+    if (g_did_a_test_fail) {
+        sitrep("NOT ALL CORRECTNESS TESTS COMPLETED SUCCESSFULLY!\n");
+    } else {
+        sitrep("ALL CORRECTNESS TESTS COMPLETED SUCCESSFULL\n");
     }
 
-    double time_start_of_reference2 = get_time_ms();
-
-    bytes_read = 0;
-    for (;;) {
-        itj_csv_smax bytes = fread(buffer, 1, buffer_max, fh);
-        if (bytes < 0) {
-            printf("Unable to read all of %s\n", generated_csv_path);
-            return EXIT_FAILURE;
-        }
+    printf("Running columnar loading correctness tests\n");
+    g_did_a_test_fail = ITJ_CSV_FALSE;
 
-        if (bytes == 0) {
-            break;
-        }
+    test_intern();
+    test_table();
+    test_table_cache();
+    test_arrow_export();
+    test_group_by();
+    test_sort();
 
-        bytes_read += bytes;
+    if (g_did_a_test_fail) {
+        sitrep("NOT ALL CORRECTNESS TESTS COMPLETED SUCCESSFULLY!\n");
+    } else {
+        sitrep("ALL CORRECTNESS TESTS COMPLETED SUCCESSFULL\n");
     }
 
-    double time_end_of_reference2 = get_time_ms();
-
-    sitrep("Reading generated csv file without any work as reference, a final time\n");
-    print_total(bytes_read, time_start_of_reference2, time_end_of_reference2);
-
-    fclose(fh);
-
-    printf("Finished. Press any key to quit\n");
-    getc(stdin);
-
     return EXIT_SUCCESS;
 }
 